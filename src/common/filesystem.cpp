@@ -1,6 +1,13 @@
 #include "filesystem.h"
 #include <fstream>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace filesystem
 {
 	file_entry_data read_file(const std::string& _path)
@@ -16,4 +23,62 @@ namespace filesystem
 		in.close();
 		return ptr;
 	}
-};
\ No newline at end of file
+
+#ifndef _WIN32
+	namespace
+	{
+		class mapped_view : public view
+		{
+		  public:
+			mapped_view(const char* data, size_t size)
+			{
+				m_data = data;
+				m_size = size;
+			}
+			~mapped_view()
+			{
+				if (m_size)
+					munmap((void*)m_data, m_size);
+			}
+		};
+	};
+
+	file_view map_file(const std::string& _path)
+	{
+		int fd = open(_path.c_str(), O_RDONLY);
+		if (fd == -1)
+			return nullptr;
+		struct stat st;
+		if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+		{
+			close(fd);
+			return nullptr;
+		}
+		//an empty file can't be mapped, it's just an empty view
+		size_t size = st.st_size;
+		void* data = nullptr;
+		if (size)
+		{
+			data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data == MAP_FAILED)
+			{
+				close(fd);
+				return nullptr;
+			}
+			//files are read front to back once
+			madvise(data, size, MADV_SEQUENTIAL);
+		}
+		//the mapping stays valid without it
+		close(fd);
+		return std::make_shared<mapped_view>((const char*)data, size);
+	}
+#else
+	file_view map_file(const std::string& _path)
+	{
+		auto data = read_file(_path);
+		if (!data)
+			return nullptr;
+		return std::make_shared<buffer_view>(std::move(data));
+	}
+#endif
+};
@@ -6,4 +6,6 @@
 namespace filesystem
 {
 	file_entry_data read_file(const std::string& _path);
+	//maps the file read only, nullptr if it can't be opened, read_file where there's no mmap
+	file_view map_file(const std::string& _path);
 };
\ No newline at end of file
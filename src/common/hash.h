@@ -1,7 +1,9 @@
+#pragma once
 // https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stddef.h>
 
 typedef uint8_t u8;
 typedef uint64_t u64;
@@ -37,6 +39,21 @@ constexpr u64 fnv1a_64(const char *str)
 	return hash;
 }
 
+//hashes a buffer, pass the previous hash as offset to hash several buffers as one
+inline u64 fnv1a_64(const void *data, size_t size, u64 offset = 0xcbf29ce484222325)
+{
+	u64 prime = 0x00000100000001B3;
+
+	const u8 *p = (const u8*)data;
+	u64 hash = offset;
+	for(size_t i = 0; i < size; ++i)
+	{
+		hash ^= p[i];
+		hash *= prime;
+	}
+	return hash;
+}
+
 //static_hash
 consteval hash_t string_hash(const char *str) // Compile-time
 {
@@ -2,6 +2,7 @@
 
 #include "../common/filesystem.h"
 #include <core/filesystem/api.h>
+#include <unordered_map>
 
 class default_filesystem : public filesystem_api
 {
@@ -5,9 +5,25 @@ bool filesystem_api::read_text_entry(const std::string& path, std::string& s)
 	auto entry = read_entry(path);
 	if (!entry)
 		return false;
-	const char* data = (const char*)entry->data();
+	text(*entry, s);
+	// s = std::string(data, entry->size());
+	return true;
+}
+
+filesystem::file_view filesystem_api::view_entry(const std::string& path)
+{
+	auto entry = read_entry(path);
+	if (!entry)
+		return nullptr;
+	return std::make_shared<filesystem::buffer_view>(std::move(entry));
+}
+
+void filesystem_api::text(const filesystem::buffer& entry, std::string& s)
+{
+	const char* data = (const char*)entry.data();
 	// convert crlf to lf
-	size_t sz = entry->size();
+	size_t sz = entry.size();
+	s.reserve(s.size() + sz);
 	for (size_t i = 0; i < sz; ++i)
 	{
 		int pk = (i + 1) < sz ? data[i + 1] : 0;
@@ -17,6 +33,4 @@ bool filesystem_api::read_text_entry(const std::string& path, std::string& s)
 		}
 		s.push_back(data[i]);
 	}
-	// s = std::string(data, entry->size());
-	return true;
 }
@@ -6,6 +6,40 @@ namespace filesystem
 {
 	using buffer = std::vector<unsigned char>;
 	using file_entry_data = std::shared_ptr<buffer>;
+
+	//read only bytes of a file, either a mapping of it or a buffer it got read into, valid for as long as it's held
+	class view
+	{
+	  protected:
+		const char* m_data = nullptr;
+		size_t m_size = 0;
+
+	  public:
+		virtual ~view()
+		{
+		}
+		const char* data() const
+		{
+			return m_data;
+		}
+		size_t size() const
+		{
+			return m_size;
+		}
+	};
+	using file_view = std::shared_ptr<const view>;
+
+	class buffer_view : public view
+	{
+		file_entry_data m_buffer;
+
+	  public:
+		buffer_view(file_entry_data buffer) : m_buffer(std::move(buffer))
+		{
+			m_data = (const char*)m_buffer->data();
+			m_size = m_buffer->size();
+		}
+	};
 }; // namespace filesystem
 
 class filesystem_api
@@ -20,6 +54,10 @@ class filesystem_api
 	virtual filesystem::file_entry_data read_entry(const std::string& s) = 0;
 	virtual const filesystem::file_entry* get_entry(const std::string& s) const = 0;
 	virtual bool file_exists(const std::string& s) const = 0;
+	//the bytes as they are on disk (crlf isn't converted), reads the entry unless it's overridden to map it
+	virtual filesystem::file_view view_entry(const std::string& s);
 
 	bool read_text_entry(const std::string& path, std::string& s);
+	//appends data to s with crlf converted to lf
+	static void text(const filesystem::buffer& data, std::string& s);
 };
@@ -4,6 +4,8 @@
 
 #include "file_path.h"
 
+class pack_filesystem;
+
 namespace filesystem
 {
 	class file_entry
@@ -24,6 +26,7 @@ namespace filesystem
 		int m_index;
 		friend class directory_impl_zip;
 		friend class directory_impl_fs;
+		friend class ::pack_filesystem;
 
 	  public:
 		explicit file_entry(const std::string& path_) noexcept
@@ -0,0 +1,254 @@
+#include "pack.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace filesystem
+{
+	namespace pack
+	{
+		//shortest match worth an offset
+		static constexpr size_t kMinMatch = 4;
+		static constexpr int kHashBits = 14;
+
+		static void write_u32(buffer& out, uint32_t v)
+		{
+			for (int i = 0; i < 4; ++i)
+				out.push_back((v >> (i * 8)) & 0xff);
+		}
+		static void write_u64(buffer& out, uint64_t v)
+		{
+			write_u32(out, v & 0xffffffff);
+			write_u32(out, v >> 32);
+		}
+
+		std::string normalize(const std::string& path)
+		{
+			std::string s = path;
+			for (auto& c : s)
+			{
+				if (c == '\\')
+					c = '/';
+				else if (c >= 'A' && c <= 'Z')
+					c += 'a' - 'A';
+			}
+			size_t start = 0;
+			while (true)
+			{
+				if (s.compare(start, 2, "./") == 0)
+					start += 2;
+				else if (s.compare(start, 1, "/") == 0)
+					++start;
+				else
+					break;
+			}
+			return s.substr(start);
+		}
+
+		//lengths of 15 and up continue in bytes of 255 until one is less
+		static void write_length(buffer& out, size_t n)
+		{
+			for (; n >= 255; n -= 255)
+				out.push_back(255);
+			out.push_back((unsigned char)n);
+		}
+
+		static bool read_length(const unsigned char*& ip, const unsigned char* end, size_t& n)
+		{
+			unsigned char b;
+			do
+			{
+				if (ip >= end)
+					return false;
+				b = *ip++;
+				n += b;
+			} while (b == 255);
+			return true;
+		}
+
+		//a token (literal count << 4 | match length - kMinMatch), the literals, then the offset of the match
+		//the last sequence is only literals
+		static void sequence(buffer& out, const unsigned char* literals, size_t num_literals, size_t offset, size_t length)
+		{
+			size_t token = out.size();
+			out.push_back(0);
+			unsigned char t = (unsigned char)(std::min<size_t>(num_literals, 15) << 4);
+			if (num_literals >= 15)
+				write_length(out, num_literals - 15);
+			out.insert(out.end(), literals, literals + num_literals);
+			if (length)
+			{
+				out.push_back(offset & 0xff);
+				out.push_back(offset >> 8);
+				length -= kMinMatch;
+				t |= (unsigned char)std::min<size_t>(length, 15);
+				if (length >= 15)
+					write_length(out, length - 15);
+			}
+			out[token] = t;
+		}
+
+		void compress(const unsigned char* data, size_t size, buffer& out)
+		{
+			out.clear();
+			if (!size)
+				return;
+			out.reserve(size / 2 + 16);
+			//last position every 4 byte sequence was seen at
+			std::vector<uint32_t> table(1 << kHashBits, UINT32_MAX);
+			size_t anchor = 0, i = 0;
+			while (i + kMinMatch <= size)
+			{
+				uint32_t seq;
+				memcpy(&seq, data + i, sizeof(seq));
+				uint32_t h = (seq * 2654435761u) >> (32 - kHashBits);
+				uint32_t candidate = table[h];
+				table[h] = (uint32_t)i;
+				if (candidate == UINT32_MAX || i - candidate > 0xffff || memcmp(data + candidate, data + i, kMinMatch))
+				{
+					++i;
+					continue;
+				}
+				size_t length = kMinMatch;
+				while (i + length < size && data[candidate + length] == data[i + length])
+					++length;
+				sequence(out, data + anchor, i - anchor, i - candidate, length);
+				i += length;
+				anchor = i;
+			}
+			sequence(out, data + anchor, size - anchor, 0, 0);
+		}
+
+		bool decompress(const unsigned char* in, size_t in_size, unsigned char* out, size_t out_size)
+		{
+			const unsigned char* ip = in;
+			const unsigned char* iend = in + in_size;
+			unsigned char* op = out;
+			unsigned char* oend = out + out_size;
+			while (ip < iend)
+			{
+				unsigned char t = *ip++;
+				size_t literals = t >> 4;
+				if (literals == 15 && !read_length(ip, iend, literals))
+					return false;
+				if ((size_t)(iend - ip) < literals || (size_t)(oend - op) < literals)
+					return false;
+				memcpy(op, ip, literals);
+				ip += literals;
+				op += literals;
+				if (ip == iend)
+					break;
+				if (iend - ip < 2)
+					return false;
+				size_t offset = ip[0] | (ip[1] << 8);
+				ip += 2;
+				if (offset == 0 || offset > (size_t)(op - out))
+					return false;
+				size_t length = t & 15;
+				if (length == 15 && !read_length(ip, iend, length))
+					return false;
+				length += kMinMatch;
+				if ((size_t)(oend - op) < length)
+					return false;
+				//the match can overlap what it writes, that repeats the last offset bytes
+				const unsigned char* match = op - offset;
+				for (size_t i = 0; i < length; ++i)
+					op[i] = match[i];
+				op += length;
+			}
+			return op == oend;
+		}
+
+		bool writer::write(const std::string& path, core::thread_pool& pool, bool compress, std::string& error,
+						   size_t* archive_size)
+		{
+			std::vector<std::pair<const std::string*, const buffer*>> files;
+			std::string names;
+			for (auto& it : m_files)
+			{
+				if (it.second->size() > UINT32_MAX)
+				{
+					error = it.first + " is too big";
+					return false;
+				}
+				files.emplace_back(&it.first, it.second.get());
+				names += it.first;
+			}
+			if (names.size() > UINT32_MAX)
+			{
+				error = "too many names";
+				return false;
+			}
+
+			std::vector<buffer> compressed(files.size());
+			if (compress)
+			{
+				for (size_t i = 0; i < files.size(); ++i)
+				{
+					pool.push([&, i] {
+						auto& data = *files[i].second;
+						pack::compress(data.data(), data.size(), compressed[i]);
+						if (compressed[i].size() >= data.size())
+							compressed[i] = buffer();
+					});
+				}
+				pool.wait();
+			}
+
+			buffer directory;
+			write_u32(directory, kMagic);
+			write_u32(directory, kVersion);
+			write_u32(directory, (uint32_t)files.size());
+			write_u32(directory, (uint32_t)names.size());
+			uint64_t offset = kHeaderSize + files.size() * kEntrySize + names.size();
+			uint32_t name_offset = 0;
+			for (size_t i = 0; i < files.size(); ++i)
+			{
+				auto& data = *files[i].second;
+				bool is_compressed = !compressed[i].empty();
+				uint32_t stored = (uint32_t)(is_compressed ? compressed[i].size() : data.size());
+				write_u64(directory, offset);
+				write_u32(directory, name_offset);
+				write_u32(directory, (uint32_t)files[i].first->size());
+				write_u32(directory, (uint32_t)data.size());
+				write_u32(directory, stored);
+				write_u32(directory, is_compressed ? kFlagCompressed : 0);
+				write_u32(directory, 0);
+				offset += stored;
+				name_offset += (uint32_t)files[i].first->size();
+			}
+			if (archive_size)
+				*archive_size = offset;
+
+			std::string tmp = path + ".tmp";
+			{
+				std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+				if (!out.is_open())
+				{
+					error = "can't write " + tmp;
+					return false;
+				}
+				out.write((const char*)directory.data(), directory.size());
+				out.write(names.data(), names.size());
+				for (size_t i = 0; i < files.size(); ++i)
+				{
+					auto& data = compressed[i].empty() ? *files[i].second : compressed[i];
+					out.write((const char*)data.data(), data.size());
+				}
+				if (!out.good())
+				{
+					error = "can't write " + tmp;
+					return false;
+				}
+			}
+			if (std::rename(tmp.c_str(), path.c_str()) != 0)
+			{
+				error = "can't replace " + path;
+				return false;
+			}
+			return true;
+		}
+	}; // namespace pack
+}; // namespace filesystem
@@ -0,0 +1,66 @@
+#pragma once
+#include <core/filesystem/api.h>
+#include <core/thread_pool.h>
+#include <cstdint>
+#include <map>
+#include <string>
+
+//a set of files in a single file, written by gscpack and read by pack_filesystem
+//a header, the directory sorted by name so a lookup is a binary search, the names and then the data of every entry
+//entries are stored as is or compressed with a small lz77 (sequences like lz4, but not compatible with it)
+//every number is little endian
+namespace filesystem
+{
+	namespace pack
+	{
+		static constexpr uint32_t kMagic = 0x50435347; //GSCP
+		//bump whenever the layout changes
+		static constexpr uint32_t kVersion = 1;
+		//magic, version, number of entries, size of the names
+		static constexpr size_t kHeaderSize = 16;
+		//offset of the data (8 bytes), offset and length of the name, size, stored size, flags, unused
+		static constexpr size_t kEntrySize = 32;
+
+		enum
+		{
+			kFlagCompressed = 1
+		};
+
+		struct entry
+		{
+			uint64_t offset;
+			uint32_t name_offset;
+			uint32_t name_length;
+			uint32_t size;
+			uint32_t stored_size;
+			uint32_t flags;
+		};
+
+		//lower case with / separators and without a leading ./, names are stored and looked up like this
+		std::string normalize(const std::string& path);
+
+		void compress(const unsigned char* data, size_t size, buffer& out);
+		//false unless in is exactly out_size bytes worth of compressed data
+		bool decompress(const unsigned char* in, size_t in_size, unsigned char* out, size_t out_size);
+
+		class writer
+		{
+			std::map<std::string, file_entry_data> m_files;
+
+		  public:
+			//a file with the same name replaces the one added before
+			void add(const std::string& name, file_entry_data data)
+			{
+				m_files[normalize(name)] = std::move(data);
+			}
+			size_t size() const
+			{
+				return m_files.size();
+			}
+			//files are compressed on the pool, the ones that don't get smaller are stored as is
+			//written to a temporary file first that replaces path once it's complete
+			bool write(const std::string& path, core::thread_pool& pool, bool compress, std::string& error,
+					   size_t* archive_size = nullptr);
+		};
+	}; // namespace pack
+}; // namespace filesystem
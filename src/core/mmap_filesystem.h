@@ -0,0 +1,14 @@
+#pragma once
+
+#include <core/default_filesystem.h>
+
+//same as default_filesystem but the preprocessor views files through a read only mapping instead of a copy
+//a file mustn't be truncated in place while it's loaded, sources are kept as long as the include_cache has them
+class mmap_filesystem : public default_filesystem
+{
+  public:
+	virtual filesystem::file_view view_entry(const std::string& s) override
+	{
+		return filesystem::map_file(s);
+	}
+};
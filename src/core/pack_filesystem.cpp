@@ -0,0 +1,166 @@
+#include "pack_filesystem.h"
+#include <common/filesystem.h>
+#include <cstring>
+
+namespace
+{
+	uint32_t read_u32(const unsigned char* p)
+	{
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+	uint64_t read_u64(const unsigned char* p)
+	{
+		return (uint64_t)read_u32(p) | ((uint64_t)read_u32(p + 4) << 32);
+	}
+
+	//an entry that's stored as is, it points into the mapping and keeps it open
+	class entry_view : public filesystem::view
+	{
+		filesystem::file_view m_archive;
+
+	  public:
+		entry_view(filesystem::file_view archive, const char* data, size_t size) : m_archive(std::move(archive))
+		{
+			m_data = data;
+			m_size = size;
+		}
+	};
+};
+
+bool pack_filesystem::open(const std::string& path, std::string& error)
+{
+	using namespace filesystem::pack;
+	auto archive = filesystem::map_file(path);
+	if (!archive)
+	{
+		error = "can't open " + path;
+		return false;
+	}
+	auto* p = (const unsigned char*)archive->data();
+	size_t n = archive->size();
+	if (n < kHeaderSize || read_u32(p) != kMagic)
+	{
+		error = path + " is not a pack";
+		return false;
+	}
+	if (read_u32(p + 4) != kVersion)
+	{
+		error = path + " was written by a different version of gscpack";
+		return false;
+	}
+	size_t count = read_u32(p + 8);
+	size_t names_size = read_u32(p + 12);
+	size_t names = kHeaderSize + count * kEntrySize;
+	if (names > n || n - names < names_size)
+	{
+		error = path + " is corrupt";
+		return false;
+	}
+	m_archive = archive;
+	m_directory = p + kHeaderSize;
+	m_names = (const char*)p + names;
+	m_count = count;
+
+	auto archive_path = std::make_shared<filesystem::filepath>(path);
+	std::vector<filesystem::file_entry> entries;
+	entries.reserve(count);
+	std::string_view previous;
+	for (size_t i = 0; i < count; ++i)
+	{
+		auto e = entry(i);
+		bool valid = (uint64_t)e.name_offset + e.name_length <= names_size && e.offset >= names + names_size &&
+					 e.offset <= n && n - e.offset >= e.stored_size &&
+					 ((e.flags & kFlagCompressed) || e.stored_size == e.size);
+		//binary search needs them in order
+		if (valid && i > 0 && !(previous < name(i)))
+			valid = false;
+		if (!valid)
+		{
+			m_archive.reset();
+			m_count = 0;
+			error = path + " is corrupt";
+			return false;
+		}
+		previous = name(i);
+		auto& fe = entries.emplace_back(std::string(previous));
+		fe.m_archive = archive_path;
+		fe.m_size = e.size;
+		fe.m_index = (int)i;
+	}
+	m_entries = std::move(entries);
+	return true;
+}
+
+filesystem::pack::entry pack_filesystem::entry(size_t index) const
+{
+	const unsigned char* p = m_directory + index * filesystem::pack::kEntrySize;
+	filesystem::pack::entry e;
+	e.offset = read_u64(p);
+	e.name_offset = read_u32(p + 8);
+	e.name_length = read_u32(p + 12);
+	e.size = read_u32(p + 16);
+	e.stored_size = read_u32(p + 20);
+	e.flags = read_u32(p + 24);
+	return e;
+}
+
+std::string_view pack_filesystem::name(size_t index) const
+{
+	const unsigned char* p = m_directory + index * filesystem::pack::kEntrySize;
+	return std::string_view(m_names + read_u32(p + 8), read_u32(p + 12));
+}
+
+int pack_filesystem::find(const std::string& path) const
+{
+	std::string key = filesystem::pack::normalize(path);
+	size_t lo = 0, hi = m_count;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		int c = name(mid).compare(key);
+		if (c == 0)
+			return (int)mid;
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return -1;
+}
+
+filesystem::file_entry_data pack_filesystem::read_entry(const std::string& s)
+{
+	int index = find(s);
+	if (index == -1)
+		return nullptr;
+	auto e = entry(index);
+	auto* stored = (const unsigned char*)m_archive->data() + e.offset;
+	auto data = std::make_shared<filesystem::buffer>(e.size);
+	if (!(e.flags & filesystem::pack::kFlagCompressed))
+		memcpy(data->data(), stored, e.size);
+	else if (!filesystem::pack::decompress(stored, e.stored_size, data->data(), e.size))
+		return nullptr;
+	return data;
+}
+
+filesystem::file_view pack_filesystem::view_entry(const std::string& s)
+{
+	int index = find(s);
+	if (index == -1)
+		return nullptr;
+	auto e = entry(index);
+	if (e.flags & filesystem::pack::kFlagCompressed)
+	{
+		auto data = read_entry(s);
+		if (!data)
+			return nullptr;
+		return std::make_shared<filesystem::buffer_view>(std::move(data));
+	}
+	return std::make_shared<entry_view>(m_archive, m_archive->data() + e.offset, e.size);
+}
+
+const filesystem::file_entry* pack_filesystem::get_entry(const std::string& s) const
+{
+	int index = find(s);
+	return index == -1 ? nullptr : &m_entries[index];
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <core/filesystem/api.h>
+#include <core/filesystem/pack.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//reads files out of a pack (core/filesystem/pack.h) that's mapped once when it's opened
+//lookups are a binary search on the normalized path, entries that are stored as is are viewed without a copy
+//nothing changes after open so entries can be read and decompressed from any number of threads at once
+class pack_filesystem : public filesystem_api
+{
+	filesystem::file_view m_archive;
+	const unsigned char* m_directory = nullptr;
+	const char* m_names = nullptr;
+	size_t m_count = 0;
+	std::vector<filesystem::file_entry> m_entries;
+
+  public:
+	//the whole archive is checked once here, entries are trusted after that
+	bool open(const std::string& path, std::string& error);
+
+	size_t size() const
+	{
+		return m_count;
+	}
+	filesystem::pack::entry entry(size_t index) const;
+	std::string_view name(size_t index) const;
+	//index of the entry, -1 if there's none
+	int find(const std::string& path) const;
+
+	virtual filesystem::file_entry_data read_entry(const std::string& s) override;
+	virtual filesystem::file_view view_entry(const std::string& s) override;
+	virtual const filesystem::file_entry* get_entry(const std::string& s) const override;
+	virtual bool file_exists(const std::string& s) const override
+	{
+		return find(s) != -1;
+	}
+};
@@ -0,0 +1,74 @@
+#include "thread_pool.h"
+
+namespace core
+{
+	size_t thread_pool::default_thread_count()
+	{
+#ifdef EMSCRIPTEN
+		return 0;
+#else
+		return std::thread::hardware_concurrency();
+#endif
+	}
+
+	thread_pool::thread_pool(size_t num_threads)
+	{
+		for (size_t i = 0; i < num_threads; ++i)
+			m_threads.emplace_back(&thread_pool::worker, this);
+	}
+
+	thread_pool::~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_job_available.notify_all();
+		for (auto& t : m_threads)
+			t.join();
+	}
+
+	void thread_pool::worker()
+	{
+		for (;;)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_job_available.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+				if (m_jobs.empty())
+					return;
+				job = std::move(m_jobs.front());
+				m_jobs.pop_front();
+				++m_active;
+			}
+			job();
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				--m_active;
+				if (m_active == 0 && m_jobs.empty())
+					m_idle.notify_all();
+			}
+		}
+	}
+
+	void thread_pool::push(std::function<void()> job)
+	{
+		if (m_threads.empty())
+		{
+			job();
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobs.push_back(std::move(job));
+		}
+		m_job_available.notify_one();
+	}
+
+	void thread_pool::wait()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idle.wait(lock, [this] { return m_active == 0 && m_jobs.empty(); });
+	}
+}; // namespace core
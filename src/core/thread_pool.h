@@ -0,0 +1,43 @@
+#ifndef CORE_THREAD_POOL_H
+#define CORE_THREAD_POOL_H
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace core
+{
+	//fixed amount of workers pulling jobs from a single queue
+	//with 0 threads (or no thread support) jobs run inline in push
+	class thread_pool
+	{
+		std::vector<std::thread> m_threads;
+		std::deque<std::function<void()>> m_jobs;
+		std::mutex m_mutex;
+		std::condition_variable m_job_available;
+		std::condition_variable m_idle;
+		size_t m_active = 0;
+		bool m_stop = false;
+
+		void worker();
+
+	  public:
+		thread_pool(size_t num_threads = default_thread_count());
+		~thread_pool();
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+
+		static size_t default_thread_count();
+		size_t size() const
+		{
+			return m_threads.size();
+		}
+		//jobs must not throw
+		void push(std::function<void()> job);
+		//blocks until the queue is empty and no job is running
+		void wait();
+	};
+}; // namespace core
+#endif
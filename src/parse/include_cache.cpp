@@ -0,0 +1,95 @@
+#include "include_cache.h"
+#include <common/hash.h>
+#include <atomic>
+#include <mutex>
+
+namespace parse
+{
+	namespace
+	{
+		struct cache
+		{
+			std::mutex mutex;
+			std::atomic<bool> enabled{true};
+			std::unordered_map<std::string, std::shared_ptr<const preprocessed_file>> preprocessed;
+		};
+
+		cache& instance()
+		{
+			static cache c;
+			return c;
+		}
+	};
+
+	uint64_t fingerprint(const Define* def)
+	{
+		if (!def)
+			return 0;
+		u64 h = fnv1a_64(&def->is_function, sizeof(def->is_function));
+		//parameters by position, the map isn't ordered
+		std::vector<const std::string*> parameters(def->parameters.size());
+		for (auto& it : def->parameters)
+		{
+			if (it.second < parameters.size())
+				parameters[it.second] = &it.first;
+		}
+		for (auto* p : parameters)
+		{
+			if (p)
+				h = fnv1a_64(p->data(), p->size() + 1, h);
+		}
+		for (auto& t : def->body)
+		{
+			h = fnv1a_64(&t.type, sizeof(t.type), h);
+			h = fnv1a_64(&t.whitespace, sizeof(t.whitespace), h);
+			//by text, the id of a definition that's gone may belong to a different text by now
+			auto& text = t.to_string();
+			h = fnv1a_64(text.data(), text.size() + 1, h);
+		}
+		//never 0, that's an undefined definition
+		return h | 1;
+	}
+
+	uint64_t include_cache::hash(const filesystem::view& data)
+	{
+		return fnv1a_64(data.data(), data.size());
+	}
+
+	void include_cache::set_enabled(bool enabled)
+	{
+		instance().enabled = enabled;
+		if (!enabled)
+			clear();
+	}
+
+	bool include_cache::enabled()
+	{
+		return instance().enabled;
+	}
+
+	std::shared_ptr<const preprocessed_file> include_cache::preprocessed(const std::string& key)
+	{
+		auto& c = instance();
+		if (!c.enabled)
+			return nullptr;
+		std::lock_guard<std::mutex> lock(c.mutex);
+		auto fnd = c.preprocessed.find(key);
+		return fnd == c.preprocessed.end() ? nullptr : fnd->second;
+	}
+
+	void include_cache::store(const std::string& key, std::shared_ptr<const preprocessed_file> file)
+	{
+		auto& c = instance();
+		if (!c.enabled)
+			return;
+		std::lock_guard<std::mutex> lock(c.mutex);
+		c.preprocessed[key] = std::move(file);
+	}
+
+	void include_cache::clear()
+	{
+		auto& c = instance();
+		std::lock_guard<std::mutex> lock(c.mutex);
+		c.preprocessed.clear();
+	}
+}; // namespace parse
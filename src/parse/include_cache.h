@@ -0,0 +1,61 @@
+#pragma once
+#include "token_parser.h"
+#include <core/filesystem/api.h>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace parse
+{
+	struct Define
+	{
+		bool is_function = false;
+		std::unordered_map<std::string, size_t> parameters;
+		token_list body;
+	};
+
+	using definition_map = std::unordered_map<std::string, Define>;
+
+	//identifies what a definition expands to, 0 if it's not defined
+	uint64_t fingerprint(const Define* def);
+
+	//what preprocessing a file did, enough to splice it's tokens in again and leave the definitions like it did
+	struct preprocessed_file
+	{
+		token_list tokens;
+		//the file and every file it included, the tokens point into them
+		std::vector<std::shared_ptr<const source>> sources;
+		//path and content hash of every file that was read
+		std::vector<std::pair<std::string, uint64_t>> files;
+		//definitions that were looked at before the file set them and their fingerprint at the time
+		std::vector<std::pair<std::string, uint64_t>> dependencies;
+		//definitions the file set, nullopt for the ones it removed
+		std::vector<std::pair<std::string, std::optional<Define>>> definitions;
+		//the text of the tokens and definitions
+		string_refs strings;
+	};
+
+	//process wide, shared between every preprocessor so a header that's included by a lot of files or an unchanged
+	//file that's loaded again doesn't get tokenized and preprocessed again
+	//entries are only used when every file they were made from still has the same content
+	class include_cache
+	{
+	  public:
+		static uint64_t hash(const filesystem::view& data);
+
+		//on by default, entries keep every token of the files they were made from
+		//off keeps a streaming preprocessor's memory down to what the open files need
+		static void set_enabled(bool enabled);
+		static bool enabled();
+
+		//the last time the file got preprocessed with the same key, up to the caller to check it's still valid
+		static std::shared_ptr<const preprocessed_file> preprocessed(const std::string& key);
+		static void store(const std::string& key, std::shared_ptr<const preprocessed_file> file);
+
+		static void clear();
+	};
+}; // namespace parse
@@ -17,6 +17,9 @@ namespace parse
 		template <typename T> bool parse(T& v)
 		{
 			parse::source src("", string);
+			//the text of the tokens is only needed while it's parsed
+			parse::string_refs strings;
+			parse::string_refs::scope scope(&strings);
 			parse::lexer lexer(&src);
 			try
 			{
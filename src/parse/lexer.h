@@ -1,8 +1,11 @@
 #pragma once
+#include "scan.h"
 #include "source.h"
 #include "token.h"
+#include <cstring>
 #include <exception>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace parse
@@ -15,35 +18,42 @@ namespace parse
 		bool backslash_comments = false;
 	};
 
-	typedef struct
+	//the token of an operator made of ch and ch2, invalid if there's none
+	inline token_type two_character_operator(int ch, int ch2)
 	{
-		const char* chars;
-		token_type type;
-	} seqmap_t;
-
-	static const seqmap_t sequence_map[] = {{"==", token_type::eq},
-											{"!=", token_type::neq},
-											{">=", token_type::geq},
-											{"<=", token_type::leq},
-											{"<<", token_type::lsht},
-											{">>", token_type::rsht},
-											{"+=", token_type::plus_assign},
-											{"-=", token_type::minus_assign},
-											{"*=", token_type::multiply_assign},
-											{"/=", token_type::divide_assign},
-											{"%=", token_type::mod_assign},
-											{"^=", token_type::xor_assign},
-											{"|=", token_type::or_assign},
-											{"&=", token_type::and_assign},
-											{"++", token_type::plus_plus},
-											{"--", token_type::minus_minus},
-											{"::", token_type::double_colon},
-											{"&&", token_type::and_and},
-											{"||", token_type::or_or},
-											{"/#", token_type::slash_pound},
-											{"#/", token_type::pound_slash},
-											{"##", token_type::pound_pound}
-	};
+		switch (ch)
+		{
+		case '=':
+			return ch2 == '=' ? token_type::eq : token_type::invalid;
+		case '!':
+			return ch2 == '=' ? token_type::neq : token_type::invalid;
+		case '>':
+			return ch2 == '=' ? token_type::geq : ch2 == '>' ? token_type::rsht : token_type::invalid;
+		case '<':
+			return ch2 == '=' ? token_type::leq : ch2 == '<' ? token_type::lsht : token_type::invalid;
+		case '+':
+			return ch2 == '=' ? token_type::plus_assign : ch2 == '+' ? token_type::plus_plus : token_type::invalid;
+		case '-':
+			return ch2 == '=' ? token_type::minus_assign : ch2 == '-' ? token_type::minus_minus : token_type::invalid;
+		case '*':
+			return ch2 == '=' ? token_type::multiply_assign : token_type::invalid;
+		case '/':
+			return ch2 == '=' ? token_type::divide_assign : ch2 == '#' ? token_type::slash_pound : token_type::invalid;
+		case '%':
+			return ch2 == '=' ? token_type::mod_assign : token_type::invalid;
+		case '^':
+			return ch2 == '=' ? token_type::xor_assign : token_type::invalid;
+		case '|':
+			return ch2 == '=' ? token_type::or_assign : ch2 == '|' ? token_type::or_or : token_type::invalid;
+		case '&':
+			return ch2 == '=' ? token_type::and_assign : ch2 == '&' ? token_type::and_and : token_type::invalid;
+		case ':':
+			return ch2 == ':' ? token_type::double_colon : token_type::invalid;
+		case '#':
+			return ch2 == '/' ? token_type::pound_slash : ch2 == '#' ? token_type::pound_pound : token_type::invalid;
+		}
+		return token_type::invalid;
+	}
 
 	struct lexer_error : std::exception
 	{
@@ -61,15 +71,142 @@ namespace parse
 		}
 	};
 
-	class lexer
+	class lexer : public token_stream
 	{
+		//what the character can be, looked up once per byte instead of asking the virtual functions every time
+		enum
+		{
+			k_ECharacterClass_Space = 1,
+			k_ECharacterClass_IdentifierPreamble = 2,
+			k_ECharacterClass_Identifier = 4,
+			k_ECharacterClass_Digit = 8
+		};
+
 		const source* m_source;
+		const char* m_data;
 		size_t m_cursor, m_bufsz;
-		int m_lineno;
 		int space = 0;
 
 		lexer_opts m_opts;
 
+		//filled in before the first token, a derived lexer isn't constructed yet in our constructor
+		unsigned char m_classes[256];
+		bool m_classified = false;
+		//every character scan::identifier skips is an identifier character, so runs can be skipped 16 at a time
+		bool m_ascii_identifiers = false;
+
+		void classify()
+		{
+			m_ascii_identifiers = true;
+			for (int ch = 0; ch < 256; ++ch)
+			{
+				unsigned char c = 0;
+				if (is_space(ch))
+					c |= k_ECharacterClass_Space;
+				if (is_identifier_preamble_character(ch))
+					c |= k_ECharacterClass_IdentifierPreamble;
+				if (is_identifier_character(ch) || is_digit(ch))
+					c |= k_ECharacterClass_Identifier;
+				if (is_digit(ch))
+					c |= k_ECharacterClass_Digit;
+				if (scan::is_identifier(ch) && !(c & k_ECharacterClass_Identifier))
+					m_ascii_identifiers = false;
+				m_classes[ch] = c;
+			}
+			m_classified = true;
+		}
+
+		int character_class(int ch) const
+		{
+			return ch == -1 ? 0 : m_classes[ch];
+		}
+
+		//the text of every token is interned, a lexer remembers the ids of what it has seen in it's source before so
+		//it doesn't have to take the string_table's lock again for them
+		//open addressing on the offset of the first occurence, id 0 is the empty string so it marks a free slot
+		struct interned_slot
+		{
+			uint32_t hash, start, length, id;
+		};
+		std::vector<interned_slot> m_interned;
+		size_t m_num_interned = 0;
+
+		//ids of tokens that always have the same text, single characters and operators
+		uint32_t m_fixed_ids[(int)token_type::invalid + 1] = {};
+
+		uint32_t intern(size_t start, size_t length)
+		{
+			if (length == 0)
+				return 0;
+			uint32_t hash = 0x811c9dc5;
+			for (size_t i = 0; i < length; ++i)
+				hash = (hash ^ (unsigned char)m_data[start + i]) * 0x01000193;
+			if (m_num_interned * 2 >= m_interned.size())
+			{
+				std::vector<interned_slot> slots(m_interned.empty() ? 1024 : m_interned.size() * 2);
+				for (auto& it : m_interned)
+				{
+					if (!it.id)
+						continue;
+					size_t i = it.hash & (slots.size() - 1);
+					while (slots[i].id)
+						i = (i + 1) & (slots.size() - 1);
+					slots[i] = it;
+				}
+				m_interned.swap(slots);
+			}
+			size_t mask = m_interned.size() - 1;
+			for (size_t i = hash & mask;; i = (i + 1) & mask)
+			{
+				auto& slot = m_interned[i];
+				if (!slot.id)
+				{
+					slot = {hash, (uint32_t)start, (uint32_t)length,
+							string_table::intern(std::string_view(m_data + start, length))};
+					++m_num_interned;
+					return slot.id;
+				}
+				if (slot.hash == hash && slot.length == length && !memcmp(m_data + slot.start, m_data + start, length))
+					return slot.id;
+			}
+		}
+
+		//the source is the file as it is on disk, everything but strings and comments sees a \r as a space
+		//those drop the \r of a \r\n from their text so it's the same as with \n line endings
+		uint32_t intern_crlf(size_t start, size_t length)
+		{
+			std::string text;
+			text.reserve(length);
+			for (size_t i = start; i < start + length; ++i)
+			{
+				if (m_data[i] == '\r' && i + 1 < m_bufsz && m_data[i + 1] == '\n')
+					continue;
+				text.push_back(m_data[i]);
+			}
+			return string_table::intern(text);
+		}
+
+		token make_token(token_type tt, size_t start, size_t length)
+		{
+			bool fixed = tt < token_type::string || tt > token_type::comment;
+			if (!fixed)
+			{
+				bool text = tt == token_type::string || tt == token_type::literal || tt == token_type::comment;
+				if (text && scan::find(m_data, start, start + length, '\r') < start + length)
+					return token(m_source, tt, (int)start, intern_crlf(start, length), space);
+				return token(m_source, tt, (int)start, intern(start, length), space);
+			}
+			if (!m_fixed_ids[(int)tt])
+				m_fixed_ids[(int)tt] = string_table::intern(std::string_view(m_data + start, length));
+			return token(m_source, tt, (int)start, m_fixed_ids[(int)tt], space);
+		}
+
+		//skips the rest of a // comment, the cursor stays on the newline
+		void skip_line()
+		{
+			m_cursor = scan::find(m_data, m_cursor, m_bufsz, '\n');
+		}
+
 	  public:
 
 		void seek(size_t pos)
@@ -91,21 +228,23 @@ namespace parse
 		{
 			if (wb)
 				*wb = m_cursor;
-			return (*m_source)[m_cursor];
+			return m_cursor < m_bufsz ? (unsigned char)m_data[m_cursor] : -1;
 		}
 
 		int peek_next_character(int distance = 0, size_t *would_be_position = nullptr)
 		{
+			size_t position = m_cursor + (distance + 1);
 			if (would_be_position)
-				*would_be_position = m_cursor + (distance + 1);
-			return (*m_source)[m_cursor + (distance + 1)];
+				*would_be_position = position;
+			return position < m_bufsz ? (unsigned char)m_data[position] : -1;
 		}
 
-		lexer(const source* src) : m_cursor(0), m_source(src), m_bufsz(src->length()), m_lineno(-1)
+		lexer(const source* src)
+			: m_cursor(0), m_source(src), m_data(src->data()), m_bufsz(src->length())
 		{
 		}
 		lexer(const source* src, lexer_opts opts)
-			: m_opts(opts), m_cursor(0), m_source(src), m_bufsz(src->length()), m_lineno(-1)
+			: m_opts(opts), m_cursor(0), m_source(src), m_data(src->data()), m_bufsz(src->length())
 		{
 		}
 
@@ -136,7 +275,7 @@ namespace parse
 				++m_cursor;
 				ch = read_character();
 			}
-			return token(m_source, token_type::hexadecimal, start, m_cursor - start, m_lineno, space);
+			return make_token(token_type::hexadecimal, start, m_cursor - start);
 		}
 
 		token number()
@@ -181,10 +320,10 @@ namespace parse
 				prev = ch;
 				ch = read_character();
 			}
-			return token(m_source, is_integer ? token_type::integer : token_type::number, start, m_cursor - start,
-						 m_lineno, space);
+			return make_token(is_integer ? token_type::integer : token_type::number, start, m_cursor - start);
 		}
 
+		//only asked once per character, the answers have to stay the same for the lifetime of the lexer
 		virtual bool is_identifier_preamble_character(int ch)
 		{
 			return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
@@ -197,70 +336,63 @@ namespace parse
 
 		token identifier()
 		{
+			if (!m_classified)
+				classify();
 			int start = m_cursor;
-			while (is_identifier_character(read_character()) || is_digit(read_character()))
+			while (1)
+			{
+				if (m_ascii_identifiers)
+					m_cursor = scan::identifier(m_data, m_cursor, m_bufsz);
+				if (!(character_class(read_character()) & k_ECharacterClass_Identifier))
+					break;
 				++m_cursor;
-			return token(m_source, token_type::identifier, start, m_cursor - start, m_lineno, space);
+			}
+			return make_token(token_type::identifier, start, m_cursor - start);
 		}
 
 		token string(int quote, token_type tt)
 		{
 			++m_cursor; //"
 			int start = m_cursor;
-			int ch;
-			bool escaped = false;
 			while (1)
 			{
-				rep:
-				ch = read_character();
-					if (ch == -1)
-						break;
-					//throw lexer_error("unexpected eof, this shouldn't happen halfway through a string.", start,
-					//				  m_cursor, m_source->line_number(start), m_source->line_number(m_cursor));
-				if(ch == '\\')
-				{
-					escaped = true;
+				m_cursor = scan::find(m_data, m_cursor, m_bufsz, quote, '\\');
+				if (m_cursor >= m_bufsz || m_data[m_cursor] == quote)
+					break;
+				//a backslash escapes the first character after it that isn't a backslash
+				while (m_cursor < m_bufsz && m_data[m_cursor] == '\\')
+					++m_cursor;
+				if (m_cursor < m_bufsz)
 					++m_cursor;
-					goto rep;
-				}
-				if (!escaped)
-				{
-					if (ch == quote)
-						break;
-				}
-				escaped = false;
-				++m_cursor;
 			}
-			auto t = token(m_source, tt, start, m_cursor - start, m_lineno, space);
+			//throw lexer_error("unexpected eof, this shouldn't happen halfway through a string.", start,
+			//				  m_cursor, m_source->line_number(start), m_source->line_number(m_cursor));
+			auto t = make_token(tt, start, m_cursor - start);
 			++m_cursor;
 			return t;
 		}
 
 		token read_token()
 		{
+			if (!m_classified)
+				classify();
 		repeat:
-			int c;
 			space = 0;
-			do
+			if (character_class(read_character()) & k_ECharacterClass_Space)
 			{
-				c = read_character();
-				if (c == '\n')
-					++m_lineno;
-				if (!is_space(c))
-					break;
-				++space;
-				++m_cursor;
-			} while (is_space(c));
-			//while (is_space(read_character()))
-				//++m_cursor;
+				size_t end = scan::spaces(m_data, m_cursor, m_bufsz);
+				space = end - m_cursor;
+				m_cursor = end;
+			}
 			int ch = read_character();
 			if (ch == -1)
 				return token(m_source, token_type::eof, space);
-			if (is_identifier_preamble_character(ch))
+			int cls = m_classes[ch];
+			if (cls & k_ECharacterClass_IdentifierPreamble)
 				return identifier();
 			if (ch == '0' && peek_next_character() == 'x')
 				return hex();
-			if (is_digit(ch) || (ch == '.' && is_digit(peek_next_character())))
+			if ((cls & k_ECharacterClass_Digit) || (ch == '.' && is_digit(peek_next_character())))
 				return number();
 			if (ch == '"')
 				return string(ch, token_type::string);
@@ -271,23 +403,11 @@ namespace parse
 				if (peek_next_character() == '\\')
 				{
 					m_cursor += 2;
-					// read till next line
-					int start = m_cursor;
-					do
-					{
-						ch = read_character();
-						if (ch == -1)
-						{
-							if (!m_opts.tokenize_comments)
-								goto repeat;
-							return token(m_source, token_type::comment, start, m_cursor - start, m_lineno, space);
-						}
-						++m_cursor;
-					} while (ch != '\n');
-					--m_cursor; // incase we read the \n as token
+					size_t start = m_cursor;
+					skip_line();
 					if (!m_opts.tokenize_comments)
 						goto repeat;
-					return token(m_source, token_type::comment, start, m_cursor - start, m_lineno, space);
+					return make_token(token_type::comment, start, m_cursor - start);
 				}
 			}
 			if (ch == '/')
@@ -299,61 +419,45 @@ namespace parse
 					int start = m_cursor;
 					while (1)
 					{
-						ch = read_character();
-						int ch2 = peek_next_character();
-						if (ch == next_peek && ch2 == '/')
-							break;
-						if (ch == -1)
+						m_cursor = scan::find(m_data, m_cursor, m_bufsz, next_peek);
+						if (m_cursor >= m_bufsz)
 						{
 							if (!m_opts.tokenize_comments)
 								goto repeat;
-							return token(m_source, token_type::comment, start, m_cursor - start, m_lineno, space);
+							return make_token(token_type::comment, start, m_cursor - start);
 						}
+						if (peek_next_character() == '/')
+							break;
 						++m_cursor;
 					}
 					m_cursor += 2;
 					if (!m_opts.tokenize_comments)
 						goto repeat;
-					return token(m_source, token_type::comment, start, m_cursor - start, m_lineno, space);
+					return make_token(token_type::comment, start, m_cursor - start);
 				}
-				else if (peek_next_character() == '/')
+				else if (next_peek == '/')
 				{
 					m_cursor += 2;
-					// read till next line
-					int start = m_cursor;
-					do
-					{
-						ch = read_character();
-						if (ch == -1)
-						{
-							if (!m_opts.tokenize_comments)
-								goto repeat;
-							return token(m_source, token_type::comment, start, m_cursor - start, m_lineno, space);
-						}
-						++m_cursor;
-					} while (ch != '\n');
-					--m_cursor; // incase we read the \n as token
+					size_t start = m_cursor;
+					skip_line();
 					if (!m_opts.tokenize_comments)
 						goto repeat;
-					return token(m_source, token_type::comment, start, m_cursor - start, m_lineno, space);
+					return make_token(token_type::comment, start, m_cursor - start);
 				}
 			}
-			for (int i = 0; i < sizeof(sequence_map) / sizeof(sequence_map[0]); ++i)
+			auto tt = two_character_operator(ch, peek_next_character());
+			if (tt != token_type::invalid)
 			{
-				if (sequence_map[i].chars[0] != ch)
-					continue;
-				// check second char if match
-				++m_cursor;
-				int ch2 = read_character();
-				if (sequence_map[i].chars[1] != ch2)
-				{
-					--m_cursor;
-					continue;
-				}
-				++m_cursor;
-				return token(m_source, sequence_map[i].type, m_cursor - 2, 2, m_lineno, space);
+				m_cursor += 2;
+				return make_token(tt, m_cursor - 2, 2);
 			}
-			return token(m_source, ch, m_cursor++, 1, m_lineno, space);
+			return make_token((token_type)ch, m_cursor++, 1);
+		}
+
+		bool next(token& t) override
+		{
+			t = read_token();
+			return t.type != token_type::eof;
 		}
 
 		std::vector<token> tokenize()
@@ -1,23 +1,35 @@
 #include "preprocessor.h"
+#include <cstring>
 
-bool parse::preprocessor::resolve_identifier(token_parser& parser, std::string ident, token_list& preprocessed_tokens,
+bool parse::preprocessor::resolve_identifier(token_parser& parser, const std::string& ident, token_list& preprocessed_tokens,
 											 definition_map& definitions)
 {
 
 	parse::token t;
-	auto def = definitions.find(ident);
-	if (def != definitions.end())
+	auto* def = find_definition(definitions, ident);
+	if (def)
 	{
 		//check if it's a function macro
-		if (def->second.is_function)
+		if (def->is_function)
 		{
 			if(!parser.accept_token(t, '('))
 				throw preprocessor_error("function macro, expecting (", t.to_string(), t.line_number());
 
-			//build token list arguments of parameters
-			std::vector<token_list> arguments;
+			//build token list arguments of parameters, one after another in arguments, argument i ends at bounds[i]
+			if (m_expansion_depth == m_arguments.size())
+			{
+				m_arguments.emplace_back();
+				m_bounds.emplace_back();
+			}
+			token_list& arguments = m_arguments[m_expansion_depth];
+			std::vector<size_t>& bounds = m_bounds[m_expansion_depth];
+			arguments.clear();
+			bounds.clear();
+			++m_expansion_depth;
+			auto argument = [&](size_t i) {
+				return std::make_pair(arguments.begin() + (i == 0 ? 0 : bounds[i - 1]), arguments.begin() + bounds[i]);
+			};
 
-			token_list tl;
 			int numparens = 0;
 			while (1)
 			{
@@ -32,10 +44,7 @@ bool parse::preprocessor::resolve_identifier(token_parser& parser, std::string i
 				else if (t.type_as_int() == ',')
 				{
 					if (numparens == 0)
-					{
-						arguments.push_back(tl);
-						tl.clear();
-					}
+						bounds.push_back(arguments.size());
 				} else if (t.type_as_int() == ')')
 				{
 					if (numparens <= 0)
@@ -43,13 +52,13 @@ bool parse::preprocessor::resolve_identifier(token_parser& parser, std::string i
 					--numparens;
 				}
 				if (t.type_as_int() != ',')
-					tl.push_back(t);
+					arguments.push_back(t);
 			}
-			arguments.push_back(tl);
+			bounds.push_back(arguments.size());
 
 			parse_opts popts;
 			popts.newlines = true;
-			token_parser def_parser(def->second.body, popts);
+			token_parser def_parser(def->body, popts);
 			while (1)
 			{
 				t = def_parser.read_token();
@@ -61,20 +70,18 @@ bool parse::preprocessor::resolve_identifier(token_parser& parser, std::string i
 						throw preprocessor_error(common::format("expected identifier got {}", t.type_as_string()), t.to_string(), t.line_number());
 
 					// if so, check if it matches any of the parameters
-					auto parm = def->second.parameters.find(t.to_string());
-					if (parm == def->second.parameters.end())
+					auto parm = def->parameters.find(t.to_string());
+					if (parm == def->parameters.end())
 					{
 						throw preprocessor_error("no such parameter", t.to_string(), t.line_number());
 					}
 					// we found the parameter, so stringify it
-					if (parm->second >= arguments.size())
+					if (parm->second >= bounds.size())
 						throw preprocessor_error("argument out of bounds for macro function", t.to_string(), t.line_number());
 						
 					std::string concatenation;
-					for (auto& it : arguments[parm->second])
-					{
-						concatenation += it.to_string();
-					}
+					for (auto [it, end] = argument(parm->second); it != end; ++it)
+						concatenation += it->to_string();
 					preprocessed_tokens.push_back(parse::token(concatenation, parse::token_type::string));
 				}
 				else if (t.type == parse::token_type::string) // is the current token in our block/body a ident?
@@ -84,34 +91,32 @@ bool parse::preprocessor::resolve_identifier(token_parser& parser, std::string i
 					{
 						if (!def_parser.accept_token(t, parse::token_type::identifier))
 							throw preprocessor_error("expected identifier", t.to_string(), t.line_number());
-						auto parm = def->second.parameters.find(t.to_string());
-						if (parm == def->second.parameters.end())
+						auto parm = def->parameters.find(t.to_string());
+						if (parm == def->parameters.end())
 						{
 							throw preprocessor_error("no such parameter", t.to_string(), t.line_number());
 						}
-						if (parm->second >= arguments.size())
+						if (parm->second >= bounds.size())
 							throw preprocessor_error("argument out of bounds for concatenation", t.to_string(),
 													 t.line_number());
 
-						for (auto& it : arguments[parm->second])
-						{
-							concatenation += it.to_string();
-						}
+						for (auto [it, end] = argument(parm->second); it != end; ++it)
+							concatenation += it->to_string();
 					}
 					preprocessed_tokens.push_back(parse::token(concatenation, parse::token_type::string));
 				}
 				else if (t.type_as_int() == (int)parse::token_type::identifier)
 				{
 					// if so, check if it matches any of the parameters
-					auto parm = def->second.parameters.find(t.to_string());
-					if (parm != def->second.parameters.end())
+					auto parm = def->parameters.find(t.to_string());
+					if (parm != def->parameters.end())
 					{
 						// we found the parameter, so replace it..
-						if (parm->second >= arguments.size())
+						if (parm->second >= bounds.size())
 							throw preprocessor_error("argument out of bounds for macro function", t.to_string(), t.line_number());
-						auto& tl = arguments[parm->second];
-						for (auto& tl_it : tl)
+						for (auto [it, end] = argument(parm->second); it != end; ++it)
 						{
+							auto& tl_it = *it;
 							if (tl_it.type_as_int() == (int)parse::token_type::identifier)
 							{
 								if (!resolve_identifier(def_parser, tl_it.to_string(), preprocessed_tokens,
@@ -135,13 +140,14 @@ bool parse::preprocessor::resolve_identifier(token_parser& parser, std::string i
 					preprocessed_tokens.push_back(t);
 				}
 			}
+			--m_expansion_depth;
 		}
 		else
 		{
 			// printf("found %s\n", t.to_string().c_str());
 			parse_opts popts;
 			popts.newlines = true;
-			token_parser def_parser(def->second.body, popts);
+			token_parser def_parser(def->body, popts);
 			while (1)
 			{
 				t = def_parser.read_token();
@@ -162,3 +168,322 @@ bool parse::preprocessor::resolve_identifier(token_parser& parser, std::string i
 	}
 	return false;
 }
+
+bool parse::preprocessor::open(filesystem_api& fs, const std::string& path_base, const std::string& path,
+							   source_map& sources, definition_map& definitions, lexer_opts opts, const char* lexer_name,
+							   lexer_factory make_lexer)
+{
+	m_inputs.clear();
+	m_spliced.clear();
+	m_pending.clear();
+	m_pending_index = 0;
+	m_frames.clear();
+	m_expansion_depth = 0;
+	m_fs = &fs;
+	m_path_base = path_base;
+	m_sources = &sources;
+	m_definitions = &definitions;
+	m_lexer_opts = opts;
+	m_lexer_opts.tokenize_newlines = true;
+	m_lexer_name = lexer_name;
+	m_make_lexer = std::move(make_lexer);
+	return open_file(path);
+}
+
+bool parse::preprocessor::open_file(const std::string& path)
+{
+	auto& definitions = *m_definitions;
+	std::string key = cache_key(m_path_base, path, m_lexer_name, m_lexer_opts);
+	//the file and the definitions it sets are spliced in when nothing it was made from changed
+	auto cached = include_cache::preprocessed(key);
+	if (cached && reusable(*cached, *m_fs, definitions))
+	{
+		for (auto& it : cached->definitions)
+		{
+			if (it.second)
+				definitions[it.first] = *it.second;
+			else
+				definitions.erase(it.first);
+		}
+		for (auto& src : cached->sources)
+			m_sources->try_emplace(src->path(), src);
+		merge(*cached);
+		m_spliced.push_back(cached);
+		auto& in = m_inputs.emplace_back();
+		in.path = path;
+		in.cached = std::move(cached);
+		return true;
+	}
+
+	auto data = m_fs->view_entry(path);
+	if (!data)
+	{
+		//LOG_WARNING("failed to open %s\n", path.c_str());
+		return false;
+	}
+	//a file that's included again reuses the source, the tokens it gave the first time refer to it
+	std::shared_ptr<const parse::source> src;
+	auto fnd = m_sources->find(path);
+	if (fnd != m_sources->end() && fnd->second->length() == data->size() &&
+		(!data->size() || !memcmp(fnd->second->data(), data->data(), data->size())))
+		src = fnd->second;
+	else
+	{
+		//views the file without copying it and indexes the lines once, every token of the file looks it's line up in there
+		src = std::make_shared<const parse::source>(path, data);
+		m_sources->try_emplace(path, src);
+	}
+
+	auto& in = m_inputs.emplace_back();
+	in.path = path;
+	in.src = src;
+	in.lex = m_make_lexer(src.get(), m_lexer_opts);
+	parse_opts popts;
+	popts.newlines = true;
+	in.parser = std::make_unique<token_parser>(*in.lex, popts);
+	if (include_cache::enabled())
+	{
+		frame f;
+		f.file = std::make_shared<preprocessed_file>();
+		f.file->files.emplace_back(path, include_cache::hash(*data));
+		f.file->sources.push_back(src);
+		m_frames.push_back(std::move(f));
+		in.key = std::move(key);
+		in.recording = true;
+	}
+	return true;
+}
+
+void parse::preprocessor::close_file()
+{
+	auto& in = m_inputs.back();
+	if (in.recording)
+	{
+		auto file = std::move(m_frames.back().file);
+		for (auto& name : m_frames.back().written)
+		{
+			auto fnd = m_definitions->find(name);
+			file->definitions.emplace_back(name, fnd == m_definitions->end() ? std::nullopt
+																		   : std::optional<Define>(fnd->second));
+		}
+		m_frames.pop_back();
+		//the cache entry may outlive whatever interned the text
+		for (auto& t : file->tokens)
+			file->strings.hold(t.text);
+		for (auto& it : file->definitions)
+		{
+			if (!it.second)
+				continue;
+			for (auto& t : it.second->body)
+				file->strings.hold(t.text);
+		}
+		include_cache::store(in.key, file);
+		merge(*file);
+	}
+	m_inputs.pop_back();
+}
+
+void parse::preprocessor::emit(const token& t)
+{
+	m_pending.push_back(t);
+	//every file that's open gets it, they're all still being read
+	for (auto& f : m_frames)
+		f.file->tokens.push_back(t);
+}
+
+bool parse::preprocessor::next(token& t)
+{
+	if (m_pending_index == m_pending.size())
+	{
+		m_pending.clear();
+		m_pending_index = 0;
+	}
+	while (m_pending.empty())
+	{
+		if (m_inputs.empty())
+			return false;
+		auto& in = m_inputs.back();
+		if (in.cached)
+		{
+			if (in.cached_index < in.cached->tokens.size())
+				emit(in.cached->tokens[in.cached_index++]);
+			else
+				m_inputs.pop_back();
+			continue;
+		}
+		token tk;
+		try
+		{
+			tk = in.parser->read_token();
+		}
+		catch (parse::lexer_error& err)
+		{
+			throw preprocessor_error(common::format("failed to tokenize file {}", err.what()), in.path, err.line1);
+		}
+		if (tk.type == parse::token_type::eof)
+			close_file();
+		else
+			process(tk);
+	}
+	t = m_pending[m_pending_index++];
+	return true;
+}
+
+void parse::preprocessor::process(token t)
+{
+	auto& in = m_inputs.back();
+	auto& parser = *in.parser;
+	auto& path = in.path;
+	auto& definitions = *m_definitions;
+
+	if (t.type_as_int() == '#')
+	{
+		if (handle_token_stack_directives(t, parser, path, definitions, in.conditions))
+			return;
+	}
+
+	if (!in.conditions.empty() && !in.conditions.top())
+		return;
+
+	switch (t.type_as_int())
+	{
+	case (int)parse::token_type::identifier:
+	{
+		m_expansion.clear();
+		if (!resolve_identifier(parser, t.to_string(), m_expansion, definitions))
+			emit(t);
+		for (auto& it : m_expansion)
+			emit(it);
+	}
+	break;
+
+	case '#':
+	{
+		std::string directive = parser.read_identifier();
+		if (directive == "include")
+		{
+			if (parser.accept_token(t, parse::token_type::string) ||
+				parser.accept_token(t, parse::token_type::identifier))
+			{
+				if (t.type == parse::token_type::identifier)
+					parser.expect_token(';');
+				std::string fixed_path = t.to_string();
+				std::replace(fixed_path.begin(), fixed_path.end(), '\\', '/');
+				if (fixed_path.find('.') == std::string::npos)
+					fixed_path += include_path_extension;
+				bool include_cond = true;
+				if ((m_options & k_EPreprocessorOption_IncludeOnce) &&
+					included.find(fixed_path) == included.end())
+					include_cond = false;
+				if (include_cond)
+				{
+					included.insert(fixed_path);
+
+					printf("including %s\n", t.to_string().c_str());
+					if ((m_options & k_EPreprocessorOption_DoNotInclude) != k_EPreprocessorOption_DoNotInclude)
+					{
+						//it's read before the rest of ours
+						if (!open_file(m_path_base + fixed_path))
+							throw preprocessor_error(
+								common::format("failed to preprocess file {} @ {}", m_path_base, fixed_path),
+								fixed_path, t.line_number());
+					}
+					else
+					{
+						parser.unread_token();
+						parser.unread_token();
+						parser.unread_token();
+						parser.unread_token();
+						emit(parser.read_token());
+						emit(parser.read_token());
+						emit(parser.read_token());
+						emit(parser.read_token());
+					}
+				}
+				else
+					printf("duplicate include '%s'\n", fixed_path.c_str());
+			}
+			else
+				throw preprocessor_error("invalid include directive", t.to_string(), t.line_number());
+		}
+		else if (directive == "undef")
+		{
+			if (!parser.accept_token(t, parse::token_type::identifier))
+				throw preprocessor_error("expected identifier", path, t.line_number());
+			wrote(t.to_string());
+			if (definitions.find(t.to_string()) != definitions.end())
+			{
+				definitions.erase(t.to_string());
+			}
+		}
+		else if (directive == "define")
+		{
+			if (!parser.accept_token(t, parse::token_type::identifier))
+				throw preprocessor_error("expected identifier", path, t.line_number());
+			//a definition that's already there gets added to
+			depend(definitions, t.to_string());
+			wrote(t.to_string());
+			auto &def = definitions[t.to_string()];
+			if (parser.accept_token(t, '('))
+			{
+				if (t.whitespace == 0)
+				{
+					def.is_function = true;
+					size_t numparm = 0;
+					do
+					{
+						if (!parser.accept_token(t, parse::token_type::identifier))
+							throw preprocessor_error("expected identifier", path, t.line_number());
+						def.parameters[t.to_string()] = numparm++;
+					} while (parser.accept_token(t, ','));
+					parser.expect_token(')');
+				}
+				else
+				{
+					parser.unread_token();
+				}
+			}
+
+			bool got_backslash = false;
+			while (1)
+			{
+				auto nt = parser.read_token();
+				if (nt.type == parse::token_type::eof)
+					break;
+				if (nt.type_as_int() == '\n')
+				{
+					if (!got_backslash)
+						break;
+					def.body.push_back(nt);
+					got_backslash = false;
+				}
+				else if (nt.type_as_int() == '\\')
+				{
+					got_backslash = true;
+				}
+				else
+				{
+					def.body.push_back(nt);
+				}
+			}
+		}
+		else
+		{
+			if (m_options & k_EPreprocessorOption_IgnoreUnknownDirectives)
+			{
+				parser.unread_token();
+				parser.unread_token();
+				emit(parser.read_token());
+				emit(parser.read_token());
+			} else
+				throw preprocessor_error(common::format("invalid directive {}", directive), t.to_string(),
+										 t.line_number());
+		}
+	}
+	break;
+
+	default:
+		emit(t);
+		break;
+	}
+}
@@ -9,21 +9,18 @@
 #include <exception>
 #include "token_parser.h"
 #include "lexer.h"
+#include "include_cache.h"
+#include <deque>
+#include <functional>
+#include <memory>
+#include <typeinfo>
 
 #include <core/filesystem/api.h>
 
 namespace parse
 {
-	using source_map = std::unordered_map<std::string, parse::source>;
-
-	struct Define
-	{
-		bool is_function = false;
-		std::unordered_map<std::string, size_t> parameters;
-		token_list body;
-	};
-
-	using definition_map = std::unordered_map<std::string, Define>;
+	//shared with the include_cache
+	using source_map = std::unordered_map<std::string, std::shared_ptr<const parse::source>>;
 
 	struct preprocessor_error : std::exception
 	{
@@ -49,11 +46,138 @@ namespace parse
 		k_EPreprocessorOption_DoNotInclude = 4
 	} EPreprocessorOptionFlags;
 
-	class preprocessor
+	//pulls tokens from the lexers of the files it has open, only what an expansion or directive produced is buffered
+	class preprocessor : public token_stream
 	{
 		std::string include_path_extension; //default don't postfix
 		EPreprocessorOptionFlags m_options = k_EPreprocessorOption_None;
 		std::set<std::string> included;
+
+		//a file that's being preprocessed, records what it depends on for the include_cache
+		struct frame
+		{
+			std::shared_ptr<preprocessed_file> file;
+			//definitions the file set, looking them up after that doesn't depend on anything outside of it
+			std::set<std::string> written;
+			std::set<std::string> looked_up;
+		};
+		std::vector<frame> m_frames;
+
+		using lexer_factory = std::function<std::unique_ptr<lexer>(const source*, lexer_opts)>;
+
+		//a file that's being read, either by it's lexer or from the include_cache
+		struct input
+		{
+			std::string path;
+			std::string key;
+			//the lexer reads from it
+			std::shared_ptr<const source> src;
+			std::unique_ptr<lexer> lex;
+			std::unique_ptr<token_parser> parser;
+			std::stack<bool> conditions;
+			std::shared_ptr<const preprocessed_file> cached;
+			size_t cached_index = 0;
+			//has a frame and goes in the include_cache when it's done
+			bool recording = false;
+		};
+		//includes are pushed on top, references stay valid
+		std::deque<input> m_inputs;
+		//include_cache entries that got spliced in, they hold the text of their tokens and definitions until it's done
+		std::vector<std::shared_ptr<const preprocessed_file>> m_spliced;
+		//what the last token expanded to, pulled before the next token is read
+		token_list m_pending;
+		size_t m_pending_index = 0;
+
+		filesystem_api* m_fs = nullptr;
+		std::string m_path_base;
+		source_map* m_sources = nullptr;
+		definition_map* m_definitions = nullptr;
+		lexer_opts m_lexer_opts;
+		const char* m_lexer_name = "";
+		lexer_factory m_make_lexer;
+
+		//macro arguments, one list per nested expansion so they're reused
+		std::deque<token_list> m_arguments;
+		std::deque<std::vector<size_t>> m_bounds;
+		size_t m_expansion_depth = 0;
+		token_list m_expansion;
+
+		bool open(filesystem_api& fs, const std::string& path_base, const std::string& path, source_map& sources,
+				  definition_map& definitions, lexer_opts opts, const char* lexer_name, lexer_factory make_lexer);
+		bool open_file(const std::string& path);
+		void close_file();
+		void emit(const token& t);
+		void process(token t);
+
+		//the definition is looked at by the file on top
+		void depend(const definition_map& definitions, const std::string& name)
+		{
+			if (m_frames.empty())
+				return;
+			auto& f = m_frames.back();
+			if (f.written.find(name) != f.written.end() || !f.looked_up.insert(name).second)
+				return;
+			auto fnd = definitions.find(name);
+			f.file->dependencies.emplace_back(name, fingerprint(fnd == definitions.end() ? nullptr : &fnd->second));
+		}
+
+		void wrote(const std::string& name)
+		{
+			if (!m_frames.empty())
+				m_frames.back().written.insert(name);
+		}
+
+		const Define* find_definition(const definition_map& definitions, const std::string& name)
+		{
+			depend(definitions, name);
+			auto fnd = definitions.find(name);
+			return fnd == definitions.end() ? nullptr : &fnd->second;
+		}
+
+		//a file got included by the one on top, it depends on whatever the included one depended on
+		void merge(const preprocessed_file& file)
+		{
+			if (m_frames.empty())
+				return;
+			auto& f = m_frames.back();
+			for (auto& it : file.dependencies)
+			{
+				if (f.written.find(it.first) == f.written.end() && f.looked_up.insert(it.first).second)
+					f.file->dependencies.push_back(it);
+			}
+			for (auto& it : file.definitions)
+				f.written.insert(it.first);
+			f.file->files.insert(f.file->files.end(), file.files.begin(), file.files.end());
+			f.file->sources.insert(f.file->sources.end(), file.sources.begin(), file.sources.end());
+		}
+
+		//every file it was made from still has the same content and every definition it looked at is the same
+		bool reusable(const preprocessed_file& file, filesystem_api& fs, const definition_map& definitions)
+		{
+			for (auto& it : file.dependencies)
+			{
+				auto fnd = definitions.find(it.first);
+				if (fingerprint(fnd == definitions.end() ? nullptr : &fnd->second) != it.second)
+					return false;
+			}
+			for (auto& it : file.files)
+			{
+				auto data = fs.view_entry(it.first);
+				if (!data || include_cache::hash(*data) != it.second)
+					return false;
+			}
+			return true;
+		}
+
+		std::string cache_key(const std::string& path_base, const std::string& path, const char* lexer,
+							  const parse::lexer_opts& opts) const
+		{
+			std::string key = path_base + '\n' + path + '\n' + lexer + '\n';
+			for (bool b : {opts.tokenize_comments, opts.tokenize_whitespace, opts.tokenize_newlines, opts.backslash_comments})
+				key += b ? '1' : '0';
+			return key + '\n' + std::to_string(m_options) + '\n' + include_path_extension;
+		}
+
 	  public:
 
 		void set_options(int opts)
@@ -67,7 +191,7 @@ namespace parse
 		}
 
 		// recursively resolve
-		bool resolve_identifier(token_parser& parser, std::string, token_list& preprocessed_tokens,
+		bool resolve_identifier(token_parser& parser, const std::string&, token_list& preprocessed_tokens,
 								definition_map& definitions);
 		bool preprocess(filesystem_api& fs, const std::string& path_base, const std::string& path,
 						token_list& preprocessed_tokens, source_map& sources, definition_map& definitions,
@@ -86,8 +210,7 @@ namespace parse
 				if (!parser.accept_token(t, parse::token_type::identifier))
 					throw preprocessor_error("expected identifier", path, t.line_number());
 				// check if we have the definition...
-				auto def = definitions.find(t.to_string());
-				if (def == definitions.end()) // nope
+				if (!find_definition(definitions, t.to_string())) // nope
 				{
 					process_token_stack.push(false);
 				}
@@ -101,8 +224,7 @@ namespace parse
 				if (!parser.accept_token(t, parse::token_type::identifier))
 					throw preprocessor_error("expected identifier", path, t.line_number());
 				// check if we have the definition...
-				auto def = definitions.find(t.to_string());
-				if (def != definitions.end()) // nope
+				if (find_definition(definitions, t.to_string())) // nope
 				{
 					process_token_stack.push(false);
 				}
@@ -134,200 +256,31 @@ namespace parse
 			return true;
 		}
 
+		//starts streaming the file, tokens are pulled with next and includes are read as they come up
+		//sources and definitions have to outlive the stream
+		template <typename T>
+		bool open(filesystem_api& fs, const std::string& path_base, const std::string& path, source_map& sources,
+				  definition_map& definitions, parse::lexer_opts opts)
+		{
+			return open(fs, path_base, path, sources, definitions, opts, typeid(T).name(),
+						[](const source* src, lexer_opts opts) -> std::unique_ptr<lexer> {
+							return std::make_unique<T>(src, opts);
+						});
+		}
+
+		bool next(token& t) override;
+
+		//the whole file at once, depth isn't used anymore, includes are read by the same stream
 		template <typename T>
 		bool preprocess_with_typed_lexer(filesystem_api& fs, const std::string& path_base, const std::string& path,
 						token_list& preprocessed_tokens,
 						source_map& sources, definition_map& definitions, parse::lexer_opts opts, int depth = 0)
 		{
-			std::string tmp;
-			if (!fs.read_text_entry(path, tmp))
-			{
-				//LOG_WARNING("failed to open %s\n", path.c_str());
+			if (!open<T>(fs, path_base, path, sources, definitions, opts))
 				return false;
-			}
-			sources.insert(std::make_pair(path, parse::source(path, tmp)));
-			opts.tokenize_newlines = true;
-			T lexer(&sources[path], opts);
-
-			token_list tokens;
-
-			try
-			{
-				tokens = lexer.tokenize();
-			}
-			catch (parse::lexer_error& err)
-			{
-				throw preprocessor_error(common::format("failed to tokenize file {}", err.what()), path, err.line1);
-			}
-			parse_opts popts;
-			popts.newlines = true;
-			token_parser parser(tokens, popts);
-
-			std::stack<bool> m_process_token_stack;
-
-			while (1)
-			{
-				auto t = parser.read_token();
-				if (t.type == parse::token_type::eof)
-					break;
-
-				if (t.type_as_int() == '#')
-				{
-					if (handle_token_stack_directives(t, parser, path, definitions, m_process_token_stack))
-						continue;
-				}
-
-				if (!m_process_token_stack.empty() && !m_process_token_stack.top())
-					continue;
-
-				switch (t.type_as_int())
-				{
-				case (int)parse::token_type::identifier:
-				{
-					if (!resolve_identifier(parser, t.to_string(), preprocessed_tokens, definitions))
-						preprocessed_tokens.push_back(t);
-				}
-				break;
-
-				case '#':
-				{
-					std::string directive = parser.read_identifier();
-					if (directive == "include")
-					{
-						if (parser.accept_token(t, parse::token_type::string) ||
-							parser.accept_token(t, parse::token_type::identifier))
-						{
-							if (t.type == parse::token_type::identifier)
-								parser.expect_token(';');
-							std::string fixed_path = t.to_string();
-							std::replace(fixed_path.begin(), fixed_path.end(), '\\', '/');
-							if (fixed_path.find('.') == std::string::npos)
-								fixed_path += include_path_extension;
-							bool include_cond = true;
-							if ((m_options & k_EPreprocessorOption_IncludeOnce) &&
-								included.find(fixed_path) == included.end())
-								include_cond = false;
-							if (include_cond)
-							{
-								included.insert(fixed_path);
-
-								// for (int i = 0; i < depth; ++i)
-								// putchar('\t');
-								printf("including %s\n", t.to_string().c_str());
-								if ((m_options & k_EPreprocessorOption_DoNotInclude) != k_EPreprocessorOption_DoNotInclude)
-								{
-									token_list tmp;
-									if (!preprocess_with_typed_lexer<T>(fs, path_base, path_base + fixed_path, tmp,
-																		sources, definitions, opts, depth + 1))
-										throw preprocessor_error(
-											common::format("failed to preprocess file {} @ {}", path_base, fixed_path),
-											fixed_path, t.line_number());
-									preprocessed_tokens.insert(preprocessed_tokens.end(), tmp.begin(), tmp.end());
-								}
-								else
-								{
-									parser.unread_token();
-									parser.unread_token();
-									parser.unread_token();
-									parser.unread_token();
-									preprocessed_tokens.push_back(parser.read_token());
-									preprocessed_tokens.push_back(parser.read_token());
-									preprocessed_tokens.push_back(parser.read_token());
-									preprocessed_tokens.push_back(parser.read_token());
-								}
-							}
-							else
-								printf("duplicate include '%s'\n", fixed_path.c_str());
-						}
-						else
-							throw preprocessor_error("invalid include directive", t.to_string(), t.line_number());
-					}
-					else if (directive == "undef")
-					{
-						if (!parser.accept_token(t, parse::token_type::identifier))
-							throw preprocessor_error("expected identifier", path, t.line_number());
-						if (definitions.find(t.to_string()) != definitions.end())
-						{
-							definitions.erase(t.to_string());
-						}
-					}
-					else if (directive == "define")
-					{
-						if (!parser.accept_token(t, parse::token_type::identifier))
-							throw preprocessor_error("expected identifier", path, t.line_number());
-						auto &def = definitions[t.to_string()];
-//						printf("adding def %s\n", t.to_string().c_str());
-						//maybe having a query/filter like function would be better
-						//e.g
-						// filter = {...}
-						// where filter has all the "search" or query options that the parsed token has to meet otherwise it won't accept it
-						// parser.accept_filter(t, filter))
-						// e.g because of t.whitespace && t.token_type == ?
-						if (parser.accept_token(t, '('))
-						{
-							if (t.whitespace == 0)
-							{
-								def.is_function = true;
-								size_t numparm = 0;
-								do
-								{
-									if (!parser.accept_token(t, parse::token_type::identifier))
-										throw preprocessor_error("expected identifier", path, t.line_number());
-									def.parameters[t.to_string()] = numparm++;
-								} while (parser.accept_token(t, ','));
-								parser.expect_token(')');
-							}
-							else
-							{
-								parser.unread_token();
-							}
-						}
-
-						bool got_backslash = false;
-						while (1)
-						{
-							auto nt = parser.read_token();
-							if (nt.type == parse::token_type::eof)
-								break;
-							if (nt.type_as_int() == '\n')
-							{
-								if (!got_backslash)
-									break;
-								def.body.push_back(nt);
-								got_backslash = false;
-							}
-							else if (nt.type_as_int() == '\\')
-							{
-								got_backslash = true;
-							}
-							else
-							{
-								def.body.push_back(nt);
-							}
-						}
-					}
-					else
-					{
-						if (m_options & k_EPreprocessorOption_IgnoreUnknownDirectives)
-						{
-							parser.unread_token();
-							parser.unread_token();
-							preprocessed_tokens.push_back(parser.read_token());
-							preprocessed_tokens.push_back(parser.read_token());
-						} else
-							throw preprocessor_error(common::format("invalid directive {}", directive), t.to_string(),
-												 t.line_number());
-					}
-				}
-				break;
-
-				default:
-					preprocessed_tokens.push_back(t);
-					break;
-				}
-				// printf("token: type=%d, %d, %d [%s]\n", t.type, t.pos, t.sz, t.to_string().c_str());
-			}
-
+			token t;
+			while (next(t))
+				preprocessed_tokens.push_back(t);
 			return true;
 		}
 	};
@@ -0,0 +1,121 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PARSE_SCAN_SSE2
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+//finds the end of runs of characters the lexer skips over, 16 bytes at a time where sse2 is available
+//every function returns the index of the first byte at or after i that ends the run, n if it runs to the end
+namespace parse
+{
+	namespace scan
+	{
+#ifdef PARSE_SCAN_SSE2
+		inline unsigned first_bit(unsigned mask)
+		{
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+
+		inline __m128i load(const char* s)
+		{
+			return _mm_loadu_si128((const __m128i*)s);
+		}
+
+		//lanes of v within [lo, hi], signed so bytes above 0x7f never match
+		inline __m128i in_range(__m128i v, char lo, char hi)
+		{
+			return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+		}
+#endif
+
+		//' ', '\t' and '\r'
+		inline bool is_space(char c)
+		{
+			return c == ' ' || c == '\t' || c == '\r';
+		}
+
+		inline bool is_identifier(char c)
+		{
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+		}
+
+		inline size_t spaces(const char* s, size_t i, size_t n)
+		{
+#ifdef PARSE_SCAN_SSE2
+			const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), cr = _mm_set1_epi8('\r');
+			for (; i + 16 <= n; i += 16)
+			{
+				__m128i v = load(s + i);
+				__m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+										 _mm_cmpeq_epi8(v, cr));
+				unsigned mask = ~(unsigned)_mm_movemask_epi8(m) & 0xffff;
+				if (mask)
+					return i + first_bit(mask);
+			}
+#endif
+			while (i < n && is_space(s[i]))
+				++i;
+			return i;
+		}
+
+		//[a-zA-Z0-9_]
+		inline size_t identifier(const char* s, size_t i, size_t n)
+		{
+#ifdef PARSE_SCAN_SSE2
+			const __m128i lower = _mm_set1_epi8(0x20), underscore = _mm_set1_epi8('_');
+			for (; i + 16 <= n; i += 16)
+			{
+				__m128i v = load(s + i);
+				//setting 0x20 folds A-Z onto a-z without pulling anything else into the range
+				__m128i m = _mm_or_si128(_mm_or_si128(in_range(_mm_or_si128(v, lower), 'a', 'z'), in_range(v, '0', '9')),
+										 _mm_cmpeq_epi8(v, underscore));
+				unsigned mask = ~(unsigned)_mm_movemask_epi8(m) & 0xffff;
+				if (mask)
+					return i + first_bit(mask);
+			}
+#endif
+			while (i < n && is_identifier(s[i]))
+				++i;
+			return i;
+		}
+
+		inline size_t find(const char* s, size_t i, size_t n, char a)
+		{
+			if (i >= n)
+				return n;
+			//libc already does this with the widest vectors the machine has
+			auto* p = (const char*)memchr(s + i, a, n - i);
+			return p ? p - s : n;
+		}
+
+		inline size_t find(const char* s, size_t i, size_t n, char a, char b)
+		{
+#ifdef PARSE_SCAN_SSE2
+			const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+			for (; i + 16 <= n; i += 16)
+			{
+				__m128i v = load(s + i);
+				unsigned mask =
+					(unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+				if (mask)
+					return i + first_bit(mask);
+			}
+#endif
+			while (i < n && s[i] != a && s[i] != b)
+				++i;
+			return i;
+		}
+	}; // namespace scan
+}; // namespace parse
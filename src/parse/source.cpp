@@ -0,0 +1,68 @@
+#include "source.h"
+#include "string_table.h"
+#include <mutex>
+
+namespace parse
+{
+	namespace
+	{
+		//the rest of an id counts how often the slot got used, a token of a source that's gone doesn't find
+		//the one that took it's place
+		constexpr uint32_t kIndexBits = 20;
+
+		struct slot
+		{
+			std::atomic<const source*> src{nullptr};
+			uint32_t generation = 0;
+		};
+
+		struct sources
+		{
+			std::mutex mutex;
+			id_table<slot, 8> entries;
+
+			sources()
+			{
+				entries.add(); //0 is no source
+			}
+		};
+
+		//never destroyed, the include_cache keeps sources until after statics are gone at exit
+		sources& registry()
+		{
+			static sources* s = new sources;
+			return *s;
+		}
+	};
+
+	uint32_t source::register_source(const source* src)
+	{
+		auto& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		uint32_t index = r.entries.add();
+		if (index >> kIndexBits)
+			throw std::length_error("too many sources");
+		auto& s = r.entries[index];
+		//never 0 so the id isn't either
+		s.generation = ((s.generation + 1) & ((1u << (32 - kIndexBits)) - 1)) | 1;
+		s.src.store(src, std::memory_order_release);
+		return s.generation << kIndexBits | index;
+	}
+
+	void source::unregister_source(uint32_t id)
+	{
+		auto& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		uint32_t index = id & ((1u << kIndexBits) - 1);
+		r.entries[index].src.store(nullptr, std::memory_order_release);
+		r.entries.remove(index);
+	}
+
+	const source* source::get(uint32_t id)
+	{
+		if (id == 0)
+			return nullptr;
+		auto* src = registry().entries[id & ((1u << kIndexBits) - 1)].src.load(std::memory_order_acquire);
+		return src && src->id() == id ? src : nullptr;
+	}
+}; // namespace parse
@@ -1,21 +1,70 @@
 #pragma once
+#include "scan.h"
+#include <core/filesystem/api.h>
+#include <algorithm>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace parse
 {
+	//the text the lexer reads, a view of the file as it is on disk (crlf is left to the lexer) or a string of it's own
 	class source
 	{
 		std::string m_buffer;
+		filesystem::file_view m_view;
+		const char* m_data = nullptr;
+		size_t m_size = 0;
 		std::string m_path;
+		//offset of every newline, ascending, line and column lookups are a binary search
+		std::vector<int> m_newlines;
+		//tokens refer to their source by id, it's registered for as long as the source lives
+		uint32_t m_id;
+
+		void index_lines()
+		{
+			size_t n = m_size;
+			for (size_t i = scan::find(m_data, 0, n, '\n'); i < n; i = scan::find(m_data, i + 1, n, '\n'))
+				m_newlines.push_back((int)i);
+		}
+
+		static uint32_t register_source(const source*);
+		static void unregister_source(uint32_t id);
 
 	  public:
-		source()
+		source() : m_id(register_source(this))
+		{
+		}
+		source(const std::string& path, std::string buf)
+			: m_path(path), m_buffer(std::move(buf)), m_id(register_source(this))
+		{
+			m_data = m_buffer.data();
+			m_size = m_buffer.size();
+			index_lines();
+		}
+		//nothing is copied, the view is kept for as long as the source lives
+		source(const std::string& path, filesystem::file_view view)
+			: m_path(path), m_view(std::move(view)), m_id(register_source(this))
+		{
+			m_data = m_view->data();
+			m_size = m_view->size();
+			index_lines();
+		}
+		~source()
 		{
+			unregister_source(m_id);
 		}
-		source(const std::string& path, const std::string& buf) : m_path(path), m_buffer(buf)
+		source(const source&) = delete;
+		source& operator=(const source&) = delete;
+
+		uint32_t id() const
 		{
+			return m_id;
 		}
 
+		//nullptr for 0 and sources that are gone
+		static const source* get(uint32_t id);
+
 		const std::string& path() const
 		{
 			return m_path;
@@ -23,29 +72,38 @@ namespace parse
 
 		const int length() const
 		{
-			return m_buffer.size();
+			return m_size;
+		}
+
+		const char* data() const
+		{
+			return m_data;
 		}
 
 		const int operator[](const size_t index) const
 		{
-			if (index >= m_buffer.size())
+			if (index >= m_size)
 				return -1;
-			return m_buffer[index];
+			return m_data[index];
 		}
 
+		//newlines before cur
 		int line_number(int cur) const
 		{
-			int n = 0;
-			for (int i = 0; i < cur; ++i)
-				if (m_buffer[i] == '\n')
-					++n;
-			return n;
+			return std::lower_bound(m_newlines.begin(), m_newlines.end(), cur) - m_newlines.begin();
+		}
+
+		//characters between the start of the line and cur
+		int column(int cur) const
+		{
+			int line = line_number(cur);
+			return line == 0 ? cur : cur - m_newlines[line - 1] - 1;
 		}
 
 		std::string extract_string(int start, int n) const
 		{
-			if (start >= 0 && n > 0)
-				return m_buffer.substr(start, n);
+			if (start >= 0 && n > 0 && (size_t)start < m_size)
+				return std::string(m_data + start, std::min((size_t)n, m_size - start));
 			return "";
 		}
 	};
@@ -0,0 +1,139 @@
+#include "string_table.h"
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace parse
+{
+	namespace
+	{
+		struct strings
+		{
+			std::shared_mutex mutex;
+			id_table<interned_string> entries;
+			//the keys point into the text of the entries
+			std::unordered_map<std::string_view, uint32_t> ids;
+
+			strings()
+			{
+				ids.emplace(entries[entries.add()].text, 0);
+			}
+		};
+
+		//never destroyed, string_refs of statics may let go of their entries after it would be
+		strings& table()
+		{
+			static strings* s = new strings;
+			return *s;
+		}
+
+		thread_local string_refs* t_current = nullptr;
+	};
+
+	void string_refs::add(uint32_t id)
+	{
+		size_t word = id >> 6;
+		if (word >= m_held.size())
+			m_held.resize(std::max(word + 1, m_held.size() * 2));
+		m_held[word] |= uint64_t(1) << (id & 63);
+		table().entries[id].refs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void string_refs::release()
+	{
+		if (m_held.empty())
+			return;
+		auto& t = table();
+		std::unique_lock<std::shared_mutex> lock(t.mutex);
+		for (size_t word = 0; word < m_held.size(); ++word)
+		{
+			for (uint64_t bits = m_held[word]; bits; bits &= bits - 1)
+			{
+				uint32_t id = (uint32_t)(word * 64 + std::countr_zero(bits));
+				auto& entry = t.entries[id];
+				if (entry.refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+					continue;
+				t.ids.erase(entry.text);
+				entry.text = std::string();
+				entry.integer = 0;
+				entry.number = 0.f;
+				t.entries.remove(id);
+			}
+		}
+		m_held.clear();
+	}
+
+	string_refs* string_refs::current()
+	{
+		return t_current;
+	}
+
+	string_refs& string_refs::get()
+	{
+		//nothing would ever let go of it
+		if (!t_current)
+			throw std::logic_error("string interned without string_refs to hold it");
+		return *t_current;
+	}
+
+	string_refs::scope::scope(string_refs* refs) : m_previous(t_current)
+	{
+		t_current = refs;
+	}
+
+	string_refs::scope::~scope()
+	{
+		t_current = m_previous;
+	}
+
+	uint32_t string_table::intern(std::string_view s)
+	{
+		if (s.empty())
+			return 0;
+		auto& refs = string_refs::get();
+		auto& t = table();
+		{
+			//a held entry can't be freed while this is locked
+			std::shared_lock<std::shared_mutex> lock(t.mutex);
+			auto fnd = t.ids.find(s);
+			if (fnd != t.ids.end())
+			{
+				refs.hold(fnd->second);
+				return fnd->second;
+			}
+		}
+		std::unique_lock<std::shared_mutex> lock(t.mutex);
+		auto fnd = t.ids.find(s);
+		if (fnd != t.ids.end())
+		{
+			refs.hold(fnd->second);
+			return fnd->second;
+		}
+		uint32_t id = t.entries.add();
+		auto& entry = t.entries[id];
+		entry.text = s;
+		if ((s[0] >= '0' && s[0] <= '9') || s[0] == '.')
+		{
+			entry.integer = strtoll(entry.text.c_str(), nullptr, 10);
+			entry.number = strtof(entry.text.c_str(), nullptr);
+		}
+		t.ids.emplace(entry.text, id);
+		refs.hold(id);
+		return id;
+	}
+
+	const interned_string& string_table::get(uint32_t id)
+	{
+		return table().entries[id];
+	}
+
+	size_t string_table::size()
+	{
+		auto& t = table();
+		std::shared_lock<std::shared_mutex> lock(t.mutex);
+		return t.entries.size() - 1;
+	}
+}; // namespace parse
@@ -0,0 +1,156 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace parse
+{
+	//table indexed by id, entries never move so they can be read without a lock while others get added
+	//adding and removing is up to the owner to serialize, removed ids get handed out again
+	template <typename T, size_t ChunkBits = 12> class id_table
+	{
+		static constexpr size_t kChunkSize = size_t(1) << ChunkBits;
+		//pointers to the chunks, a full one is replaced by a copy twice the size
+		//the old ones are kept until the table is gone, a reader may still be looking at one
+		std::atomic<std::atomic<T*>*> m_directory{nullptr};
+		std::vector<std::unique_ptr<std::atomic<T*>[]>> m_directories;
+		size_t m_capacity = 0;
+		size_t m_chunks = 0;
+		uint32_t m_size = 0;
+		std::vector<uint32_t> m_free;
+
+		void grow()
+		{
+			if (m_chunks == m_capacity)
+			{
+				size_t capacity = m_capacity ? m_capacity * 2 : 16;
+				auto directory = std::make_unique<std::atomic<T*>[]>(capacity);
+				auto* previous = m_directory.load(std::memory_order_relaxed);
+				for (size_t i = 0; i < m_chunks; ++i)
+					directory[i].store(previous[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+				m_directory.store(directory.get(), std::memory_order_release);
+				m_directories.push_back(std::move(directory));
+				m_capacity = capacity;
+			}
+			m_directory.load(std::memory_order_relaxed)[m_chunks++].store(new T[kChunkSize], std::memory_order_release);
+		}
+
+	  public:
+		id_table() = default;
+		id_table(const id_table&) = delete;
+		id_table& operator=(const id_table&) = delete;
+		~id_table()
+		{
+			auto* directory = m_directory.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < m_chunks; ++i)
+				delete[] directory[i].load(std::memory_order_relaxed);
+		}
+
+		//a removed id if there is one, a new default constructed entry otherwise
+		uint32_t add()
+		{
+			if (!m_free.empty())
+			{
+				uint32_t id = m_free.back();
+				m_free.pop_back();
+				return id;
+			}
+			if (m_size == UINT32_MAX)
+				throw std::length_error("id_table is full");
+			uint32_t id = m_size;
+			if ((id >> ChunkBits) == m_chunks)
+				grow();
+			++m_size;
+			return id;
+		}
+
+		//the entry is left as it is, it's up to the owner to clear it before the id gets added again
+		void remove(uint32_t id)
+		{
+			m_free.push_back(id);
+		}
+
+		//ids in use
+		size_t size() const
+		{
+			return m_size - m_free.size();
+		}
+
+		T& operator[](uint32_t id) const
+		{
+			auto* directory = m_directory.load(std::memory_order_acquire);
+			return directory[id >> ChunkBits].load(std::memory_order_acquire)[id & (kChunkSize - 1)];
+		}
+	};
+
+	struct interned_string
+	{
+		std::string text;
+		//texts that start like a number are parsed once when they're interned
+		long long integer = 0;
+		float number = 0.f;
+		//string_refs that hold it, it's freed when the last one lets go
+		std::atomic<uint32_t> refs{0};
+	};
+
+	//the entries of the string_table something holds on to, e.g. a program and the text of it's nodes
+	//everything that's interned gets held by the current one, the entries go away with the last one that holds them
+	class string_refs
+	{
+		//bit per id
+		std::vector<uint64_t> m_held;
+
+		void add(uint32_t id);
+
+	  public:
+		string_refs() = default;
+		string_refs(const string_refs&) = delete;
+		string_refs& operator=(const string_refs&) = delete;
+		~string_refs()
+		{
+			release();
+		}
+
+		//id has to be held by something already, e.g. the text of a token that's being copied
+		void hold(uint32_t id)
+		{
+			size_t word = id >> 6;
+			if (id && (word >= m_held.size() || !(m_held[word] & (uint64_t(1) << (id & 63)))))
+				add(id);
+		}
+		//lets go of everything
+		void release();
+
+		static string_refs* current();
+		//throws if there's no current one
+		static string_refs& get();
+		//makes refs the current one until it goes out of scope
+		class scope
+		{
+			string_refs* m_previous;
+
+		  public:
+			scope(string_refs* refs);
+			~scope();
+			scope(const scope&) = delete;
+			scope& operator=(const scope&) = delete;
+		};
+	};
+
+	//the text of every token and node is in here once, tokens only carry the id
+	//interning and freeing take a lock, looking an id up doesn't
+	class string_table
+	{
+	  public:
+		//id 0 is the empty string, anything else is held by the current string_refs
+		static uint32_t intern(std::string_view s);
+		static const interned_string& get(uint32_t id);
+		//entries that are held by something
+		static size_t size();
+	};
+}; // namespace parse
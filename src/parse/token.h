@@ -1,10 +1,15 @@
 #pragma once
+#include <cstdint>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include "source.h"
+#include "string_table.h"
 
 namespace parse
 {
-	enum class token_type
+	enum class token_type : uint16_t
 	{
 		// 0 through 255 reserved for ascii
 		string = 256,
@@ -81,65 +86,73 @@ namespace parse
 		"<<",	  ">>",			"+=",	   "-=",	  "/=",			 "*=",	   "&=",	  "|=",		 "^=", "%=", "++",
 		"--",	  "::",			"&&",	   "||",	  "/#",			 "#/",	   "##",	  "eof", "invalid", NULL};
 
+	//trivially copyable, the text is interned in the string_table and the source is looked up by id
 	struct token
 	{
-		//either stringvalue is set and it has no reference to any source anymore or the source is set and the string can be extracted from there
-		std::string m_stringvalue;
-		const source* m_source;
 		token_type type;
-		int pos, sz;
-		int real_line_number;
-		int whitespace = 0; //kinda just hack atm to fix macro preprocessor functions to check whether it's FUNC( or FUNC ( altough it might be useful...? would kinda have to track all cases of whitespace e.g \t\n\r\s+ and so on
+		//kinda just hack atm to fix macro preprocessor functions to check whether it's FUNC( or FUNC ( altough it might be useful...? would kinda have to track all cases of whitespace e.g \t\n\r\s+ and so on
+		uint16_t whitespace;
+		uint32_t source_id;
+		//offset in the source, -1 if it didn't come from one
+		int pos;
+		uint32_t text;
 
-		token() : pos(-1), sz(0), type(token_type::invalid), m_source(NULL), real_line_number(-1)
+		token() : type(token_type::invalid), whitespace(0), source_id(0), pos(-1), text(0)
 		{
 		}
-		token(token_type t, int space = 0) : type(t), m_source(NULL), pos(-1), sz(0), real_line_number(-1), whitespace(space)
+		token(token_type t, int space = 0) : type(t), whitespace(clamp(space)), source_id(0), pos(-1), text(0)
 		{
 		}
-		token(int t, int space = 0)
-			: type((token_type)t), m_source(NULL), pos(-1), sz(0), real_line_number(-1), whitespace(space)
+		token(int t, int space = 0) : type((token_type)t), whitespace(clamp(space)), source_id(0), pos(-1), text(0)
 		{
 		}
 		token(const source* src, token_type t, int space = 0)
-			: m_source(src), type(t), pos(-1), sz(0), real_line_number(-1), whitespace(space)
+			: type(t), whitespace(clamp(space)), source_id(src ? src->id() : 0), pos(-1), text(0)
 		{
 		}
 		template <typename T>
-		token(const source* src, T t, int _pos, int _sz, int ln, int space = 0)
-			: m_source(src), type((token_type)t), pos(_pos), sz(_sz), real_line_number(ln), whitespace(space)
+		token(const source* src, T t, int _pos, uint32_t _text, int space = 0)
+			: type((token_type)t), whitespace(clamp(space)), source_id(src ? src->id() : 0), pos(_pos), text(_text)
 		{
 		}
 
-		token(const std::string& sv, parse::token_type t, int space = 0)
-			: m_stringvalue(sv), pos(-1), sz(-1), type(t), real_line_number(-1), m_source(nullptr), whitespace(space)
+		token(std::string_view sv, parse::token_type t, int space = 0)
+			: type(t), whitespace(clamp(space)), source_id(0), pos(-1), text(string_table::intern(sv))
 		{
 		}
 
-		token copy() const
+		static uint16_t clamp(int space)
 		{
-			token t;
-			t.m_stringvalue = m_source ? to_string() : m_stringvalue;
-			t.pos = -1;
-			t.sz = -1;
-			t.type = type;
-			t.real_line_number = -1;
-			t.m_source = nullptr;
-			return t;
+			return space > 0xffff ? 0xffff : (uint16_t)space;
+		}
+
+		const parse::source* get_source() const
+		{
+			return source::get(source_id);
 		}
 
 		std::string source_file() const
 		{
-			if (!m_source)
+			auto* src = get_source();
+			if (!src)
 				return "memory buffer";
-			return m_source->path();
+			return src->path();
 		}
 
 		const int line_number() const
 		{
-			if (!m_source || pos == -1)
-				return real_line_number;
-			return m_source->line_number(pos);
+			auto* src = get_source();
+			if (!src || pos == -1)
+				return -1;
+			return src->line_number(pos);
+		}
+
+		const int column() const
+		{
+			auto* src = get_source();
+			if (!src || pos == -1)
+				return -1;
+			return src->column(pos);
 		}
 
 		std::string type_as_string() const
@@ -153,21 +166,28 @@ namespace parse
 			return token_type_strings[type_as_int() - (int)token_type::string];
 		}
 
-		std::string to_string() const
+		const std::string& to_string() const
 		{
-			if(m_stringvalue.empty())
-				return m_source->extract_string(pos, sz);
-			return m_stringvalue;
+			return string_table::get(text).text;
 		}
 
+		//parsed once when the text got interned, throws like std::stoi
 		int to_int() const
 		{
-			return std::stoi(to_string());
+			auto& s = string_table::get(text);
+			if (s.text.empty() || !((s.text[0] >= '0' && s.text[0] <= '9') || s.text[0] == '.'))
+				throw std::invalid_argument("to_int");
+			if (s.integer < INT32_MIN || s.integer > INT32_MAX)
+				throw std::out_of_range("to_int");
+			return (int)s.integer;
 		}
 
 		float to_float() const
 		{
-			return std::stof(to_string());
+			auto& s = string_table::get(text);
+			if (s.text.empty() || !((s.text[0] >= '0' && s.text[0] <= '9') || s.text[0] == '.'))
+				throw std::invalid_argument("to_float");
+			return s.number;
 		}
 
 		int type_as_int() const
@@ -175,4 +195,14 @@ namespace parse
 			return (int)type;
 		}
 	};
-}; // namespace parse
\ No newline at end of file
+	static_assert(sizeof(token) == 16 && std::is_trivially_copyable_v<token>);
+
+	//tokens that are pulled one at a time instead of being put in a list first
+	class token_stream
+	{
+	  public:
+		virtual ~token_stream() = default;
+		//false once there's nothing left
+		virtual bool next(token& t) = 0;
+	};
+}; // namespace parse
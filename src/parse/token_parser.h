@@ -1,9 +1,12 @@
 #pragma once
+#include <cstdlib>
 #include <vector>
 #include <string>
 #include "token.h"
 #include <common/format.h>
+#include <algorithm>
 #include <stack>
+#include <span>
 #include <sstream>
 #include <platform/debug.h>
 
@@ -19,7 +22,7 @@ namespace parse
 	struct parse_error : std::exception
 	{
 		std::string message_;
-		explicit parse_error(const std::string& message, token* t = nullptr)
+		explicit parse_error(const std::string& message, const token* t = nullptr)
 		{
 			if (t)
 				message_ = common::format("[{}:{}] {}", t->source_file(), t->line_number(), message);
@@ -34,29 +37,96 @@ namespace parse
 
 	class token_parser
 	{
-		const token_list& m_tokens;
+		//a list that's read from instead of a stream
+		std::span<const token> m_tokens;
+		bool m_list = false;
+		//pulled on demand, only the tokens that can still be read again are kept
+		token_stream* m_stream = nullptr;
+		token_list m_buffer;
+		//index of the first token in m_buffer
+		int m_base = 0;
+		bool m_stream_eof = false;
 		int m_tokenindex = 0;
 		parse_opts m_opts;
 
-		std::stack<int> m_tokenindex_stack;
+		std::vector<int> m_tokenindex_stack;
 		//int m_tokenindex_saved = -1;
 
+		//how far back unread_token can go when streaming, on top of anything that's been saved
+		static constexpr int kHistory = 16;
+
+		//nullptr if it isn't there (yet)
+		const parse::token* buffered(int index) const
+		{
+			if (m_list)
+				return index >= 0 && index < (int)m_tokens.size() ? &m_tokens[index] : nullptr;
+			if (index < m_base || index >= m_base + (int)m_buffer.size())
+				return nullptr;
+			return &m_buffer[index - m_base];
+		}
+
+		bool pull()
+		{
+			if (m_stream_eof)
+				return false;
+			parse::token t;
+			while (m_stream->next(t))
+			{
+				if (!m_opts.newlines && t.type_as_int() == '\n')
+					continue;
+				//drop what can't be read again once there's enough of it, moving the rest down is cheaper than a deque
+				int keep = m_tokenindex - kHistory;
+				for (int i : m_tokenindex_stack)
+					keep = std::min(keep, i);
+				int drop = keep - m_base;
+				if (drop >= kHistory * 4 && drop * 2 >= (int)m_buffer.size())
+				{
+					m_buffer.erase(m_buffer.begin(), m_buffer.begin() + drop);
+					m_base = keep;
+				}
+				m_buffer.push_back(t);
+				return true;
+			}
+			m_stream_eof = true;
+			return false;
+		}
+
+		const parse::token* at(int index)
+		{
+			if (m_stream)
+			{
+				while (index >= m_base + (int)m_buffer.size())
+				{
+					if (!pull())
+						return nullptr;
+				}
+			}
+			return buffered(index);
+		}
+
 	  public:
-		token_parser(const token_list& t) : m_tokens(t), m_tokenindex(0)
+		token_parser(std::span<const token> t) : m_tokens(t), m_list(true), m_tokenindex(0)
+		{
+		}
+		token_parser(std::span<const token> t, parse_opts opts) : m_tokens(t), m_list(true), m_tokenindex(0), m_opts(opts)
 		{
 		}
-		token_parser(const token_list& t, parse_opts opts) : m_tokens(t), m_tokenindex(0), m_opts(opts)
+		//pulls from the stream as it's read, newlines are dropped right away unless opts.newlines is set
+		token_parser(token_stream& stream) : m_stream(&stream), m_tokenindex(0)
+		{
+		}
+		token_parser(token_stream& stream, parse_opts opts) : m_stream(&stream), m_tokenindex(0), m_opts(opts)
 		{
 		}
 
 		void dump()
 		{
-			for (size_t i = 0; i < 55; ++i)
+			for (int i = 0; i < 55; ++i)
 			{
-				if (m_tokenindex - i < 0 || m_tokenindex - i >= m_tokens.size())
+				auto* tk = buffered(m_tokenindex - i);
+				if (!tk)
 					continue;
-				auto tk = m_tokens[m_tokenindex - i];
-				printf("token %d/%d: %s (type %d)\n", m_tokenindex - i, m_tokens.size(), tk.to_string().c_str(), tk.type_as_int());
+				printf("token %d/%d: %s (type %d)\n", m_tokenindex - i, capacity(), tk->to_string().c_str(), tk->type_as_int());
 			}
 		}
 
@@ -65,9 +135,10 @@ namespace parse
 			return m_tokenindex;
 		}
 
+		//tokens read from the stream so far
 		const int capacity() const
 		{
-			return m_tokens.size();
+			return m_list ? (int)m_tokens.size() : m_base + (int)m_buffer.size();
 		}
 
 		void pop()
@@ -76,7 +147,7 @@ namespace parse
 			{
 				platform::breakpoint();
 			}
-			m_tokenindex_stack.pop();
+			m_tokenindex_stack.pop_back();
 		}
 
 		void save()
@@ -91,7 +162,7 @@ namespace parse
 			}
 			m_tokenindex_saved = m_tokenindex;
 			#endif
-			m_tokenindex_stack.push(m_tokenindex);
+			m_tokenindex_stack.push_back(m_tokenindex);
 		}
 
 		void restore()
@@ -104,15 +175,16 @@ namespace parse
 			{
 				platform::breakpoint();
 			}
-			m_tokenindex = m_tokenindex_stack.top();
-			m_tokenindex_stack.pop();
+			m_tokenindex = m_tokenindex_stack.back();
+			m_tokenindex_stack.pop_back();
 		}
 
 		std::string current_token_string() const
 		{
-			if (m_tokenindex - 1 < 0 || m_tokenindex - 1 >= m_tokens.size())
+			auto* t = buffered(m_tokenindex - 1);
+			if (!t)
 				return "eof";
-			return m_tokens[m_tokenindex - 1].to_string();
+			return t->to_string();
 		}
 
 		void unread_token()
@@ -121,19 +193,22 @@ namespace parse
 				--m_tokenindex;
 		}
 
-		parse::token read_token()
+		//stays valid for as long as the token list does, when streaming until the next token is pulled
+		const parse::token& read_token()
 		{
-			if (eof())
-				return parse::token(parse::token_type::eof);
-			auto t = m_tokens[m_tokenindex++];
-			if (!m_opts.newlines && t.type_as_int() == '\n')
-				return read_token();
-			return t;
+			static const parse::token eof_token(parse::token_type::eof);
+			while (auto* t = at(m_tokenindex))
+			{
+				++m_tokenindex;
+				if (m_opts.newlines || t->type_as_int() != '\n')
+					return *t;
+			}
+			return eof_token;
 		}
 
-		bool eof() const
+		bool eof()
 		{
-			return m_tokenindex >= m_tokens.size();
+			return !at(m_tokenindex);
 		}
 
 		void read_tokens_till(std::vector<parse::token>& tokens, const char* tt)
@@ -214,15 +289,12 @@ namespace parse
 			}
 			if (t.type == parse::token_type::hexadecimal)
 			{
-				int i;
-				std::stringstream ss;
-				ss << std::hex << t.to_string();
-				ss >> i;
+				int i = (int)strtoul(t.to_string().c_str(), nullptr, 16);
 				return neg ? -i : i;
 			}
 			else if (t.type == parse::token_type::integer)
 			{
-				return neg ? -std::stoi(t.to_string()) : std::stoi(t.to_string());
+				return neg ? -t.to_int() : t.to_int();
 			}
 			throw parse_error("expected integer got " + t.type_as_string() + ", " + t.to_string(), &t);
 		}
@@ -238,7 +310,7 @@ namespace parse
 			}
 			if (t.type != parse::token_type::number && t.type != parse::token_type::integer)
 				throw parse_error("expected number got " + t.type_as_string() + ", " + t.to_string(), &t);
-			return neg ? -std::stof(t.to_string()) : std::stof(t.to_string());
+			return neg ? -t.to_float() : t.to_float();
 		}
 
 		std::string read_string()
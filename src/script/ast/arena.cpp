@@ -0,0 +1,58 @@
+#include "arena.h"
+#include <stdexcept>
+
+namespace script
+{
+	namespace ast
+	{
+		static thread_local Arena* t_current = nullptr;
+
+		void* Arena::allocate(size_t size)
+		{
+			//new[] is aligned to __STDCPP_DEFAULT_NEW_ALIGNMENT__, keep every allocation at that
+			size = (size + 15) & ~(size_t)15;
+			if ((size_t)(m_end - m_cursor) < size)
+			{
+				//big allocations get a chunk of their own
+				size_t chunk = size > kChunkSize ? size : kChunkSize;
+				m_chunks.push_back(std::unique_ptr<uint8_t[]>(new uint8_t[chunk]));
+				m_cursor = m_chunks.back().get();
+				m_end = m_cursor + chunk;
+			}
+			void* p = m_cursor;
+			m_cursor += size;
+			m_allocated += size;
+			return p;
+		}
+
+		void Arena::reset()
+		{
+			m_chunks.clear();
+			m_cursor = m_end = nullptr;
+			m_allocated = 0;
+			m_strings.release();
+		}
+
+		Arena* Arena::current()
+		{
+			return t_current;
+		}
+
+		Arena& Arena::get()
+		{
+			//nothing would ever free it
+			if (!t_current)
+				throw std::logic_error("ast node created without an arena");
+			return *t_current;
+		}
+
+		Arena::Scope::Scope(Arena* arena) : m_previous(t_current), m_strings(arena ? &arena->m_strings : nullptr)
+		{
+			t_current = arena;
+		}
+		Arena::Scope::~Scope()
+		{
+			t_current = m_previous;
+		}
+	}; // namespace ast
+};	   // namespace script
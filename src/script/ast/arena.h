@@ -0,0 +1,322 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <parse/string_table.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace script
+{
+	namespace ast
+	{
+		//bump allocator for the nodes of a program, everything is freed at once when it's destroyed or reset
+		//nothing in it gets destroyed, whatever is allocated from it has to be trivially destructible
+		//the text of the nodes is held by it as well, it's let go of with the memory
+		class Arena
+		{
+			static constexpr size_t kChunkSize = 64 * 1024;
+			std::vector<std::unique_ptr<uint8_t[]>> m_chunks;
+			uint8_t* m_cursor = nullptr;
+			uint8_t* m_end = nullptr;
+			size_t m_allocated = 0;
+			parse::string_refs m_strings;
+
+		  public:
+			Arena() = default;
+			Arena(const Arena&) = delete;
+			Arena& operator=(const Arena&) = delete;
+
+			//16 byte aligned
+			void* allocate(size_t size);
+			void reset();
+			//bytes handed out since the last reset
+			size_t allocated() const
+			{
+				return m_allocated;
+			}
+			size_t reserved() const
+			{
+				return m_chunks.size() * kChunkSize;
+			}
+			parse::string_refs& strings()
+			{
+				return m_strings;
+			}
+
+			//nodes and lists get allocated from this on this thread
+			static Arena* current();
+			//throws if there's no current arena
+			static Arena& get();
+			//makes arena and it's strings the current ones until it goes out of scope
+			class Scope
+			{
+				Arena* m_previous;
+				parse::string_refs::scope m_strings;
+
+			  public:
+				Scope(Arena* arena);
+				~Scope();
+			};
+		};
+
+		//owns a node like unique_ptr, but the memory belongs to the arena so there's nothing to delete
+		//moving leaves the source empty, a node is only ever in one place in the tree
+		template <typename T> class Ptr
+		{
+			template <typename U> friend class Ptr;
+			T* m_ptr = nullptr;
+
+		  public:
+			Ptr() = default;
+			Ptr(std::nullptr_t)
+			{
+			}
+			explicit Ptr(T* ptr) : m_ptr(ptr)
+			{
+			}
+			Ptr(Ptr&& other) noexcept : m_ptr(other.release())
+			{
+			}
+			template <typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+			Ptr(Ptr<U>&& other) noexcept : m_ptr(other.release())
+			{
+			}
+			Ptr(const Ptr&) = delete;
+			Ptr& operator=(const Ptr&) = delete;
+			Ptr& operator=(Ptr&& other) noexcept
+			{
+				m_ptr = other.release();
+				return *this;
+			}
+			template <typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+			Ptr& operator=(Ptr<U>&& other) noexcept
+			{
+				m_ptr = other.release();
+				return *this;
+			}
+			Ptr& operator=(std::nullptr_t) noexcept
+			{
+				m_ptr = nullptr;
+				return *this;
+			}
+
+			T* get() const
+			{
+				return m_ptr;
+			}
+			T* operator->() const
+			{
+				return m_ptr;
+			}
+			T& operator*() const
+			{
+				return *m_ptr;
+			}
+			explicit operator bool() const
+			{
+				return m_ptr != nullptr;
+			}
+			T* release()
+			{
+				T* ptr = m_ptr;
+				m_ptr = nullptr;
+				return ptr;
+			}
+			void reset(T* ptr = nullptr)
+			{
+				m_ptr = ptr;
+			}
+			bool operator==(std::nullptr_t) const
+			{
+				return m_ptr == nullptr;
+			}
+		};
+
+		//a node of the current arena
+		template <typename T, typename... Ts> Ptr<T> make(Ts&&... ts)
+		{
+			return Ptr<T>(new (Arena::get().allocate(sizeof(T))) T(std::forward<Ts>(ts)...));
+		}
+
+		//vector in the current arena, growing leaves the old storage to it
+		template <typename T> class List
+		{
+			static_assert(std::is_trivially_destructible_v<T>);
+			T* m_data = nullptr;
+			uint32_t m_size = 0;
+			uint32_t m_capacity = 0;
+
+		  public:
+			using value_type = T;
+			using iterator = T*;
+			using const_iterator = const T*;
+
+			List() = default;
+			List(const List&) = delete;
+			List& operator=(const List&) = delete;
+			List(List&& other) noexcept : m_data(other.m_data), m_size(other.m_size), m_capacity(other.m_capacity)
+			{
+				other.m_data = nullptr;
+				other.m_size = other.m_capacity = 0;
+			}
+			List& operator=(List&& other) noexcept
+			{
+				if (this != &other)
+				{
+					m_data = other.m_data;
+					m_size = other.m_size;
+					m_capacity = other.m_capacity;
+					other.m_data = nullptr;
+					other.m_size = other.m_capacity = 0;
+				}
+				return *this;
+			}
+			//a copy in the current arena, for elements that can be copied
+			List copy() const
+			{
+				List l;
+				l.reserve(m_size);
+				for (auto& v : *this)
+					l.push_back(v);
+				return l;
+			}
+
+			T* begin()
+			{
+				return m_data;
+			}
+			T* end()
+			{
+				return m_data + m_size;
+			}
+			const T* begin() const
+			{
+				return m_data;
+			}
+			const T* end() const
+			{
+				return m_data + m_size;
+			}
+			std::reverse_iterator<T*> rbegin()
+			{
+				return std::reverse_iterator<T*>(end());
+			}
+			std::reverse_iterator<T*> rend()
+			{
+				return std::reverse_iterator<T*>(begin());
+			}
+			T* data()
+			{
+				return m_data;
+			}
+			const T* data() const
+			{
+				return m_data;
+			}
+			size_t size() const
+			{
+				return m_size;
+			}
+			bool empty() const
+			{
+				return m_size == 0;
+			}
+			T& operator[](size_t i)
+			{
+				return m_data[i];
+			}
+			const T& operator[](size_t i) const
+			{
+				return m_data[i];
+			}
+			T& front()
+			{
+				return m_data[0];
+			}
+			T& back()
+			{
+				return m_data[m_size - 1];
+			}
+			const T& back() const
+			{
+				return m_data[m_size - 1];
+			}
+
+			void reserve(size_t n)
+			{
+				if (n <= m_capacity)
+					return;
+				T* data = (T*)Arena::get().allocate(n * sizeof(T));
+				for (uint32_t i = 0; i < m_size; ++i)
+					new (&data[i]) T(std::move(m_data[i]));
+				m_data = data;
+				m_capacity = (uint32_t)n;
+			}
+			template <typename... Ts> T& emplace_back(Ts&&... ts)
+			{
+				if (m_size == m_capacity)
+					reserve(m_capacity ? m_capacity * 2 : 4);
+				new (&m_data[m_size]) T(std::forward<Ts>(ts)...);
+				return m_data[m_size++];
+			}
+			void push_back(T&& v)
+			{
+				emplace_back(std::move(v));
+			}
+			void push_back(const T& v)
+			{
+				emplace_back(v);
+			}
+			void pop_back()
+			{
+				--m_size;
+			}
+			iterator insert(const_iterator pos, T&& v)
+			{
+				size_t index = pos - m_data;
+				emplace_back();
+				for (size_t i = m_size - 1; i > index; --i)
+					m_data[i] = std::move(m_data[i - 1]);
+				m_data[index] = std::move(v);
+				return m_data + index;
+			}
+			//moves the elements out of [first, last)
+			template <typename It> iterator insert(const_iterator pos, It first, It last)
+			{
+				size_t index = pos - m_data;
+				size_t n = std::distance(first, last);
+				reserve(m_size + n > m_capacity ? std::max<size_t>(m_size + n, m_capacity * 2) : m_capacity);
+				for (size_t i = 0; i < n; ++i)
+					new (&m_data[m_size + i]) T();
+				for (size_t i = m_size; i > index; --i)
+					m_data[i - 1 + n] = std::move(m_data[i - 1]);
+				for (size_t i = 0; i < n; ++i, ++first)
+					m_data[index + i] = std::move(*first);
+				m_size += (uint32_t)n;
+				return m_data + index;
+			}
+			iterator erase(const_iterator pos)
+			{
+				return erase(pos, pos + 1);
+			}
+			iterator erase(const_iterator first, const_iterator last)
+			{
+				size_t index = first - m_data;
+				size_t n = last - first;
+				for (size_t i = index; i + n < m_size; ++i)
+					m_data[i] = std::move(m_data[i + n]);
+				m_size -= (uint32_t)n;
+				return m_data + index;
+			}
+			void clear()
+			{
+				m_size = 0;
+			}
+		};
+	}; // namespace ast
+};	   // namespace script
@@ -25,7 +25,6 @@ namespace script
 			if (b)
 			{
 				debug.line = token.line_number();
-				debug.file = token.source_file();
 			}
 			return b;
 		}
@@ -43,16 +42,14 @@ namespace script
 			}
 		}
 
-		std::unique_ptr<Identifier> ASTGenerator::identifier()
+		Ptr<Identifier> ASTGenerator::identifier()
 		{
 			expect(parse::TokenType_kIdentifier);
-			std::string ident = token.to_string();
+			auto ident = Text::from_id(token.text);
 			if (accept(parse::TokenType_kDoubleColon))
 			{
 				expect(parse::TokenType_kIdentifier);
-				std::string file_reference = ident;
-				ident = token.to_string();
-				return node<Identifier>(ident, file_reference);
+				return node<Identifier>(Text::from_id(token.text), ident);
 			}
 			return node<Identifier>(ident);
 		}
@@ -100,6 +97,7 @@ namespace script
 				auto n = node<Literal>();
 				n->type = Literal::Type::kInteger;
 				n->value = "1";
+				n->integer = 1;
 				return n;
 			}
 			if (accept_identifier_string("false"))
@@ -210,7 +208,7 @@ namespace script
 			expect('&');
 			auto n = node<LocalizedString>();
 			expect(parse::TokenType_kString);
-			n->reference = token.to_string();
+			n->reference = Text::from_id(token.text);
 			return n;
 		}
 		ExpressionPtr ASTGenerator::factor_function_pointer()
@@ -218,11 +216,11 @@ namespace script
 			expect(parse::TokenType_kDoubleColon);
 			auto n = node<FunctionPointer>();
 			expect(parse::TokenType_kIdentifier);
-			n->function_name = token.to_string();
+			n->function_name = Text::from_id(token.text);
 			return n;
 		}
 
-		std::unique_ptr<CallExpression> ASTGenerator::regular_function_pointer_call()
+		Ptr<CallExpression> ASTGenerator::regular_function_pointer_call()
 		{
 			// if (!accept_token_string("[["))
 			// throw ASTException("Expected [[");
@@ -235,7 +233,7 @@ namespace script
 			return n;
 		}
 
-		std::unique_ptr<CallExpression> ASTGenerator::function_pointer_call(bool threaded)
+		Ptr<CallExpression> ASTGenerator::function_pointer_call(bool threaded)
 		{
 			// function pointer call
 			auto ident = factor_identifier();
@@ -252,7 +250,7 @@ namespace script
 			expect(parse::TokenType_kIdentifier);
 			auto n = node<Literal>();
 			n->type = Literal::Type::kAnimation;
-			n->value = token.to_string();
+			n->value = Text::from_id(token.text);
 			return n;
 		}
 		ExpressionPtr ASTGenerator::factor_pound()
@@ -288,7 +286,8 @@ namespace script
 			expect(parse::TokenType_kInteger);
 			auto n = node<Literal>();
 			n->type = Literal::Type::kInteger;
-			n->value = token.to_string();
+			n->value = Text::from_id(token.text);
+			n->integer = (int)parse::string_table::get(token.text).integer;
 			return n;
 		}
 		ExpressionPtr ASTGenerator::factor_number()
@@ -296,7 +295,8 @@ namespace script
 			expect(parse::TokenType_kNumber);
 			auto n = node<Literal>();
 			n->type = Literal::Type::kNumber;
-			n->value = token.to_string();
+			n->value = Text::from_id(token.text);
+			n->number = parse::string_table::get(token.text).number;
 			return n;
 		}
 		ExpressionPtr ASTGenerator::factor_string()
@@ -304,7 +304,7 @@ namespace script
 			expect(parse::TokenType_kString);
 			auto n = node<Literal>();
 			n->type = Literal::Type::kString;
-			n->value = token.to_string();
+			n->value = Text::from_id(token.text);
 			return n;
 		}
 
@@ -320,7 +320,8 @@ namespace script
 			m_token_parser->restore();
 
 			using FactorFunction = std::function<ExpressionPtr(ASTGenerator&)>;
-			std::unordered_map<int, FactorFunction> factors = {
+			//built once, this runs for every factor
+			static const std::unordered_map<int, FactorFunction> factors = {
 				{parse::TokenType_kIdentifier, &ASTGenerator::factor_identifier},
 				{'(', &ASTGenerator::factor_parentheses},
 				{parse::TokenType_kInteger, &ASTGenerator::factor_integer},
@@ -523,7 +524,7 @@ namespace script
 			}
 		}
 
-		std::unique_ptr<AssignmentExpression> ASTGenerator::assignment_node(int op, ExpressionPtr& lhs)
+		Ptr<AssignmentExpression> ASTGenerator::assignment_node(int op, ExpressionPtr& lhs)
 		{
 			auto n = node<AssignmentExpression>();
 			n->op = op;
@@ -573,7 +574,7 @@ namespace script
 			return expr;
 		}
 
-		std::unique_ptr<CallExpression> ASTGenerator::call_expression(std::unique_ptr<Expression> ident,
+		Ptr<CallExpression> ASTGenerator::call_expression(Ptr<Expression> ident,
 																		   bool threaded)
 		{
 			auto call = node<CallExpression>();
@@ -690,14 +691,14 @@ namespace script
 			n->discriminant = expression();
 			expect(')');
 			expect('{');
-			std::vector<std::shared_ptr<SwitchCase>> active_cases;
+			std::vector<SwitchCase*> active_cases;
 			while (1)
 			{
 				if (accept('}'))
 					goto skip;
 			rep:
 				expect(parse::TokenType_kIdentifier);
-				auto sc = std::make_shared<SwitchCase>();
+				auto sc = node<SwitchCase>();
 				if (token.to_string() != "default")
 				{
 					if (token.to_string() != "case")
@@ -714,7 +715,7 @@ namespace script
 						sc->test = factor_string();
 				}
 				expect(':');
-				active_cases.push_back(sc);
+				active_cases.push_back(sc.get());
 
 				while (1)
 				{
@@ -726,11 +727,13 @@ namespace script
 					if (accept_identifier_string("case") || accept_identifier_string("default"))
 					{
 						m_token_parser->unread_token();
+						//falls through into the next case, which still needs to be a case of it's own
+						n->cases.push_back(std::move(sc));
 						goto rep;
 					}
-					std::shared_ptr<Statement> stmt = statement();
-					//if (dynamic_cast<BreakStatement*>(stmt.get()))
-					auto* bs = stmt.get()->cast<BreakStatement>();
+					Statement* stmt = statement().release();
+					//if (dynamic_cast<BreakStatement*>(stmt))
+					auto* bs = stmt->cast<BreakStatement>();
 					if (bs)
 					{
 						active_cases.clear();
@@ -753,23 +756,23 @@ namespace script
 			expect(';');
 			return n;
 		}
-		std::unique_ptr<Directive> ASTGenerator::directive()
+		Ptr<Directive> ASTGenerator::directive()
 		{
 			expect(parse::TokenType_kIdentifier);
 			auto n = node<Directive>();
-			n->directive = token.to_string();
+			n->directive = Text::from_id(token.text);
 			if (token.to_string() == "using_animtree")
 			{
 				expect('(');
 				expect(parse::TokenType_kString);
 				using_animtree_value = token.to_string();
-				n->value = token.to_string();
+				n->value = Text::from_id(token.text);
 				expect(')');
 			}
 			else if (token.to_string() == "include")
 			{
 				expect(parse::TokenType_kIdentifier);
-				n->value = token.to_string();
+				n->value = Text::from_id(token.text);
 			}
 			else
 				throw ASTException("unexpected directive {}", token.to_string());
@@ -789,7 +792,7 @@ namespace script
 			return stmt;
 		}
 
-		std::unique_ptr<Statement> ASTGenerator::statement()
+		Ptr<Statement> ASTGenerator::statement()
 		{
 			if (accept(';'))
 				return empty_statement();
@@ -799,8 +802,10 @@ namespace script
 			token = m_token_parser->read_token();
 			m_token_parser->restore(); // restore now otherwise we may call statement in a recursive way later again and
 									   // bugs will happen.
+			//the statement starts at the token that was peeked, not the last one accepted
+			debug.line = token.line_number();
 			using StatementFunction = std::function<StatementPtr(ASTGenerator&)>;
-			std::unordered_map<std::string, StatementFunction> statements = {
+			static const std::unordered_map<std::string, StatementFunction> statements = {
 				{"for", &ASTGenerator::for_statement},
 				{"while", &ASTGenerator::while_statement},
 				{"wait", &ASTGenerator::wait_statement},
@@ -828,7 +833,7 @@ namespace script
 			return node<EmptyStatement>();
 		}
 
-		std::unique_ptr<BlockStatement> ASTGenerator::block_statement()
+		Ptr<BlockStatement> ASTGenerator::block_statement()
 		{
 			auto block = node<BlockStatement>();
 			while (1)
@@ -844,8 +849,8 @@ namespace script
 		{
 			expect(parse::TokenType_kIdentifier);
 			auto decl = node<FunctionDeclaration>();
-			decl->function_name = token.to_string();
-			decl->debug.function = debug.function = decl->function_name;
+			decl->function_name = Text::from_id(token.text);
+			decl->source_file = token.source_file();
 			expect('(');
 			while (1)
 			{
@@ -853,21 +858,42 @@ namespace script
 					goto skip_rparen;
 				//decl->parameters.push_back(identifier());
 				expect(parse::TokenType_kIdentifier);
-				decl->parameters.push_back(token.to_string());
+				decl->parameters.push_back(Text::from_id(token.text));
 				if (!accept(','))
 					break;
 			}
 			expect(')');
 		skip_rparen:
 			expect('{');
-			decl->body = block_statement();
+			if (m_skip_function_bodies)
+			{
+				//up to the matching brace, nothing in between gets looked at
+				//tokens from the include_cache have their text held by it, the program needs it until the body is parsed
+				auto& strings = Arena::get().strings();
+				strings.hold(token.text);
+				decl->skipped_body.push_back(token);
+				for (int depth = 1; depth > 0;)
+				{
+					auto& t = m_token_parser->read_token();
+					if (t.type == parse::token_type::eof)
+						throw ASTException("unexpected eof in function {}. {}:{}", decl->function_name, decl->source_file,
+										   decl->debug.line);
+					if (t.type_as_int() == '{')
+						++depth;
+					else if (t.type_as_int() == '}')
+						--depth;
+					strings.hold(t.text);
+					decl->skipped_body.push_back(t);
+				}
+			}
+			else
+				decl->body = block_statement();
 			// kinda ugly, but for now it'll do, i dont wanna add add_node methods on every node struct
 			program.body.push_back(std::move(decl));
 		}
 
 		void ASTGenerator::program()
 		{
-			tree = std::make_unique<ast::Program>();
 			while (1)
 			{
 				if (accept(parse::TokenType_kEof))
@@ -885,6 +911,10 @@ namespace script
 		{
 			try
 			{
+				//what the lexers intern is held by the program from the start
+				tree = std::make_unique<ast::Program>();
+				tree->arena = std::make_unique<Arena>();
+				Arena::Scope scope(tree->arena.get());
 				parse::source_map sources;
 				parse::definition_map definitions;
 				parse::preprocessor proc;
@@ -910,14 +940,17 @@ namespace script
 				};
 
 				opts.backslash_comments = true;
-				if (proc.preprocess_with_typed_lexer<custom_lexer>(fs, base_path, path, tokens, sources, definitions,
-																   opts))
+				if (proc.open<custom_lexer>(fs, base_path, path, sources, definitions, opts))
 				{
-					auto it = std::remove_if(tokens.begin(), tokens.end(),
-											 [](const parse::token& t) { return t.type_as_int() == '\n'; });
-					tokens.erase(it, tokens.end());
-					m_token_parser = std::make_unique<parse::token_parser>(tokens);
+					//pulled from the preprocessor while it's parsed, the parser drops the newlines
+					m_token_parser = std::make_unique<parse::token_parser>(proc);
 					program();
+					m_token_parser.reset();
+					if (m_skip_function_bodies)
+					{
+						for (auto& it : sources)
+							tree->sources.push_back(it.second);
+					}
 #if 0
 				FILE* fp = fopen("F:\\export\\dm.txt", "w");
 				BasicPrinter out(fp);
@@ -930,10 +963,39 @@ namespace script
 			}
 			catch (std::exception& e)
 			{
+				//it pulls from the preprocessor that's gone now
+				m_token_parser.reset();
 				// throw ASTException("something went wrong generating syntax tree {}", e.what());
 				throw ASTException("{}", e.what());
 				return false;
 			}
 		}
+
+		std::unique_ptr<Program> ASTGenerator::generate_function(const FunctionDeclaration& skipped)
+		{
+			try
+			{
+				m_token_parser = std::make_unique<parse::token_parser>(skipped.skipped_body);
+				tree = std::make_unique<ast::Program>();
+				tree->arena = std::make_unique<Arena>();
+				Arena::Scope scope(tree->arena.get());
+				debug = skipped.debug;
+				auto decl = node<FunctionDeclaration>();
+				decl->function_name = skipped.function_name;
+				decl->parameters = skipped.parameters.copy();
+				decl->source_file = skipped.source_file;
+				decl->variadic = skipped.variadic;
+				expect('{');
+				decl->body = block_statement();
+				tree->body.push_back(std::move(decl));
+				m_token_parser.reset();
+				return std::move(tree);
+			}
+			catch (std::exception& e)
+			{
+				m_token_parser.reset();
+				throw ASTException("{}", e.what());
+			}
+		}
 	}; // namespace ast
 }; // namespace script
\ No newline at end of file
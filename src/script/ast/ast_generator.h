@@ -29,28 +29,29 @@ namespace script
 		class ASTGenerator
 		{
 			std::string using_animtree_value;
-			parse::token_list tokens;
 			parse::token token;
 			std::unique_ptr<parse::token_parser> m_token_parser;
 			void program();
 			std::unique_ptr<Program> tree;
 
-			DebugInfo debug;
+			SourceLocation debug;
+			bool m_skip_function_bodies = false;
 
-			template <typename T, typename... Ts> std::unique_ptr<T> node(Ts... ts)
+			//allocated from the arena of the program while it's being generated
+			template <typename T, typename... Ts> Ptr<T> node(Ts&&... ts)
 			{
 				// printf("node(%s)\n", typeid(T).name());
-				auto n = std::move(std::make_unique<T>(ts...));
+				auto n = make<T>(std::forward<Ts>(ts)...);
 				n->debug = debug;
 				return n;
 			}
-			std::unique_ptr<Identifier> identifier();
-			std::unique_ptr<BlockStatement> block_statement();
+			Ptr<Identifier> identifier();
+			Ptr<BlockStatement> block_statement();
 			void function_declaration(Program&);
 			bool accept(int token_type);
 			void expect(int token_type);
-			std::unique_ptr<Statement> statement();
-			std::unique_ptr<CallExpression> call_expression(std::unique_ptr<Expression>, bool threaded = false);
+			Ptr<Statement> statement();
+			Ptr<CallExpression> call_expression(Ptr<Expression>, bool threaded = false);
 			ExpressionPtr expression();
 			ExpressionPtr factor_integer();
 			ExpressionPtr factor_number();
@@ -61,8 +62,8 @@ namespace script
 			ExpressionPtr factor_pound();
 			ExpressionPtr factor_percent_symbol();
 			void factor(ExpressionPtr&);
-			std::unique_ptr<CallExpression> function_pointer_call(bool threaded = false);
-			std::unique_ptr<CallExpression> regular_function_pointer_call();
+			Ptr<CallExpression> function_pointer_call(bool threaded = false);
+			Ptr<CallExpression> regular_function_pointer_call();
 			void assignment_expression(ExpressionPtr& expr);
 			bool accept_assignment_operator();
 			void ternary_expression(ExpressionPtr& expr);
@@ -76,7 +77,7 @@ namespace script
 			void term(ExpressionPtr& expr);
 			void postfix(ExpressionPtr& expr);
 			ExpressionPtr binary_expression(int, ExpressionPtr&, ExpressionPtr&);
-			std::unique_ptr<AssignmentExpression> assignment_node(int op, ExpressionPtr& lhs);
+			Ptr<AssignmentExpression> assignment_node(int op, ExpressionPtr& lhs);
 			StatementPtr if_statement();
 			StatementPtr return_statement();
 			StatementPtr for_statement();
@@ -87,7 +88,7 @@ namespace script
 			StatementPtr wait_statement();
 			StatementPtr empty_statement();
 			StatementPtr switch_statement();
-			std::unique_ptr<Directive> directive();
+			Ptr<Directive> directive();
 			StatementPtr waittillframeend_statement();
 			bool accept_identifier_string(const std::string string);
 			ExpressionPtr factor_array_expression();
@@ -107,6 +108,13 @@ namespace script
 			ASTGenerator();
 			~ASTGenerator();
 			bool generate(filesystem_api& fs, const std::string base_path, const std::string path);
+			//only the signatures get parsed, bodies are kept as tokens for generate_function
+			void set_skip_function_bodies(bool skip)
+			{
+				m_skip_function_bodies = skip;
+			}
+			//a program with just the function, it's body parsed from the tokens generate skipped
+			std::unique_ptr<Program> generate_function(const FunctionDeclaration& skipped);
 		};
 	}; // namespace ast
 }; // namespace script
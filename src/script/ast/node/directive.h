@@ -8,8 +8,8 @@ namespace script
 	{
 		struct Directive : Node
 		{
-			std::string directive;
-			std::string value;
+			Text directive;
+			Text value;
 
 			virtual void print(Printer& out) override
 			{
@@ -11,7 +11,7 @@ namespace script
 		struct ArrayExpression : Expression
 		{
 			AST_NODE(ArrayExpression)
-			std::vector<std::unique_ptr<Expression>> elements;
+			List<Ptr<Expression>> elements;
 
 			virtual void print(Printer& out) override
 			{
@@ -9,8 +9,8 @@ namespace script
 	{
 		struct AssignmentExpression : Expression
 		{
-			std::unique_ptr<Expression> lhs;
-			std::unique_ptr<Expression> rhs;
+			Ptr<Expression> lhs;
+			Ptr<Expression> rhs;
 			int op;
 
 			AST_NODE(AssignmentExpression)
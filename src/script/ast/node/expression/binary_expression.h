@@ -9,8 +9,8 @@ namespace script
 	{
 		struct BinaryExpression : Expression
 		{
-			std::unique_ptr<Expression> left;
-			std::unique_ptr<Expression> right;
+			Ptr<Expression> left;
+			Ptr<Expression> right;
 			int op;
 
 			AST_NODE(BinaryExpression)
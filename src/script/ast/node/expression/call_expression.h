@@ -13,9 +13,9 @@ namespace script
 		{
 			bool threaded = false;
 			bool pointer = false;
-			std::unique_ptr<Expression> object;
-			std::unique_ptr<Expression> callee;
-			std::vector<std::unique_ptr<Expression>> arguments;
+			Ptr<Expression> object;
+			Ptr<Expression> callee;
+			List<Ptr<Expression>> arguments;
 
 			AST_NODE(CallExpression)
 
@@ -9,9 +9,9 @@ namespace script
 	{
 		struct ConditionalExpression : Expression //TernaryExpression
 		{
-			std::unique_ptr<Expression> condition;
-			std::unique_ptr<Expression> consequent;
-			std::unique_ptr<Expression> alternative;
+			Ptr<Expression> condition;
+			Ptr<Expression> consequent;
+			Ptr<Expression> alternative;
 
 			AST_NODE(ConditionalExpression)
 
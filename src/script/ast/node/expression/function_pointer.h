@@ -9,7 +9,7 @@ namespace script
 		struct FunctionPointer : Expression
 		{
 			//std::unique_ptr<Identifier> identifier;
-			std::string function_name;
+			Text function_name;
 
 			AST_NODE(FunctionPointer)
 
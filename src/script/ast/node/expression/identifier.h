@@ -8,24 +8,27 @@ namespace script
 	{
 		struct Identifier : Expression
 		{
-			std::string file_reference; //optional e.g util\string::tolower
-			std::string name;
+			Text file_reference; //optional e.g util\string::tolower
+			Text name;
 
 			std::string full_identifier_string()
 			{
 				if (file_reference.empty())
 					return name;
-				return file_reference + "::" + name;
+				return file_reference.str() + "::" + name.str();
 			}
 
-			Identifier(const std::string s)
+			Identifier(Text s) : name(s)
 			{
-				name = s;
 			}
-			Identifier(const std::string s, const std::string file_ref)
+			Identifier(Text s, Text file_ref) : file_reference(file_ref), name(s)
+			{
+			}
+			Identifier(std::string_view s) : name(s)
+			{
+			}
+			Identifier(std::string_view s, std::string_view file_ref) : file_reference(file_ref), name(s)
 			{
-				name = s;
-				file_reference = file_ref;
 			}
 
 			AST_NODE(Identifier)
@@ -17,7 +17,10 @@ namespace script
 				kAnimation,
 				kUndefined
 			} type;
-			std::string value;
+			Text value;
+			//integers and numbers as they were parsed with the token or folded, nothing reads the text again
+			int integer = 0;
+			float number = 0.f;
 
 			AST_NODE(Literal)
 
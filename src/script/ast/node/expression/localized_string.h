@@ -8,7 +8,7 @@ namespace script
 	{
 		struct LocalizedString : Expression
 		{
-			std::string reference;
+			Text reference;
 
 			AST_NODE(LocalizedString)
 
@@ -9,8 +9,8 @@ namespace script
 	{
 		struct MemberExpression : Expression
 		{
-			std::unique_ptr<Expression> object;
-			std::unique_ptr<Expression> prop;
+			Ptr<Expression> object;
+			Ptr<Expression> prop;
 			int op;
 
 			AST_NODE(MemberExpression)
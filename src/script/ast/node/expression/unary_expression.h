@@ -9,7 +9,7 @@ namespace script
 	{
 		struct UnaryExpression : Expression
 		{
-			std::unique_ptr<Expression> argument;
+			Ptr<Expression> argument;
 			int op;
 			bool prefix;
 			AST_NODE(UnaryExpression)
@@ -11,7 +11,7 @@ namespace script
 		struct VectorExpression : Expression
 		{
 			AST_NODE(VectorExpression)
-			std::vector<std::unique_ptr<Expression>> elements;
+			List<Ptr<Expression>> elements;
 
 			virtual void print(Printer& out) override
 			{
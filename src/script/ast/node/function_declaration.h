@@ -1,6 +1,7 @@
 #pragma once
 #include "expression/identifier.h"
 #include "statement.h"
+#include <parse/token_parser.h>
 #include <string>
 #include <vector>
 #include <memory>
@@ -11,18 +12,23 @@ namespace script
 	{
 		struct FunctionDeclaration : Node
 		{
-			std::string function_name;
+			Text function_name;
 			//std::vector<std::unique_ptr<Identifier>> parameters;
-			std::vector<std::string> parameters;
-			std::unique_ptr<Statement> body;
+			List<Text> parameters;
+			//nullptr when the generator skipped it, skipped_body has it's tokens from { to } then
+			Ptr<Statement> body;
+			List<parse::token> skipped_body;
+			//path of the file it was read from, the nodes in it only know their line
+			Text source_file;
 			//std::unique_ptr<Node> return_data_type;
 			bool variadic = false;
-			std::vector<std::unique_ptr<Identifier>> declarations;
+			List<Ptr<Identifier>> declarations;
 			virtual void print(Printer& out) override
 			{
 				out.print("function '%s':", function_name.c_str());
 				out.indent();
-				body->print(out);
+				if (body)
+					body->print(out);
 				out.unindent();
 			}
 			AST_NODE(FunctionDeclaration)
@@ -3,6 +3,8 @@
 #include <functional>
 #include <common/type_id.h>
 #include "../printer.h"
+#include <script/ast/arena.h>
+#include <script/ast/text.h>
 #include <script/ast/visitor.h>
 #include <script/debug_info.h>
 
@@ -27,8 +29,18 @@ namespace script
 		struct Node
 		{
 			size_t start, end;
-			std::string raw;
-			DebugInfo debug;
+			SourceLocation debug;
+
+			//only made with ast::make, they belong to the arena and never get destroyed
+			static void* operator new(size_t, void* ptr)
+			{
+				return ptr;
+			}
+			static void operator delete(void*, void*)
+			{
+			}
+			static void* operator new(size_t) = delete;
+			static void operator delete(void*) = delete;
 
 			virtual const char* to_string() = 0;
 			virtual void accept(ASTVisitor& visitor) = 0;
@@ -42,10 +54,6 @@ namespace script
 					return NULL;
 				return (T*)this;
 			}
-
-			virtual ~Node()
-			{
-			}
 		};
 	}; // namespace ast
 };	   // namespace compiler
\ No newline at end of file
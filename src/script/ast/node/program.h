@@ -1,9 +1,11 @@
 #pragma once
 #include "node.h"
+#include <script/ast/arena.h>
 #include <string>
 #include <vector>
 #include <memory>
 #include <script/ast/node/statement.h>
+#include <parse/source.h>
 
 namespace script
 {
@@ -11,7 +13,21 @@ namespace script
 	{
 		struct Program : Node
 		{
-			std::vector<std::unique_ptr<Node>> body;
+			//every node of this program and the ones the passes add to it, freeing it frees the whole tree
+			//they're never destroyed, so the program is the only node that isn't in an arena
+			std::unique_ptr<Arena> arena;
+			List<Ptr<Node>> body;
+			//the tokens of skipped function bodies refer to these
+			std::vector<std::shared_ptr<const parse::source>> sources;
+
+			static void* operator new(size_t size)
+			{
+				return ::operator new(size);
+			}
+			static void operator delete(void* ptr)
+			{
+				::operator delete(ptr);
+			}
 			virtual void print(Printer& out) override
 			{
 				out.print("program:");
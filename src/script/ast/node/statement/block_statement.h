@@ -10,7 +10,7 @@ namespace script
 	{
 		struct BlockStatement : Statement
 		{
-			std::vector<std::unique_ptr<Statement>> body;
+			List<Ptr<Statement>> body;
 
 			AST_NODE(BlockStatement)
 
@@ -10,8 +10,8 @@ namespace script
 	{
 		struct DoWhileStatement : Statement
 		{
-			std::unique_ptr<Expression> test;
-			std::unique_ptr<Statement> body;
+			Ptr<Expression> test;
+			Ptr<Statement> body;
 			virtual void print(Printer& out) override
 			{
 				out.print("do while:");
@@ -10,7 +10,7 @@ namespace script
 	{
 		struct ExpressionStatement : Statement
 		{
-			std::unique_ptr<Expression> expression;
+			Ptr<Expression> expression;
 			virtual void print(Printer& out) override
 			{
 				out.print("expression statement:");
@@ -10,10 +10,10 @@ namespace script
 	{
 		struct ForStatement : Statement
 		{
-			std::unique_ptr<Expression> init; //kinda special statement, init-statement
-			std::unique_ptr<Expression> test;
-			std::unique_ptr<Expression> update;
-			std::unique_ptr<Statement> body;
+			Ptr<Expression> init; //kinda special statement, init-statement
+			Ptr<Expression> test;
+			Ptr<Expression> update;
+			Ptr<Statement> body;
 			virtual void print(Printer& out) override
 			{
 				out.print("for:");
@@ -10,9 +10,9 @@ namespace script
 	{
 		struct IfStatement : Statement
 		{
-			std::unique_ptr<Expression> test;
-			std::unique_ptr<Statement> consequent;
-			std::unique_ptr<Statement> alternative;
+			Ptr<Expression> test;
+			Ptr<Statement> consequent;
+			Ptr<Statement> alternative;
 			virtual void print(Printer& out) override
 			{
 				out.print("if:");
@@ -11,7 +11,7 @@ namespace script
 	{
 		struct ReturnStatement : Statement
 		{
-			std::unique_ptr<Expression> argument;
+			Ptr<Expression> argument;
 			virtual void print(Printer& out) override
 			{
 				out.print("return:");
@@ -11,8 +11,9 @@ namespace script
 	{
 		struct SwitchCase : Node
 		{
-			std::unique_ptr<Expression> test;
-			std::vector<std::shared_ptr<Statement>> consequent;
+			Ptr<Expression> test;
+			//cases that fall through into the next one share statements with it, they belong to the arena
+			List<Statement*> consequent;
 			AST_NODE(SwitchCase)
 
 			virtual void print(Printer& out) override
@@ -23,8 +24,8 @@ namespace script
 
 		struct SwitchStatement : Statement
 		{
-			std::unique_ptr<Expression> discriminant;
-			std::vector<std::shared_ptr<SwitchCase>> cases;
+			Ptr<Expression> discriminant;
+			List<Ptr<SwitchCase>> cases;
 
 			AST_NODE(SwitchStatement)
 
@@ -10,7 +10,7 @@ namespace script
 	{
 		struct WaitStatement : Statement
 		{
-			std::unique_ptr<Expression> duration;
+			Ptr<Expression> duration;
 			virtual void print(Printer& out) override
 			{
 				out.print("wait statement:");
@@ -10,8 +10,8 @@ namespace script
 	{
 		struct WhileStatement : Statement
 		{
-			std::unique_ptr<Expression> test;
-			std::unique_ptr<Statement> body;
+			Ptr<Expression> test;
+			Ptr<Statement> body;
 
 			AST_NODE(WhileStatement)
 
@@ -36,7 +36,15 @@ namespace script
 {
 	namespace ast
 	{
-		using ExpressionPtr = std::unique_ptr<Expression>;
-		using StatementPtr = std::unique_ptr<Statement>;
+		using ExpressionPtr = Ptr<Expression>;
+		using StatementPtr = Ptr<Statement>;
+
+		//the arena of a program is freed without running any destructors
+		static_assert(std::is_trivially_destructible_v<Identifier> && std::is_trivially_destructible_v<Literal> &&
+					  std::is_trivially_destructible_v<CallExpression> && std::is_trivially_destructible_v<BlockStatement> &&
+					  std::is_trivially_destructible_v<SwitchStatement> && std::is_trivially_destructible_v<SwitchCase> &&
+					  std::is_trivially_destructible_v<FunctionDeclaration> && std::is_trivially_destructible_v<Directive> &&
+					  std::is_trivially_destructible_v<LocalizedString> && std::is_trivially_destructible_v<FunctionPointer> &&
+					  std::is_trivially_destructible_v<ForStatement> && std::is_trivially_destructible_v<VectorExpression>);
 	};
 };
\ No newline at end of file
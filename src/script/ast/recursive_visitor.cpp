@@ -19,7 +19,9 @@ namespace script
 		{
 			if (!pre_visit(n))
 				return;
-			n.body->accept(*this);
+			//skipped bodies have nothing to visit
+			if (n.body)
+				n.body->accept(*this);
 			post_visit(n);
 		}
 
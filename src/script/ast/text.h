@@ -0,0 +1,103 @@
+#pragma once
+#include <parse/string_table.h>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace script
+{
+	namespace ast
+	{
+		//names and literals of nodes, just the id of the text in the string_table so nodes stay trivially destructible
+		//the current arena holds on to the entry, it goes away with the last program that has the text
+		class Text
+		{
+			uint32_t m_id = 0;
+
+			//a copy outside of an arena is only good for as long as what it came from
+			static void hold(uint32_t id)
+			{
+				if (auto* refs = parse::string_refs::current())
+					refs->hold(id);
+			}
+
+		  public:
+			Text() = default;
+			explicit Text(std::string_view s) : m_id(parse::string_table::intern(s))
+			{
+			}
+			Text(const Text& other) : m_id(other.m_id)
+			{
+				hold(m_id);
+			}
+			Text& operator=(const Text& other)
+			{
+				m_id = other.m_id;
+				hold(m_id);
+				return *this;
+			}
+			//the text of a token, without looking it up again
+			static Text from_id(uint32_t id)
+			{
+				Text t;
+				t.m_id = id;
+				hold(id);
+				return t;
+			}
+			Text& operator=(std::string_view s)
+			{
+				m_id = parse::string_table::intern(s);
+				return *this;
+			}
+			Text& operator=(const std::string& s)
+			{
+				return *this = std::string_view(s);
+			}
+			Text& operator=(const char* s)
+			{
+				return *this = std::string_view(s);
+			}
+
+			const std::string& str() const
+			{
+				return parse::string_table::get(m_id).text;
+			}
+			operator const std::string&() const
+			{
+				return str();
+			}
+			const char* c_str() const
+			{
+				return str().c_str();
+			}
+			size_t size() const
+			{
+				return str().size();
+			}
+			bool empty() const
+			{
+				return m_id == 0;
+			}
+			uint32_t id() const
+			{
+				return m_id;
+			}
+
+			//the same text is always the same id
+			bool operator==(const Text& other) const
+			{
+				return m_id == other.m_id;
+			}
+			bool operator==(std::string_view s) const
+			{
+				return str() == s;
+			}
+		};
+
+		inline std::ostream& operator<<(std::ostream& os, const Text& t)
+		{
+			return os << t.str();
+		}
+	}; // namespace ast
+};	   // namespace script
@@ -0,0 +1,646 @@
+#include "bytecode_cache.h"
+#include <common/stringutil.h>
+#include <script/vm/instructions/instructions.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+
+namespace script
+{
+	namespace compiler
+	{
+		static constexpr u32 kMagic = 0x43435347; //GSCC
+
+		struct CorruptCacheException
+		{
+		};
+
+		//reads or writes the fields of an instruction, so every instruction only has to list it's fields once
+		class Archive
+		{
+		  public:
+			bool writing;
+
+			//writing
+			std::vector<u8> body;
+			std::unordered_map<std::string, u32> string_lookup;
+			std::vector<std::string> strings;
+			std::unordered_map<vm::Instruction*, size_t> label_positions;
+
+			//reading
+			const u8* p = nullptr;
+			const u8* end = nullptr;
+			std::vector<std::string> string_table;
+			std::vector<std::pair<std::weak_ptr<vm::Label>*, size_t>> label_fixups;
+
+			const vm::Constants* constants = nullptr;
+
+			Archive(bool writing_) : writing(writing_)
+			{
+			}
+
+			u8 byte(u8 v = 0)
+			{
+				if (writing)
+				{
+					body.push_back(v);
+					return v;
+				}
+				if (p >= end)
+					throw CorruptCacheException();
+				return *p++;
+			}
+			void varint(u64& v)
+			{
+				if (writing)
+				{
+					u64 n = v;
+					do
+					{
+						u8 b = n & 0x7f;
+						n >>= 7;
+						byte(n ? b | 0x80 : b);
+					} while (n);
+					return;
+				}
+				v = 0;
+				for (int shift = 0; shift < 64; shift += 7)
+				{
+					u8 b = byte();
+					v |= (u64)(b & 0x7f) << shift;
+					if (!(b & 0x80))
+						return;
+				}
+				throw CorruptCacheException();
+			}
+			size_t count(size_t n = 0)
+			{
+				u64 v = n;
+				varint(v);
+				if (!writing && v > (u64)(end - p))
+					throw CorruptCacheException();
+				return v;
+			}
+			void operator()(size_t& v)
+			{
+				u64 n = v;
+				varint(n);
+				v = n;
+			}
+			void operator()(int& v)
+			{
+				//zigzag so small negative numbers stay small
+				u64 n = ((u32)v << 1) ^ (u32)(v >> 31);
+				varint(n);
+				v = (int)((u32)(n >> 1) ^ (0u - (u32)(n & 1)));
+			}
+			void operator()(bool& v)
+			{
+				v = byte(v ? 1 : 0) != 0;
+			}
+			void operator()(float& v)
+			{
+				//the bits of the float, little endian
+				static_assert(sizeof(float) == sizeof(u32));
+				u32 n;
+				memcpy(&n, &v, sizeof(n));
+				u32 r = 0;
+				for (int shift = 0; shift < 32; shift += 8)
+					r |= (u32)byte((n >> shift) & 0xff) << shift;
+				memcpy(&v, &r, sizeof(r));
+			}
+			void operator()(std::string& v)
+			{
+				if (writing)
+				{
+					auto fnd = string_lookup.find(v);
+					u64 index;
+					if (fnd == string_lookup.end())
+					{
+						index = strings.size();
+						string_lookup[v] = index;
+						strings.push_back(v);
+					}
+					else
+						index = fnd->second;
+					varint(index);
+					return;
+				}
+				u64 index;
+				varint(index);
+				if (index >= string_table.size())
+					throw CorruptCacheException();
+				v = string_table[index];
+			}
+			void operator()(vm::String& v)
+			{
+				std::string s = v;
+				(*this)(s);
+				if (!writing)
+					v = s;
+			}
+			void operator()(std::weak_ptr<vm::Label>& v)
+			{
+				if (writing)
+				{
+					auto fnd = label_positions.find(v.lock().get());
+					if (fnd == label_positions.end())
+						throw std::runtime_error("jump to a label outside of the function");
+					size_t position = fnd->second;
+					(*this)(position);
+					return;
+				}
+				size_t position;
+				(*this)(position);
+				label_fixups.push_back({&v, position});
+			}
+			void constant(vm::PushConstant& i)
+			{
+				(*this)(i.index);
+				if (!writing)
+				{
+					if (i.index >= constants->size())
+						throw CorruptCacheException();
+					i.constants = constants;
+				}
+			}
+		};
+
+		struct InstructionEntry
+		{
+			size_t kind;
+			std::shared_ptr<vm::Instruction> (*create)();
+			std::function<void(Archive&, vm::Instruction&)> fields;
+		};
+
+		template <typename T> static InstructionEntry entry(void (*fields)(Archive&, T&) = nullptr)
+		{
+			InstructionEntry e;
+			e.kind = type_id<T>::id();
+			e.create = []() -> std::shared_ptr<vm::Instruction> { return std::make_shared<T>(); };
+			if (fields)
+				e.fields = [fields](Archive& ar, vm::Instruction& i) { fields(ar, static_cast<T&>(i)); };
+			return e;
+		}
+
+		static void call_fields(Archive& ar, vm::Call& i)
+		{
+			ar(i.is_method_call);
+			ar(i.is_threaded);
+			ar(i.numargs);
+		}
+
+		static void switch_fields(Archive& ar, vm::SwitchTable& i)
+		{
+			auto& values = i.cases.values;
+			size_t n = ar.count(values.size());
+			if (!ar.writing)
+			{
+				values.resize(n);
+				i.dest.resize(n);
+			}
+			for (size_t k = 0; k < n; ++k)
+			{
+				bool is_string = std::holds_alternative<vm::String>(values[k]);
+				ar(is_string);
+				if (is_string)
+				{
+					if (!ar.writing)
+						values[k] = vm::String();
+					ar(std::get<vm::String>(values[k]));
+				}
+				else
+				{
+					if (!ar.writing)
+						values[k] = vm::Integer();
+					ar(std::get<vm::Integer>(values[k]));
+				}
+				ar(i.dest[k]);
+			}
+			ar(i.dest_default);
+			if (!ar.writing)
+				i.cases.build();
+		}
+
+		//the position in this list is what ends up in the file, only ever append (and bump kBytecodeCacheVersion)
+		static const std::vector<InstructionEntry>& instruction_entries()
+		{
+			using namespace vm;
+			static const std::vector<InstructionEntry> entries = {
+				entry<PushInteger>([](Archive& ar, PushInteger& i) { ar(i.value); }),
+				entry<Pop>([](Archive& ar, Pop& i) { ar(i.value); }),
+				entry<PushNumber>([](Archive& ar, PushNumber& i) { ar(i.value); }),
+				entry<PushVector>([](Archive& ar, PushVector& i) { ar(i.nelements); }),
+				entry<PushArray>([](Archive& ar, PushArray& i) { ar(i.nelements); }),
+				entry<PushString>([](Archive& ar, PushString& i) { ar.constant(i); }),
+				entry<PushLocalizedString>([](Archive& ar, PushLocalizedString& i) { ar.constant(i); }),
+				entry<PushFunctionPointer>([](Archive& ar, PushFunctionPointer& i) { ar.constant(i); }),
+				entry<PushAnimationString>([](Archive& ar, PushAnimationString& i) { ar.constant(i); }),
+				entry<PushUndefined>(),
+				entry<Nop>(),
+				entry<LoadRef>([](Archive& ar, LoadRef& i) { ar(i.variable_name); }),
+				entry<LoadValue>([](Archive& ar, LoadValue& i) { ar(i.variable_name); }),
+				entry<StoreRef>(),
+				entry<LoadObjectFieldRef>([](Archive& ar, LoadObjectFieldRef& i) {
+					ar(i.op);
+					ar(i.create);
+				}),
+				entry<LoadObjectFieldValue>([](Archive& ar, LoadObjectFieldValue& i) { ar(i.op); }),
+				entry<Not>(),
+				entry<LogicalNot>(),
+				entry<Ret>(),
+				entry<Wait>(),
+				entry<WaitTillFrameEnd>(),
+				entry<BinOp>([](Archive& ar, BinOp& i) { ar(i.op); }),
+				entry<Label>([](Archive& ar, Label& i) { ar(i.label_index); }),
+				entry<Test>(),
+				entry<Jump>([](Archive& ar, Jump& i) { ar(i.dest); }),
+				entry<JumpZero>([](Archive& ar, JumpZero& i) { ar(i.dest); }),
+				entry<JumpNotZero>([](Archive& ar, JumpNotZero& i) { ar(i.dest); }),
+				entry<Constant0>(),
+				entry<Constant1>(),
+				entry<WaitTill>([](Archive& ar, WaitTill& i) {
+					ar(i.is_method_call);
+					ar(i.numargs);
+				}),
+				entry<CallFunction>([](Archive& ar, CallFunction& i) {
+					call_fields(ar, i);
+					ar(i.function);
+				}),
+				entry<CallFunctionFile>([](Archive& ar, CallFunctionFile& i) {
+					call_fields(ar, i);
+					ar(i.file);
+					ar(i.function);
+				}),
+				entry<CallFunctionPointer>([](Archive& ar, CallFunctionPointer& i) { call_fields(ar, i); }),
+				entry<SwitchTable>(switch_fields),
+				entry<AddInt>(),
+				entry<SubInt>(),
+				entry<MulInt>(),
+				entry<LtInt>(),
+				entry<LeqInt>(),
+				entry<GtInt>(),
+				entry<GeqInt>(),
+				entry<EqInt>(),
+				entry<NeqInt>(),
+				entry<AddFloat>(),
+				entry<SubFloat>(),
+				entry<MulFloat>(),
+				entry<DivFloat>(),
+				entry<LtFloat>(),
+				entry<LeqFloat>(),
+				entry<GtFloat>(),
+				entry<GeqFloat>(),
+				entry<AddVec>(),
+				entry<SubVec>(),
+				entry<ConcatStr>(),
+				entry<BinOpRef>([](Archive& ar, BinOpRef& i) { ar(i.op); }),
+				entry<LoadRefValue>(),
+			};
+			return entries;
+		}
+
+		static const std::unordered_map<size_t, size_t>& instruction_ordinals()
+		{
+			static const std::unordered_map<size_t, size_t> ordinals = [] {
+				std::unordered_map<size_t, size_t> m;
+				auto& entries = instruction_entries();
+				for (size_t i = 0; i < entries.size(); ++i)
+					m[entries[i].kind] = i;
+				return m;
+			}();
+			return ordinals;
+		}
+
+		static void constant_fields(Archive& ar, vm::Variant& v)
+		{
+			u8 type = ar.byte((u8)v.index());
+			switch ((vm::Type)type)
+			{
+			case vm::Type::kString:
+			{
+				if (!ar.writing)
+					v = vm::String();
+				ar(std::get<vm::String>(v));
+			}
+			break;
+			case vm::Type::kLocalizedString:
+			{
+				if (!ar.writing)
+					v = vm::LocalizedString();
+				ar(std::get<vm::LocalizedString>(v).reference);
+			}
+			break;
+			case vm::Type::kAnimation:
+			{
+				if (!ar.writing)
+					v = vm::Animation();
+				ar(std::get<vm::Animation>(v).reference);
+			}
+			break;
+			case vm::Type::kFunctionPointer:
+			{
+				if (!ar.writing)
+					v = vm::FunctionPointer();
+				auto& fp = std::get<vm::FunctionPointer>(v);
+				ar(fp.file);
+				ar(fp.name);
+			}
+			break;
+			default:
+				if (!ar.writing)
+					throw CorruptCacheException();
+				throw std::runtime_error(common::format("can't cache constant of type {}", vm::kVariantNames[type]));
+			}
+		}
+
+		static void line_table_fields(Archive& ar, LineTable& lines)
+		{
+			ar(lines.source);
+			size_t nentries = ar.count(lines.entries.size());
+			lines.entries.resize(nentries);
+			for (auto& e : lines.entries)
+			{
+				size_t offset = e.offset, line = e.line;
+				ar(offset);
+				ar(line);
+				e.offset = (uint32_t)offset;
+				e.line = (uint32_t)line;
+			}
+		}
+
+		static void function_fields(Archive& ar, CompiledFunction& f, std::vector<std::shared_ptr<vm::Constants>>& pools)
+		{
+			ar(f.name);
+			ar(f.file);
+			size_t nparameters = ar.count(f.parameters.size());
+			f.parameters.resize(nparameters);
+			for (auto& p : f.parameters)
+				ar(p);
+
+			size_t pool = 0;
+			if (ar.writing)
+			{
+				auto fnd = std::find(pools.begin(), pools.end(), f.constants);
+				pool = fnd - pools.begin();
+			}
+			ar(pool);
+			if (!ar.writing)
+			{
+				if (pool >= pools.size())
+					throw CorruptCacheException();
+				f.constants = pools[pool];
+			}
+			line_table_fields(ar, f.lines);
+			ar.constants = f.constants.get();
+
+			auto& entries = instruction_entries();
+			auto& ordinals = instruction_ordinals();
+			size_t ninstructions = ar.count(f.instructions.size());
+			if (ar.writing)
+			{
+				ar.label_positions.clear();
+				for (size_t i = 0; i < ninstructions; ++i)
+					ar.label_positions[f.instructions[i].get()] = i;
+			}
+			else
+			{
+				ar.label_fixups.clear();
+				f.instructions.resize(ninstructions);
+			}
+			for (size_t i = 0; i < ninstructions; ++i)
+			{
+				size_t ordinal = 0;
+				if (ar.writing)
+				{
+					auto fnd = ordinals.find(f.instructions[i]->kind());
+					if (fnd == ordinals.end())
+						throw std::runtime_error(
+							common::format("can't cache instruction {}", f.instructions[i]->to_string()));
+					ordinal = fnd->second;
+				}
+				ar(ordinal);
+				if (ordinal >= entries.size())
+					throw CorruptCacheException();
+				auto& e = entries[ordinal];
+				if (!ar.writing)
+					f.instructions[i] = e.create();
+				if (e.fields)
+					e.fields(ar, *f.instructions[i]);
+			}
+			for (auto& fixup : ar.label_fixups)
+			{
+				if (fixup.second >= f.instructions.size())
+					throw CorruptCacheException();
+				auto& target = f.instructions[fixup.second];
+				if (!target->cast<vm::Label>())
+					throw CorruptCacheException();
+				*fixup.first = std::static_pointer_cast<vm::Label>(target);
+			}
+		}
+
+		static void file_fields(Archive& ar, CompiledFunctions& functions, std::vector<std::string>& references)
+		{
+			size_t nreferences = ar.count(references.size());
+			references.resize(nreferences);
+			for (auto& ref : references)
+				ar(ref);
+
+			std::vector<std::shared_ptr<vm::Constants>> pools;
+			if (ar.writing)
+			{
+				for (auto& it : functions)
+				{
+					if (std::find(pools.begin(), pools.end(), it.second.constants) == pools.end())
+						pools.push_back(it.second.constants);
+				}
+			}
+			size_t npools = ar.count(pools.size());
+			pools.resize(npools);
+			for (auto& pool : pools)
+			{
+				if (!ar.writing)
+					pool = std::make_shared<vm::Constants>();
+				size_t nconstants = ar.count(pool ? pool->size() : 0);
+				if (!pool)
+					continue;
+				pool->resize(nconstants);
+				for (auto& c : *pool)
+					constant_fields(ar, c);
+			}
+
+			size_t nfunctions = ar.count(functions.size());
+			if (ar.writing)
+			{
+				//sort by name so the same input always results in the same file
+				std::vector<std::pair<std::string, CompiledFunction*>> sorted;
+				for (auto& it : functions)
+					sorted.push_back({it.first, &it.second});
+				std::sort(sorted.begin(), sorted.end(),
+						  [](auto& a, auto& b) { return a.first < b.first; });
+				for (auto& it : sorted)
+				{
+					ar(it.first);
+					function_fields(ar, *it.second, pools);
+				}
+				return;
+			}
+			for (size_t i = 0; i < nfunctions; ++i)
+			{
+				std::string name;
+				ar(name);
+				function_fields(ar, functions[name], pools);
+			}
+		}
+
+		static void write_u32(std::vector<u8>& out, u32 v)
+		{
+			for (int i = 0; i < 4; ++i)
+				out.push_back((v >> (i * 8)) & 0xff);
+		}
+		static void write_u64(std::vector<u8>& out, u64 v)
+		{
+			write_u32(out, v & 0xffffffff);
+			write_u32(out, v >> 32);
+		}
+
+		void BytecodeCache::serialize(std::vector<u8>& out, u64 key, const std::string& file,
+									  const CompiledFunctions& functions, const std::vector<std::string>& references)
+		{
+			Archive ar(true);
+			std::string name = file;
+			ar(name);
+			file_fields(ar, const_cast<CompiledFunctions&>(functions), const_cast<std::vector<std::string>&>(references));
+
+			//header and string table go in front of the body, strings are only known once the body is written
+			Archive header(true);
+			size_t nstrings = header.count(ar.strings.size());
+			for (size_t i = 0; i < nstrings; ++i)
+			{
+				size_t len = header.count(ar.strings[i].size());
+				header.body.insert(header.body.end(), ar.strings[i].begin(), ar.strings[i].begin() + len);
+			}
+
+			out.clear();
+			write_u32(out, kMagic);
+			write_u32(out, kBytecodeCacheVersion);
+			write_u64(out, key);
+			out.insert(out.end(), header.body.begin(), header.body.end());
+			out.insert(out.end(), ar.body.begin(), ar.body.end());
+		}
+
+		bool BytecodeCache::deserialize(const std::vector<u8>& in, u64 key, const std::string& file,
+										CompiledFunctions& functions, std::vector<std::string>& references)
+		{
+			if (in.size() < 16)
+				return false;
+			auto read_u32 = [&](size_t offset) {
+				return (u32)in[offset] | ((u32)in[offset + 1] << 8) | ((u32)in[offset + 2] << 16) |
+					   ((u32)in[offset + 3] << 24);
+			};
+			if (read_u32(0) != kMagic || read_u32(4) != kBytecodeCacheVersion ||
+				((u64)read_u32(8) | ((u64)read_u32(12) << 32)) != key)
+				return false;
+			try
+			{
+				Archive ar(false);
+				ar.p = in.data() + 16;
+				ar.end = in.data() + in.size();
+				size_t nstrings = ar.count();
+				ar.string_table.resize(nstrings);
+				for (auto& s : ar.string_table)
+				{
+					size_t len = ar.count();
+					s.assign((const char*)ar.p, len);
+					ar.p += len;
+				}
+				std::string name;
+				ar(name);
+				if (name != file)
+					return false;
+				CompiledFunctions tmp_functions;
+				std::vector<std::string> tmp_references;
+				file_fields(ar, tmp_functions, tmp_references);
+				if (ar.p != ar.end)
+					return false;
+				functions = std::move(tmp_functions);
+				references = std::move(tmp_references);
+			}
+			catch (CorruptCacheException&)
+			{
+				return false;
+			}
+			return true;
+		}
+
+		BytecodeCache::BytecodeCache(const std::string& directory, u64 salt) : m_directory(directory), m_salt(salt)
+		{
+			std::error_code ec;
+			std::filesystem::create_directories(m_directory, ec);
+		}
+
+		std::string BytecodeCache::entry_path(const std::string& file) const
+		{
+			char hex[17];
+			hash_to_hex_string(hash_string(util::string::to_lower(file).c_str()), hex);
+			return m_directory + "/" + hex + ".gscc";
+		}
+
+		u64 BytecodeCache::key(const std::string& file, const ::filesystem::view& source) const
+		{
+			u64 h = fnv1a_64(&kBytecodeCacheVersion, sizeof(kBytecodeCacheVersion));
+			h = fnv1a_64(&m_salt, sizeof(m_salt), h);
+			h = fnv1a_64(file.data(), file.size() + 1, h);
+			return fnv1a_64(source.data(), source.size(), h);
+		}
+
+		bool BytecodeCache::load(const std::string& file, u64 key, CompiledFunctions& functions,
+								 std::vector<std::string>& references)
+		{
+			std::ifstream in(entry_path(file), std::ios::binary | std::ios::ate);
+			bool hit = false;
+			if (in.is_open())
+			{
+				std::vector<u8> data(in.tellg());
+				in.seekg(0, std::ios::beg);
+				in.read((char*)data.data(), data.size());
+				hit = in.good() && deserialize(data, key, file, functions, references);
+			}
+			if (hit)
+				++m_hits;
+			else
+				++m_misses;
+			return hit;
+		}
+
+		bool BytecodeCache::store(const std::string& file, u64 key, const CompiledFunctions& functions,
+								  const std::vector<std::string>& references)
+		{
+			std::vector<u8> data;
+			try
+			{
+				serialize(data, key, file, functions, references);
+			}
+			catch (std::runtime_error& e)
+			{
+				printf("not caching %s: %s\n", file.c_str(), e.what());
+				return false;
+			}
+			//write to a temporary file first so a crash or a concurrent load never sees half an entry
+			std::string path = entry_path(file);
+			std::string tmp = path + ".tmp";
+			{
+				std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+				if (!out.is_open())
+					return false;
+				out.write((const char*)data.data(), data.size());
+				if (!out.good())
+					return false;
+			}
+			return std::rename(tmp.c_str(), path.c_str()) == 0;
+		}
+	}; // namespace compiler
+};	   // namespace script
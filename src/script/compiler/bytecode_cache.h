@@ -0,0 +1,65 @@
+#pragma once
+#include <script/compiler/compiler.h>
+#include <common/hash.h>
+#include <core/filesystem/api.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace script
+{
+	namespace compiler
+	{
+		//bump whenever the compiler output or the layout of the cache files changes
+		static constexpr u32 kBytecodeCacheVersion = 6;
+
+		//stores the compiled functions of every file in <directory>/<hash of the file name>.gscc
+		//entries are keyed by the source of the file, includes aren't expanded and there are no predefined defines
+		//so the source is everything the preprocessor sees
+		//load/store can be called from multiple threads as long as they're for different files
+		class BytecodeCache
+		{
+			std::string m_directory;
+			u64 m_salt;
+			std::atomic<size_t> m_hits{0};
+			std::atomic<size_t> m_misses{0};
+
+			std::string entry_path(const std::string& file) const;
+
+		  public:
+			//salt is mixed into every key, e.g the optimizer options
+			BytecodeCache(const std::string& directory, u64 salt = 0);
+
+			//e.g when the options change, entries stored with the old one are missed from then on
+			void set_salt(u64 salt)
+			{
+				m_salt = salt;
+			}
+
+			u64 key(const std::string& file, const ::filesystem::view& source) const;
+			bool load(const std::string& file, u64 key, CompiledFunctions& functions, std::vector<std::string>& references);
+			bool store(const std::string& file, u64 key, const CompiledFunctions& functions,
+					   const std::vector<std::string>& references);
+
+			size_t hits() const
+			{
+				return m_hits;
+			}
+			size_t misses() const
+			{
+				return m_misses;
+			}
+			void reset_stats()
+			{
+				m_hits = 0;
+				m_misses = 0;
+			}
+
+			static void serialize(std::vector<u8>& out, u64 key, const std::string& file, const CompiledFunctions& functions,
+								  const std::vector<std::string>& references);
+			//returns false if the data is corrupt or was written for a different key or file
+			static bool deserialize(const std::vector<u8>& in, u64 key, const std::string& file, CompiledFunctions& functions,
+									std::vector<std::string>& references);
+		};
+	}; // namespace compiler
+};	   // namespace script
@@ -2,7 +2,9 @@
 #include <script/ast/nodes.h>
 #include <parse/token.h>
 #include <script/ast/gsc_writer.h>
+#include <exception>
 #include <iostream>
+#include <map>
 
 namespace script
 {
@@ -135,33 +137,24 @@ namespace script
 
 		using namespace vm;
 
-		Compiler::Compiler(script::ReferenceMap& refmap) : m_refmap(refmap)
+		Compiler::Compiler(script::ReferenceMap& refmap, const Options& options) : m_refmap(refmap), m_options(options)
 		{
 		}
-		CompiledFiles Compiler::compile()
+		bool Compiler::compile_file(const std::string& file, LoadedProgramReference& lpr)
 		{
-			ast::FunctionDeclaration* func = nullptr;
-			std::string file;
 			try
 			{
-				for (auto& refmap_iter : m_refmap)
+				m_compiledfunctions = &m_files[util::string::to_lower(file)];
+				m_currentfile = file;
+				begin_constants();
+				m_num_operators = m_num_specialized = 0;
+				for (auto& fun_iter : lpr.function_map)
 				{
-					file = refmap_iter.first;
-					m_compiledfunctions = &m_files[util::string::to_lower(file)];
-					printf("compiling program %s\n", refmap_iter.first.c_str());
-					m_currentfile = refmap_iter.first;
-					for (auto& fun_iter : refmap_iter.second.function_map)
-					{
-						func = fun_iter.second;
-						//printf("\tcompiling function: %s\n", fun_iter.first.c_str());
-						debug = fun_iter.second->debug;
-						fun_iter.second->accept(*this);
-					}
+					//printf("\tcompiling function: %s\n", fun_iter.first.c_str());
+					fun_iter.second->accept(*this);
 				}
-				printf("-------------------------------------------------------------------------------\n");
-				printf("Compile done!\n");
 				#if 0
-				for (auto& cf : m_compiledfunctions)
+				for (auto& cf : *m_compiledfunctions)
 				{
 					printf("===function: %s\n", cf.first.c_str());
 					for (auto& instr : cf.second.instructions)
@@ -173,18 +166,157 @@ namespace script
 			}
 			catch (CompileException& e)
 			{
-				printf("===============================================================================\n");
-				printf("File: %s\n", file.c_str());
+				std::stringstream ss;
+				ss << "===============================================================================\n";
+				ss << "File: " << file << "\n";
 				if (last_expression_statement)
 				{
-					GSCWriter wr(std::cout);
+					GSCWriter wr(ss);
 					wr.visit(*last_expression_statement);
 				}
-				printf("Failed to compile %s\n", e.what());
-				printf("===============================================================================\n");
+				ss << "Failed to compile " << e.what() << "\n";
+				ss << "===============================================================================\n";
+				printf("%s", ss.str().c_str());
+				return false;
+			}
+			return true;
+		}
+		void Compiler::report_operators(const std::string& file) const
+		{
+			if (m_options.report && m_num_operators > 0)
+				printf("%s: specialized %zu of %zu operators (%.1f%%)\n", file.c_str(), m_num_specialized,
+					   m_num_operators, 100.0 * m_num_specialized / m_num_operators);
+		}
+		CompiledFiles Compiler::compile()
+		{
+			for (auto& refmap_iter : m_refmap)
+			{
+				printf("compiling program %s\n", refmap_iter.first.c_str());
+				compile_file(refmap_iter.first, refmap_iter.second);
+				report_operators(refmap_iter.first);
 			}
+			printf("-------------------------------------------------------------------------------\n");
+			printf("Compile done! %zu literals, %zu constants\n", m_num_literals, m_num_constants);
 			return m_files;
 		}
+		CompiledFiles Compiler::compile(script::ReferenceMap& refmap, core::thread_pool& pool,
+										std::unordered_set<std::string>* failed, const Options& options)
+		{
+			//files don't depend on each other, every file gets it's own compiler so the result is the same as compile()
+			std::vector<std::unique_ptr<Compiler>> compilers;
+			std::vector<char> ok(refmap.size());
+			//anything but a CompileException is thrown again here, the first one in file order
+			std::vector<std::exception_ptr> errors(refmap.size());
+			size_t index = 0;
+			for (auto& refmap_iter : refmap)
+			{
+				printf("compiling program %s\n", refmap_iter.first.c_str());
+				auto* compiler = compilers.emplace_back(std::make_unique<Compiler>(refmap, options)).get();
+				auto* entry = &refmap_iter;
+				char* result = &ok[index];
+				std::exception_ptr* error = &errors[index++];
+				pool.push([compiler, entry, result, error] {
+					try
+					{
+						*result = compiler->compile_file(entry->first, entry->second);
+					}
+					catch (...)
+					{
+						*error = std::current_exception();
+					}
+				});
+			}
+			pool.wait();
+			for (auto& error : errors)
+			{
+				if (error)
+					std::rethrow_exception(error);
+			}
+			//in file order once they're all done, not mixed up by the workers
+			index = 0;
+			for (auto& refmap_iter : refmap)
+				compilers[index++]->report_operators(refmap_iter.first);
+			if (failed)
+			{
+				index = 0;
+				for (auto& refmap_iter : refmap)
+				{
+					if (!ok[index++])
+						failed->insert(refmap_iter.first);
+				}
+			}
+			CompiledFiles files;
+			size_t num_literals = 0, num_constants = 0;
+			for (auto& compiler : compilers)
+			{
+				for (auto& it : compiler->m_files)
+					files[it.first] = std::move(it.second);
+				num_literals += compiler->m_num_literals;
+				num_constants += compiler->m_num_constants;
+			}
+			printf("-------------------------------------------------------------------------------\n");
+			printf("Compile done! %zu literals, %zu constants\n", num_literals, num_constants);
+			return files;
+		}
+		CompiledFunction Compiler::compile_function(const std::string& file, ast::FunctionDeclaration& n)
+		{
+			CompiledFunctions scratch;
+			m_compiledfunctions = &scratch;
+			m_currentfile = file;
+			begin_constants();
+			n.accept(*this);
+			return std::move(*m_function);
+		}
+		size_t Compiler::count_instructions(const std::string& file, ast::FunctionDeclaration& n)
+		{
+			CompiledFunctions scratch;
+			m_compiledfunctions = &scratch;
+			m_currentfile = file;
+			if (!m_constants)
+				begin_constants();
+			n.accept(*this);
+			return m_function->instructions.size();
+		}
+
+		void Compiler::begin_constants()
+		{
+			m_constants = std::make_shared<vm::Constants>();
+			m_constant_lookup.clear();
+		}
+
+		size_t Compiler::register_constant(const vm::Variant& v)
+		{
+			++m_num_literals;
+			std::string key = std::to_string(v.index()) + ':';
+			switch ((vm::Type)v.index())
+			{
+			case vm::Type::kString:
+				key += std::get<vm::String>(v).str();
+				break;
+			case vm::Type::kLocalizedString:
+				key += std::get<vm::LocalizedString>(v).reference.str();
+				break;
+			case vm::Type::kAnimation:
+				key += std::get<vm::Animation>(v).reference.str();
+				break;
+			case vm::Type::kFunctionPointer:
+			{
+				auto& fp = std::get<vm::FunctionPointer>(v);
+				key += fp.file.str() + "::" + fp.name.str();
+			}
+			break;
+			default:
+				throw CompileException("unhandled constant type {}", vm::kVariantNames[v.index()]);
+			}
+			auto fnd = m_constant_lookup.find(key);
+			if (fnd != m_constant_lookup.end())
+				return fnd->second;
+			++m_num_constants;
+			m_constants->push_back(v);
+			m_constant_lookup[key] = m_constants->size() - 1;
+			return m_constants->size() - 1;
+		}
+
 		void Compiler::visit(ast::Program& n)
 		{
 			throw CompileException("unimplemented {}", __LINE__);
@@ -195,8 +327,17 @@ namespace script
 			m_function = &(*m_compiledfunctions)[util::string::to_lower(n.function_name)];
 			m_function->name = n.function_name;
 			m_function->file = m_currentfile;
-			m_function->parameters = n.parameters;
+			m_function->parameters.assign(n.parameters.begin(), n.parameters.end());
+			m_function->constants = m_constants;
+			if (!m_options.strip_debug_info)
+				m_function->lines.source = n.source_file;
+			m_line = n.debug.line;
+			label_index = 0;
+			TypeInference types(m_options.globals);
+			types.run(n);
+			m_types = &types;
 			n.body->accept(*this);
+			m_types = nullptr;
 			auto instr = instruction<PushUndefined>();
 			add(instr);
 			auto ret = instruction<Ret>();
@@ -217,10 +358,7 @@ namespace script
 		{
 			for (auto& stmt : n.body)
 			{
-				std::stringstream ss;
-				GSCWriter wr(ss);
-				wr.visit_statement(stmt);
-				debug.expression_string = ss.str();
+				m_line = stmt->debug.line;
 				stmt->accept(*this);
 			}
 		}
@@ -397,68 +535,63 @@ namespace script
 			add(instr);
 		}
 
+		//converts a case label to the value SwitchCases compares against
+		static vm::Variant switch_case_value(ast::Expression& test)
+		{
+			auto* lit = test.cast<ast::Literal>();
+			if (lit && lit->type == ast::Literal::Type::kInteger)
+				return vm::Integer(lit->integer);
+			if (lit && lit->type == ast::Literal::Type::kString)
+				return vm::String(lit->value);
+			throw CompileException("switch case has to be an integer or string");
+		}
+
 		void Compiler::visit(ast::SwitchStatement& n)
 		{
 			auto end = label();
-			ast::SwitchCase* default_switch_case = nullptr;
+			//the discriminant is evaluated once, SwitchTable pops it and jumps straight to the case
+			n.discriminant->accept(*this);
+			auto table = instruction<SwitchTable>();
+			table->dest_default = end;
+			add(table);
 
-			std::vector<std::shared_ptr<Label>> labels;
-			for (size_t i = 0; i < n.cases.size(); ++i)
-			{
-				labels.push_back(label());
-			}
-			size_t numcases = 0;
-			for (size_t i = 0; i < n.cases.size(); ++i)
+			//cases that fall through into each other end up with the same statements, those share a body
+			std::map<std::vector<ast::Statement*>, std::shared_ptr<Label>> bodies;
+			for (auto& sc : n.cases)
 			{
-				auto& sc = n.cases[i];
-				if (!sc->test)
-				{
-					default_switch_case = sc.get();
-					continue;
-				}
-				if (i > 0)
-					add(labels[i]);
-				n.discriminant->accept(*this);
-				sc->test->accept(*this);
-				auto instr = instruction<BinOp>();
-				instr->op = parse::TokenType_kEq;
-				add(instr);
-				auto test = instruction<Test>();
-				add(test);
-				auto jz = instruction<JumpZero>();
-				jz->dest = (i+1) >= labels.size() ? end : labels[i + 1];
-				add(jz);
-
+				std::vector<ast::Statement*> key;
 				for (auto& stmt : sc->consequent)
+					key.push_back(stmt);
+				auto& body = bodies[key];
+				if (!body)
 				{
-					exit_labels.push(end);
-					stmt->accept(*this);
-					exit_labels.pop();
+					body = label();
+					add(body);
+					for (auto& stmt : sc->consequent)
+					{
+						exit_labels.push(end);
+						stmt->accept(*this);
+						exit_labels.pop();
+					}
+					auto jmp = instruction<Jump>();
+					jmp->dest = end;
+					add(jmp);
 				}
-				auto jmp = instruction<Jump>();
-				jmp->dest = end;
-				add(jmp);
-			}
-			//add default case
-			if (default_switch_case)
-			{
-				add(labels[labels.size() - 1]);
-				for (auto& stmt : default_switch_case->consequent)
+				if (!sc->test)
 				{
-					exit_labels.push(end);
-					stmt->accept(*this);
-					exit_labels.pop();
+					table->dest_default = body;
+					continue;
 				}
+				table->cases.values.push_back(switch_case_value(*sc->test));
+				table->dest.push_back(body);
 			}
+			table->cases.build();
 			add(end);
 		}
 
 		void Compiler::visit(ast::LocalizedString& n)
 		{
-			auto instr = instruction<PushLocalizedString>();
-			instr->value = n.reference;
-			instr->length = n.reference.size();
-			add(instr);
+			add_constant<PushLocalizedString>(vm::LocalizedString{n.reference.str()});
 		}
 
 		void Compiler::visit(ast::Literal& n)
@@ -468,27 +601,22 @@ namespace script
 			case ast::Literal::Type::kInteger:
 			{
 				auto instr = instruction<PushInteger>();
-				instr->value = atoi(n.value.c_str());
+				instr->value = n.integer;
 				add(instr);
 			} break;
 			case ast::Literal::Type::kNumber:
 			{
 				auto instr = instruction<PushNumber>();
-				instr->value = atof(n.value.c_str());
+				instr->value = n.number;
 				add(instr);
 			} break;
 			case ast::Literal::Type::kString:
 			{
-				auto instr = instruction<PushString>();
-				instr->value = n.value;
-				instr->length = n.value.size();
-				add(instr);
+				add_constant<PushString>(vm::String(n.value));
 			} break;
 			case ast::Literal::Type::kAnimation:
 			{
-				auto instr = instruction<PushAnimationString>();
-				instr->value = n.value;
-				add(instr);
+				add_constant<PushAnimationString>(vm::Animation{n.value.str()});
 			} break;
 			case ast::Literal::Type::kUndefined:
 			{
@@ -505,10 +633,7 @@ namespace script
 		{
 			if (!n.file_reference.empty())
 			{
-				auto instr = instruction<PushFunctionPointer>();
-				instr->file = n.file_reference;
-				instr->function = n.name;
-				add(instr);
+				add_constant<PushFunctionPointer>(vm::FunctionPointer{n.file_reference.str(), n.name.str()});
 			}
 			else
 			{
@@ -520,10 +645,7 @@ namespace script
 
 		void Compiler::visit(ast::FunctionPointer& n)
 		{
-			auto instr = instruction<PushFunctionPointer>();
-			instr->file = m_currentfile;
-			instr->function = n.function_name;
-			add(instr);
+			add_constant<PushFunctionPointer>(vm::FunctionPointer{m_currentfile, n.function_name.str()});
 		}
 
 		void Compiler::visit(ast::BinaryExpression& n)
@@ -575,12 +697,110 @@ namespace script
 			{
 				n.right->accept(*this);
 				n.left->accept(*this);
-				auto instr = instruction<BinOp>();
-				instr->op = n.op;
-				add(instr);
+				add_binop(n, n.op);
 			}
 		}
 
+		void Compiler::add_ref_binop(int op)
+		{
+			++m_num_operators;
+			auto instr = instruction<BinOpRef>();
+			instr->op = op;
+			add(instr);
+		}
+
+		void Compiler::add_binop(ast::Node& n, int op)
+		{
+			using Type = TypeInference::Type;
+			++m_num_operators;
+			auto types = m_types ? m_types->operands(n) : TypeInference::Operands();
+			bool integers = types.a == Type::kInteger && types.b == Type::kInteger;
+			bool numbers = (types.a == Type::kInteger || types.a == Type::kNumber) &&
+						   (types.b == Type::kInteger || types.b == Type::kNumber);
+			std::shared_ptr<vm::Instruction> instr;
+			if (integers)
+			{
+				switch (op)
+				{
+				case '+':
+					instr = instruction<AddInt>();
+					break;
+				case '-':
+					instr = instruction<SubInt>();
+					break;
+				case '*':
+					instr = instruction<MulInt>();
+					break;
+				case '<':
+					instr = instruction<LtInt>();
+					break;
+				case '>':
+					instr = instruction<GtInt>();
+					break;
+				case parse::TokenType_kLeq:
+					instr = instruction<LeqInt>();
+					break;
+				case parse::TokenType_kGeq:
+					instr = instruction<GeqInt>();
+					break;
+				case parse::TokenType_kEq:
+					instr = instruction<EqInt>();
+					break;
+				case parse::TokenType_kNeq:
+					instr = instruction<NeqInt>();
+					break;
+				}
+			}
+			else if (numbers)
+			{
+				switch (op)
+				{
+				case '+':
+					instr = instruction<AddFloat>();
+					break;
+				case '-':
+					instr = instruction<SubFloat>();
+					break;
+				case '*':
+					instr = instruction<MulFloat>();
+					break;
+				case '/':
+					instr = instruction<DivFloat>();
+					break;
+				case '<':
+					instr = instruction<LtFloat>();
+					break;
+				case '>':
+					instr = instruction<GtFloat>();
+					break;
+				case parse::TokenType_kLeq:
+					instr = instruction<LeqFloat>();
+					break;
+				case parse::TokenType_kGeq:
+					instr = instruction<GeqFloat>();
+					break;
+				}
+			}
+			else if (types.a == Type::kVector && types.b == Type::kVector)
+			{
+				if (op == '+')
+					instr = instruction<AddVec>();
+				else if (op == '-')
+					instr = instruction<SubVec>();
+			}
+			else if (op == '+' && (types.a == Type::kString || types.b == Type::kString))
+				instr = instruction<ConcatStr>();
+			if (!instr)
+			{
+				auto binop = instruction<BinOp>();
+				binop->op = op;
+				add(binop);
+				return;
+			}
+			++m_num_specialized;
+			add(instr);
+		}
+
 		bool get_property(ast::Expression& n, std::string& prop, int op)
 		{
 			//auto* id = dynamic_cast<ast::Identifier*>(&n);
@@ -602,11 +822,35 @@ namespace script
 			}
 			return false;
 		}
+		int compound_assignment_operator(int op)
+		{
+			switch (op)
+			{
+			case parse::TokenType_kMinusAssign:
+				return '-';
+			case parse::TokenType_kPlusAssign:
+				return '+';
+			case parse::TokenType_kMultiplyAssign:
+				return '*';
+			case parse::TokenType_kDivideAssign:
+				return '/';
+			case parse::TokenType_kModAssign:
+				return '%';
+			case parse::TokenType_kOrAssign:
+				return '|';
+			case parse::TokenType_kXorAssign:
+				return '^';
+			case parse::TokenType_kAndAssign:
+				return '&';
+			}
+			throw CompileException("unhandled operator {}", op);
+		}
 		class LValueVisitor : public CompileVisitor
 		{
 			Compiler* compiler;
+			bool create;
 		  public:
-			LValueVisitor(Compiler* c) : compiler(c)
+			LValueVisitor(Compiler* c, bool create_ = true) : compiler(c), create(create_)
 			{
 			}
 			virtual void visit(ast::MemberExpression& n)
@@ -618,14 +862,12 @@ namespace script
 				}
 				else
 				{
-					auto instr = compiler->instruction<PushString>();
-					instr->value = field_name;
-					instr->length = field_name.size();
-					compiler->add(instr);
+					compiler->add_constant<PushString>(vm::String(field_name));
 				}
 				n.object->accept(*this);
 				auto instr = compiler->instruction<LoadObjectFieldRef>();
 				instr->op = n.op;
+				instr->create = create;
 				compiler->add(instr);
 			}
 			virtual void visit(ast::Identifier& n)
@@ -651,43 +893,20 @@ namespace script
 				LValueVisitor vis(this);
 				n.lhs->accept(vis);
 			}
+			else if (n.lhs->cast<ast::MemberExpression>())
+			{
+				//walk the path to the field once and read and write it through the reference
+				n.rhs->accept(*this);
+				LValueVisitor vis(this, false);
+				n.lhs->accept(vis);
+				add_ref_binop(compound_assignment_operator(n.op));
+				return;
+			}
 			else
 			{
 				n.rhs->accept(*this);
 				n.lhs->accept(*this);
-
-				auto instr = instruction<BinOp>();
-				switch (n.op)
-				{
-				case parse::TokenType_kMinusAssign:
-					instr->op = '-';
-					break;
-				case parse::TokenType_kPlusAssign:
-					instr->op = '+';
-					break;
-				case parse::TokenType_kMultiplyAssign:
-					instr->op = '*';
-					break;
-				case parse::TokenType_kDivideAssign:
-					instr->op = '/';
-					break;
-				case parse::TokenType_kModAssign:
-					instr->op = '%';
-					break;
-				case parse::TokenType_kOrAssign:
-					instr->op = '|';
-					break;
-				case parse::TokenType_kXorAssign:
-					instr->op = '^';
-					break;
-				case parse::TokenType_kAndAssign:
-					instr->op = '&';
-					break;
-				default:
-					throw CompileException("unhandled operator {}", n.op);
-					break;
-				}
-				add(instr);
+				add_binop(n, compound_assignment_operator(n.op));
 				LValueVisitor vis(this);
 				n.lhs->accept(vis);
 			}
@@ -713,10 +932,7 @@ namespace script
 					throw CompileException("unexpected file reference");
 				}
 
-				auto ps = instruction<PushString>();
-				ps->value = id->name;
-				ps->length = id->name.size();
-				add(ps);
+				add_constant<PushString>(vm::String(id->name));
 			}
 			instr->is_method_call = n.object != nullptr;
 			instr->numargs = n.arguments.size() - 1;
@@ -808,10 +1024,7 @@ namespace script
 			}
 			else
 			{
-				auto instr = instruction<PushString>();
-				instr->value = field_name;
-				instr->length = field_name.size();
-				add(instr);
+				add_constant<PushString>(vm::String(field_name));
 			}
 			n.object->accept(*this);
 			auto instr = instruction<LoadObjectFieldValue>();
@@ -828,9 +1041,7 @@ namespace script
 				n.argument->accept(*this);
 				auto constant0 = instruction<Constant0>();
 				add(constant0);
-				auto instr = instruction<BinOp>();
-				instr->op = '-';
-				add(instr);
+				add_binop(n, '-');
 			} break;
 			case '!':
 			{
@@ -849,26 +1060,28 @@ namespace script
 			{
 				if (n.prefix)
 					throw CompileException("unsupported prefix operator -- or ++");
-				n.argument->accept(*this);
+				//BinOp computes top - next, so the argument has to end up on top
 				auto constant1 = instruction<Constant1>();
 				add(constant1);
-				if (n.op == parse::TokenType_kPlusPlus)
+				if (n.argument->cast<ast::MemberExpression>())
 				{
-					auto instr = instruction<BinOp>();
-					instr->op = '+';
-					add(instr);
+					//walk the path to the field once, the new value is read back through the reference
+					LValueVisitor vis(this, false);
+					n.argument->accept(vis);
+					add_ref_binop(n.op == parse::TokenType_kPlusPlus ? '+' : '-');
+					auto value = instruction<LoadRefValue>();
+					add(value);
 				}
 				else
 				{
-					auto instr = instruction<BinOp>();
-					instr->op = '-';
-					add(instr);
+					n.argument->accept(*this);
+					add_binop(n, n.op == parse::TokenType_kPlusPlus ? '+' : '-');
+					LValueVisitor vis(this);
+					n.argument->accept(vis);
+					auto sr = instruction<StoreRef>();
+					add(sr);
+					n.argument->accept(*this);
 				}
-				LValueVisitor vis(this);
-				n.argument->accept(vis);
-				auto sr = instruction<StoreRef>();
-				add(sr);
-				n.argument->accept(*this);
 			} break;
 			default:
 				throw CompileException("invalid operator {}", n.op);
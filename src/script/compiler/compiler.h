@@ -1,13 +1,19 @@
 #pragma once
 #include <script/ast/visitor.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <string>
 #include <memory>
 #include <stack>
 #include <script/vm/instructions/instructions.h>
 #include <script/vm/types.h>
+#include <script/vm/register_function.h>
+#include <script/vm/native_module.h>
+#include <script/vm/jit.h>
+#include <core/thread_pool.h>
 #include "traverse_info.h"
+#include "type_inference.h"
 
 #include <script/vm/function.h>
 #include <script/vm/instruction.h>
@@ -19,24 +25,62 @@ namespace script
 		std::unique_ptr<ast::Program> program;
 		std::string name;
 		std::unordered_map<std::string, ast::FunctionDeclaration*> function_map;
+		//files this one references and the key of it's source, used for storing it in the bytecode cache
+		//the key is 0 unless there's a cache or ReferenceSolver::set_key_sources
+		std::vector<std::string> references;
+		uint64_t cache_key = 0;
 	};
 	using ReferenceMap = std::unordered_map<std::string, LoadedProgramReference>;
 
 	namespace compiler
 	{
+		class LazyFunction;
+
 		struct CompiledFunction
 		{
 			std::string name;
 			std::string file;
 			std::vector<std::string> parameters;
 			std::vector<std::shared_ptr<vm::Instruction>> instructions;
+			//shared by all functions of the same file
+			std::shared_ptr<vm::Constants> constants;
+			//code for the register backend, only set when RegisterCompiler ran and never stored in the bytecode cache
+			std::shared_ptr<vm::RegisterFunction> register_function;
+			//empty when compiled with strip_debug_info
+			LineTable lines;
+			//set when it got loaded from a module written by gsc2cpp, runs in place of the instructions
+			vm::NativeFunction native = nullptr;
+			//hotness and machine code for VirtualMachine's flags::kJit
+			vm::JitSlot jit;
+			//set while it's a stub from compile_lazy, there's no code until resolve_lazy
+			std::shared_ptr<LazyFunction> lazy;
 		};
 		using CompiledFunctions = std::unordered_map<std::string, CompiledFunction>;
 		using CompiledFiles = std::unordered_map<std::string, CompiledFunctions>;
 
+		//constant property name of a member expression (a.b, a[0], a["b"]), false if it has to be evaluated
+		bool get_property(ast::Expression& n, std::string& prop, int op);
+		//the BinOp operator of a compound assignment (+= gives +), throws for anything else
+		int compound_assignment_operator(int op);
+
+		struct CompilerOptions
+		{
+			//names exposed by the host through VirtualMachine::set_global, their type is never known
+			std::unordered_set<std::string> globals;
+			//leave out the line tables, errors and print only know the file and function
+			bool strip_debug_info = false;
+			//print how many operators of every file got specialized
+			bool report = false;
+		};
+
 		class Compiler : public ast::ASTVisitor
 		{
+		  public:
+			using Options = CompilerOptions;
+
+		  private:
 			script::ReferenceMap& m_refmap;
+			Options m_options;
 			CompiledFiles m_files;
 			CompiledFunctions *m_compiledfunctions;
 			CompiledFunction *m_function;
@@ -45,18 +89,45 @@ namespace script
 			std::stack<std::weak_ptr<vm::Label>> continue_labels;
 			ast::ExpressionStatement* last_expression_statement = nullptr;
 			size_t label_index = 0;
+			//constant pool of the file that is currently being compiled
+			std::shared_ptr<vm::Constants> m_constants;
+			std::unordered_map<std::string, size_t> m_constant_lookup;
+			size_t m_num_literals = 0;
+			size_t m_num_constants = 0;
+			//types of the function that is currently being compiled
+			TypeInference* m_types = nullptr;
+			//operator sites of the current file and how many of them got a specialized instruction
+			size_t m_num_operators = 0;
+			size_t m_num_specialized = 0;
+			void report_operators(const std::string& file) const;
 
-			DebugInfo debug;
+			//line of the statement that is currently being compiled
+			size_t m_line = 0;
+			void begin_constants();
+			//a specialized instruction for op if the operand types of n are known, BinOp otherwise
+			void add_binop(ast::Node& n, int op);
+			//BinOpRef for a compound assignment to a field
+			void add_ref_binop(int op);
 
 		  public:
-			Compiler(script::ReferenceMap&);
+			Compiler(script::ReferenceMap&, const Options& options = Options());
 			CompiledFiles compile();
+			//same as compile() but every file is compiled as a job on the pool
+			//names of files that failed to compile are added to failed
+			static CompiledFiles compile(script::ReferenceMap&, core::thread_pool&,
+										 std::unordered_set<std::string>* failed = nullptr,
+										 const Options& options = Options());
+			//returns false (and prints the error) if the file failed to compile
+			bool compile_file(const std::string& file, LoadedProgramReference&);
+			//compiles a single function with a constant pool of it's own, throws CompileException
+			CompiledFunction compile_function(const std::string& file, ast::FunctionDeclaration&);
+			//compiles a single function on it's own and returns the amount of instructions, for statistics
+			size_t count_instructions(const std::string& file, ast::FunctionDeclaration&);
 
 			template <typename T, typename... Ts> std::shared_ptr<T> instruction(Ts... ts)
 			{
 				// printf("node(%s)\n", typeid(T).name());
 				auto instr = std::move(std::make_shared<T>(ts...));
-				instr->debug = debug;
 				return instr;
 			}
 			std::shared_ptr<vm::Label> label()
@@ -69,30 +140,24 @@ namespace script
 			template <typename T>
 			void add(std::shared_ptr<T>& t)
 			{
+				if (!m_options.strip_debug_info)
+					m_function->lines.add(m_function->instructions.size(), m_line);
 				m_function->instructions.push_back(t);
 			}
 
-			size_t register_string(const vm::String s)
+			size_t register_string(const std::string& s)
 			{
-				return 0;
-				#if 0
-				auto fnd = strings.find(s);
-				if (fnd == strings.end())
-				{
-					strings[s] = register_constant(s);
-				}
-				return strings[s];
-				#endif
+				return register_constant(vm::String(s));
 			}
-			template <typename T> size_t register_constant(T t)
+			//returns the index of the constant in the pool, equal constants share the same index
+			size_t register_constant(const vm::Variant& v);
+
+			template <typename T> void add_constant(const vm::Variant& v)
 			{
-#if 0
-				vm::Variant u;
-				u = t;
-				m_constants.push_back(u);
-				return m_constants.size() - 1;
-				#endif
-				return 0;
+				auto instr = instruction<T>();
+				instr->index = register_constant(v);
+				instr->constants = m_constants.get();
+				add(instr);
 			}
 
 			// Inherited via ASTVisitor
@@ -0,0 +1,302 @@
+#include "cpp_emitter.h"
+#include "bytecode_cache.h"
+#include <script/vm/instructions/instructions.h>
+#include <common/stringutil.h>
+#include <algorithm>
+#include <cstdio>
+#include <set>
+
+namespace script
+{
+	namespace compiler
+	{
+		static std::string quote(const std::string& s)
+		{
+			std::string out = "\"";
+			for (unsigned char c : s)
+			{
+				if (c == '"' || c == '\\')
+				{
+					out += '\\';
+					out += c;
+				}
+				else if (c < 0x20 || c >= 0x7f)
+				{
+					char buf[8];
+					snprintf(buf, sizeof(buf), "\\%03o", c);
+					out += buf;
+				}
+				else
+					out += c;
+			}
+			return out + "\"";
+		}
+
+		static bool is_call(vm::Instruction& instr)
+		{
+			return instr.cast<vm::CallFunction>() || instr.cast<vm::CallFunctionFile>() ||
+				   instr.cast<vm::CallFunctionPointer>();
+		}
+
+		//instructions after which the frame may have to go back to run_thread
+		static bool may_suspend(vm::Instruction& instr)
+		{
+			return is_call(instr) || instr.cast<vm::WaitTill>() || instr.cast<vm::Wait>() ||
+				   instr.cast<vm::WaitTillFrameEnd>();
+		}
+
+		//instructions that set the instruction_index of the frame themselves
+		static bool may_jump(vm::Instruction& instr)
+		{
+			return instr.cast<vm::Jump>() || instr.cast<vm::JumpZero>() || instr.cast<vm::JumpNotZero>() ||
+				   instr.cast<vm::SwitchTable>();
+		}
+
+		std::string CppEmitter::string_constant(const std::string& s)
+		{
+			auto fnd = m_strings.find(s);
+			if (fnd == m_strings.end())
+			{
+				fnd = m_strings.emplace(s, m_strings.size()).first;
+				m_string_declarations +=
+					"\tconst std::string s" + std::to_string(fnd->second) + " = " + quote(s) + ";\n";
+			}
+			return "s" + std::to_string(fnd->second);
+		}
+
+		//the position of the Label the jump goes to, false if it doesn't go anywhere the function knows about
+		static bool jump_target(const std::weak_ptr<vm::Label>& dest, const std::unordered_map<size_t, size_t>& labels,
+								size_t& position)
+		{
+			if (dest.expired())
+				return false;
+			auto fnd = labels.find(dest.lock()->label_index);
+			if (fnd == labels.end())
+				return false;
+			position = fnd->second;
+			return true;
+		}
+
+		bool CppEmitter::emit_inline(size_t index, vm::Instruction& instr, const std::unordered_map<size_t, size_t>& labels)
+		{
+			size_t target = 0;
+			if (instr.cast<vm::Label>())
+				return true;
+			if (auto* pi = instr.cast<vm::PushInteger>())
+				m_out += "\t\ttc->push(vm::Integer(" + std::to_string(pi->value) + "));\n";
+			else if (auto* pn = instr.cast<vm::PushNumber>())
+			{
+				char buf[64];
+				snprintf(buf, sizeof(buf), "%a", (double)pn->value);
+				m_out += std::string("\t\ttc->push(vm::Number(") + buf + "));\n";
+			}
+			else if (instr.cast<vm::PushString>() || instr.cast<vm::PushLocalizedString>() ||
+					 instr.cast<vm::PushFunctionPointer>() || instr.cast<vm::PushAnimationString>())
+				m_out += "\t\ttc->push(static_cast<vm::PushConstant&>(*I[" + std::to_string(index) + "]).constant());\n";
+			else if (instr.cast<vm::Constant0>())
+				m_out += "\t\ttc->push(0);\n";
+			else if (instr.cast<vm::Constant1>())
+				m_out += "\t\ttc->push(1);\n";
+			else if (instr.cast<vm::PushUndefined>())
+				m_out += "\t\ttc->push(vm::Undefined());\n";
+			else if (instr.cast<vm::Pop>())
+				m_out += "\t\ttc->pop();\n";
+			else if (auto* lv = instr.cast<vm::LoadValue>())
+				m_out += "\t\ttc->push(vm.get_variable(tc, " +
+						 string_constant(util::string::to_lower(lv->variable_name)) + "));\n";
+			else if (auto* j = instr.cast<vm::Jump>())
+			{
+				if (j->dest.expired())
+					return true;
+				if (!jump_target(j->dest, labels, target))
+					return false;
+				m_out += "\t\tgoto L" + std::to_string(target) + ";\n";
+			}
+			else if (auto* jz = instr.cast<vm::JumpZero>())
+			{
+				if (jz->dest.expired())
+					return true;
+				if (!jump_target(jz->dest, labels, target))
+					return false;
+				m_out += "\t\tif (vm.get_flags() & vm::flags::kZF)\n\t\t\tgoto L" + std::to_string(target) + ";\n";
+			}
+			else if (auto* jnz = instr.cast<vm::JumpNotZero>())
+			{
+				if (jnz->dest.expired())
+					return true;
+				if (!jump_target(jnz->dest, labels, target))
+					return false;
+				m_out += "\t\tif ((vm.get_flags() & vm::flags::kZF) != vm::flags::kZF)\n\t\t\tgoto L" +
+						 std::to_string(target) + ";\n";
+			}
+			else
+			{
+				//same as INTEGER_BINOP in instructions.cpp
+				static const std::pair<size_t, const char*> integer_binops[] = {
+					{type_id<vm::AddInt>::id(), "a + b"},
+					{type_id<vm::SubInt>::id(), "a - b"},
+					{type_id<vm::MulInt>::id(), "a * b"},
+					{type_id<vm::LtInt>::id(), "a < b ? 1 : 0"},
+					{type_id<vm::LeqInt>::id(), "a <= b ? 1 : 0"},
+					{type_id<vm::GtInt>::id(), "a > b ? 1 : 0"},
+					{type_id<vm::GeqInt>::id(), "a >= b ? 1 : 0"},
+					{type_id<vm::EqInt>::id(), "a == b ? 1 : 0"},
+					{type_id<vm::NeqInt>::id(), "a == b ? 0 : 1"},
+				};
+				for (auto& it : integer_binops)
+				{
+					if (it.first != instr.kind())
+						continue;
+					m_out += "\t\t{\n"
+							 "\t\t\tint a = std::get<vm::Integer>(tc->top(0));\n"
+							 "\t\t\tauto& slot = tc->top(1);\n"
+							 "\t\t\tint b = std::get<vm::Integer>(slot);\n"
+							 "\t\t\tslot = (vm::Integer)(" +
+							 std::string(it.second) +
+							 ");\n"
+							 "\t\t\ttc->pop();\n"
+							 "\t\t}\n";
+					return true;
+				}
+				return false;
+			}
+			return true;
+		}
+
+		void CppEmitter::emit_function(const std::string& symbol, const CompiledFunction& function)
+		{
+			auto& instructions = function.instructions;
+			size_t n = instructions.size();
+			//same as VirtualMachine::call_impl, a later label with the same index wins
+			std::unordered_map<size_t, size_t> labels;
+			for (size_t i = 0; i < n; ++i)
+			{
+				if (auto* l = instructions[i]->cast<vm::Label>())
+					labels[l->label_index] = i;
+			}
+			//positions the frame can be at when the function gets entered
+			std::set<size_t> entries = {0};
+			for (auto& it : labels)
+				entries.insert(it.second);
+			bool has_resume = false;
+			for (size_t i = 0; i < n; ++i)
+			{
+				if (may_suspend(*instructions[i]) || may_jump(*instructions[i]))
+					entries.insert(i + 1);
+			}
+
+			m_out += "\t//" + function.file + "::" + function.name + "\n";
+			m_out += "\tvoid " + symbol + "(VirtualMachine& vm, ThreadContext* tc)\n\t{\n";
+			m_out += "\t\tauto& fc = tc->function_context();\n";
+			m_out += "\t\t[[maybe_unused]] auto& I = fc.function->instructions;\n";
+			m_out += "\t\t[[maybe_unused]] const size_t depth = tc->m_callstack.size();\n";
+			size_t resume_at = m_out.size();
+			m_out += "\t\tswitch (fc.instruction_index)\n\t\t{\n";
+			for (size_t e : entries)
+				m_out += "\t\tcase " + std::to_string(e) + ":\n\t\t\tgoto L" + std::to_string(e) + ";\n";
+			m_out += "\t\t}\n";
+			m_out += "\t\tthrow vm::Exception(\"can't resume {}::{} at {}\", fc.file_name, fc.function_name, "
+					 "fc.instruction_index);\n";
+
+			for (size_t i = 0; i < n; ++i)
+			{
+				auto& instr = *instructions[i];
+				if (entries.find(i) != entries.end())
+					m_out += "\tL" + std::to_string(i) + ":\n";
+				m_out += "\t\tfc.instruction_index = " + std::to_string(i + 1) + ";\n";
+				++m_num_instructions;
+				if (emit_inline(i, instr, labels))
+				{
+					++m_num_inlined;
+					continue;
+				}
+				m_out += "\t\tnative::execute(vm, tc, *I[" + std::to_string(i) + "]);\n";
+				if (instr.cast<vm::Ret>())
+					m_out += "\t\treturn;\n";
+				else if (may_suspend(instr))
+					m_out += "\t\tif (native::suspended(tc, depth))\n\t\t\treturn;\n";
+				else if (may_jump(instr))
+				{
+					m_out += "\t\tgoto resume;\n";
+					has_resume = true;
+				}
+			}
+			if (entries.find(n) != entries.end())
+				m_out += "\tL" + std::to_string(n) + ":\n";
+			//the interpreter fails the same way when it runs past the end
+			m_out += "\t\tthrow vm::Exception(\"shouldn't be nullptr\");\n\t}\n\n";
+			if (has_resume)
+				m_out.insert(resume_at, "\tresume:\n");
+		}
+
+		std::string CppEmitter::emit(const CompiledFiles& files)
+		{
+			m_out.clear();
+			m_strings.clear();
+			m_string_declarations.clear();
+			m_num_instructions = m_num_inlined = 0;
+
+			std::vector<std::string> file_names;
+			for (auto& it : files)
+				file_names.push_back(it.first);
+			std::sort(file_names.begin(), file_names.end());
+
+			std::string tables;
+			std::string module_files;
+			size_t num_functions = 0;
+			for (size_t f = 0; f < file_names.size(); ++f)
+			{
+				auto& functions = files.at(file_names[f]);
+				std::vector<std::string> function_names;
+				for (auto& it : functions)
+					function_names.push_back(it.first);
+				std::sort(function_names.begin(), function_names.end());
+
+				std::string entries;
+				for (auto& name : function_names)
+				{
+					std::string symbol = "f" + std::to_string(num_functions++);
+					emit_function(symbol, functions.at(name));
+					entries += "\t\t{" + quote(name) + ", " + symbol + "},\n";
+				}
+
+				std::vector<u8> bytecode;
+				BytecodeCache::serialize(bytecode, 0, file_names[f], functions, {});
+				std::string suffix = std::to_string(f);
+				tables += "\tconst unsigned char bytecode" + suffix + "[] = {";
+				for (size_t i = 0; i < bytecode.size(); ++i)
+				{
+					if (i % 16 == 0)
+						tables += "\n\t\t";
+					tables += std::to_string(bytecode[i]) + ",";
+				}
+				tables += "\n\t};\n";
+				if (!entries.empty())
+					tables += "\tconst NativeModuleFunction functions" + suffix + "[] = {\n" + entries + "\t};\n";
+				module_files += "\t\t{" + quote(file_names[f]) + ", bytecode" + suffix + ", sizeof(bytecode" + suffix +
+								"), " + (entries.empty() ? "nullptr" : "functions" + suffix) + ", " +
+								std::to_string(function_names.size()) + "},\n";
+			}
+
+			std::string out = "//written by gsc2cpp, don't edit\n"
+							  "#include <script/vm/native_runtime.h>\n\n"
+							  "using namespace script;\n"
+							  "using namespace script::vm;\n\n"
+							  "namespace\n{\n";
+			out += m_string_declarations;
+			if (!m_string_declarations.empty())
+				out += "\n";
+			out += m_out;
+			out += tables;
+			if (file_names.empty())
+				out += "\tconst NativeModuleFile* files = nullptr;\n";
+			else
+				out += "\tconst NativeModuleFile files[] = {\n" + module_files + "\t};\n";
+			out += "};\n\n";
+			out += "extern \"C\" const NativeModule gsc_module = {kNativeModuleVersion, files, " +
+				   std::to_string(file_names.size()) + "};\n";
+			m_out.clear();
+			return out;
+		}
+	}; // namespace compiler
+};	   // namespace script
@@ -0,0 +1,40 @@
+#pragma once
+#include "compiler.h"
+#include <string>
+#include <unordered_map>
+
+namespace script
+{
+	namespace compiler
+	{
+		//writes the source of a native module (vm/native_module.h) for compiled files, used by gsc2cpp
+		//every function becomes a state machine that picks up at the instruction_index of it's frame, control flow and
+		//simple stack operations are written out and everything else runs the instruction from the embedded bytecode
+		class CppEmitter
+		{
+			std::string m_out;
+			//lowercased variable names, declared once at the top
+			std::unordered_map<std::string, size_t> m_strings;
+			std::string m_string_declarations;
+			size_t m_num_instructions = 0;
+			size_t m_num_inlined = 0;
+
+			std::string string_constant(const std::string& s);
+			void emit_function(const std::string& symbol, const CompiledFunction& function);
+			//false if the instruction has to be executed
+			bool emit_inline(size_t index, vm::Instruction& instr, const std::unordered_map<size_t, size_t>& labels);
+
+		  public:
+			std::string emit(const CompiledFiles& files);
+
+			size_t num_instructions() const
+			{
+				return m_num_instructions;
+			}
+			size_t num_inlined() const
+			{
+				return m_num_inlined;
+			}
+		};
+	}; // namespace compiler
+};	   // namespace script
@@ -0,0 +1,254 @@
+#include "effect_analysis.h"
+#include <script/compiler/compiler.h>
+#include <parse/token.h>
+#include <common/stringutil.h>
+#include <algorithm>
+
+namespace script
+{
+	namespace compiler
+	{
+		//stock functions that never store to a script object or wait
+		static const std::unordered_set<std::string> kPureFunctions = {
+			"isdefined", "typeof", "tolower", "distance", "pi", "cos", "sin", "pow", "abs", "sqrt", "float",
+			"spawnstruct", "randomint", "randomintrange", "randomfloat", "gettime", "vectornormalize", "vectortoangles",
+			"anglestoforward", "vectorscale", "print", "logprint"};
+
+		static std::string normalize_file(const std::string& file)
+		{
+			std::string s = util::string::to_lower(file);
+			std::replace(s.begin(), s.end(), '\\', '/');
+			return s;
+		}
+
+		void EffectAnalysis::Effects::merge(const Effects& other)
+		{
+			all = all || other.all;
+			stores = stores || other.stores;
+			variables.insert(other.variables.begin(), other.variables.end());
+			fields.insert(other.fields.begin(), other.fields.end());
+		}
+
+		bool EffectAnalysis::resolve(ast::CallExpression& n, std::string& file, ast::FunctionDeclaration*& fn)
+		{
+			auto* id = n.callee->cast<ast::Identifier>();
+			file = id->file_reference.empty() ? m_file : normalize_file(id->file_reference);
+			if (file != m_file && !m_options.inline_across_files)
+				return false;
+			auto fnd = m_refmap.find(file);
+			if (fnd == m_refmap.end())
+				return false;
+			auto f = fnd->second.function_map.find(util::string::to_lower(id->name));
+			if (f == fnd->second.function_map.end())
+				return false;
+			fn = f->second;
+			return true;
+		}
+
+		const EffectAnalysis::Effects& EffectAnalysis::summarize(const std::string& file, ast::FunctionDeclaration& fn)
+		{
+			static const Effects anything = {.all = true};
+			auto fnd = m_summaries.find(&fn);
+			if (fnd != m_summaries.end())
+				return fnd->second;
+			//recursion, don't bother
+			if (!m_summarizing.insert(&fn).second)
+				return anything;
+			//calls in it are resolved from its own file
+			std::string caller = m_file;
+			m_file = file;
+			Effects fx;
+			if (fn.body)
+				statement(*fn.body, fx);
+			m_file = caller;
+			Effects summary;
+			summary.all = fx.all;
+			summary.stores = fx.stores;
+			summary.fields = std::move(fx.fields);
+			//the locals of the callee are its own, except for these
+			for (auto& var : fx.variables)
+			{
+				if (var == "level" || var == "game" || m_options.globals.find(var) != m_options.globals.end())
+					summary.all = true;
+			}
+			m_summarizing.erase(&fn);
+			return m_summaries[&fn] = std::move(summary);
+		}
+
+		void EffectAnalysis::lvalue(ast::Expression& e, Effects& fx)
+		{
+			if (auto* n = e.cast<ast::Identifier>())
+			{
+				if (n->file_reference.empty())
+					fx.variables.insert(util::string::to_lower(n->name));
+				return;
+			}
+			auto* n = e.cast<ast::MemberExpression>();
+			if (!n)
+			{
+				fx.all = true;
+				return;
+			}
+			//every field on the way gets created if it's undefined
+			fx.stores = true;
+			std::string prop;
+			if (get_property(*n->prop, prop, n->op))
+				fx.fields.insert(util::string::to_lower(prop));
+			else
+			{
+				//could be any field
+				expression(n->prop.get(), fx);
+				fx.all = true;
+			}
+			auto* object = n->object->cast<ast::MemberExpression>();
+			if (object)
+				lvalue(*object, fx);
+			else
+				expression(n->object.get(), fx);
+		}
+
+		void EffectAnalysis::expression(ast::Expression* e, Effects& fx)
+		{
+			if (!e)
+				return;
+			if (auto* n = e->cast<ast::BinaryExpression>())
+			{
+				expression(n->left.get(), fx);
+				expression(n->right.get(), fx);
+			}
+			else if (auto* n = e->cast<ast::UnaryExpression>())
+			{
+				if (n->op == parse::TokenType_kPlusPlus || n->op == parse::TokenType_kMinusMinus)
+					lvalue(*n->argument, fx);
+				else
+					expression(n->argument.get(), fx);
+			}
+			else if (auto* n = e->cast<ast::AssignmentExpression>())
+			{
+				expression(n->rhs.get(), fx);
+				lvalue(*n->lhs, fx);
+			}
+			else if (auto* n = e->cast<ast::ConditionalExpression>())
+			{
+				expression(n->condition.get(), fx);
+				expression(n->consequent.get(), fx);
+				expression(n->alternative.get(), fx);
+			}
+			else if (auto* n = e->cast<ast::MemberExpression>())
+			{
+				expression(n->object.get(), fx);
+				expression(n->prop.get(), fx);
+			}
+			else if (auto* n = e->cast<ast::VectorExpression>())
+			{
+				for (auto& el : n->elements)
+					expression(el.get(), fx);
+			}
+			else if (auto* n = e->cast<ast::ArrayExpression>())
+			{
+				for (auto& el : n->elements)
+					expression(el.get(), fx);
+			}
+			else if (auto* n = e->cast<ast::CallExpression>())
+			{
+				expression(n->object.get(), fx);
+				auto* id = n->callee->cast<ast::Identifier>();
+				std::string name = id ? util::string::to_lower(id->name) : "";
+				if (!n->pointer && name == "waittill")
+				{
+					if (!n->arguments.empty())
+						expression(n->arguments[0].get(), fx);
+					for (size_t i = 1; i < n->arguments.size(); ++i)
+						lvalue(*n->arguments[i], fx);
+					fx.all = true;
+					return;
+				}
+				for (auto& arg : n->arguments)
+					expression(arg.get(), fx);
+				if (n->pointer || !id)
+				{
+					expression(n->callee.get(), fx);
+					fx.all = true;
+					return;
+				}
+				//notify only queues the event, the waiting threads run on the next frame
+				if (n->object && (name == "endon" || name == "notify"))
+					return;
+				std::string file;
+				ast::FunctionDeclaration* fn = nullptr;
+				if (resolve(*n, file, fn))
+				{
+					fx.merge(summarize(file, *fn));
+					return;
+				}
+				if (id->file_reference.empty() && kPureFunctions.find(name) != kPureFunctions.end())
+				{
+					//unless a script function by that name is found at runtime instead
+					//without looking into other files, e.g. the ones that came from the cache, any of them may define it
+					bool defined = !m_options.inline_across_files;
+					for (auto& file : m_refmap)
+					{
+						if (file.second.function_map.find(name) != file.second.function_map.end())
+							defined = true;
+					}
+					if (!defined)
+						return;
+				}
+				fx.all = true;
+			}
+		}
+
+		void EffectAnalysis::statement(ast::Statement& s, Effects& fx)
+		{
+			if (auto* n = s.cast<ast::BlockStatement>())
+			{
+				for (auto& stmt : n->body)
+					statement(*stmt, fx);
+			}
+			else if (auto* n = s.cast<ast::ExpressionStatement>())
+				expression(n->expression.get(), fx);
+			else if (auto* n = s.cast<ast::IfStatement>())
+			{
+				expression(n->test.get(), fx);
+				statement(*n->consequent, fx);
+				if (n->alternative)
+					statement(*n->alternative, fx);
+			}
+			else if (auto* n = s.cast<ast::WhileStatement>())
+			{
+				expression(n->test.get(), fx);
+				statement(*n->body, fx);
+			}
+			else if (auto* n = s.cast<ast::ForStatement>())
+			{
+				expression(n->init.get(), fx);
+				expression(n->test.get(), fx);
+				expression(n->update.get(), fx);
+				statement(*n->body, fx);
+			}
+			else if (auto* n = s.cast<ast::DoWhileStatement>())
+			{
+				expression(n->test.get(), fx);
+				statement(*n->body, fx);
+			}
+			else if (auto* n = s.cast<ast::ReturnStatement>())
+				expression(n->argument.get(), fx);
+			else if (auto* n = s.cast<ast::WaitStatement>())
+			{
+				expression(n->duration.get(), fx);
+				fx.all = true;
+			}
+			else if (s.cast<ast::WaitTillFrameEndStatement>())
+				fx.all = true;
+			else if (auto* n = s.cast<ast::SwitchStatement>())
+			{
+				expression(n->discriminant.get(), fx);
+				for (auto& c : n->cases)
+				{
+					for (auto& stmt : c->consequent)
+						statement(*stmt, fx);
+				}
+			}
+		}
+	}; // namespace compiler
+};	   // namespace script
@@ -0,0 +1,56 @@
+#pragma once
+#include <script/compiler/optimizer.h>
+#include <script/ast/nodes.h>
+#include <unordered_set>
+#include <unordered_map>
+#include <string>
+
+namespace script
+{
+	namespace compiler
+	{
+		//what running a piece of code may store to, for the passes that keep loaded values around
+		//calls are followed into script functions that can be resolved from the refmap, anything else that isn't a known pure builtin may change everything
+		class EffectAnalysis
+		{
+		  public:
+			struct Effects
+			{
+				//anything may have changed, e.g. after a wait or a call to something unknown
+				bool all = false;
+				//some field got stored to, the size of any object may be different
+				bool stores = false;
+				std::unordered_set<std::string> variables;
+				std::unordered_set<std::string> fields;
+
+				void merge(const Effects& other);
+			};
+
+		  private:
+			script::ReferenceMap& m_refmap;
+			const Optimizer::Options& m_options;
+			std::string m_file;
+			//of the script functions called, the locals of the callee aren't included
+			std::unordered_map<ast::FunctionDeclaration*, Effects> m_summaries;
+			std::unordered_set<ast::FunctionDeclaration*> m_summarizing;
+
+			bool resolve(ast::CallExpression& n, std::string& file, ast::FunctionDeclaration*& fn);
+			const Effects& summarize(const std::string& file, ast::FunctionDeclaration& fn);
+
+		  public:
+			EffectAnalysis(script::ReferenceMap& refmap, const Optimizer::Options& options)
+				: m_refmap(refmap), m_options(options)
+			{
+			}
+			//the file calls without a file reference are resolved from
+			void set_file(const std::string& file)
+			{
+				m_file = file;
+			}
+			void expression(ast::Expression* e, Effects& fx);
+			//storing to e, the fields on the way get created if they're undefined
+			void lvalue(ast::Expression& e, Effects& fx);
+			void statement(ast::Statement& s, Effects& fx);
+		};
+	}; // namespace compiler
+};	   // namespace script
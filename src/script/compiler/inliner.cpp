@@ -0,0 +1,527 @@
+#include "inliner.h"
+#include <script/ast/recursive_visitor.h>
+#include <script/compiler/exception.h>
+#include <parse/token.h>
+#include <common/stringutil.h>
+#include <algorithm>
+
+namespace script
+{
+	namespace compiler
+	{
+		//deeper than this and the inlined expressions only grow
+		static constexpr size_t kMaxDepth = 4;
+
+		//finds self = ... and waittill(..., self), after that self no longer is the object the function was called on
+		class SelfWriteVisitor : public ast::RecursiveASTVisitor
+		{
+		  public:
+			bool found = false;
+			virtual bool pre_visit(ast::AssignmentExpression& n) override
+			{
+				auto* id = n.lhs->cast<ast::Identifier>();
+				if (id && id->file_reference.empty() && util::string::to_lower(id->name) == "self")
+					found = true;
+				return !found;
+			}
+			virtual bool pre_visit(ast::CallExpression& n) override
+			{
+				auto* id = n.callee->cast<ast::Identifier>();
+				if (!n.pointer && id && util::string::to_lower(id->name) == "waittill")
+				{
+					for (auto& arg : n.arguments)
+					{
+						auto* var = arg->cast<ast::Identifier>();
+						if (var && util::string::to_lower(var->name) == "self")
+							found = true;
+					}
+				}
+				return !found;
+			}
+		};
+
+		static std::string normalize_file(const std::string& file)
+		{
+			std::string s = util::string::to_lower(file);
+			std::replace(s.begin(), s.end(), '\\', '/');
+			return s;
+		}
+
+		static bool is_trivial(ast::Expression* e)
+		{
+			if (e->cast<ast::Identifier>() || e->cast<ast::FunctionPointer>() || e->cast<ast::LocalizedString>())
+				return true;
+			auto* lit = e->cast<ast::Literal>();
+			return lit && lit->type != ast::Literal::Type::kVector;
+		}
+
+		static bool has_side_effects(ast::Expression* e)
+		{
+			if (!e)
+				return false;
+			if (e->cast<ast::CallExpression>() || e->cast<ast::AssignmentExpression>())
+				return true;
+			if (auto* n = e->cast<ast::UnaryExpression>())
+			{
+				if (n->op == parse::TokenType_kPlusPlus || n->op == parse::TokenType_kMinusMinus)
+					return true;
+				return has_side_effects(n->argument.get());
+			}
+			if (auto* n = e->cast<ast::BinaryExpression>())
+				return has_side_effects(n->left.get()) || has_side_effects(n->right.get());
+			if (auto* n = e->cast<ast::ConditionalExpression>())
+				return has_side_effects(n->condition.get()) || has_side_effects(n->consequent.get()) ||
+					   has_side_effects(n->alternative.get());
+			if (auto* n = e->cast<ast::MemberExpression>())
+				return has_side_effects(n->object.get()) || has_side_effects(n->prop.get());
+			if (auto* n = e->cast<ast::VectorExpression>())
+			{
+				for (auto& el : n->elements)
+					if (has_side_effects(el.get()))
+						return true;
+			}
+			if (auto* n = e->cast<ast::ArrayExpression>())
+			{
+				for (auto& el : n->elements)
+					if (has_side_effects(el.get()))
+						return true;
+			}
+			return false;
+		}
+
+		static ast::ExpressionPtr make_undefined(ast::Node& from)
+		{
+			auto n = ast::make<ast::Literal>();
+			n->debug = from.debug;
+			n->type = ast::Literal::Type::kUndefined;
+			return n;
+		}
+
+		bool Inliner::resolve(ast::CallExpression& n, Callee& callee)
+		{
+			if (n.threaded || n.pointer)
+				return false;
+			auto* id = n.callee->cast<ast::Identifier>();
+			if (!id)
+				return false;
+			callee.file = id->file_reference.empty() ? m_file : normalize_file(id->file_reference);
+			if (callee.file != m_file && !m_options.inline_across_files)
+				return false;
+			auto file = m_refmap.find(callee.file);
+			if (file == m_refmap.end())
+				return false;
+			auto fn = file->second.function_map.find(util::string::to_lower(id->name));
+			if (fn == file->second.function_map.end())
+				return false;
+			callee.function = fn->second;
+
+			auto& f = *callee.function;
+			auto* body = f.body ? f.body->cast<ast::BlockStatement>() : nullptr;
+			if (f.variadic || !body || body->body.size() > 1)
+				return false;
+			if (!body->body.empty())
+			{
+				auto* ret = body->body[0]->cast<ast::ReturnStatement>();
+				if (!ret)
+					return false;
+				callee.expression = ret->argument.get();
+			}
+			for (auto& parm : f.parameters)
+			{
+				if (util::string::to_lower(parm) == "self")
+					return false;
+			}
+			if (callee.expression && !analyze(*callee.expression, callee))
+				return false;
+			return !callee.recursive;
+		}
+
+		bool Inliner::analyze(ast::Expression& e, Callee& callee)
+		{
+			if (++callee.nodes > m_options.inline_threshold)
+				return false;
+			if (auto* n = e.cast<ast::Identifier>())
+			{
+				if (n->file_reference.empty())
+					++callee.uses[util::string::to_lower(n->name)];
+				return true;
+			}
+			if (e.cast<ast::Literal>() || e.cast<ast::LocalizedString>() || e.cast<ast::FunctionPointer>())
+				return true;
+			if (auto* n = e.cast<ast::BinaryExpression>())
+				return analyze(*n->left, callee) && analyze(*n->right, callee);
+			if (auto* n = e.cast<ast::UnaryExpression>())
+			{
+				if (n->op == parse::TokenType_kPlusPlus || n->op == parse::TokenType_kMinusMinus)
+					return false;
+				return analyze(*n->argument, callee);
+			}
+			if (auto* n = e.cast<ast::MemberExpression>())
+			{
+				if (!analyze(*n->object, callee))
+					return false;
+				if (n->op == '.' && n->prop->cast<ast::Identifier>())
+					return true;
+				return analyze(*n->prop, callee);
+			}
+			if (auto* n = e.cast<ast::CallExpression>())
+			{
+				if (n->pointer)
+				{
+					if (!analyze(*n->callee, callee))
+						return false;
+				}
+				else
+				{
+					auto* id = n->callee->cast<ast::Identifier>();
+					if (!id || util::string::to_lower(id->name) == "waittill")
+						return false;
+					std::string file = id->file_reference.empty() ? callee.file : normalize_file(id->file_reference);
+					if (file == callee.file &&
+						util::string::to_lower(id->name) == util::string::to_lower(callee.function->function_name))
+						callee.recursive = true;
+				}
+				//calls without an object get passed self implicitly
+				if (n->object)
+				{
+					if (!analyze(*n->object, callee))
+						return false;
+				}
+				else
+					++callee.uses["self"];
+				for (auto& arg : n->arguments)
+				{
+					if (!analyze(*arg, callee))
+						return false;
+				}
+				return true;
+			}
+			if (auto* n = e.cast<ast::VectorExpression>())
+			{
+				for (auto& el : n->elements)
+					if (!analyze(*el, callee))
+						return false;
+				return true;
+			}
+			if (auto* n = e.cast<ast::ArrayExpression>())
+			{
+				for (auto& el : n->elements)
+					if (!analyze(*el, callee))
+						return false;
+				return true;
+			}
+			//assignments, waittill and conditionals
+			return false;
+		}
+
+		ast::ExpressionPtr Inliner::clone(ast::Expression& e, const Substitution& s)
+		{
+			ast::ExpressionPtr result;
+			Substitution verbatim;
+			verbatim.substitute = false;
+			if (auto* n = e.cast<ast::Identifier>())
+			{
+				std::string name = util::string::to_lower(n->name);
+				if (!s.substitute || !n->file_reference.empty() || name == "level" || name == "game" ||
+					m_options.globals.find(name) != m_options.globals.end())
+					result = ast::make<ast::Identifier>(n->name, n->file_reference);
+				else
+				{
+					auto fnd = s.names.find(name);
+					if (fnd != s.names.end())
+					{
+						if (!fnd->second)
+							return make_undefined(e);
+						return clone(*fnd->second, verbatim);
+					}
+					//a local the callee never assigned
+					if (name != "self")
+						return make_undefined(e);
+					result = ast::make<ast::Identifier>(n->name);
+				}
+			}
+			else if (auto* n = e.cast<ast::Literal>())
+			{
+				auto lit = ast::make<ast::Literal>();
+				lit->type = n->type;
+				lit->value = n->value;
+				lit->integer = n->integer;
+				lit->number = n->number;
+				result = std::move(lit);
+			}
+			else if (auto* n = e.cast<ast::LocalizedString>())
+			{
+				auto loc = ast::make<ast::LocalizedString>();
+				loc->reference = n->reference;
+				result = std::move(loc);
+			}
+			else if (auto* n = e.cast<ast::FunctionPointer>())
+			{
+				//::name refers to the file it's written in
+				if (s.qualify)
+					result = ast::make<ast::Identifier>(n->function_name, ast::Text(s.file));
+				else
+				{
+					auto fp = ast::make<ast::FunctionPointer>();
+					fp->function_name = n->function_name;
+					result = std::move(fp);
+				}
+			}
+			else if (auto* n = e.cast<ast::BinaryExpression>())
+			{
+				auto bin = ast::make<ast::BinaryExpression>();
+				bin->op = n->op;
+				bin->left = clone(*n->left, s);
+				bin->right = clone(*n->right, s);
+				result = std::move(bin);
+			}
+			else if (auto* n = e.cast<ast::UnaryExpression>())
+			{
+				auto un = ast::make<ast::UnaryExpression>();
+				un->op = n->op;
+				un->prefix = n->prefix;
+				un->argument = clone(*n->argument, s);
+				result = std::move(un);
+			}
+			else if (auto* n = e.cast<ast::MemberExpression>())
+			{
+				auto mem = ast::make<ast::MemberExpression>();
+				mem->op = n->op;
+				mem->object = clone(*n->object, s);
+				if (n->op == '.' && n->prop->cast<ast::Identifier>())
+					mem->prop = ast::make<ast::Identifier>(n->prop->cast<ast::Identifier>()->name);
+				else
+					mem->prop = clone(*n->prop, s);
+				mem->prop->debug = n->prop->debug;
+				result = std::move(mem);
+			}
+			else if (auto* n = e.cast<ast::CallExpression>())
+			{
+				auto call = ast::make<ast::CallExpression>();
+				call->threaded = n->threaded;
+				call->pointer = n->pointer;
+				if (n->object)
+					call->object = clone(*n->object, s);
+				else
+				{
+					//keep passing the object the callee was called on
+					auto self = s.names.find("self");
+					if (self != s.names.end())
+						call->object = clone(*self->second, verbatim);
+				}
+				if (n->pointer)
+					call->callee = clone(*n->callee, s);
+				else
+				{
+					auto* id = n->callee->cast<ast::Identifier>();
+					//resolve calls from the file of the callee, not the one it gets inlined into
+					ast::Text file_reference = id->file_reference;
+					if (file_reference.empty() && s.qualify)
+						file_reference = s.file;
+					call->callee = ast::make<ast::Identifier>(id->name, file_reference);
+					call->callee->debug = id->debug;
+				}
+				for (auto& arg : n->arguments)
+					call->arguments.push_back(clone(*arg, s));
+				result = std::move(call);
+			}
+			else if (auto* n = e.cast<ast::VectorExpression>())
+			{
+				auto vec = ast::make<ast::VectorExpression>();
+				for (auto& el : n->elements)
+					vec->elements.push_back(clone(*el, s));
+				result = std::move(vec);
+			}
+			else if (auto* n = e.cast<ast::ArrayExpression>())
+			{
+				auto arr = ast::make<ast::ArrayExpression>();
+				for (auto& el : n->elements)
+					arr->elements.push_back(clone(*el, s));
+				result = std::move(arr);
+			}
+			else
+				throw CompileException("can't inline {}", e.to_string());
+			result->debug = e.debug;
+			return result;
+		}
+
+		void Inliner::try_inline(ast::ExpressionPtr& e, ast::CallExpression& n)
+		{
+			Callee callee;
+			if (!resolve(n, callee))
+				return;
+			if (m_expanding.size() >= kMaxDepth ||
+				std::find(m_expanding.begin(), m_expanding.end(), callee.function) != m_expanding.end())
+				return;
+			//the inlined expression may evaluate the arguments any number of times and in any order
+			if (has_side_effects(n.object.get()))
+				return;
+			for (auto& arg : n.arguments)
+			{
+				if (has_side_effects(arg.get()))
+					return;
+			}
+			Substitution s;
+			s.file = callee.file;
+			s.qualify = callee.file != m_file;
+			auto& parameters = callee.function->parameters;
+			for (size_t i = 0; i < parameters.size(); ++i)
+			{
+				std::string parm = util::string::to_lower(parameters[i]);
+				ast::Expression* arg = i < n.arguments.size() ? n.arguments[i].get() : nullptr;
+				if (arg && callee.uses[parm] > 1 && !is_trivial(arg))
+					return;
+				s.names[parm] = arg;
+			}
+			size_t self_uses = callee.uses["self"];
+			if (n.object)
+			{
+				if (self_uses > 1 && !is_trivial(n.object.get()))
+					return;
+				s.names["self"] = n.object.get();
+			}
+			else if (self_uses > 0 && m_self_assigned)
+				return;
+
+			auto replacement = callee.expression ? clone(*callee.expression, s) : make_undefined(n);
+			if (m_options.report)
+				printf("inlined %s::%s into %s::%s\n", callee.file.c_str(), callee.function->function_name.c_str(),
+					   m_file.c_str(), m_function->function_name.c_str());
+			++m_inlined;
+			e = std::move(replacement);
+
+			m_expanding.push_back(callee.function);
+			visit(e);
+			m_expanding.pop_back();
+		}
+
+		void Inliner::visit_lvalue(ast::ExpressionPtr& e)
+		{
+			auto* member = e->cast<ast::MemberExpression>();
+			if (!member)
+				return;
+			visit_lvalue(member->object);
+			if (member->op != '.')
+				visit(member->prop);
+		}
+
+		void Inliner::visit(ast::ExpressionPtr& e)
+		{
+			if (!e)
+				return;
+			if (auto* n = e->cast<ast::BinaryExpression>())
+			{
+				visit(n->left);
+				visit(n->right);
+			}
+			else if (auto* n = e->cast<ast::UnaryExpression>())
+			{
+				if (n->op == parse::TokenType_kPlusPlus || n->op == parse::TokenType_kMinusMinus)
+					visit_lvalue(n->argument);
+				else
+					visit(n->argument);
+			}
+			else if (auto* n = e->cast<ast::AssignmentExpression>())
+			{
+				visit(n->rhs);
+				visit_lvalue(n->lhs);
+			}
+			else if (auto* n = e->cast<ast::CallExpression>())
+			{
+				visit(n->object);
+				for (auto& arg : n->arguments)
+					visit(arg);
+				if (n->pointer)
+					visit(n->callee);
+				try_inline(e, *n);
+			}
+			else if (auto* n = e->cast<ast::ConditionalExpression>())
+			{
+				visit(n->condition);
+				visit(n->consequent);
+				visit(n->alternative);
+			}
+			else if (auto* n = e->cast<ast::MemberExpression>())
+			{
+				visit(n->object);
+				if (n->op != '.')
+					visit(n->prop);
+			}
+			else if (auto* n = e->cast<ast::VectorExpression>())
+			{
+				for (auto& el : n->elements)
+					visit(el);
+			}
+			else if (auto* n = e->cast<ast::ArrayExpression>())
+			{
+				for (auto& el : n->elements)
+					visit(el);
+			}
+		}
+
+		void Inliner::visit(ast::Statement& s)
+		{
+			if (!m_visited.insert(&s).second)
+				return;
+			if (auto* n = s.cast<ast::BlockStatement>())
+			{
+				for (auto& stmt : n->body)
+					visit(*stmt);
+			}
+			else if (auto* n = s.cast<ast::ExpressionStatement>())
+				visit(n->expression);
+			else if (auto* n = s.cast<ast::IfStatement>())
+			{
+				visit(n->test);
+				visit(*n->consequent);
+				if (n->alternative)
+					visit(*n->alternative);
+			}
+			else if (auto* n = s.cast<ast::WhileStatement>())
+			{
+				visit(n->test);
+				visit(*n->body);
+			}
+			else if (auto* n = s.cast<ast::ForStatement>())
+			{
+				visit(n->init);
+				visit(n->test);
+				visit(n->update);
+				visit(*n->body);
+			}
+			else if (auto* n = s.cast<ast::DoWhileStatement>())
+			{
+				visit(n->test);
+				visit(*n->body);
+			}
+			else if (auto* n = s.cast<ast::ReturnStatement>())
+				visit(n->argument);
+			else if (auto* n = s.cast<ast::WaitStatement>())
+				visit(n->duration);
+			else if (auto* n = s.cast<ast::SwitchStatement>())
+			{
+				visit(n->discriminant);
+				for (auto& c : n->cases)
+				{
+					for (auto& stmt : c->consequent)
+						visit(*stmt);
+				}
+			}
+		}
+
+		size_t Inliner::inline_calls(const std::string& file, ast::FunctionDeclaration& n)
+		{
+			if (m_options.inline_threshold == 0 || !n.body)
+				return 0;
+			m_file = file;
+			m_function = &n;
+			m_visited.clear();
+			m_inlined = 0;
+			SelfWriteVisitor self_writes;
+			n.body->accept(self_writes);
+			m_self_assigned = self_writes.found;
+			visit(*n.body);
+			return m_inlined;
+		}
+	}; // namespace compiler
+};	   // namespace script
@@ -0,0 +1,66 @@
+#pragma once
+#include <script/compiler/optimizer.h>
+#include <script/ast/nodes.h>
+#include <unordered_set>
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+namespace script
+{
+	namespace compiler
+	{
+		//replaces calls to small functions with the expression they return
+		//only callees that are a single return statement without side effects of their own are considered
+		//the call has to be resolvable from the refmap alone, pointer and threaded calls are left alone
+		class Inliner
+		{
+			script::ReferenceMap& m_refmap;
+			const Optimizer::Options& m_options;
+			std::string m_file;
+			ast::FunctionDeclaration* m_function = nullptr;
+			//callees that are currently being expanded, a call to any of these is never inlined
+			std::vector<ast::FunctionDeclaration*> m_expanding;
+			//switch cases share their statements
+			std::unordered_set<ast::Statement*> m_visited;
+			bool m_self_assigned = false;
+			size_t m_inlined = 0;
+
+			struct Callee
+			{
+				std::string file;
+				ast::FunctionDeclaration* function = nullptr;
+				//nullptr if the function returns nothing
+				ast::Expression* expression = nullptr;
+				std::unordered_map<std::string, size_t> uses;
+				size_t nodes = 0;
+				bool recursive = false;
+			};
+			//what a parameter, or self with the name "self", gets replaced with
+			struct Substitution
+			{
+				std::string file;
+				bool qualify = false;
+				//false for arguments, they're copied as they are written at the call site
+				bool substitute = true;
+				std::unordered_map<std::string, ast::Expression*> names;
+			};
+
+			bool resolve(ast::CallExpression& n, Callee& callee);
+			bool analyze(ast::Expression& e, Callee& callee);
+			ast::ExpressionPtr clone(ast::Expression& e, const Substitution& s);
+			void try_inline(ast::ExpressionPtr& e, ast::CallExpression& n);
+			void visit(ast::ExpressionPtr& e);
+			void visit_lvalue(ast::ExpressionPtr& e);
+			void visit(ast::Statement& s);
+
+		  public:
+			Inliner(script::ReferenceMap& refmap, const Optimizer::Options& options)
+				: m_refmap(refmap), m_options(options)
+			{
+			}
+			//returns the amount of call sites that got inlined
+			size_t inline_calls(const std::string& file, ast::FunctionDeclaration& n);
+		};
+	}; // namespace compiler
+};	   // namespace script
@@ -0,0 +1,136 @@
+#include "lazy_function.h"
+#include <common/stringutil.h>
+#include <script/ast/ast_generator.h>
+#include <script/compiler/exception.h>
+#include <script/compiler/register_compiler.h>
+#include <vector>
+
+namespace script
+{
+	namespace compiler
+	{
+		const CompiledFunction* LazyFunction::compile(std::string& error)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_done)
+			{
+				m_done = true;
+				try
+				{
+					auto* decl = m_declaration;
+					std::unique_ptr<ast::Program> parsed;
+					if (!decl->body)
+					{
+						ast::ASTGenerator generator;
+						parsed = generator.generate_function(*decl);
+						decl = static_cast<ast::FunctionDeclaration*>(parsed->body[0].get());
+					}
+					//the program's arena isn't safe to grow from the warm up thread, what the passes add to a body
+					//that was already parsed only has to live until it's compiled, nothing looks at it after that
+					ast::Arena scratch;
+					ast::Arena::Scope scope(parsed ? parsed->arena.get() : &scratch);
+					//just this function, a call to anything else isn't inlined
+					script::ReferenceMap refmap;
+					auto& lpr = refmap[m_file];
+					lpr.name = m_file;
+					lpr.function_map[util::string::to_lower(decl->function_name)] = decl;
+					Optimizer optimizer(m_options->optimizer);
+					optimizer.optimize(refmap);
+					Compiler compiler(refmap, m_options->compiler);
+					m_compiled = compiler.compile_function(m_file, *decl);
+					if (m_options->register_backend)
+					{
+						RegisterCompiler::Options register_options;
+						register_options.globals = m_options->compiler.globals;
+						RegisterCompiler rc(register_options);
+						rc.compile_function(m_file, *decl, m_compiled);
+					}
+				}
+				catch (std::exception& e)
+				{
+					m_error = e.what();
+				}
+				m_declaration = nullptr;
+				m_program.reset();
+			}
+			if (!m_error.empty())
+			{
+				error = m_error;
+				return nullptr;
+			}
+			return &m_compiled;
+		}
+
+		CompiledFiles compile_lazy(script::ReferenceMap& refmap, const LazyOptions& options)
+		{
+			auto shared_options = std::make_shared<LazyOptions>(options);
+			shared_options->optimizer.report = false;
+			CompiledFiles files;
+			for (auto& refmap_iter : refmap)
+			{
+				std::shared_ptr<ast::Program> program = std::move(refmap_iter.second.program);
+				auto& functions = files[util::string::to_lower(refmap_iter.first)];
+				for (auto& fun_iter : refmap_iter.second.function_map)
+				{
+					auto* decl = fun_iter.second;
+					auto& fn = functions[fun_iter.first];
+					fn.name = decl->function_name;
+					fn.file = refmap_iter.first;
+					fn.parameters.assign(decl->parameters.begin(), decl->parameters.end());
+					fn.lazy = std::make_shared<LazyFunction>(program, decl, refmap_iter.first, shared_options);
+				}
+			}
+			return files;
+		}
+
+		void resolve_lazy(CompiledFunction& fn)
+		{
+			auto lazy = std::move(fn.lazy);
+			std::string error;
+			auto* compiled = lazy->compile(error);
+			if (!compiled)
+			{
+				fn.lazy = std::move(lazy);
+				throw CompileException("failed to compile {}::{}: {}", fn.file, fn.name, error);
+			}
+			fn.instructions = compiled->instructions;
+			fn.constants = compiled->constants;
+			fn.register_function = compiled->register_function;
+			fn.lines = compiled->lines;
+		}
+
+		void WarmUp::start(const CompiledFiles& files)
+		{
+			stop();
+			std::vector<std::shared_ptr<LazyFunction>> functions;
+			for (auto& it : files)
+			{
+				for (auto& fn : it.second)
+				{
+					if (fn.second.lazy)
+						functions.push_back(fn.second.lazy);
+				}
+			}
+			if (functions.empty())
+				return;
+			m_stop = false;
+			m_thread = std::thread([this, functions = std::move(functions)] {
+				std::string error;
+				for (auto& fn : functions)
+				{
+					if (m_stop)
+						break;
+					//errors are reported when it gets called
+					fn->compile(error);
+				}
+			});
+		}
+
+		void WarmUp::stop()
+		{
+			m_stop = true;
+			if (m_thread.joinable())
+				m_thread.join();
+		}
+	}; // namespace compiler
+}; // namespace script
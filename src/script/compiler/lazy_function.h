@@ -0,0 +1,69 @@
+#pragma once
+#include <script/compiler/compiler.h>
+#include <script/compiler/optimizer.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace script
+{
+	namespace compiler
+	{
+		struct LazyOptions
+		{
+			Optimizer::Options optimizer;
+			CompilerOptions compiler;
+			//also lower it for the register backend
+			bool register_backend = false;
+		};
+
+		//a function ASTGenerator skipped the body of, it gets parsed, optimized and compiled on it's own the first time it's needed
+		//only calls within the function itself get inlined, there's nothing else to look at
+		//shared by every copy of it's CompiledFunction, compile can be called from any thread
+		class LazyFunction
+		{
+			std::mutex m_mutex;
+			bool m_done = false;
+			//owns the declaration and the sources the skipped tokens point into, dropped once it's compiled
+			std::shared_ptr<ast::Program> m_program;
+			ast::FunctionDeclaration* m_declaration;
+			std::string m_file;
+			std::shared_ptr<const LazyOptions> m_options;
+			CompiledFunction m_compiled;
+			std::string m_error;
+
+		  public:
+			LazyFunction(std::shared_ptr<ast::Program> program, ast::FunctionDeclaration* declaration,
+						 const std::string& file, std::shared_ptr<const LazyOptions> options)
+				: m_program(std::move(program)), m_declaration(declaration), m_file(file), m_options(std::move(options))
+			{
+			}
+			//nullptr and the error if it doesn't parse or compile, it isn't tried again
+			const CompiledFunction* compile(std::string& error);
+		};
+
+		//a stub for every function in refmap that gets compiled the first time resolve_lazy is called for it
+		//the programs are moved out of refmap
+		CompiledFiles compile_lazy(script::ReferenceMap&, const LazyOptions&);
+		//fills in the code of a stub, throws CompileException if it doesn't compile
+		void resolve_lazy(CompiledFunction& fn);
+
+		//compiles stubs ahead of time on a thread of it's own, so they're ready by the time they're called
+		class WarmUp
+		{
+			std::thread m_thread;
+			std::atomic<bool> m_stop{false};
+
+		  public:
+			~WarmUp()
+			{
+				stop();
+			}
+			//stops the last one first
+			void start(const CompiledFiles& files);
+			void stop();
+		};
+	}; // namespace compiler
+};	   // namespace script
@@ -0,0 +1,442 @@
+#include "loop_hoister.h"
+#include <script/compiler/compiler.h>
+#include <parse/token.h>
+#include <common/stringutil.h>
+
+namespace script
+{
+	namespace compiler
+	{
+		bool LoopHoister::chain(ast::Expression& e, Chain& c)
+		{
+			if (auto* n = e.cast<ast::Identifier>())
+			{
+				if (!n->file_reference.empty())
+					return false;
+				c.root = util::string::to_lower(n->name);
+				return true;
+			}
+			auto* n = e.cast<ast::MemberExpression>();
+			std::string prop;
+			if (!n || !get_property(*n->prop, prop, n->op) || !chain(*n->object, c))
+				return false;
+			c.fields.push_back(util::string::to_lower(prop));
+			c.nodes.push_back(n);
+			return true;
+		}
+
+		std::string LoopHoister::key(const Chain& c, size_t depth)
+		{
+			std::string k = c.root;
+			for (size_t i = 0; i < depth; ++i)
+				k += "." + c.fields[i];
+			return k;
+		}
+
+		//chains the test always evaluates, if they throw after hoisting they'd have thrown on the first test anyway
+		void LoopHoister::evaluated(ast::Expression& e, std::unordered_set<std::string>& keys)
+		{
+			if (auto* n = e.cast<ast::MemberExpression>())
+			{
+				Chain c;
+				if (chain(e, c))
+				{
+					for (size_t depth = 1; depth <= c.fields.size(); ++depth)
+						keys.insert(key(c, depth));
+					return;
+				}
+				evaluated(*n->object, keys);
+				evaluated(*n->prop, keys);
+			}
+			else if (auto* n = e.cast<ast::BinaryExpression>())
+			{
+				evaluated(*n->left, keys);
+				if (n->op != parse::TokenType_kAndAnd)
+					evaluated(*n->right, keys);
+			}
+			else if (auto* n = e.cast<ast::UnaryExpression>())
+			{
+				if (n->op != parse::TokenType_kPlusPlus && n->op != parse::TokenType_kMinusMinus)
+					evaluated(*n->argument, keys);
+			}
+			else if (auto* n = e.cast<ast::ConditionalExpression>())
+				evaluated(*n->condition, keys);
+			else if (auto* n = e.cast<ast::CallExpression>())
+			{
+				if (n->object)
+					evaluated(*n->object, keys);
+				for (auto& arg : n->arguments)
+					evaluated(*arg, keys);
+			}
+			else if (auto* n = e.cast<ast::VectorExpression>())
+			{
+				for (auto& el : n->elements)
+					evaluated(*el, keys);
+			}
+		}
+
+		bool LoopHoister::invariant(const Loop& loop, const Chain& c, size_t depth)
+		{
+			auto& fx = loop.effects;
+			if (fx.variables.find(c.root) != fx.variables.end())
+				return false;
+			for (size_t i = 0; i < depth; ++i)
+			{
+				if (fx.fields.find(c.fields[i]) != fx.fields.end())
+					return false;
+				if (c.fields[i] == "size" && fx.stores)
+					return false;
+			}
+			return true;
+		}
+
+		bool LoopHoister::safe(const Loop& loop, const Chain& c, size_t depth)
+		{
+			if (loop.evaluated.find(key(c, depth)) != loop.evaluated.end())
+				return true;
+			//always objects, loading a field from them can't throw
+			if (depth != 1)
+				return false;
+			return c.root == "level" || c.root == "game" || (c.root == "self" && !m_self_assigned);
+		}
+
+		std::string LoopHoister::hoist(Loop& loop, const Chain& c, size_t depth, ast::Node& at)
+		{
+			std::string k = key(c, depth);
+			auto fnd = loop.temporaries.find(k);
+			if (fnd != loop.temporaries.end())
+				return fnd->second;
+
+			//start from the longest part that already has a temporary
+			size_t from = depth - 1;
+			ast::ExpressionPtr value;
+			for (; from > 0; --from)
+			{
+				auto prefix = loop.temporaries.find(key(c, from));
+				if (prefix != loop.temporaries.end())
+				{
+					value = ast::make<ast::Identifier>(prefix->second);
+					break;
+				}
+			}
+			if (!value)
+				value = ast::make<ast::Identifier>(c.nodes[0]->object->cast<ast::Identifier>()->name);
+			value->debug = at.debug;
+			for (size_t i = from; i < depth; ++i)
+			{
+				auto* node = c.nodes[i];
+				auto mem = ast::make<ast::MemberExpression>();
+				mem->op = node->op;
+				mem->object = std::move(value);
+				if (auto* id = node->prop->cast<ast::Identifier>())
+					mem->prop = ast::make<ast::Identifier>(id->name);
+				else
+				{
+					auto* lit = node->prop->cast<ast::Literal>();
+					auto copy = ast::make<ast::Literal>();
+					copy->type = lit->type;
+					copy->value = lit->value;
+					mem->prop = std::move(copy);
+				}
+				mem->prop->debug = node->prop->debug;
+				mem->debug = node->debug;
+				value = std::move(mem);
+			}
+
+			std::string name = "$licm" + std::to_string(m_temporaries++);
+			auto assignment = ast::make<ast::AssignmentExpression>();
+			assignment->op = '=';
+			assignment->lhs = ast::make<ast::Identifier>(name);
+			assignment->lhs->debug = at.debug;
+			assignment->rhs = std::move(value);
+			assignment->debug = at.debug;
+			auto stmt = ast::make<ast::ExpressionStatement>();
+			stmt->expression = std::move(assignment);
+			stmt->debug = at.debug;
+			loop.hoisted.push_back(std::move(stmt));
+			loop.temporaries[k] = name;
+			return name;
+		}
+
+		void LoopHoister::replace_lvalue(Loop& loop, ast::ExpressionPtr& e)
+		{
+			//the path to what gets stored to has to stay as it is, it creates the fields it walks over
+			auto* member = e->cast<ast::MemberExpression>();
+			if (!member)
+				return;
+			replace_lvalue(loop, member->object);
+			std::string prop;
+			if (!get_property(*member->prop, prop, member->op))
+				replace(loop, member->prop);
+		}
+
+		void LoopHoister::replace(Loop& loop, ast::ExpressionPtr& e)
+		{
+			if (!e)
+				return;
+			if (auto* n = e->cast<ast::MemberExpression>())
+			{
+				Chain c;
+				if (!chain(*e, c))
+				{
+					replace(loop, n->object);
+					std::string prop;
+					if (!get_property(*n->prop, prop, n->op))
+						replace(loop, n->prop);
+					return;
+				}
+				size_t depth = c.fields.size();
+				for (; depth > 0; --depth)
+				{
+					if (invariant(loop, c, depth) && safe(loop, c, depth))
+						break;
+				}
+				if (depth == 0)
+					return;
+				auto temporary = ast::make<ast::Identifier>(hoist(loop, c, depth, *c.nodes[depth - 1]));
+				temporary->debug = c.nodes[depth - 1]->debug;
+				if (depth == c.fields.size())
+					e = std::move(temporary);
+				else
+					c.nodes[depth]->object = std::move(temporary);
+			}
+			else if (auto* n = e->cast<ast::BinaryExpression>())
+			{
+				replace(loop, n->left);
+				replace(loop, n->right);
+			}
+			else if (auto* n = e->cast<ast::UnaryExpression>())
+			{
+				if (n->op == parse::TokenType_kPlusPlus || n->op == parse::TokenType_kMinusMinus)
+					replace_lvalue(loop, n->argument);
+				else
+					replace(loop, n->argument);
+			}
+			else if (auto* n = e->cast<ast::AssignmentExpression>())
+			{
+				replace(loop, n->rhs);
+				replace_lvalue(loop, n->lhs);
+			}
+			else if (auto* n = e->cast<ast::CallExpression>())
+			{
+				replace(loop, n->object);
+				auto* id = n->callee->cast<ast::Identifier>();
+				if (!n->pointer && id && util::string::to_lower(id->name) == "waittill")
+				{
+					//the rest are the variables the arguments of the notify get stored to
+					if (!n->arguments.empty())
+						replace(loop, n->arguments[0]);
+					return;
+				}
+				for (auto& arg : n->arguments)
+					replace(loop, arg);
+				if (n->pointer)
+					replace(loop, n->callee);
+			}
+			else if (auto* n = e->cast<ast::ConditionalExpression>())
+			{
+				replace(loop, n->condition);
+				replace(loop, n->consequent);
+				replace(loop, n->alternative);
+			}
+			else if (auto* n = e->cast<ast::VectorExpression>())
+			{
+				for (auto& el : n->elements)
+					replace(loop, el);
+			}
+			else if (auto* n = e->cast<ast::ArrayExpression>())
+			{
+				for (auto& el : n->elements)
+					replace(loop, el);
+			}
+		}
+
+		void LoopHoister::replace(Loop& loop, ast::Statement& s)
+		{
+			if (auto* n = s.cast<ast::BlockStatement>())
+			{
+				for (auto& stmt : n->body)
+					replace(loop, *stmt);
+			}
+			else if (auto* n = s.cast<ast::ExpressionStatement>())
+				replace(loop, n->expression);
+			else if (auto* n = s.cast<ast::IfStatement>())
+			{
+				replace(loop, n->test);
+				replace(loop, *n->consequent);
+				if (n->alternative)
+					replace(loop, *n->alternative);
+			}
+			else if (auto* n = s.cast<ast::WhileStatement>())
+			{
+				replace(loop, n->test);
+				replace(loop, *n->body);
+			}
+			else if (auto* n = s.cast<ast::ForStatement>())
+			{
+				replace(loop, n->init);
+				replace(loop, n->test);
+				replace(loop, n->update);
+				replace(loop, *n->body);
+			}
+			else if (auto* n = s.cast<ast::DoWhileStatement>())
+			{
+				replace(loop, n->test);
+				replace(loop, *n->body);
+			}
+			else if (auto* n = s.cast<ast::ReturnStatement>())
+				replace(loop, n->argument);
+			else if (auto* n = s.cast<ast::WaitStatement>())
+				replace(loop, n->duration);
+			else if (auto* n = s.cast<ast::SwitchStatement>())
+			{
+				replace(loop, n->discriminant);
+				//shared statements get visited more than once, the second time there's nothing left to replace
+				for (auto& c : n->cases)
+				{
+					for (auto& stmt : c->consequent)
+						replace(loop, *stmt);
+				}
+			}
+		}
+
+		//returns { init; hoisted loads; loop } or nullptr if nothing could be hoisted
+		ast::StatementPtr LoopHoister::hoist_loop(ast::Statement& s)
+		{
+			auto* while_loop = s.cast<ast::WhileStatement>();
+			auto* for_loop = s.cast<ast::ForStatement>();
+			if (!while_loop && !for_loop)
+				return nullptr;
+			auto& test = while_loop ? while_loop->test : for_loop->test;
+			auto& body = while_loop ? while_loop->body : for_loop->body;
+
+			Loop loop;
+			m_analysis.expression(test.get(), loop.effects);
+			if (for_loop)
+				m_analysis.expression(for_loop->update.get(), loop.effects);
+			m_analysis.statement(*body, loop.effects);
+			if (loop.effects.all)
+				return nullptr;
+			if (test)
+				evaluated(*test, loop.evaluated);
+			replace(loop, test);
+			if (for_loop)
+				replace(loop, for_loop->update);
+			replace(loop, *body);
+			if (loop.hoisted.empty())
+				return nullptr;
+			m_hoisted += loop.hoisted.size();
+
+			auto block = ast::make<ast::BlockStatement>();
+			block->debug = s.debug;
+			ast::StatementPtr moved;
+			if (while_loop)
+			{
+				auto n = ast::make<ast::WhileStatement>();
+				n->test = std::move(while_loop->test);
+				n->body = std::move(while_loop->body);
+				moved = std::move(n);
+			}
+			else
+			{
+				//the init may assign what the hoisted loads read, it goes first
+				if (for_loop->init)
+				{
+					auto init = ast::make<ast::ExpressionStatement>();
+					init->debug = for_loop->init->debug;
+					init->expression = std::move(for_loop->init);
+					block->body.push_back(std::move(init));
+				}
+				auto n = ast::make<ast::ForStatement>();
+				n->test = std::move(for_loop->test);
+				n->update = std::move(for_loop->update);
+				n->body = std::move(for_loop->body);
+				moved = std::move(n);
+			}
+			moved->debug = s.debug;
+			moved->start = s.start;
+			moved->end = s.end;
+			for (auto& stmt : loop.hoisted)
+				block->body.push_back(std::move(stmt));
+			block->body.push_back(std::move(moved));
+			return block;
+		}
+
+		void LoopHoister::visit_children(ast::Statement& s)
+		{
+			if (auto* n = s.cast<ast::BlockStatement>())
+			{
+				for (auto& stmt : n->body)
+					visit(stmt);
+			}
+			else if (auto* n = s.cast<ast::IfStatement>())
+			{
+				visit(n->consequent);
+				if (n->alternative)
+					visit(n->alternative);
+			}
+			else if (auto* n = s.cast<ast::WhileStatement>())
+				visit(n->body);
+			else if (auto* n = s.cast<ast::ForStatement>())
+				visit(n->body);
+			else if (auto* n = s.cast<ast::DoWhileStatement>())
+				visit(n->body);
+			else if (auto* n = s.cast<ast::SwitchStatement>())
+			{
+				for (auto& c : n->cases)
+				{
+					for (auto& stmt : c->consequent)
+						visit_shared(stmt);
+				}
+			}
+		}
+
+		//inner loops go first, what they hoist can then be hoisted further by the outer ones
+		void LoopHoister::visit(ast::StatementPtr& s)
+		{
+			if (!m_visited.insert(s.get()).second)
+				return;
+			visit_children(*s);
+			auto replacement = hoist_loop(*s);
+			if (replacement)
+				s = std::move(replacement);
+		}
+
+		void LoopHoister::visit_shared(ast::Statement*& s)
+		{
+			auto fnd = m_replaced_shared.find(s);
+			if (fnd != m_replaced_shared.end())
+			{
+				s = fnd->second;
+				return;
+			}
+			if (!m_visited.insert(s).second)
+				return;
+			visit_children(*s);
+			auto replacement = hoist_loop(*s);
+			if (replacement)
+			{
+				//the old one stays in the arena, its address can't be reused while it's still a key
+				m_replaced_shared[s] = replacement.get();
+				s = replacement.release();
+			}
+		}
+
+		size_t LoopHoister::hoist(const std::string& file, ast::FunctionDeclaration& n)
+		{
+			if (!m_options.hoist_loop_invariants || !n.body)
+				return 0;
+			m_analysis.set_file(file);
+			m_hoisted = 0;
+			m_temporaries = 0;
+			m_visited.clear();
+			m_replaced_shared.clear();
+			EffectAnalysis::Effects fx;
+			m_analysis.statement(*n.body, fx);
+			m_self_assigned = fx.variables.find("self") != fx.variables.end();
+			visit(n.body);
+			m_replaced_shared.clear();
+			return m_hoisted;
+		}
+	}; // namespace compiler
+};	   // namespace script
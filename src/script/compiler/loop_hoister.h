@@ -0,0 +1,70 @@
+#pragma once
+#include <script/compiler/optimizer.h>
+#include <script/compiler/effect_analysis.h>
+#include <script/ast/nodes.h>
+#include <unordered_set>
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+namespace script
+{
+	namespace compiler
+	{
+		//moves loads of member chains that can't change inside a for or while loop (level.players.size) in front of it
+		//a chain stays in the loop if its base variable or any field with the same name may get stored to in it
+		//waits, pointer calls and calls to functions that aren't known keep everything in the loop
+		class LoopHoister
+		{
+			EffectAnalysis m_analysis;
+			const Optimizer::Options& m_options;
+			bool m_self_assigned = false;
+			size_t m_temporaries = 0;
+			size_t m_hoisted = 0;
+			std::unordered_set<ast::Statement*> m_visited;
+			//switch cases share their statements, keep track of what already got replaced
+			std::unordered_map<ast::Statement*, ast::Statement*> m_replaced_shared;
+
+			struct Chain
+			{
+				std::string root;
+				//lowercase field names from the root outwards
+				std::vector<std::string> fields;
+				//the member expression of every field
+				std::vector<ast::MemberExpression*> nodes;
+			};
+			struct Loop
+			{
+				EffectAnalysis::Effects effects;
+				//chains evaluated every time the test is, these are known to not throw when hoisted
+				std::unordered_set<std::string> evaluated;
+				std::unordered_map<std::string, std::string> temporaries;
+				std::vector<ast::StatementPtr> hoisted;
+			};
+
+			static bool chain(ast::Expression& e, Chain& c);
+			static std::string key(const Chain& c, size_t depth);
+
+			void evaluated(ast::Expression& e, std::unordered_set<std::string>& keys);
+			bool invariant(const Loop& loop, const Chain& c, size_t depth);
+			bool safe(const Loop& loop, const Chain& c, size_t depth);
+			std::string hoist(Loop& loop, const Chain& c, size_t depth, ast::Node& at);
+			void replace(Loop& loop, ast::ExpressionPtr& e);
+			void replace_lvalue(Loop& loop, ast::ExpressionPtr& e);
+			void replace(Loop& loop, ast::Statement& s);
+
+			ast::StatementPtr hoist_loop(ast::Statement& s);
+			void visit(ast::StatementPtr& s);
+			void visit_shared(ast::Statement*& s);
+			void visit_children(ast::Statement& s);
+
+		  public:
+			LoopHoister(script::ReferenceMap& refmap, const Optimizer::Options& options)
+				: m_analysis(refmap, options), m_options(options)
+			{
+			}
+			//returns the amount of loads that got moved out of loops
+			size_t hoist(const std::string& file, ast::FunctionDeclaration& n);
+		};
+	}; // namespace compiler
+};	   // namespace script
@@ -0,0 +1,495 @@
+#include "member_cse.h"
+#include <script/compiler/compiler.h>
+#include <parse/token.h>
+#include <common/stringutil.h>
+#include <algorithm>
+
+namespace script
+{
+	namespace compiler
+	{
+		//these get a component out of a vector instead of throwing
+		static bool is_vector_component(const std::string& field)
+		{
+			return field.empty() || std::string("xyz012").find(field[0]) != std::string::npos;
+		}
+
+		bool MemberCSE::chain(ast::Expression& e, Chain& c)
+		{
+			if (auto* n = e.cast<ast::Identifier>())
+			{
+				if (!n->file_reference.empty())
+					return false;
+				c.root = util::string::to_lower(n->name);
+				return true;
+			}
+			auto* n = e.cast<ast::MemberExpression>();
+			if (!n || !chain(*n->object, c))
+				return false;
+			Part part;
+			auto* key = n->prop->cast<ast::Identifier>();
+			if (get_property(*n->prop, part.name, n->op))
+				part.name = util::string::to_lower(part.name);
+			else if (key && key->file_reference.empty())
+			{
+				part.name = util::string::to_lower(key->name);
+				part.variable = true;
+			}
+			else
+				return false;
+			c.parts.push_back(part);
+			c.nodes.push_back(n);
+			return true;
+		}
+
+		std::string MemberCSE::key(const Chain& c, size_t depth)
+		{
+			std::string k = c.root;
+			for (size_t i = 0; i < depth; ++i)
+				k += c.parts[i].variable ? "[" + c.parts[i].name + "]" : "." + c.parts[i].name;
+			return k;
+		}
+
+		bool MemberCSE::invariant(const EffectAnalysis::Effects& fx, const Chain& c, size_t depth)
+		{
+			if (fx.all || fx.variables.find(c.root) != fx.variables.end())
+				return false;
+			for (size_t i = 0; i < depth; ++i)
+			{
+				auto& part = c.parts[i];
+				if (part.variable)
+				{
+					//the field it names could be any that got stored to
+					if (fx.stores || fx.variables.find(part.name) != fx.variables.end())
+						return false;
+				}
+				else if (fx.fields.find(part.name) != fx.fields.end() || (part.name == "size" && fx.stores))
+					return false;
+			}
+			return true;
+		}
+
+		ast::ExpressionPtr MemberCSE::clone_property(ast::Expression& prop)
+		{
+			ast::ExpressionPtr result;
+			if (auto* id = prop.cast<ast::Identifier>())
+				result = ast::make<ast::Identifier>(id->name);
+			else
+			{
+				auto* lit = prop.cast<ast::Literal>();
+				auto copy = ast::make<ast::Literal>();
+				copy->type = lit->type;
+				copy->value = lit->value;
+				copy->integer = lit->integer;
+				copy->number = lit->number;
+				result = std::move(copy);
+			}
+			result->debug = prop.debug;
+			return result;
+		}
+
+		//starts from the longest prefix that has a temporary as well
+		ast::ExpressionPtr MemberCSE::build(Run& run, Definition& def, ast::Node& at)
+		{
+			size_t from = 0;
+			ast::ExpressionPtr value;
+			for (size_t i = def.prefixes.size(); i > 0; --i)
+			{
+				int prefix = def.prefixes[i - 1];
+				if (prefix >= 0 && run.definitions[prefix].selected)
+				{
+					value = ast::make<ast::Identifier>(run.definitions[prefix].temporary);
+					from = i;
+					break;
+				}
+			}
+			if (!value)
+				value = ast::make<ast::Identifier>(def.root);
+			value->debug = at.debug;
+			for (size_t i = from; i < def.depth; ++i)
+			{
+				auto mem = ast::make<ast::MemberExpression>();
+				mem->op = def.ops[i];
+				mem->object = std::move(value);
+				mem->prop = clone_property(*def.props[i]);
+				mem->debug = at.debug;
+				value = std::move(mem);
+			}
+			return value;
+		}
+
+		void MemberCSE::collect(ast::ExpressionPtr& e, bool conditional, std::vector<Occurrence>& out)
+		{
+			if (!e)
+				return;
+			if (auto* n = e->cast<ast::MemberExpression>())
+			{
+				Occurrence o;
+				if (chain(*e, o.chain))
+				{
+					o.slot = &e;
+					o.conditional = conditional;
+					out.push_back(std::move(o));
+					return;
+				}
+				collect(n->object, conditional, out);
+				std::string prop;
+				if (!get_property(*n->prop, prop, n->op))
+					collect(n->prop, conditional, out);
+			}
+			else if (auto* n = e->cast<ast::BinaryExpression>())
+			{
+				collect(n->left, conditional, out);
+				collect(n->right, conditional || n->op == parse::TokenType_kAndAnd, out);
+			}
+			else if (auto* n = e->cast<ast::UnaryExpression>())
+			{
+				if (n->op == parse::TokenType_kPlusPlus || n->op == parse::TokenType_kMinusMinus)
+					collect_lvalue(n->argument, false, out);
+				else
+					collect(n->argument, conditional, out);
+			}
+			else if (auto* n = e->cast<ast::AssignmentExpression>())
+			{
+				collect(n->rhs, conditional, out);
+				collect_lvalue(n->lhs, false, out);
+			}
+			else if (auto* n = e->cast<ast::CallExpression>())
+			{
+				collect(n->object, conditional, out);
+				auto* id = n->callee->cast<ast::Identifier>();
+				if (!n->pointer && id && util::string::to_lower(id->name) == "waittill")
+				{
+					if (!n->arguments.empty())
+						collect(n->arguments[0], conditional, out);
+					return;
+				}
+				for (auto& arg : n->arguments)
+					collect(arg, conditional, out);
+				if (n->pointer)
+					collect(n->callee, conditional, out);
+			}
+			else if (auto* n = e->cast<ast::ConditionalExpression>())
+			{
+				collect(n->condition, conditional, out);
+				collect(n->consequent, true, out);
+				collect(n->alternative, true, out);
+			}
+			else if (auto* n = e->cast<ast::VectorExpression>())
+			{
+				for (auto& el : n->elements)
+					collect(el, conditional, out);
+			}
+			else if (auto* n = e->cast<ast::ArrayExpression>())
+			{
+				for (auto& el : n->elements)
+					collect(el, conditional, out);
+			}
+		}
+
+		//only the object of the field a statement stores to can use a temporary, the computed keys on the way are loads like any other
+		void MemberCSE::collect_lvalue(ast::ExpressionPtr& e, bool top, std::vector<Occurrence>& out)
+		{
+			auto* member = e->cast<ast::MemberExpression>();
+			if (!member)
+				return;
+			std::string prop;
+			if (!get_property(*member->prop, prop, member->op))
+				collect(member->prop, false, out);
+			Occurrence o;
+			if (top && member->object->cast<ast::MemberExpression>() && chain(*member->object, o.chain))
+			{
+				o.slot = &member->object;
+				o.lvalue = true;
+				out.push_back(std::move(o));
+				return;
+			}
+			collect_lvalue(member->object, false, out);
+		}
+
+		void MemberCSE::keys(ast::Expression& lhs, EffectAnalysis::Effects& fx)
+		{
+			auto* member = lhs.cast<ast::MemberExpression>();
+			if (!member)
+				return;
+			std::string prop;
+			if (!get_property(*member->prop, prop, member->op))
+				m_analysis.expression(member->prop.get(), fx);
+			keys(*member->object, fx);
+		}
+
+		void MemberCSE::invalidate(Run& run, const EffectAnalysis::Effects& fx)
+		{
+			for (auto it = run.available.begin(); it != run.available.end();)
+			{
+				auto& def = run.definitions[it->second];
+				if (!invariant(fx, def.chain, def.depth))
+					it = run.available.erase(it);
+				else
+					++it;
+			}
+		}
+
+		void MemberCSE::use(Run& run, size_t statement, Occurrence& o, const EffectAnalysis::Effects& before)
+		{
+			auto& parts = o.chain.parts;
+			//a load only reuses the objects on the way, a store can reuse the object it stores to as well
+			size_t max = o.lvalue ? parts.size() : parts.size() - 1;
+			o.defs.assign(max, -1);
+			for (size_t depth = 1; depth <= max; ++depth)
+			{
+				if (!invariant(before, o.chain, depth))
+					break;
+				std::string k = key(o.chain, depth);
+				auto fnd = run.available.find(k);
+				if (fnd != run.available.end())
+				{
+					//storing through a temporary holding undefined or a vector wouldn't store to the original
+					if (o.lvalue && !run.definitions[fnd->second].object)
+						continue;
+					o.defs[depth - 1] = fnd->second;
+					continue;
+				}
+				//the temporary is loaded in front of the statement, that's only the same if it's always loaded in it
+				if (o.lvalue || o.conditional)
+					continue;
+				Definition def;
+				def.chain.root = o.chain.root;
+				def.chain.parts = parts;
+				def.statement = statement;
+				def.depth = depth;
+				def.root = o.chain.nodes[0]->object->cast<ast::Identifier>()->name;
+				for (size_t i = 0; i < depth; ++i)
+				{
+					def.ops.push_back(o.chain.nodes[i]->op);
+					def.props.push_back(clone_property(*o.chain.nodes[i]->prop));
+				}
+				def.prefixes.assign(o.defs.begin(), o.defs.begin() + (depth - 1));
+				int index = (int)run.definitions.size();
+				run.definitions.push_back(std::move(def));
+				run.available[k] = index;
+				o.defs[depth - 1] = index;
+			}
+			if (o.lvalue || o.conditional)
+				return;
+			for (size_t depth = 1; depth < parts.size(); ++depth)
+			{
+				if (o.defs[depth - 1] >= 0 && !parts[depth].variable && !is_vector_component(parts[depth].name))
+					run.definitions[o.defs[depth - 1]].object = true;
+			}
+		}
+
+		void MemberCSE::analyze(Run& run, size_t statement, ast::ExpressionPtr& e)
+		{
+			std::vector<Occurrence> found;
+			//what happens before the loads in the statement, the store of an assignment happens after all of them
+			EffectAnalysis::Effects before, after;
+			auto* assignment = e->cast<ast::AssignmentExpression>();
+			auto* unary = e->cast<ast::UnaryExpression>();
+			if (assignment)
+			{
+				collect(assignment->rhs, false, found);
+				collect_lvalue(assignment->lhs, true, found);
+				m_analysis.expression(assignment->rhs.get(), before);
+				keys(*assignment->lhs, before);
+			}
+			else if (unary && (unary->op == parse::TokenType_kPlusPlus || unary->op == parse::TokenType_kMinusMinus))
+			{
+				collect_lvalue(unary->argument, true, found);
+				keys(*unary->argument, before);
+			}
+			else
+			{
+				collect(e, false, found);
+				m_analysis.expression(e.get(), before);
+			}
+			m_analysis.expression(e.get(), after);
+
+			invalidate(run, before);
+			//the right hand side is evaluated first, it may show the object stored to is one
+			for (auto& o : found)
+			{
+				if (!o.lvalue)
+					use(run, statement, o, before);
+			}
+			for (auto& o : found)
+			{
+				if (o.lvalue)
+					use(run, statement, o, before);
+			}
+			invalidate(run, after);
+			for (auto& o : found)
+				run.occurrences.push_back(std::move(o));
+		}
+
+		//a temporary costs a store and a load, it's only worth it if it saves at least two field lookups
+		void MemberCSE::select(Run& run)
+		{
+			std::vector<int> order;
+			for (size_t i = 0; i < run.definitions.size(); ++i)
+				order.push_back((int)i);
+			std::stable_sort(order.begin(), order.end(),
+							 [&](int a, int b) { return run.definitions[a].depth > run.definitions[b].depth; });
+			for (int index : order)
+			{
+				auto& def = run.definitions[index];
+				size_t uses = 0;
+				for (auto& o : run.occurrences)
+				{
+					if (o.claimed == 0 && o.defs.size() >= def.depth && o.defs[def.depth - 1] == index)
+						++uses;
+				}
+				//the longer ones get built from it
+				for (auto& longer : run.definitions)
+				{
+					if (longer.selected && longer.prefixes.size() >= def.depth && longer.prefixes[def.depth - 1] == index)
+						++uses;
+				}
+				if (uses < 2 || (uses - 1) * def.depth < 2)
+					continue;
+				def.selected = true;
+				for (auto& o : run.occurrences)
+				{
+					if (o.claimed == 0 && o.defs.size() >= def.depth && o.defs[def.depth - 1] == index)
+						o.claimed = def.depth;
+				}
+			}
+		}
+
+		void MemberCSE::rewrite(Run& run, ast::List<ast::StatementPtr>& body)
+		{
+			bool any = false;
+			for (auto& def : run.definitions)
+			{
+				if (!def.selected)
+					continue;
+				def.temporary = "$cse" + std::to_string(m_temporaries++);
+				any = true;
+			}
+			if (!any)
+				return;
+
+			std::vector<ast::StatementPtr> hoisted(run.definitions.size());
+			for (size_t i = 0; i < run.definitions.size(); ++i)
+			{
+				auto& def = run.definitions[i];
+				if (!def.selected)
+					continue;
+				auto& at = *body[def.statement];
+				auto assignment = ast::make<ast::AssignmentExpression>();
+				assignment->op = '=';
+				assignment->lhs = ast::make<ast::Identifier>(def.temporary);
+				assignment->lhs->debug = at.debug;
+				assignment->rhs = build(run, def, at);
+				assignment->debug = at.debug;
+				auto stmt = ast::make<ast::ExpressionStatement>();
+				stmt->expression = std::move(assignment);
+				stmt->debug = at.debug;
+				hoisted[i] = std::move(stmt);
+			}
+
+			for (auto& o : run.occurrences)
+			{
+				if (o.claimed == 0)
+					continue;
+				auto& def = run.definitions[o.defs[o.claimed - 1]];
+				auto temporary = ast::make<ast::Identifier>(def.temporary);
+				if (o.claimed == o.chain.parts.size())
+				{
+					temporary->debug = (*o.slot)->debug;
+					*o.slot = std::move(temporary);
+				}
+				else
+				{
+					auto& object = o.chain.nodes[o.claimed]->object;
+					temporary->debug = object->debug;
+					object = std::move(temporary);
+				}
+				++m_reused;
+			}
+
+			ast::List<ast::StatementPtr> result;
+			for (size_t i = 0; i < body.size(); ++i)
+			{
+				for (size_t k = 0; k < run.definitions.size(); ++k)
+				{
+					if (hoisted[k] && run.definitions[k].statement == i)
+						result.push_back(std::move(hoisted[k]));
+				}
+				result.push_back(std::move(body[i]));
+			}
+			body = std::move(result);
+		}
+
+		void MemberCSE::block(ast::List<ast::StatementPtr>& body)
+		{
+			Run run;
+			for (size_t i = 0; i < body.size(); ++i)
+			{
+				auto& s = *body[i];
+				visit(s);
+				if (auto* n = s.cast<ast::ExpressionStatement>())
+					analyze(run, i, n->expression);
+				else if (s.cast<ast::EmptyStatement>())
+					continue;
+				else
+				{
+					//the expression of these is still evaluated in line with the statements before it
+					if (auto* n = s.cast<ast::IfStatement>())
+						analyze(run, i, n->test);
+					else if (auto* n = s.cast<ast::ReturnStatement>())
+					{
+						if (n->argument)
+							analyze(run, i, n->argument);
+					}
+					else if (auto* n = s.cast<ast::WaitStatement>())
+						analyze(run, i, n->duration);
+					run.available.clear();
+				}
+			}
+			select(run);
+			rewrite(run, body);
+		}
+
+		void MemberCSE::visit(ast::Statement& s)
+		{
+			if (!m_visited.insert(&s).second)
+				return;
+			if (auto* n = s.cast<ast::BlockStatement>())
+				block(n->body);
+			else if (auto* n = s.cast<ast::IfStatement>())
+			{
+				visit(*n->consequent);
+				if (n->alternative)
+					visit(*n->alternative);
+			}
+			else if (auto* n = s.cast<ast::WhileStatement>())
+				visit(*n->body);
+			else if (auto* n = s.cast<ast::ForStatement>())
+				visit(*n->body);
+			else if (auto* n = s.cast<ast::DoWhileStatement>())
+				visit(*n->body);
+			else if (auto* n = s.cast<ast::SwitchStatement>())
+			{
+				//cases share their statements, a temporary made in one case wouldn't exist when jumping to the next
+				for (auto& c : n->cases)
+				{
+					for (auto& stmt : c->consequent)
+						visit(*stmt);
+				}
+			}
+		}
+
+		size_t MemberCSE::eliminate(const std::string& file, ast::FunctionDeclaration& n)
+		{
+			if (!m_options.eliminate_common_subexpressions || !n.body)
+				return 0;
+			m_analysis.set_file(file);
+			m_reused = 0;
+			m_temporaries = 0;
+			m_visited.clear();
+			visit(*n.body);
+			return m_reused;
+		}
+	}; // namespace compiler
+};	   // namespace script
@@ -0,0 +1,100 @@
+#pragma once
+#include <script/compiler/optimizer.h>
+#include <script/compiler/effect_analysis.h>
+#include <script/ast/nodes.h>
+#include <unordered_set>
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+namespace script
+{
+	namespace compiler
+	{
+		//block local common subexpression elimination for the objects member chains walk over
+		//self.pers["stats"]["kills"] and self.pers["stats"]["deaths"] in the same straight line code load self.pers["stats"] once into a temporary
+		//a temporary lives until a statement may store to its variables or a field with one of its names, calls and waits usually end it
+		class MemberCSE
+		{
+			EffectAnalysis m_analysis;
+			const Optimizer::Options& m_options;
+			size_t m_temporaries = 0;
+			size_t m_reused = 0;
+			std::unordered_set<ast::Statement*> m_visited;
+
+			struct Part
+			{
+				//lowercase field name, or the variable holding it
+				std::string name;
+				bool variable = false;
+			};
+			struct Chain
+			{
+				std::string root;
+				std::vector<Part> parts;
+				//the member expression of every part
+				std::vector<ast::MemberExpression*> nodes;
+			};
+			struct Occurrence
+			{
+				ast::ExpressionPtr* slot;
+				Chain chain;
+				bool conditional = false;
+				//the object of a field that gets stored to
+				bool lvalue = false;
+				//the definition of the prefix of every length, -1 if there is none
+				std::vector<int> defs;
+				//length of the longest prefix that got a temporary
+				size_t claimed = 0;
+			};
+			struct Definition
+			{
+				Chain chain;
+				size_t statement;
+				size_t depth;
+				//copies of the root and of the properties, the chain itself may already be replaced when it's built
+				std::string root;
+				std::vector<int> ops;
+				std::vector<ast::ExpressionPtr> props;
+				//the definitions of the shorter prefixes that were available when this one was made
+				std::vector<int> prefixes;
+				//a field that can't be a vector component got loaded from it, so it's safe to store through
+				bool object = false;
+				bool selected = false;
+				std::string temporary;
+			};
+			struct Run
+			{
+				std::vector<Definition> definitions;
+				std::unordered_map<std::string, int> available;
+				std::vector<Occurrence> occurrences;
+			};
+
+			static bool chain(ast::Expression& e, Chain& c);
+			static std::string key(const Chain& c, size_t depth);
+			static bool invariant(const EffectAnalysis::Effects& fx, const Chain& c, size_t depth);
+			static ast::ExpressionPtr clone_property(ast::Expression& prop);
+			ast::ExpressionPtr build(Run& run, Definition& def, ast::Node& at);
+
+			void collect(ast::ExpressionPtr& e, bool conditional, std::vector<Occurrence>& out);
+			void collect_lvalue(ast::ExpressionPtr& e, bool top, std::vector<Occurrence>& out);
+			void keys(ast::Expression& lhs, EffectAnalysis::Effects& fx);
+			void invalidate(Run& run, const EffectAnalysis::Effects& fx);
+			void use(Run& run, size_t statement, Occurrence& o, const EffectAnalysis::Effects& before);
+			void analyze(Run& run, size_t statement, ast::ExpressionPtr& e);
+			void select(Run& run);
+			void rewrite(Run& run, ast::List<ast::StatementPtr>& body);
+
+			void block(ast::List<ast::StatementPtr>& body);
+			void visit(ast::Statement& s);
+
+		  public:
+			MemberCSE(script::ReferenceMap& refmap, const Optimizer::Options& options)
+				: m_analysis(refmap, options), m_options(options)
+			{
+			}
+			//returns the amount of loads that now use a temporary
+			size_t eliminate(const std::string& file, ast::FunctionDeclaration& n);
+		};
+	}; // namespace compiler
+};	   // namespace script
@@ -0,0 +1,76 @@
+#include "native_library.h"
+#include "bytecode_cache.h"
+#include <common/format.h>
+#include <dlfcn.h>
+
+namespace script
+{
+	namespace compiler
+	{
+		NativeLibrary::~NativeLibrary()
+		{
+			if (m_handle)
+				dlclose(m_handle);
+		}
+
+		bool NativeLibrary::open(const std::string& path, std::string& error)
+		{
+			//the path has to have a slash in it or dlopen searches the library paths instead
+			std::string p = path.find('/') == std::string::npos ? "./" + path : path;
+			m_handle = dlopen(p.c_str(), RTLD_NOW | RTLD_LOCAL);
+			if (!m_handle)
+			{
+				error = dlerror();
+				return false;
+			}
+			m_module = (const vm::NativeModule*)dlsym(m_handle, "gsc_module");
+			if (!m_module)
+			{
+				error = common::format("{} has no gsc_module", path);
+				return false;
+			}
+			if (m_module->version != vm::kNativeModuleVersion)
+			{
+				error = common::format("{} was written for version {}, expected {}", path, m_module->version,
+									   vm::kNativeModuleVersion);
+				m_module = nullptr;
+				return false;
+			}
+			return true;
+		}
+
+		bool NativeLibrary::load(CompiledFiles& files, std::string& error) const
+		{
+			if (!m_module)
+			{
+				error = "no module";
+				return false;
+			}
+			for (size_t i = 0; i < m_module->num_files; ++i)
+			{
+				auto& file = m_module->files[i];
+				std::vector<u8> bytecode(file.bytecode, file.bytecode + file.bytecode_size);
+				CompiledFunctions functions;
+				std::vector<std::string> references;
+				//the bytecode version is part of it's header
+				if (!BytecodeCache::deserialize(bytecode, 0, file.name, functions, references))
+				{
+					error = common::format("bytecode of {} doesn't match this version", file.name);
+					return false;
+				}
+				for (size_t k = 0; k < file.num_functions; ++k)
+				{
+					auto fnd = functions.find(file.functions[k].name);
+					if (fnd == functions.end())
+					{
+						error = common::format("{}::{} isn't in the bytecode", file.name, file.functions[k].name);
+						return false;
+					}
+					fnd->second.native = file.functions[k].function;
+				}
+				files[file.name] = std::move(functions);
+			}
+			return true;
+		}
+	}; // namespace compiler
+};	   // namespace script
@@ -0,0 +1,28 @@
+#pragma once
+#include "compiler.h"
+#include <script/vm/native_module.h>
+#include <string>
+
+namespace script
+{
+	namespace compiler
+	{
+		//a shared object written by gsc2cpp, has to stay open while any of the functions it loaded can run
+		class NativeLibrary
+		{
+			void* m_handle = nullptr;
+			const vm::NativeModule* m_module = nullptr;
+
+		  public:
+			NativeLibrary() = default;
+			NativeLibrary(const NativeLibrary&) = delete;
+			NativeLibrary& operator=(const NativeLibrary&) = delete;
+			~NativeLibrary();
+
+			//false and error set if it can't be opened or was written for a different version
+			bool open(const std::string& path, std::string& error);
+			//the files the module was written for, every function runs the native code in place of it's instructions
+			bool load(CompiledFiles& files, std::string& error) const;
+		};
+	}; // namespace compiler
+};	   // namespace script
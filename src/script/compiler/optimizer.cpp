@@ -0,0 +1,841 @@
+#include "optimizer.h"
+#include "inliner.h"
+#include "loop_hoister.h"
+#include "member_cse.h"
+#include <script/compiler/visitors/variable_reads.h>
+#include <parse/token.h>
+#include <common/stringutil.h>
+#include <common/hash.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace script
+{
+	namespace compiler
+	{
+		//mirrors what VirtualMachine::binop does at runtime, anything that would throw or is undefined behaviour is left alone
+		struct ConstantValue
+		{
+			enum class Type
+			{
+				kInteger,
+				kNumber,
+				kString
+			} type;
+			int integer = 0;
+			float number = 0.f;
+			std::string string;
+		};
+
+		static bool get_constant(ast::Expression* e, ConstantValue& out)
+		{
+			auto* lit = e->cast<ast::Literal>();
+			if (!lit)
+				return false;
+			switch (lit->type)
+			{
+			case ast::Literal::Type::kInteger:
+				out.type = ConstantValue::Type::kInteger;
+				out.integer = lit->integer;
+				return true;
+			case ast::Literal::Type::kNumber:
+				out.type = ConstantValue::Type::kNumber;
+				out.number = lit->number;
+				return true;
+			case ast::Literal::Type::kString:
+				out.type = ConstantValue::Type::kString;
+				out.string = lit->value;
+				return true;
+			default:
+				break;
+			}
+			return false;
+		}
+
+		static ast::ExpressionPtr make_literal(const ConstantValue& v, ast::Node& from)
+		{
+			auto n = ast::make<ast::Literal>();
+			n->debug = from.debug;
+			switch (v.type)
+			{
+			case ConstantValue::Type::kInteger:
+				n->type = ast::Literal::Type::kInteger;
+				n->value = std::to_string(v.integer);
+				n->integer = v.integer;
+				break;
+			case ConstantValue::Type::kNumber:
+			{
+				//the text is only printed, enough digits to read the same float back from it
+				char buf[32];
+				snprintf(buf, sizeof(buf), "%.9g", v.number);
+				n->type = ast::Literal::Type::kNumber;
+				n->value = buf;
+				n->number = v.number;
+			}
+			break;
+			case ConstantValue::Type::kString:
+				n->type = ast::Literal::Type::kString;
+				n->value = v.string;
+				break;
+			}
+			return n;
+		}
+
+		//what Test would do with it, only integers and undefined are allowed there
+		static bool get_truthiness(ast::Expression* e, bool& out)
+		{
+			auto* lit = e->cast<ast::Literal>();
+			if (!lit)
+				return false;
+			if (lit->type == ast::Literal::Type::kUndefined)
+			{
+				out = false;
+				return true;
+			}
+			if (lit->type == ast::Literal::Type::kInteger)
+			{
+				out = lit->integer != 0;
+				return true;
+			}
+			return false;
+		}
+
+		static bool is_pure(ast::Expression* e)
+		{
+			if (e->cast<ast::Identifier>() || e->cast<ast::FunctionPointer>() || e->cast<ast::LocalizedString>())
+				return true;
+			auto* lit = e->cast<ast::Literal>();
+			return lit && lit->type != ast::Literal::Type::kVector;
+		}
+
+		static bool fold_integer(int a, int b, int op, int& r)
+		{
+			switch (op)
+			{
+			case '-':
+				r = (int)((unsigned)a - (unsigned)b);
+				return true;
+			case '+':
+				r = (int)((unsigned)a + (unsigned)b);
+				return true;
+			case '*':
+				r = (int)((unsigned)a * (unsigned)b);
+				return true;
+			case '/':
+				if (b == 0 || (a == INT_MIN && b == -1))
+					return false;
+				r = a / b;
+				return true;
+			case '%':
+				if (b == 0 || (a == INT_MIN && b == -1))
+					return false;
+				r = a % b;
+				return true;
+			case '&':
+				r = a & b;
+				return true;
+			case '|':
+				r = a | b;
+				return true;
+			case parse::TokenType_kLsht:
+				if (b < 0 || b > 31)
+					return false;
+				r = (int)((unsigned)a << b);
+				return true;
+			case parse::TokenType_kRsht:
+				if (b < 0 || b > 31)
+					return false;
+				r = a >> b;
+				return true;
+			case parse::TokenType_kEq:
+				r = a == b ? 1 : 0;
+				return true;
+			case parse::TokenType_kNeq:
+				r = a == b ? 0 : 1;
+				return true;
+			case parse::TokenType_kGeq:
+				r = a >= b ? 1 : 0;
+				return true;
+			case '>':
+				r = a > b ? 1 : 0;
+				return true;
+			case '<':
+				r = a < b ? 1 : 0;
+				return true;
+			case parse::TokenType_kLeq:
+				r = a <= b ? 1 : 0;
+				return true;
+			case parse::TokenType_kAndAnd:
+				r = a && b ? 1 : 0;
+				return true;
+			case parse::TokenType_kOrOr:
+				r = a || b ? 1 : 0;
+				return true;
+			}
+			return false;
+		}
+
+		static bool fold_number(float a, float b, int op, ConstantValue& r)
+		{
+			r.type = ConstantValue::Type::kInteger;
+			switch (op)
+			{
+			case parse::TokenType_kEq:
+				r.integer = a == b ? 1 : 0;
+				return true;
+			case parse::TokenType_kNeq:
+				r.integer = a == b ? 0 : 1;
+				return true;
+			case parse::TokenType_kGeq:
+				r.integer = a >= b ? 1 : 0;
+				return true;
+			case parse::TokenType_kLeq:
+				r.integer = a <= b ? 1 : 0;
+				return true;
+			case '>':
+				r.integer = a > b ? 1 : 0;
+				return true;
+			case '<':
+				r.integer = a < b ? 1 : 0;
+				return true;
+			}
+			r.type = ConstantValue::Type::kNumber;
+			switch (op)
+			{
+			case '-':
+				r.number = a - b;
+				break;
+			case '+':
+				r.number = a + b;
+				break;
+			case '*':
+				r.number = a * b;
+				break;
+			case '/':
+				r.number = a / b;
+				break;
+			case '%':
+				r.number = fmod(a, b);
+				break;
+			default:
+				return false;
+			}
+			return std::isfinite(r.number);
+		}
+
+		static std::string constant_to_string(const ConstantValue& v)
+		{
+			switch (v.type)
+			{
+			case ConstantValue::Type::kInteger:
+				return std::to_string(v.integer);
+			case ConstantValue::Type::kNumber:
+				return std::to_string(v.number);
+			case ConstantValue::Type::kString:
+				break;
+			}
+			return v.string;
+		}
+
+		static bool fold_constants(const ConstantValue& a, const ConstantValue& b, int op, ConstantValue& r)
+		{
+			if (a.type == ConstantValue::Type::kString || b.type == ConstantValue::Type::kString)
+			{
+				std::string sa = constant_to_string(a);
+				std::string sb = constant_to_string(b);
+				switch (op)
+				{
+				case '+':
+					r.type = ConstantValue::Type::kString;
+					r.string = sa + sb;
+					return true;
+				case parse::TokenType_kEq:
+					r.type = ConstantValue::Type::kInteger;
+					r.integer = sa == sb ? 1 : 0;
+					return true;
+				case parse::TokenType_kNeq:
+					r.type = ConstantValue::Type::kInteger;
+					r.integer = sa == sb ? 0 : 1;
+					return true;
+				}
+				return false;
+			}
+			if (a.type == ConstantValue::Type::kNumber || b.type == ConstantValue::Type::kNumber)
+			{
+				float fa = a.type == ConstantValue::Type::kNumber ? a.number : (float)a.integer;
+				float fb = b.type == ConstantValue::Type::kNumber ? b.number : (float)b.integer;
+				return fold_number(fa, fb, op, r);
+			}
+			r.type = ConstantValue::Type::kInteger;
+			return fold_integer(a.integer, b.integer, op, r.integer);
+		}
+
+		//vector literal e.g (0, 0, 1), elements get converted to float by PushVector
+		static bool get_constant_vector(ast::Expression* e, float* out)
+		{
+			auto* vec = e->cast<ast::VectorExpression>();
+			if (!vec || vec->elements.size() != 3)
+				return false;
+			for (size_t i = 0; i < 3; ++i)
+			{
+				ConstantValue v;
+				if (!get_constant(vec->elements[i].get(), v) || v.type == ConstantValue::Type::kString)
+					return false;
+				out[i] = v.type == ConstantValue::Type::kNumber ? v.number : (float)v.integer;
+			}
+			return true;
+		}
+
+		static ast::ExpressionPtr make_vector(const float* v, ast::Node& from)
+		{
+			auto n = ast::make<ast::VectorExpression>();
+			n->debug = from.debug;
+			for (size_t i = 0; i < 3; ++i)
+			{
+				ConstantValue cv;
+				cv.type = ConstantValue::Type::kNumber;
+				cv.number = v[i];
+				n->elements.push_back(make_literal(cv, from));
+			}
+			return n;
+		}
+
+		static bool fold_vector(const float* a, const float* b, int op, float* r)
+		{
+			for (size_t i = 0; i < 3; ++i)
+			{
+				switch (op)
+				{
+				case '-':
+					r[i] = a[i] - b[i];
+					break;
+				case '+':
+					r[i] = a[i] + b[i];
+					break;
+				case '*':
+					r[i] = a[i] * b[i];
+					break;
+				case '/':
+					r[i] = a[i] / b[i];
+					break;
+				default:
+					return false;
+				}
+				if (!std::isfinite(r[i]))
+					return false;
+			}
+			return true;
+		}
+
+		bool Optimizer::fold_binary(ast::ExpressionPtr& e, ast::BinaryExpression& n)
+		{
+			//&& is short circuited by the compiler, the result is always 0 or 1
+			if (n.op == parse::TokenType_kAndAnd)
+			{
+				bool left, right;
+				if (!get_truthiness(n.left.get(), left))
+					return false;
+				ConstantValue r;
+				r.type = ConstantValue::Type::kInteger;
+				if (!left)
+					r.integer = 0;
+				else if (get_truthiness(n.right.get(), right))
+					r.integer = right ? 1 : 0;
+				else
+					return false;
+				e = make_literal(r, n);
+				return true;
+			}
+			ConstantValue a, b, r;
+			if (get_constant(n.left.get(), a) && get_constant(n.right.get(), b))
+			{
+				if (!fold_constants(a, b, n.op, r))
+					return false;
+				e = make_literal(r, n);
+				return true;
+			}
+			float va[3], vb[3], vr[3];
+			if (!get_constant_vector(n.left.get(), va))
+				return false;
+			if (get_constant_vector(n.right.get(), vb))
+			{
+				if (!fold_vector(va, vb, n.op, vr))
+					return false;
+				e = make_vector(vr, n);
+				return true;
+			}
+			//vector op float, VirtualMachine::binop doesn't accept an integer here
+			if (get_constant(n.right.get(), b) && b.type == ConstantValue::Type::kNumber)
+			{
+				vb[0] = vb[1] = vb[2] = b.number;
+				if (!fold_vector(va, vb, n.op, vr))
+					return false;
+				e = make_vector(vr, n);
+				return true;
+			}
+			return false;
+		}
+
+		bool Optimizer::fold_unary(ast::ExpressionPtr& e, ast::UnaryExpression& n)
+		{
+			auto* lit = n.argument->cast<ast::Literal>();
+			if (!lit)
+				return false;
+			ConstantValue v, r;
+			if (n.op == '!' && lit->type == ast::Literal::Type::kUndefined)
+			{
+				r.type = ConstantValue::Type::kInteger;
+				r.integer = 1;
+				e = make_literal(r, n);
+				return true;
+			}
+			if (!get_constant(lit, v) || v.type == ConstantValue::Type::kString)
+				return false;
+			switch (n.op)
+			{
+			case '-':
+				//compiled as 0 - x
+				if (v.type == ConstantValue::Type::kInteger)
+				{
+					r.type = ConstantValue::Type::kInteger;
+					r.integer = (int)(0u - (unsigned)v.integer);
+				}
+				else
+				{
+					r.type = ConstantValue::Type::kNumber;
+					r.number = 0.f - v.number;
+				}
+				break;
+			case '!':
+				if (v.type != ConstantValue::Type::kInteger)
+					return false;
+				r.type = ConstantValue::Type::kInteger;
+				r.integer = !v.integer;
+				break;
+			case '~':
+				if (v.type != ConstantValue::Type::kInteger)
+					return false;
+				r.type = ConstantValue::Type::kInteger;
+				r.integer = ~v.integer;
+				break;
+			default:
+				return false;
+			}
+			e = make_literal(r, n);
+			return true;
+		}
+
+		void Optimizer::fold_lvalue(ast::ExpressionPtr& e)
+		{
+			auto* member = e->cast<ast::MemberExpression>();
+			if (!member)
+				return;
+			fold_lvalue(member->object);
+			if (member->op != '.')
+				fold(member->prop);
+		}
+
+		void Optimizer::fold(ast::ExpressionPtr& e)
+		{
+			if (!e || !m_options.fold_constants)
+				return;
+			if (auto* n = e->cast<ast::BinaryExpression>())
+			{
+				fold(n->left);
+				fold(n->right);
+				if (fold_binary(e, *n))
+					m_changed = true;
+			}
+			else if (auto* n = e->cast<ast::UnaryExpression>())
+			{
+				if (n->op == parse::TokenType_kPlusPlus || n->op == parse::TokenType_kMinusMinus)
+				{
+					fold_lvalue(n->argument);
+					return;
+				}
+				fold(n->argument);
+				if (fold_unary(e, *n))
+					m_changed = true;
+			}
+			else if (auto* n = e->cast<ast::AssignmentExpression>())
+			{
+				fold(n->rhs);
+				fold_lvalue(n->lhs);
+			}
+			else if (auto* n = e->cast<ast::CallExpression>())
+			{
+				fold(n->object);
+				for (auto& arg : n->arguments)
+					fold(arg);
+				if (n->pointer)
+					fold(n->callee);
+			}
+			else if (auto* n = e->cast<ast::ConditionalExpression>())
+			{
+				fold(n->condition);
+				fold(n->consequent);
+				fold(n->alternative);
+				bool truthy;
+				if (get_truthiness(n->condition.get(), truthy))
+				{
+					e = std::move(truthy ? n->consequent : n->alternative);
+					m_changed = true;
+				}
+			}
+			else if (auto* n = e->cast<ast::MemberExpression>())
+			{
+				fold(n->object);
+				if (n->op != '.')
+					fold(n->prop);
+			}
+			else if (auto* n = e->cast<ast::VectorExpression>())
+			{
+				for (auto& el : n->elements)
+					fold(el);
+			}
+			else if (auto* n = e->cast<ast::ArrayExpression>())
+			{
+				for (auto& el : n->elements)
+					fold(el);
+			}
+		}
+
+		static bool terminates(ast::Statement& s)
+		{
+			if (s.cast<ast::ReturnStatement>() || s.cast<ast::BreakStatement>() || s.cast<ast::ContinueStatement>())
+				return true;
+			if (auto* n = s.cast<ast::BlockStatement>())
+			{
+				for (auto& stmt : n->body)
+				{
+					if (terminates(*stmt))
+						return true;
+				}
+				return false;
+			}
+			if (auto* n = s.cast<ast::IfStatement>())
+				return n->alternative && terminates(*n->consequent) && terminates(*n->alternative);
+			return false;
+		}
+
+		static ast::StatementPtr empty_statement(ast::Node& from)
+		{
+			auto n = ast::make<ast::EmptyStatement>();
+			n->debug = from.debug;
+			return n;
+		}
+
+		ast::StatementPtr Optimizer::optimize_statement_impl(ast::Statement& s)
+		{
+			bool prune = m_options.prune_dead_code;
+			bool truthy;
+			if (auto* n = s.cast<ast::BlockStatement>())
+			{
+				optimize_block(n->body);
+			}
+			else if (auto* n = s.cast<ast::ExpressionStatement>())
+			{
+				fold(n->expression);
+			}
+			else if (auto* n = s.cast<ast::IfStatement>())
+			{
+				fold(n->test);
+				if (prune && get_truthiness(n->test.get(), truthy))
+				{
+					auto& branch = truthy ? n->consequent : n->alternative;
+					if (!branch)
+						return empty_statement(s);
+					optimize_statement(branch);
+					return std::move(branch);
+				}
+				optimize_statement(n->consequent);
+				if (n->alternative)
+					optimize_statement(n->alternative);
+			}
+			else if (auto* n = s.cast<ast::WhileStatement>())
+			{
+				fold(n->test);
+				if (prune && get_truthiness(n->test.get(), truthy) && !truthy)
+					return empty_statement(s);
+				optimize_statement(n->body);
+			}
+			else if (auto* n = s.cast<ast::ForStatement>())
+			{
+				fold(n->init);
+				fold(n->test);
+				fold(n->update);
+				if (prune && n->test && get_truthiness(n->test.get(), truthy) && !truthy)
+				{
+					if (!n->init)
+						return empty_statement(s);
+					auto es = ast::make<ast::ExpressionStatement>();
+					es->debug = s.debug;
+					es->expression = std::move(n->init);
+					return es;
+				}
+				optimize_statement(n->body);
+			}
+			else if (auto* n = s.cast<ast::DoWhileStatement>())
+			{
+				fold(n->test);
+				optimize_statement(n->body);
+			}
+			else if (auto* n = s.cast<ast::ReturnStatement>())
+			{
+				fold(n->argument);
+			}
+			else if (auto* n = s.cast<ast::WaitStatement>())
+			{
+				fold(n->duration);
+			}
+			else if (auto* n = s.cast<ast::SwitchStatement>())
+			{
+				fold(n->discriminant);
+				for (auto& c : n->cases)
+					optimize_block(c->consequent);
+			}
+			return nullptr;
+		}
+
+		void Optimizer::optimize_statement(ast::StatementPtr& stmt)
+		{
+			auto replacement = optimize_statement_impl(*stmt);
+			if (replacement)
+			{
+				stmt = std::move(replacement);
+				m_changed = true;
+			}
+		}
+
+		void Optimizer::optimize_shared_statement(ast::Statement*& stmt)
+		{
+			auto fnd = m_replaced_shared.find(stmt);
+			if (fnd != m_replaced_shared.end())
+			{
+				stmt = fnd->second;
+				return;
+			}
+			auto replacement = optimize_statement_impl(*stmt);
+			if (replacement)
+			{
+				//the old one stays in the arena, so the address can't be reused while it's still a key
+				m_replaced_shared[stmt] = replacement.get();
+				stmt = replacement.release();
+				m_changed = true;
+			}
+		}
+
+		template <typename T> static bool prune_block(ast::List<T>& body)
+		{
+			bool changed = false;
+			for (size_t i = 0; i < body.size(); ++i)
+			{
+				auto* es = body[i]->template cast<ast::ExpressionStatement>();
+				if ((es && is_pure(es->expression.get())) || body[i]->template cast<ast::EmptyStatement>())
+				{
+					body.erase(body.begin() + i);
+					--i;
+					changed = true;
+					continue;
+				}
+				if (terminates(*body[i]) && i + 1 < body.size())
+				{
+					body.erase(body.begin() + i + 1, body.end());
+					changed = true;
+					break;
+				}
+			}
+			return changed;
+		}
+
+		void Optimizer::optimize_block(ast::List<ast::StatementPtr>& body)
+		{
+			for (auto& stmt : body)
+				optimize_statement(stmt);
+			if (m_options.prune_dead_code && prune_block(body))
+				m_changed = true;
+		}
+
+		void Optimizer::optimize_block(ast::List<ast::Statement*>& body)
+		{
+			for (auto& stmt : body)
+				optimize_shared_statement(stmt);
+			if (m_options.prune_dead_code && prune_block(body))
+				m_changed = true;
+		}
+
+		bool Optimizer::is_dead_store(ast::Statement& s)
+		{
+			auto* es = s.cast<ast::ExpressionStatement>();
+			if (!es)
+				return false;
+			auto* assignment = es->expression->cast<ast::AssignmentExpression>();
+			if (!assignment || assignment->op != '=')
+				return false;
+			auto* id = assignment->lhs->cast<ast::Identifier>();
+			if (!id || !id->file_reference.empty())
+				return false;
+			auto name = util::string::to_lower(id->name);
+			if (name == "self" || name == "level" || name == "game")
+				return false;
+			if (m_options.globals.find(name) != m_options.globals.end())
+				return false;
+			return m_reads.find(name) == m_reads.end();
+		}
+
+		void Optimizer::remove_dead_stores(ast::Statement& s)
+		{
+			if (is_dead_store(s))
+			{
+				//keep the right hand side around for side effects, it'll get removed if it's pure
+				//the node itself is modified because switch cases can share it
+				auto* es = s.cast<ast::ExpressionStatement>();
+				auto* assignment = es->expression->cast<ast::AssignmentExpression>();
+				auto rhs = std::move(assignment->rhs);
+				es->expression = std::move(rhs);
+				m_changed = true;
+			}
+			else if (auto* n = s.cast<ast::BlockStatement>())
+			{
+				for (auto& stmt : n->body)
+					remove_dead_stores(*stmt);
+			}
+			else if (auto* n = s.cast<ast::IfStatement>())
+			{
+				remove_dead_stores(*n->consequent);
+				if (n->alternative)
+					remove_dead_stores(*n->alternative);
+			}
+			else if (auto* n = s.cast<ast::WhileStatement>())
+			{
+				remove_dead_stores(*n->body);
+			}
+			else if (auto* n = s.cast<ast::ForStatement>())
+			{
+				remove_dead_stores(*n->body);
+			}
+			else if (auto* n = s.cast<ast::DoWhileStatement>())
+			{
+				remove_dead_stores(*n->body);
+			}
+			else if (auto* n = s.cast<ast::SwitchStatement>())
+			{
+				for (auto& c : n->cases)
+				{
+					for (auto& stmt : c->consequent)
+						remove_dead_stores(*stmt);
+				}
+			}
+		}
+
+		void Optimizer::optimize_function(ast::FunctionDeclaration& n)
+		{
+			m_replaced_shared.clear();
+			//removing a store can make another variable dead, just go again a few times
+			for (size_t i = 0; i < 8; ++i)
+			{
+				m_changed = false;
+				optimize_statement(n.body);
+				if (m_options.remove_dead_stores)
+				{
+					VariableReadVisitor reads;
+					n.body->accept(reads);
+					m_reads = std::move(reads.reads());
+					remove_dead_stores(*n.body);
+				}
+				if (!m_changed)
+					break;
+			}
+			m_replaced_shared.clear();
+		}
+
+		static size_t count_instructions(script::ReferenceMap& refmap, const std::string& file,
+										 ast::FunctionDeclaration& n, bool& ok)
+		{
+			try
+			{
+				Compiler compiler(refmap);
+				return compiler.count_instructions(file, n);
+			}
+			catch (CompileException&)
+			{
+				ok = false;
+			}
+			return 0;
+		}
+
+		void Optimizer::optimize(script::ReferenceMap& refmap)
+		{
+			size_t total_before = 0, total_after = 0, total_inlined = 0, total_hoisted = 0, total_reused = 0;
+			Inliner inliner(refmap, m_options);
+			LoopHoister hoister(refmap, m_options);
+			MemberCSE cse(refmap, m_options);
+			//the inliner copies whatever a callee looks like at that point and summaries are kept once they're made,
+			//files come from the pool in any order so go by name for the same result every time
+			std::vector<std::pair<const std::string, LoadedProgramReference>*> files;
+			for (auto& refmap_iter : refmap)
+				files.push_back(&refmap_iter);
+			std::sort(files.begin(), files.end(), [](auto* a, auto* b) { return a->first < b->first; });
+			for (auto* file : files)
+			{
+				auto& refmap_iter = *file;
+				//what the passes add to a function goes in the arena of it's program, a lazy function brings it's own
+				auto& program = refmap_iter.second.program;
+				ast::Arena::Scope scope(program ? program->arena.get() : ast::Arena::current());
+				size_t before = 0, after = 0;
+				bool ok = true;
+				std::vector<std::pair<const std::string, ast::FunctionDeclaration*>*> functions;
+				for (auto& fun_iter : refmap_iter.second.function_map)
+					functions.push_back(&fun_iter);
+				std::sort(functions.begin(), functions.end(), [](auto* a, auto* b) { return a->first < b->first; });
+				for (auto* function : functions)
+				{
+					auto& fun_iter = *function;
+					if (m_options.report)
+						before += count_instructions(refmap, refmap_iter.first, *fun_iter.second, ok);
+					total_inlined += inliner.inline_calls(refmap_iter.first, *fun_iter.second);
+					optimize_function(*fun_iter.second);
+					total_hoisted += hoister.hoist(refmap_iter.first, *fun_iter.second);
+					total_reused += cse.eliminate(refmap_iter.first, *fun_iter.second);
+					if (m_options.report)
+						after += count_instructions(refmap, refmap_iter.first, *fun_iter.second, ok);
+				}
+				if (!m_options.report)
+					continue;
+				if (!ok)
+				{
+					printf("optimized %s, failed to count instructions\n", refmap_iter.first.c_str());
+					continue;
+				}
+				printf("optimized %s, %zu -> %zu instructions (%lld saved)\n", refmap_iter.first.c_str(), before, after,
+					   (long long)before - (long long)after);
+				total_before += before;
+				total_after += after;
+			}
+			if (m_options.report && total_inlined)
+				printf("inlined %zu calls\n", total_inlined);
+			if (m_options.report && total_hoisted)
+				printf("hoisted %zu loads out of loops\n", total_hoisted);
+			if (m_options.report && total_reused)
+				printf("reused %zu loaded objects\n", total_reused);
+			if (m_options.report)
+				printf("optimized total, %zu -> %zu instructions (%lld saved)\n", total_before, total_after,
+					   (long long)total_before - (long long)total_after);
+		}
+
+		uint64_t Optimizer::Options::hash() const
+		{
+			u8 flags = (fold_constants ? 1 : 0) | (prune_dead_code ? 2 : 0) | (remove_dead_stores ? 4 : 0) |
+				   (hoist_loop_invariants ? 8 : 0) | (eliminate_common_subexpressions ? 16 : 0);
+			u64 h = fnv1a_64(&flags, sizeof(flags));
+			u64 inlining = (u64)inline_threshold << 1 | (inline_across_files ? 1 : 0);
+			h = fnv1a_64(&inlining, sizeof(inlining), h);
+			std::vector<std::string> sorted(globals.begin(), globals.end());
+			std::sort(sorted.begin(), sorted.end());
+			for (auto& g : sorted)
+				h = fnv1a_64(g.c_str(), g.size() + 1, h);
+			return h;
+		}
+	}; // namespace compiler
+};	   // namespace script
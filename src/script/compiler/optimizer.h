@@ -0,0 +1,75 @@
+#pragma once
+#include <script/compiler/compiler.h>
+#include <script/ast/nodes.h>
+#include <unordered_set>
+#include <unordered_map>
+#include <string>
+
+namespace script
+{
+	namespace compiler
+	{
+		//runs on the AST between ASTGenerator and Compiler
+		//inlines small functions, folds constant expressions, removes dead branches, unreachable statements and stores to locals that are never read
+		//hoists loop invariant loads and reuses member chains loaded earlier in the same block
+		class Optimizer
+		{
+		  public:
+			struct Options
+			{
+				bool fold_constants = true;
+				bool prune_dead_code = true;
+				bool remove_dead_stores = true;
+				//calls to functions that only return an expression of at most this many nodes get replaced by it, 0 disables
+				size_t inline_threshold = 12;
+				//also inline functions from other files and look into them for what a call in a loop may store to
+				//or whether a call to a pure builtin isn't a script function by that name instead
+				//the result then depends on the source of those files too
+				bool inline_across_files = true;
+				//move loads of member chains that don't change in a loop in front of it
+				bool hoist_loop_invariants = true;
+				//load the objects member chains in straight line code have in common once
+				bool eliminate_common_subexpressions = true;
+				//compiles every function before and after and prints the instructions saved per file and every inlined call
+				bool report = false;
+				//names exposed by the host through VirtualMachine::set_global
+				//a store to one of these is never removed even if the script itself doesn't read it
+				std::unordered_set<std::string> globals;
+
+				//everything that changes the output, for keying the bytecode cache
+				uint64_t hash() const;
+			};
+
+		  private:
+			Options m_options;
+			//switch cases share their statements, keep track of what already got replaced
+			std::unordered_map<ast::Statement*, ast::Statement*> m_replaced_shared;
+			std::unordered_set<std::string> m_reads;
+			bool m_changed = false;
+
+			void fold(ast::ExpressionPtr& e);
+			void fold_lvalue(ast::ExpressionPtr& e);
+			bool fold_binary(ast::ExpressionPtr& e, ast::BinaryExpression& n);
+			bool fold_unary(ast::ExpressionPtr& e, ast::UnaryExpression& n);
+
+			void optimize_statement(ast::StatementPtr& stmt);
+			void optimize_shared_statement(ast::Statement*& stmt);
+			ast::StatementPtr optimize_statement_impl(ast::Statement& stmt);
+			void optimize_block(ast::List<ast::StatementPtr>& body);
+			void optimize_block(ast::List<ast::Statement*>& body);
+
+			bool is_dead_store(ast::Statement& s);
+			void remove_dead_stores(ast::Statement& s);
+			void optimize_function(ast::FunctionDeclaration& n);
+
+		  public:
+			Optimizer()
+			{
+			}
+			Optimizer(const Options& options) : m_options(options)
+			{
+			}
+			void optimize(script::ReferenceMap&);
+		};
+	}; // namespace compiler
+};	   // namespace script
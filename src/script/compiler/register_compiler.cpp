@@ -0,0 +1,904 @@
+#include "register_compiler.h"
+#include <script/compiler/exception.h>
+#include <script/compiler/visitors/variable_reads.h>
+#include <parse/token.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace script
+{
+	namespace compiler
+	{
+		using vm::RegisterOpcode;
+		using vm::kConstantBit;
+		using vm::kNoRegister;
+
+		//every name used as a variable, stores included
+		class LocalNamesVisitor : public VariableReadVisitor
+		{
+		  public:
+			virtual bool pre_visit(ast::AssignmentExpression& n) override
+			{
+				n.rhs->accept(*this);
+				n.lhs->accept(*this);
+				return false;
+			}
+		};
+
+		//whether evaluating the node can change the value of a local
+		class LocalWriteVisitor : public ast::RecursiveASTVisitor
+		{
+		  public:
+			bool found = false;
+			virtual bool pre_visit(ast::AssignmentExpression& n) override
+			{
+				found = true;
+				return false;
+			}
+			virtual bool pre_visit(ast::UnaryExpression& n) override
+			{
+				if (n.op == parse::TokenType_kPlusPlus || n.op == parse::TokenType_kMinusMinus)
+					found = true;
+				return !found;
+			}
+			virtual bool pre_visit(ast::CallExpression& n) override
+			{
+				auto* id = n.callee->cast<ast::Identifier>();
+				if (id && id->name == "waittill")
+					found = true;
+				return !found;
+			}
+		};
+
+		static bool writes_locals(ast::Expression& n)
+		{
+			LocalWriteVisitor vis;
+			n.accept(vis);
+			return vis.found;
+		}
+
+		static RegisterOpcode binary_opcode(int op)
+		{
+			switch (op)
+			{
+			case '+':
+				return RegisterOpcode::kAdd;
+			case '-':
+				return RegisterOpcode::kSub;
+			case '*':
+				return RegisterOpcode::kMul;
+			case '/':
+				return RegisterOpcode::kDiv;
+			case '%':
+				return RegisterOpcode::kMod;
+			case '&':
+				return RegisterOpcode::kAnd;
+			case '|':
+				return RegisterOpcode::kOr;
+			case '^':
+				return RegisterOpcode::kXor;
+			case parse::TokenType_kLsht:
+				return RegisterOpcode::kShl;
+			case parse::TokenType_kRsht:
+				return RegisterOpcode::kShr;
+			case parse::TokenType_kEq:
+				return RegisterOpcode::kEq;
+			case parse::TokenType_kNeq:
+				return RegisterOpcode::kNeq;
+			case '<':
+				return RegisterOpcode::kLt;
+			case parse::TokenType_kLeq:
+				return RegisterOpcode::kLeq;
+			case '>':
+				return RegisterOpcode::kGt;
+			case parse::TokenType_kGeq:
+				return RegisterOpcode::kGeq;
+			case parse::TokenType_kOrOr:
+				return RegisterOpcode::kOrOr;
+			}
+			throw CompileException("unhandled operator {}", op);
+		}
+
+		static RegisterOpcode compound_opcode(int op)
+		{
+			switch (op)
+			{
+			case parse::TokenType_kMinusAssign:
+				return RegisterOpcode::kSub;
+			case parse::TokenType_kPlusAssign:
+				return RegisterOpcode::kAdd;
+			case parse::TokenType_kMultiplyAssign:
+				return RegisterOpcode::kMul;
+			case parse::TokenType_kDivideAssign:
+				return RegisterOpcode::kDiv;
+			case parse::TokenType_kModAssign:
+				return RegisterOpcode::kMod;
+			case parse::TokenType_kOrAssign:
+				return RegisterOpcode::kOr;
+			case parse::TokenType_kXorAssign:
+				return RegisterOpcode::kXor;
+			case parse::TokenType_kAndAssign:
+				return RegisterOpcode::kAnd;
+			}
+			throw CompileException("unhandled operator {}", op);
+		}
+
+		bool RegisterCompiler::compile(script::ReferenceMap& refmap, CompiledFiles& files)
+		{
+			bool ok = true;
+			for (auto& refmap_iter : refmap)
+			{
+				auto fnd = files.find(util::string::to_lower(refmap_iter.first));
+				if (fnd == files.end())
+					continue;
+				try
+				{
+					for (auto& fun_iter : refmap_iter.second.function_map)
+					{
+						auto cf = fnd->second.find(util::string::to_lower(fun_iter.second->function_name));
+						if (cf == fnd->second.end())
+							continue;
+						compile_function(refmap_iter.first, *fun_iter.second, cf->second);
+					}
+				}
+				catch (CompileException& e)
+				{
+					printf("Failed to compile %s for the register backend: %s\n", refmap_iter.first.c_str(), e.what());
+					ok = false;
+				}
+			}
+			return ok;
+		}
+
+		void RegisterCompiler::compile_function(const std::string& file, ast::FunctionDeclaration& n,
+												CompiledFunction& cf)
+		{
+			m_currentfile = file;
+			cf.register_function = std::make_shared<vm::RegisterFunction>();
+			m_function = cf.register_function.get();
+			m_function->lines.source = n.source_file;
+			m_line = n.debug.line;
+			n.accept(*this);
+		}
+
+		size_t RegisterCompiler::emit(RegisterOpcode op, uint32_t a, uint32_t b, uint32_t c)
+		{
+			auto& rf = *m_function;
+			rf.lines.add(rf.instructions.size(), m_line);
+			rf.instructions.push_back({op, a, b, c});
+			++m_num_instructions;
+			return rf.instructions.size() - 1;
+		}
+
+		uint32_t RegisterCompiler::temp()
+		{
+			uint32_t r = m_next_temp++;
+			m_function->num_registers = std::max(m_function->num_registers, m_next_temp);
+			return r;
+		}
+
+		uint32_t RegisterCompiler::target()
+		{
+			return m_dest != kNoRegister ? m_dest : temp();
+		}
+
+		void RegisterCompiler::finish(uint32_t operand)
+		{
+			if (m_dest != kNoRegister && operand != m_dest)
+			{
+				emit(RegisterOpcode::kMove, m_dest, operand);
+				operand = m_dest;
+			}
+			m_result = operand;
+		}
+
+		uint32_t RegisterCompiler::constant(const vm::Variant& v)
+		{
+			std::string key = std::to_string(v.index()) + ':';
+			auto bits = [](float f)
+			{
+				uint32_t u;
+				memcpy(&u, &f, sizeof(u));
+				return std::to_string(u);
+			};
+			switch ((vm::Type)v.index())
+			{
+			case vm::Type::kUndefined:
+				break;
+			case vm::Type::kInteger:
+				key += std::to_string(std::get<vm::Integer>(v));
+				break;
+			case vm::Type::kFloat:
+				key += bits(std::get<vm::Number>(v));
+				break;
+			case vm::Type::kVector:
+			{
+				auto& vec = std::get<vm::Vector>(v);
+				key += bits(vec.x) + ',' + bits(vec.y) + ',' + bits(vec.z);
+			}
+			break;
+			case vm::Type::kString:
+				key += std::get<vm::String>(v).str();
+				break;
+			case vm::Type::kLocalizedString:
+				key += std::get<vm::LocalizedString>(v).reference.str();
+				break;
+			case vm::Type::kAnimation:
+				key += std::get<vm::Animation>(v).reference.str();
+				break;
+			case vm::Type::kFunctionPointer:
+			{
+				auto& fp = std::get<vm::FunctionPointer>(v);
+				key += fp.file.str() + "::" + fp.name.str();
+			}
+			break;
+			default:
+				throw CompileException("unhandled constant type {}", vm::kVariantNames[v.index()]);
+			}
+			auto fnd = m_constant_lookup.find(key);
+			if (fnd != m_constant_lookup.end())
+				return fnd->second;
+			uint32_t k = (uint32_t)m_function->constants.size() | kConstantBit;
+			m_function->constants.push_back(v);
+			m_constant_lookup[key] = k;
+			return k;
+		}
+
+		uint32_t RegisterCompiler::local(ast::Expression& n)
+		{
+			auto* id = n.cast<ast::Identifier>();
+			if (!id || !id->file_reference.empty())
+				return kNoRegister;
+			auto fnd = m_locals.find(util::string::to_lower(id->name));
+			if (fnd == m_locals.end())
+				return kNoRegister;
+			return fnd->second;
+		}
+
+		uint32_t RegisterCompiler::pin(uint32_t operand)
+		{
+			if ((operand & kConstantBit) || operand >= m_num_locals)
+				return operand;
+			uint32_t t = temp();
+			emit(RegisterOpcode::kMove, t, operand);
+			return t;
+		}
+
+		uint32_t RegisterCompiler::expression(ast::Expression& n, uint32_t dest)
+		{
+			auto saved = m_dest;
+			m_dest = dest;
+			n.accept(*this);
+			m_dest = saved;
+			return m_result;
+		}
+
+		void RegisterCompiler::discard(ast::Expression& n)
+		{
+			if (auto* call_expression = n.cast<ast::CallExpression>())
+				call(*call_expression, true);
+			else
+				expression(n);
+		}
+
+		void RegisterCompiler::statement(ast::Statement& n)
+		{
+			m_next_temp = m_num_locals;
+			n.accept(*this);
+		}
+
+		void RegisterCompiler::visit(ast::Program& n)
+		{
+			throw CompileException("unimplemented {}", __LINE__);
+		}
+
+		void RegisterCompiler::visit(ast::FunctionDeclaration& n)
+		{
+			auto& rf = *m_function;
+			m_locals.clear();
+			m_constant_lookup.clear();
+			m_break_jumps.clear();
+			m_continue_jumps.clear();
+
+			auto add_local = [&](const std::string& name)
+			{
+				auto fnd = m_locals.find(name);
+				if (fnd != m_locals.end())
+					return fnd->second;
+				uint32_t r = (uint32_t)m_locals.size();
+				m_locals[name] = r;
+				rf.register_names.push_back(name);
+				return r;
+			};
+			for (auto& parm : n.parameters)
+				rf.parameter_registers.push_back(add_local(util::string::to_lower(parm)));
+			rf.self_register = add_local("self");
+
+			LocalNamesVisitor names;
+			n.body->accept(names);
+			std::vector<std::string> sorted(names.reads().begin(), names.reads().end());
+			std::sort(sorted.begin(), sorted.end());
+			for (auto& name : sorted)
+			{
+				if (name == "level" || name == "game" || m_options.globals.count(name))
+					continue;
+				add_local(name);
+			}
+			m_num_locals = (uint32_t)m_locals.size();
+			m_next_temp = m_num_locals;
+			rf.num_registers = m_num_locals;
+
+			n.body->accept(*this);
+			emit(RegisterOpcode::kRet, constant(vm::Undefined()));
+		}
+
+		void RegisterCompiler::visit(ast::SwitchCase&)
+		{
+			throw CompileException("unimplemented {}", __LINE__);
+		}
+
+		void RegisterCompiler::visit(ast::Directive& n)
+		{
+			throw CompileException("unimplemented {}", __LINE__);
+		}
+
+		void RegisterCompiler::visit(ast::BlockStatement& n)
+		{
+			for (auto& stmt : n.body)
+			{
+				m_line = stmt->debug.line;
+				statement(*stmt);
+			}
+		}
+
+		void RegisterCompiler::visit(ast::IfStatement& n)
+		{
+			auto jz = emit(RegisterOpcode::kJumpZero, 0, expression(*n.test));
+			statement(*n.consequent);
+			if (n.alternative)
+			{
+				auto jmp = emit(RegisterOpcode::kJump);
+				patch(jz, here());
+				statement(*n.alternative);
+				patch(jmp, here());
+			}
+			else
+				patch(jz, here());
+		}
+
+		//loops are rotated, the test sits at the bottom so an iteration only takes one jump
+		void RegisterCompiler::visit(ast::WhileStatement& n)
+		{
+			auto saved = m_line;
+			auto jmp = emit(RegisterOpcode::kJump);
+			auto body = here();
+			m_break_jumps.emplace_back();
+			m_continue_jumps.emplace_back();
+			statement(*n.body);
+			m_line = saved;
+			auto test = here();
+			m_next_temp = m_num_locals;
+			emit(RegisterOpcode::kJumpNotZero, (uint32_t)body, expression(*n.test));
+			patch(jmp, test);
+			for (auto j : m_break_jumps.back())
+				patch(j, here());
+			for (auto j : m_continue_jumps.back())
+				patch(j, test);
+			m_break_jumps.pop_back();
+			m_continue_jumps.pop_back();
+		}
+
+		void RegisterCompiler::visit(ast::ForStatement& n)
+		{
+			auto saved = m_line;
+			if (n.init)
+				discard(*n.init);
+			size_t jmp = 0;
+			if (n.test)
+				jmp = emit(RegisterOpcode::kJump);
+			auto body = here();
+			m_break_jumps.emplace_back();
+			m_continue_jumps.emplace_back();
+			statement(*n.body);
+			m_line = saved;
+			auto update = here();
+			m_next_temp = m_num_locals;
+			if (n.update)
+				discard(*n.update);
+			if (n.test)
+			{
+				patch(jmp, here());
+				m_next_temp = m_num_locals;
+				emit(RegisterOpcode::kJumpNotZero, (uint32_t)body, expression(*n.test));
+			}
+			else
+				emit(RegisterOpcode::kJump, (uint32_t)body);
+			for (auto j : m_break_jumps.back())
+				patch(j, here());
+			for (auto j : m_continue_jumps.back())
+				patch(j, update);
+			m_break_jumps.pop_back();
+			m_continue_jumps.pop_back();
+		}
+
+		void RegisterCompiler::visit(ast::DoWhileStatement&)
+		{
+			throw CompileException("unimplemented {}", __LINE__);
+		}
+
+		void RegisterCompiler::visit(ast::ReturnStatement& n)
+		{
+			emit(RegisterOpcode::kRet, n.argument ? expression(*n.argument) : constant(vm::Undefined()));
+		}
+
+		void RegisterCompiler::visit(ast::BreakStatement& n)
+		{
+			if (m_break_jumps.empty())
+				throw CompileException("no exit label for break statement");
+			m_break_jumps.back().push_back(emit(RegisterOpcode::kJump));
+		}
+
+		void RegisterCompiler::visit(ast::WaitStatement& n)
+		{
+			emit(RegisterOpcode::kWait, expression(*n.duration));
+		}
+
+		void RegisterCompiler::visit(ast::WaitTillFrameEndStatement&)
+		{
+			emit(RegisterOpcode::kWaitTillFrameEnd);
+		}
+
+		void RegisterCompiler::visit(ast::ExpressionStatement& n)
+		{
+			discard(*n.expression);
+		}
+
+		void RegisterCompiler::visit(ast::EmptyStatement& n)
+		{
+		}
+
+		void RegisterCompiler::visit(ast::ContinueStatement& n)
+		{
+			if (m_continue_jumps.empty())
+				throw CompileException("no label for continue statement");
+			m_continue_jumps.back().push_back(emit(RegisterOpcode::kJump));
+		}
+
+		//the discriminant is evaluated once and compared against every case in order, default runs if none matched
+		void RegisterCompiler::visit(ast::SwitchStatement& n)
+		{
+			auto discriminant = expression(*n.discriminant);
+			uint32_t index = (uint32_t)m_function->switches.size();
+			m_function->switches.emplace_back();
+			emit(RegisterOpcode::kSwitch, index, discriminant);
+
+			//same as Compiler, cases that fall through into each other share a body
+			std::map<std::vector<ast::Statement*>, uint32_t> bodies;
+			std::vector<size_t> ends;
+			uint32_t target_default = vm::kNoRegister;
+			m_break_jumps.emplace_back();
+			for (auto& sc : n.cases)
+			{
+				std::vector<ast::Statement*> key;
+				for (auto& stmt : sc->consequent)
+					key.push_back(stmt);
+				auto fnd = bodies.find(key);
+				uint32_t body;
+				if (fnd != bodies.end())
+					body = fnd->second;
+				else
+				{
+					body = (uint32_t)here();
+					bodies[key] = body;
+					for (auto& stmt : sc->consequent)
+						statement(*stmt);
+					ends.push_back(emit(RegisterOpcode::kJump));
+				}
+				auto& sw = m_function->switches[index];
+				if (!sc->test)
+				{
+					target_default = body;
+					continue;
+				}
+				auto* lit = sc->test->cast<ast::Literal>();
+				if (lit && lit->type == ast::Literal::Type::kInteger)
+					sw.cases.values.push_back(vm::Integer(lit->integer));
+				else if (lit && lit->type == ast::Literal::Type::kString)
+					sw.cases.values.push_back(vm::String(lit->value));
+				else
+					throw CompileException("switch case has to be an integer or string");
+				sw.targets.push_back(body);
+			}
+			for (auto j : ends)
+				patch(j, here());
+			for (auto j : m_break_jumps.back())
+				patch(j, here());
+			m_break_jumps.pop_back();
+			auto& sw = m_function->switches[index];
+			sw.target_default = target_default == vm::kNoRegister ? (uint32_t)here() : target_default;
+			sw.cases.build();
+		}
+
+		void RegisterCompiler::visit(ast::LocalizedString& n)
+		{
+			finish(constant(vm::LocalizedString{n.reference.str()}));
+		}
+
+		void RegisterCompiler::visit(ast::Literal& n)
+		{
+			switch (n.type)
+			{
+			case ast::Literal::Type::kInteger:
+				finish(constant(vm::Integer(n.integer)));
+				break;
+			case ast::Literal::Type::kNumber:
+				finish(constant(vm::Number(n.number)));
+				break;
+			case ast::Literal::Type::kString:
+				finish(constant(vm::String(n.value)));
+				break;
+			case ast::Literal::Type::kAnimation:
+				finish(constant(vm::Animation{n.value.str()}));
+				break;
+			case ast::Literal::Type::kUndefined:
+				finish(constant(vm::Undefined()));
+				break;
+			default:
+				throw CompileException("unhandled literal type {}", (int)n.type);
+				break;
+			}
+		}
+
+		void RegisterCompiler::visit(ast::Identifier& n)
+		{
+			if (!n.file_reference.empty())
+			{
+				finish(constant(vm::FunctionPointer{n.file_reference.str(), n.name.str()}));
+				return;
+			}
+			auto r = local(n);
+			if (r != kNoRegister)
+			{
+				finish(r);
+				return;
+			}
+			auto dest = target();
+			emit(RegisterOpcode::kLoadGlobal, dest, constant(vm::String(util::string::to_lower(n.name))));
+			m_result = dest;
+		}
+
+		void RegisterCompiler::visit(ast::FunctionPointer& n)
+		{
+			finish(constant(vm::FunctionPointer{m_currentfile, n.function_name.str()}));
+		}
+
+		void RegisterCompiler::visit(ast::BinaryExpression& n)
+		{
+			if (n.op == parse::TokenType_kAndAnd)
+			{
+				//result is written before the operands are evaluated, so it can't go straight into a local
+				uint32_t result = (m_dest != kNoRegister && m_dest >= m_num_locals) ? m_dest : temp();
+				emit(RegisterOpcode::kMove, result, constant(vm::Integer(0)));
+				auto jz_left = emit(RegisterOpcode::kJumpZero, 0, expression(*n.left));
+				auto jz_right = emit(RegisterOpcode::kJumpZero, 0, expression(*n.right));
+				emit(RegisterOpcode::kMove, result, constant(vm::Integer(1)));
+				patch(jz_left, here());
+				patch(jz_right, here());
+				finish(result);
+				return;
+			}
+			//right is evaluated first, same as the stack compiler
+			auto top = m_next_temp;
+			auto right = expression(*n.right);
+			if (writes_locals(*n.left))
+				right = pin(right);
+			auto left = expression(*n.left);
+			m_next_temp = top;
+			auto dest = target();
+			emit(binary_opcode(n.op), dest, left, right);
+			m_result = dest;
+		}
+
+		void RegisterCompiler::store(ast::Expression& lhs, uint32_t value)
+		{
+			std::vector<ast::MemberExpression*> chain;
+			ast::Expression* base = &lhs;
+			while (auto* member = base->cast<ast::MemberExpression>())
+			{
+				chain.push_back(member);
+				base = member->object.get();
+			}
+			auto* id = base->cast<ast::Identifier>();
+			if (!id)
+				throw CompileException("invalid node {}", __LINE__);
+			if (!id->file_reference.empty())
+				throw CompileException("unsupported file reference in lvalue expression");
+			auto r = local(*id);
+			if (chain.empty() && r != kNoRegister)
+			{
+				if (value != r)
+					emit(RegisterOpcode::kMove, r, value);
+				return;
+			}
+			vm::RegisterStore st;
+			if (r != kNoRegister)
+				st.base = r;
+			else
+				st.name = util::string::to_lower(id->name);
+
+			//outer keys are evaluated first, same as the stack compiler
+			bool writes = false;
+			for (auto* member : chain)
+				writes = writes || writes_locals(*member->prop);
+			if (writes)
+				value = pin(value);
+			st.keys.resize(chain.size());
+			for (size_t i = 0; i < chain.size(); ++i)
+			{
+				auto* member = chain[i];
+				std::string field_name;
+				uint32_t key;
+				if (get_property(*member->prop, field_name, member->op))
+					key = constant(vm::String(field_name));
+				else
+				{
+					key = expression(*member->prop);
+					bool later = false;
+					for (size_t j = i + 1; j < chain.size(); ++j)
+						later = later || writes_locals(*chain[j]->prop);
+					if (later)
+						key = pin(key);
+				}
+				st.keys[chain.size() - 1 - i] = key;
+			}
+			st.value = value;
+			m_function->stores.push_back(std::move(st));
+			emit(RegisterOpcode::kStore, (uint32_t)m_function->stores.size() - 1);
+		}
+
+		void RegisterCompiler::visit(ast::AssignmentExpression& n)
+		{
+			auto r = local(*n.lhs);
+			if (n.op == '=')
+			{
+				if (r != kNoRegister)
+				{
+					expression(*n.rhs, r);
+					finish(r);
+					return;
+				}
+				auto value = expression(*n.rhs);
+				store(*n.lhs, value);
+				finish(value);
+				return;
+			}
+			auto op = compound_opcode(n.op);
+			auto right = expression(*n.rhs);
+			if (writes_locals(*n.lhs))
+				right = pin(right);
+			if (r != kNoRegister)
+			{
+				emit(op, r, r, right);
+				finish(r);
+				return;
+			}
+			auto left = expression(*n.lhs);
+			auto result = temp();
+			emit(op, result, left, right);
+			store(*n.lhs, result);
+			finish(result);
+		}
+
+		void RegisterCompiler::waittill(ast::CallExpression& n)
+		{
+			if (n.arguments.size() < 1)
+				throw CompileException("waittill requires a minimum of 1 argument");
+			vm::RegisterWaitTill site;
+			for (size_t i = 1; i < n.arguments.size(); ++i)
+			{
+				auto* id = n.arguments[i]->cast<ast::Identifier>();
+				if (!id)
+					throw CompileException("expected identifier");
+				if (!id->file_reference.empty())
+					throw CompileException("unexpected file reference");
+				auto r = local(*id);
+				if (r == kNoRegister)
+					throw CompileException("waittill can only store into locals, got {}", id->name);
+				site.registers.push_back(r);
+			}
+			site.event = expression(*n.arguments[0]);
+			if (n.object)
+			{
+				if (writes_locals(*n.object))
+					site.event = pin(site.event);
+				site.object = expression(*n.object);
+			}
+			m_function->waittills.push_back(std::move(site));
+			emit(RegisterOpcode::kWaitTill, (uint32_t)m_function->waittills.size() - 1);
+			finish(constant(vm::Undefined()));
+		}
+
+		void RegisterCompiler::call(ast::CallExpression& n, bool discard)
+		{
+			auto* id = n.callee->cast<ast::Identifier>();
+			if (id && id->name == "waittill")
+			{
+				if (!id->file_reference.empty())
+					throw CompileException("expected empty file reference");
+				waittill(n);
+				return;
+			}
+			auto top = m_next_temp;
+			vm::RegisterCallSite site;
+			site.threaded = n.threaded;
+
+			//arguments are evaluated last to first, then the pointer and the object
+			//anything that's evaluated later and writes to a local means earlier locals need a copy
+			std::vector<bool> later_writes(n.arguments.size() + 1, false);
+			bool writes = (n.pointer && writes_locals(*n.callee)) || (n.object && writes_locals(*n.object));
+			for (size_t i = 0; i < n.arguments.size(); ++i)
+			{
+				later_writes[i] = writes;
+				writes = writes || writes_locals(*n.arguments[i]);
+			}
+			site.arguments.resize(n.arguments.size());
+			for (size_t i = n.arguments.size(); i-- > 0;)
+			{
+				auto arg = expression(*n.arguments[i]);
+				site.arguments[i] = later_writes[i] ? pin(arg) : arg;
+			}
+
+			if (id && !id->file_reference.empty())
+			{
+				site.kind = vm::RegisterCallSite::Kind::kFile;
+				site.file = id->file_reference;
+				std::replace(site.file.begin(), site.file.end(), '\\', '/');
+				site.function = id->name;
+			}
+			else if (id && !n.pointer)
+			{
+				site.kind = vm::RegisterCallSite::Kind::kFunction;
+				site.function = id->name;
+			}
+			else
+			{
+				if (!id && !n.pointer)
+					throw CompileException("expected pointer");
+				site.kind = vm::RegisterCallSite::Kind::kPointer;
+				site.pointer = expression(*n.callee);
+				if (n.object && writes_locals(*n.object))
+					site.pointer = pin(site.pointer);
+			}
+			if (n.object)
+				site.object = expression(*n.object);
+
+			m_next_temp = top;
+			uint32_t dest = discard ? kNoRegister : target();
+			m_function->calls.push_back(std::move(site));
+			emit(RegisterOpcode::kCall, dest, (uint32_t)m_function->calls.size() - 1);
+			m_result = discard ? constant(vm::Undefined()) : dest;
+		}
+
+		void RegisterCompiler::visit(ast::CallExpression& n)
+		{
+			call(n, false);
+		}
+
+		void RegisterCompiler::visit(ast::ConditionalExpression&)
+		{
+			throw CompileException("unimplemented {}", __LINE__);
+		}
+
+		void RegisterCompiler::visit(ast::MemberExpression& n)
+		{
+			auto top = m_next_temp;
+			std::string field_name;
+			uint32_t key;
+			if (get_property(*n.prop, field_name, n.op))
+				key = constant(vm::String(field_name));
+			else
+			{
+				key = expression(*n.prop);
+				if (writes_locals(*n.object))
+					key = pin(key);
+			}
+			auto object = expression(*n.object);
+			m_next_temp = top;
+			auto dest = target();
+			emit(RegisterOpcode::kGetField, dest, object, key);
+			m_result = dest;
+		}
+
+		void RegisterCompiler::visit(ast::UnaryExpression& n)
+		{
+			RegisterOpcode op;
+			switch (n.op)
+			{
+			case '-':
+				op = RegisterOpcode::kNeg;
+				break;
+			case '!':
+				op = RegisterOpcode::kLogicalNot;
+				break;
+			case '~':
+				op = RegisterOpcode::kNot;
+				break;
+			case parse::TokenType_kPlusPlus:
+			case parse::TokenType_kMinusMinus:
+			{
+				if (n.prefix)
+					throw CompileException("unsupported prefix operator -- or ++");
+				op = n.op == parse::TokenType_kPlusPlus ? RegisterOpcode::kAdd : RegisterOpcode::kSub;
+				auto r = local(*n.argument);
+				if (r != kNoRegister)
+				{
+					emit(op, r, r, constant(vm::Integer(1)));
+					finish(r);
+					return;
+				}
+				auto value = expression(*n.argument);
+				auto result = temp();
+				emit(op, result, value, constant(vm::Integer(1)));
+				store(*n.argument, result);
+				//the value is loaded again like the stack compiler does, a setter may have changed it
+				m_result = expression(*n.argument, m_dest);
+				return;
+			}
+			default:
+				throw CompileException("invalid operator {}", n.op);
+			}
+			auto top = m_next_temp;
+			auto argument = expression(*n.argument);
+			m_next_temp = top;
+			auto dest = target();
+			emit(op, dest, argument);
+			m_result = dest;
+		}
+
+		void RegisterCompiler::visit(ast::VectorExpression& n)
+		{
+			if (n.elements.size() != 3)
+				throw CompileException("expected 3 elements for vector, got {}", n.elements.size());
+			vm::Vector v;
+			size_t numeric = 0;
+			for (size_t i = 0; i < 3; ++i)
+			{
+				auto* lit = n.elements[i]->cast<ast::Literal>();
+				if (!lit)
+					break;
+				if (lit->type == ast::Literal::Type::kInteger)
+					v[i] = (float)lit->integer;
+				else if (lit->type == ast::Literal::Type::kNumber)
+					v[i] = lit->number;
+				else
+					break;
+				++numeric;
+			}
+			if (numeric == 3)
+			{
+				finish(constant(v));
+				return;
+			}
+			auto top = m_next_temp;
+			uint32_t elements = temp();
+			temp();
+			temp();
+			for (size_t i = 3; i-- > 0;)
+				expression(*n.elements[i], elements + (uint32_t)i);
+			m_next_temp = top;
+			auto dest = target();
+			emit(RegisterOpcode::kVector, dest, elements);
+			m_result = dest;
+		}
+
+		void RegisterCompiler::visit(ast::ArrayExpression& n)
+		{
+			for (auto it = n.elements.rbegin(); it != n.elements.rend(); ++it)
+				discard(**it);
+			auto dest = target();
+			emit(RegisterOpcode::kNewArray, dest);
+			m_result = dest;
+		}
+	}; // namespace compiler
+};	   // namespace script
@@ -0,0 +1,113 @@
+#pragma once
+#include <script/compiler/compiler.h>
+#include <script/vm/register_function.h>
+#include <script/ast/nodes.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <string>
+
+namespace script
+{
+	namespace compiler
+	{
+		//lowers the same AST as Compiler into vm::RegisterFunction's for the register backend
+		//every local gets a fixed register so reading or writing one doesn't cost an instruction
+		//temporaries are allocated above the locals and are reused after every statement
+		class RegisterCompiler : public ast::ASTVisitor
+		{
+		  public:
+			struct Options
+			{
+				//names exposed by the host through VirtualMachine::set_global, these are looked up by name instead
+				std::unordered_set<std::string> globals;
+			};
+
+		  private:
+			Options m_options;
+			std::string m_currentfile;
+			vm::RegisterFunction* m_function = nullptr;
+			std::unordered_map<std::string, uint32_t> m_locals;
+			std::unordered_map<std::string, uint32_t> m_constant_lookup;
+			uint32_t m_num_locals = 0;
+			uint32_t m_next_temp = 0;
+			//register the parent wants the result of the expression in, kNoRegister if it doesn't care
+			uint32_t m_dest = vm::kNoRegister;
+			//operand holding the result of the last visited expression
+			uint32_t m_result = 0;
+			std::vector<std::vector<size_t>> m_break_jumps;
+			std::vector<std::vector<size_t>> m_continue_jumps;
+			size_t m_num_instructions = 0;
+			//line of the statement that is currently being compiled
+			size_t m_line = 0;
+
+			size_t emit(vm::RegisterOpcode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0);
+			size_t here()
+			{
+				return m_function->instructions.size();
+			}
+			void patch(size_t jump, size_t target)
+			{
+				m_function->instructions[jump].a = (uint32_t)target;
+			}
+			uint32_t temp();
+			uint32_t target();
+			void finish(uint32_t operand);
+			uint32_t constant(const vm::Variant&);
+			uint32_t local(ast::Expression&);
+			//copies a local into a temporary, for operands that get evaluated before something that writes to locals
+			uint32_t pin(uint32_t operand);
+			uint32_t expression(ast::Expression&, uint32_t dest = vm::kNoRegister);
+			void discard(ast::Expression&);
+			void statement(ast::Statement&);
+			void store(ast::Expression& lhs, uint32_t value);
+			void call(ast::CallExpression&, bool discard);
+			void waittill(ast::CallExpression&);
+
+		  public:
+			RegisterCompiler(const Options& options = Options()) : m_options(options)
+			{
+			}
+			//sets register_function of every function in files that has a declaration in the refmap
+			//returns false (and prints the error) if any file failed to compile
+			bool compile(script::ReferenceMap&, CompiledFiles& files);
+			void compile_function(const std::string& file, ast::FunctionDeclaration&, CompiledFunction&);
+
+			size_t num_instructions()
+			{
+				return m_num_instructions;
+			}
+
+			// Inherited via ASTVisitor
+			virtual void visit(ast::Program&) override;
+			virtual void visit(ast::FunctionDeclaration&) override;
+			virtual void visit(ast::SwitchCase&) override;
+			virtual void visit(ast::Directive&) override;
+			virtual void visit(ast::BlockStatement&) override;
+			virtual void visit(ast::IfStatement&) override;
+			virtual void visit(ast::WhileStatement&) override;
+			virtual void visit(ast::ForStatement&) override;
+			virtual void visit(ast::DoWhileStatement&) override;
+			virtual void visit(ast::ReturnStatement&) override;
+			virtual void visit(ast::BreakStatement&) override;
+			virtual void visit(ast::WaitStatement&) override;
+			virtual void visit(ast::WaitTillFrameEndStatement&) override;
+			virtual void visit(ast::ExpressionStatement&) override;
+			virtual void visit(ast::EmptyStatement&) override;
+			virtual void visit(ast::ContinueStatement&) override;
+			virtual void visit(ast::SwitchStatement&) override;
+			virtual void visit(ast::LocalizedString&) override;
+			virtual void visit(ast::Literal&) override;
+			virtual void visit(ast::Identifier&) override;
+			virtual void visit(ast::FunctionPointer&) override;
+			virtual void visit(ast::BinaryExpression&) override;
+			virtual void visit(ast::AssignmentExpression&) override;
+			virtual void visit(ast::CallExpression&) override;
+			virtual void visit(ast::ConditionalExpression&) override;
+			virtual void visit(ast::MemberExpression&) override;
+			virtual void visit(ast::UnaryExpression&) override;
+			virtual void visit(ast::VectorExpression&) override;
+			virtual void visit(ast::ArrayExpression&) override;
+		};
+	};
+};
@@ -0,0 +1,87 @@
+#include "tree_shaker.h"
+#include <script/compiler/visitors/function_call_reference.h>
+#include <common/stringutil.h>
+#include <algorithm>
+
+namespace script
+{
+	namespace compiler
+	{
+		static std::string normalize_file(const std::string& file)
+		{
+			std::string s = util::string::to_lower(file);
+			std::replace(s.begin(), s.end(), '\\', '/');
+			return s;
+		}
+
+		void TreeShaker::reach(const std::string& file, ast::FunctionDeclaration* fn)
+		{
+			if (m_reached.insert(fn).second)
+				m_pending.emplace_back(file, fn);
+		}
+
+		void TreeShaker::reach(const std::string& file, const std::string& function)
+		{
+			std::string name = util::string::to_lower(function);
+			if (!file.empty())
+			{
+				//the file the solver was started with keeps the name it was given
+				auto fnd = m_refmap.find(file);
+				if (fnd == m_refmap.end())
+					fnd = m_refmap.find(normalize_file(file));
+				if (fnd != m_refmap.end())
+				{
+					auto fn = fnd->second.function_map.find(name);
+					if (fn != fnd->second.function_map.end())
+					{
+						reach(fnd->first, fn->second);
+						return;
+					}
+				}
+			}
+			for (auto& it : m_refmap)
+			{
+				auto fn = it.second.function_map.find(name);
+				if (fn != it.second.function_map.end())
+					reach(it.first, fn->second);
+			}
+		}
+
+		size_t TreeShaker::shake()
+		{
+			m_reached.clear();
+			m_pending.clear();
+			for (auto& entry : m_entry_points)
+				reach(entry.first, entry.second);
+			while (!m_pending.empty())
+			{
+				auto [file, fn] = m_pending.back();
+				m_pending.pop_back();
+				FunctionCallReferenceVisitor fcrv(file);
+				fcrv.visit_node(*fn);
+				for (auto& ref : fcrv.references())
+				{
+					for (auto& function : ref.second)
+						reach(ref.first, function);
+				}
+			}
+
+			size_t removed = 0;
+			for (auto& it : m_refmap)
+			{
+				auto& functions = it.second.function_map;
+				for (auto fn = functions.begin(); fn != functions.end();)
+				{
+					if (m_reached.find(fn->second) == m_reached.end())
+					{
+						fn = functions.erase(fn);
+						++removed;
+					}
+					else
+						++fn;
+				}
+			}
+			return removed;
+		}
+	}; // namespace compiler
+};	   // namespace script
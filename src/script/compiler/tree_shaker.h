@@ -0,0 +1,39 @@
+#pragma once
+#include <script/compiler/compiler.h>
+#include <script/ast/nodes.h>
+#include <unordered_set>
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace script
+{
+	namespace compiler
+	{
+		//removes the functions that can't be reached from the entry points from the function_map of every file, so they're never optimized or compiled
+		//a function is reached through a call or a function pointer (::foo, maps\mp\_utility::foo) in a function that is
+		//the vm looks a function up by name in every file when the file of the call doesn't define it, such a reference keeps every function with that name
+		class TreeShaker
+		{
+			script::ReferenceMap& m_refmap;
+			std::vector<std::pair<std::string, std::string>> m_entry_points;
+			std::unordered_set<ast::FunctionDeclaration*> m_reached;
+			std::vector<std::pair<std::string, ast::FunctionDeclaration*>> m_pending;
+
+			void reach(const std::string& file, const std::string& function);
+			void reach(const std::string& file, ast::FunctionDeclaration* fn);
+
+		  public:
+			TreeShaker(script::ReferenceMap& refmap) : m_refmap(refmap)
+			{
+			}
+			//with an empty file every function with that name is kept, for callbacks the host looks up itself
+			void add_entry_point(const std::string& file, const std::string& function)
+			{
+				m_entry_points.emplace_back(file, function);
+			}
+			//returns the amount of functions that got removed
+			size_t shake();
+		};
+	}; // namespace compiler
+};	   // namespace script
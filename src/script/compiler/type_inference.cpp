@@ -0,0 +1,391 @@
+#include "type_inference.h"
+#include <script/compiler/compiler.h>
+#include <parse/token.h>
+#include <common/stringutil.h>
+
+namespace script
+{
+	namespace compiler
+	{
+		using Type = TypeInference::Type;
+
+		Type TypeInference::join(Type a, Type b)
+		{
+			return a == b ? a : Type::kUnknown;
+		}
+
+		void TypeInference::join(State& into, const State& other)
+		{
+			if (!other.reachable)
+				return;
+			if (!into.reachable)
+			{
+				into = other;
+				return;
+			}
+			for (auto it = into.variables.begin(); it != into.variables.end();)
+			{
+				auto fnd = other.variables.find(it->first);
+				if (fnd == other.variables.end() || fnd->second != it->second)
+					it = into.variables.erase(it);
+				else
+					++it;
+			}
+		}
+
+		Type TypeInference::result(int op, Type a, Type b)
+		{
+			bool compare = op == parse::TokenType_kEq || op == parse::TokenType_kNeq;
+			bool ordered = op == '<' || op == '>' || op == parse::TokenType_kLeq || op == parse::TokenType_kGeq;
+			bool arithmetic = op == '+' || op == '-' || op == '*' || op == '/';
+			//the other operand gets converted to a string whatever it is
+			if (a == Type::kString || b == Type::kString)
+			{
+				if (op == '+')
+					return Type::kString;
+				return compare ? Type::kInteger : Type::kUnknown;
+			}
+			if (a == Type::kUnknown || b == Type::kUnknown)
+				return Type::kUnknown;
+			if (a == Type::kVector || b == Type::kVector)
+			{
+				if (a == Type::kVector && (b == Type::kVector || b == Type::kNumber) && arithmetic)
+					return Type::kVector;
+				return Type::kUnknown;
+			}
+			if (a == Type::kNumber || b == Type::kNumber)
+			{
+				if (arithmetic || op == '%')
+					return Type::kNumber;
+				return compare || ordered ? Type::kInteger : Type::kUnknown;
+			}
+			switch (op)
+			{
+			case '+':
+			case '-':
+			case '*':
+			case '/':
+			case '%':
+			case '&':
+			case '|':
+			case parse::TokenType_kLsht:
+			case parse::TokenType_kRsht:
+			case parse::TokenType_kAndAnd:
+			case parse::TokenType_kOrOr:
+				return Type::kInteger;
+			}
+			return compare || ordered ? Type::kInteger : Type::kUnknown;
+		}
+
+		Type TypeInference::variable(const std::string& name)
+		{
+			auto fnd = m_state.variables.find(util::string::to_lower(name));
+			return fnd == m_state.variables.end() ? Type::kUnknown : fnd->second;
+		}
+
+		void TypeInference::assign(ast::Expression& lhs, Type t)
+		{
+			auto* id = lhs.cast<ast::Identifier>();
+			if (!id || !id->file_reference.empty())
+				return;
+			std::string name = util::string::to_lower(id->name);
+			//these don't live in the function, the host or another thread can change them at any time
+			if (name == "level" || name == "game" || m_globals.find(name) != m_globals.end())
+				return;
+			if (t == Type::kUnknown)
+				m_state.variables.erase(name);
+			else
+				m_state.variables[name] = t;
+		}
+
+		void TypeInference::lvalue(ast::Expression& lhs)
+		{
+			auto* n = lhs.cast<ast::MemberExpression>();
+			if (!n)
+				return;
+			std::string prop;
+			if (!get_property(*n->prop, prop, n->op))
+				expression(*n->prop);
+			lvalue(*n->object);
+		}
+
+		void TypeInference::record(ast::Node& n, Type a, Type b)
+		{
+			//a node can be reached more than once (loops, shared switch cases), it has to hold for all of them
+			auto fnd = m_operands.find(&n);
+			if (fnd == m_operands.end())
+			{
+				m_operands[&n] = {a, b};
+				return;
+			}
+			fnd->second.a = join(fnd->second.a, a);
+			fnd->second.b = join(fnd->second.b, b);
+		}
+
+		//walks in the same order Compiler emits code so assignments inside expressions are seen where they happen
+		Type TypeInference::expression(ast::Expression& e)
+		{
+			if (auto* n = e.cast<ast::Literal>())
+			{
+				switch (n->type)
+				{
+				case ast::Literal::Type::kInteger:
+					return Type::kInteger;
+				case ast::Literal::Type::kNumber:
+					return Type::kNumber;
+				case ast::Literal::Type::kString:
+					return Type::kString;
+				default:
+					break;
+				}
+				return Type::kUnknown;
+			}
+			if (auto* n = e.cast<ast::Identifier>())
+			{
+				if (!n->file_reference.empty())
+					return Type::kUnknown;
+				return variable(n->name);
+			}
+			if (auto* n = e.cast<ast::BinaryExpression>())
+			{
+				if (n->op == parse::TokenType_kAndAnd)
+				{
+					expression(*n->left);
+					State skipped = m_state;
+					expression(*n->right);
+					join(m_state, skipped);
+					return Type::kInteger;
+				}
+				Type b = expression(*n->right);
+				Type a = expression(*n->left);
+				record(*n, a, b);
+				return result(n->op, a, b);
+			}
+			if (auto* n = e.cast<ast::UnaryExpression>())
+			{
+				switch (n->op)
+				{
+				case '-':
+				{
+					//0 - argument
+					Type b = expression(*n->argument);
+					record(*n, Type::kInteger, b);
+					return result('-', Type::kInteger, b);
+				}
+				case '!':
+				case '~':
+					expression(*n->argument);
+					return Type::kInteger;
+				case parse::TokenType_kPlusPlus:
+				case parse::TokenType_kMinusMinus:
+				{
+					Type a = expression(*n->argument);
+					record(*n, a, Type::kInteger);
+					lvalue(*n->argument);
+					assign(*n->argument, result(n->op == parse::TokenType_kPlusPlus ? '+' : '-', a, Type::kInteger));
+					return expression(*n->argument);
+				}
+				}
+				expression(*n->argument);
+				return Type::kUnknown;
+			}
+			if (auto* n = e.cast<ast::AssignmentExpression>())
+			{
+				Type t = expression(*n->rhs);
+				if (n->op != '=')
+				{
+					Type a = expression(*n->lhs);
+					record(*n, a, t);
+					t = result(compound_assignment_operator(n->op), a, t);
+				}
+				lvalue(*n->lhs);
+				assign(*n->lhs, t);
+				lvalue(*n->lhs);
+				//leaves a reference behind
+				return Type::kUnknown;
+			}
+			if (auto* n = e.cast<ast::CallExpression>())
+			{
+				auto* id = n->callee->cast<ast::Identifier>();
+				if (id && id->name == "waittill")
+				{
+					if (!n->arguments.empty())
+						expression(*n->arguments[0]);
+					if (n->object)
+						expression(*n->object);
+					for (size_t i = 1; i < n->arguments.size(); ++i)
+						assign(*n->arguments[i], Type::kUnknown);
+					return Type::kUnknown;
+				}
+				for (auto it = n->arguments.rbegin(); it != n->arguments.rend(); ++it)
+					expression(**it);
+				if (n->pointer || !id)
+					expression(*n->callee);
+				if (n->object)
+					expression(*n->object);
+				return Type::kUnknown;
+			}
+			if (auto* n = e.cast<ast::MemberExpression>())
+			{
+				std::string prop;
+				if (!get_property(*n->prop, prop, n->op))
+					expression(*n->prop);
+				expression(*n->object);
+				return Type::kUnknown;
+			}
+			if (auto* n = e.cast<ast::VectorExpression>())
+			{
+				for (auto it = n->elements.rbegin(); it != n->elements.rend(); ++it)
+					expression(**it);
+				return Type::kVector;
+			}
+			if (auto* n = e.cast<ast::ArrayExpression>())
+			{
+				for (auto it = n->elements.rbegin(); it != n->elements.rend(); ++it)
+					expression(**it);
+				return Type::kUnknown;
+			}
+			if (auto* n = e.cast<ast::ConditionalExpression>())
+			{
+				expression(*n->condition);
+				State before = m_state;
+				expression(*n->consequent);
+				State after = m_state;
+				m_state = before;
+				expression(*n->alternative);
+				join(m_state, after);
+				return Type::kUnknown;
+			}
+			return Type::kUnknown;
+		}
+
+		void TypeInference::loop(ast::Expression* test, ast::Statement& body, ast::Expression* update, bool test_first)
+		{
+			//the state at the top is the join of the one before the loop and the one at the end of every iteration
+			//types only ever get dropped so this ends after at most one more pass than there are variables
+			State head = m_state;
+			while (true)
+			{
+				m_state = head;
+				State exit;
+				exit.reachable = false;
+				if (test && test_first)
+				{
+					expression(*test);
+					exit = m_state;
+				}
+				std::vector<State> breaks, continues;
+				m_breaks.push_back(&breaks);
+				m_continues.push_back(&continues);
+				statement(body);
+				m_breaks.pop_back();
+				m_continues.pop_back();
+				for (auto& s : continues)
+					join(m_state, s);
+				if (update)
+					expression(*update);
+				if (test && !test_first)
+				{
+					expression(*test);
+					exit = m_state;
+				}
+				State next = head;
+				join(next, m_state);
+				if (next.variables == head.variables)
+				{
+					m_state = exit;
+					for (auto& s : breaks)
+						join(m_state, s);
+					return;
+				}
+				head = std::move(next);
+			}
+		}
+
+		void TypeInference::statement(ast::Statement& s)
+		{
+			if (auto* n = s.cast<ast::BlockStatement>())
+			{
+				for (auto& stmt : n->body)
+					statement(*stmt);
+			}
+			else if (auto* n = s.cast<ast::ExpressionStatement>())
+				expression(*n->expression);
+			else if (auto* n = s.cast<ast::IfStatement>())
+			{
+				expression(*n->test);
+				State before = m_state;
+				statement(*n->consequent);
+				State after = m_state;
+				m_state = before;
+				if (n->alternative)
+					statement(*n->alternative);
+				join(m_state, after);
+			}
+			else if (auto* n = s.cast<ast::WhileStatement>())
+				loop(n->test.get(), *n->body, nullptr, true);
+			else if (auto* n = s.cast<ast::ForStatement>())
+			{
+				if (n->init)
+					expression(*n->init);
+				loop(n->test.get(), *n->body, n->update.get(), true);
+			}
+			else if (auto* n = s.cast<ast::DoWhileStatement>())
+				loop(n->test.get(), *n->body, nullptr, false);
+			else if (auto* n = s.cast<ast::ReturnStatement>())
+			{
+				if (n->argument)
+					expression(*n->argument);
+				m_state.reachable = false;
+			}
+			else if (s.cast<ast::BreakStatement>())
+			{
+				if (!m_breaks.empty())
+					m_breaks.back()->push_back(m_state);
+				m_state.reachable = false;
+			}
+			else if (s.cast<ast::ContinueStatement>())
+			{
+				if (!m_continues.empty())
+					m_continues.back()->push_back(m_state);
+				m_state.reachable = false;
+			}
+			else if (auto* n = s.cast<ast::WaitStatement>())
+				expression(*n->duration);
+			else if (auto* n = s.cast<ast::SwitchStatement>())
+			{
+				expression(*n->discriminant);
+				State entry = m_state;
+				State exit;
+				exit.reachable = false;
+				bool has_default = false;
+				std::vector<State> breaks;
+				m_breaks.push_back(&breaks);
+				for (auto& c : n->cases)
+				{
+					if (!c->test)
+						has_default = true;
+					m_state = entry;
+					for (auto& stmt : c->consequent)
+						statement(*stmt);
+					join(exit, m_state);
+				}
+				m_breaks.pop_back();
+				if (!has_default)
+					join(exit, entry);
+				for (auto& b : breaks)
+					join(exit, b);
+				m_state = std::move(exit);
+			}
+		}
+
+		void TypeInference::run(ast::FunctionDeclaration& n)
+		{
+			m_state = State();
+			m_operands.clear();
+			m_breaks.clear();
+			m_continues.clear();
+			statement(*n.body);
+		}
+	}; // namespace compiler
+};	   // namespace script
@@ -0,0 +1,70 @@
+#pragma once
+#include <script/ast/nodes.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
+#include <vector>
+
+namespace script
+{
+	namespace compiler
+	{
+		//flow sensitive type inference for the locals of a function, so Compiler can pick a specialized BinOp
+		//a type is only known if every path reaching it agrees, anything the script can't see (fields, return values, parameters) is unknown
+		class TypeInference
+		{
+		  public:
+			enum class Type : uint8_t
+			{
+				kUnknown,
+				kInteger,
+				kNumber,
+				kVector,
+				kString
+			};
+			//operands of a BinOp as the vm sees them, a is the one on top of the stack
+			struct Operands
+			{
+				Type a = Type::kUnknown;
+				Type b = Type::kUnknown;
+			};
+
+		  private:
+			struct State
+			{
+				std::unordered_map<std::string, Type> variables;
+				bool reachable = true;
+			};
+			const std::unordered_set<std::string>& m_globals;
+			State m_state;
+			std::unordered_map<ast::Node*, Operands> m_operands;
+			//states at every break/continue of the innermost loop or switch
+			std::vector<std::vector<State>*> m_breaks;
+			std::vector<std::vector<State>*> m_continues;
+
+			static Type join(Type a, Type b);
+			static void join(State& into, const State& other);
+			Type variable(const std::string& name);
+			void assign(ast::Expression& lhs, Type t);
+			void lvalue(ast::Expression& lhs);
+			void record(ast::Node& n, Type a, Type b);
+			Type expression(ast::Expression& e);
+			void statement(ast::Statement& s);
+			void loop(ast::Expression* test, ast::Statement& body, ast::Expression* update, bool test_first);
+
+		  public:
+			TypeInference(const std::unordered_set<std::string>& globals) : m_globals(globals)
+			{
+			}
+			void run(ast::FunctionDeclaration& n);
+			//unknown for both if n wasn't reached or the types differ between paths
+			Operands operands(ast::Node& n) const
+			{
+				auto fnd = m_operands.find(&n);
+				return fnd == m_operands.end() ? Operands() : fnd->second;
+			}
+			//what VirtualMachine::binop returns for these operand types, kUnknown if it depends on the values or throws
+			static Type result(int op, Type a, Type b);
+		};
+	}; // namespace compiler
+};	   // namespace script
@@ -42,7 +42,7 @@ namespace script
 				m_references[util::string::to_lower(ref)].insert(util::string::to_lower(id->name));
 				return true;
 			}
-			#if 0
+			//maps\mp\_utility::foo used as a function pointer
 			virtual bool pre_visit(ast::Identifier& n) override
 			{
 				if (n.file_reference.empty())
@@ -51,10 +51,9 @@ namespace script
 				}
 				std::string ref = n.file_reference;
 				std::replace(ref.begin(), ref.end(), '\\', '/');
-				m_references[ref].insert(n.name);
+				m_references[util::string::to_lower(ref)].insert(util::string::to_lower(n.name));
 				return false;
 			}
-			#endif
 		};
 	};
 };
\ No newline at end of file
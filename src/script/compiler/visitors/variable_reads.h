@@ -0,0 +1,55 @@
+#pragma once
+#include <script/ast/recursive_visitor.h>
+#include <unordered_set>
+#include <string>
+#include <common/stringutil.h>
+
+namespace script
+{
+	namespace compiler
+	{
+		//collects every variable that gets read (or referenced) inside a node
+		//a plain store (x = ...) doesn't count as a read, compound assignments and member stores (x.y = ...) do
+		class VariableReadVisitor : public ast::RecursiveASTVisitor
+		{
+			std::unordered_set<std::string> m_reads;
+
+		  public:
+			std::unordered_set<std::string>& reads()
+			{
+				return m_reads;
+			}
+			virtual bool pre_visit(ast::Identifier& n) override
+			{
+				if (n.file_reference.empty())
+					m_reads.insert(util::string::to_lower(n.name));
+				return false;
+			}
+			virtual bool pre_visit(ast::CallExpression& n) override
+			{
+				if (n.object)
+					n.object->accept(*this);
+				for (auto& arg : n.arguments)
+					arg->accept(*this);
+				//callee is a function name unless it's a pointer call
+				if (n.pointer || !n.callee->cast<ast::Identifier>())
+					n.callee->accept(*this);
+				return false;
+			}
+			virtual bool pre_visit(ast::MemberExpression& n) override
+			{
+				n.object->accept(*this);
+				if (n.op != '.' || !n.prop->cast<ast::Identifier>())
+					n.prop->accept(*this);
+				return false;
+			}
+			virtual bool pre_visit(ast::AssignmentExpression& n) override
+			{
+				n.rhs->accept(*this);
+				if (n.op != '=' || !n.lhs->cast<ast::Identifier>())
+					n.lhs->accept(*this);
+				return false;
+			}
+		};
+	};
+};
@@ -1,13 +1,67 @@
 #pragma once
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
 
 namespace script
 {
+	//filled in when it's asked for, e.g when an error gets reported
 	struct DebugInfo
 	{
 		std::string file;
 		std::string function;
-		size_t line;
+		size_t line = 0;
 		std::string expression_string;
 	};
-};
\ No newline at end of file
+
+	//where a node starts in the source, the file is kept once by the function it's in
+	struct SourceLocation
+	{
+		uint32_t line = 0;
+	};
+
+	//line of every instruction of a function, an entry holds from it's offset until the next one
+	struct LineTable
+	{
+		struct Entry
+		{
+			uint32_t offset;
+			uint32_t line;
+		};
+		//path of the source file as it was read
+		std::string source;
+		std::vector<Entry> entries;
+
+		void add(size_t offset, size_t line)
+		{
+			if (!entries.empty() && entries.back().line == line)
+				return;
+			//the last line didn't get any instructions
+			if (!entries.empty() && entries.back().offset == offset)
+				entries.back().line = (uint32_t)line;
+			else
+				entries.push_back({(uint32_t)offset, (uint32_t)line});
+		}
+		//0 if there's no entry for it
+		size_t line(size_t offset) const
+		{
+			auto it = std::upper_bound(entries.begin(), entries.end(), offset,
+									   [](size_t o, const Entry& e) { return o < e.offset; });
+			if (it == entries.begin())
+				return 0;
+			return (it - 1)->line;
+		}
+		bool empty() const
+		{
+			return entries.empty();
+		}
+		void clear()
+		{
+			source.clear();
+			source.shrink_to_fit();
+			entries.clear();
+			entries.shrink_to_fit();
+		}
+	};
+};
@@ -0,0 +1,145 @@
+#include "reference_solver.h"
+#include <common/hash.h>
+#include <common/stringutil.h>
+#include <script/ast/ast_generator.h>
+#include <script/ast/type_visitor.h>
+#include <script/compiler/exception.h>
+#include <script/compiler/visitors/function_call_reference.h>
+#include <exception>
+#include <map>
+#include <set>
+
+namespace script
+{
+	struct ReferenceSolver::LoadResult
+	{
+		std::string file;
+		script::LoadedProgramReference lpr;
+		std::vector<std::string> references;
+		std::exception_ptr error;
+		bool from_cache = false;
+		compiler::CompiledFunctions compiled;
+	};
+
+	void ReferenceSolver::load(const std::string& file, LoadResult& result)
+	{
+		std::string path = m_path_base + file + ".gsc";
+		u64 cache_key = 0;
+		if (m_cache || m_key_sources)
+		{
+			auto source = m_fs.view_entry(path);
+			if (!source)
+				throw script::compiler::CompileException("Failed to read file {}, {}", file, path);
+			cache_key = m_cache ? m_cache->key(file, *source) : fnv1a_64(source->data(), source->size());
+			if (m_cache && m_cache->load(file, cache_key, result.compiled, result.references))
+			{
+				result.from_cache = true;
+				return;
+			}
+		}
+		script::ast::ASTGenerator generator;
+		generator.set_skip_function_bodies(m_lazy);
+		if (!generator.generate(m_fs, m_path_base, path))
+		{
+			throw script::compiler::CompileException("Failed to read file {}, {}", file, path);
+		}
+		auto& lpr = result.lpr;
+		lpr.cache_key = cache_key;
+		lpr.program = std::move(generator.root());
+		lpr.name = file;
+
+		script::ast::NodeTypeVisitor<script::ast::FunctionDeclaration> ntv;
+		auto& fun = ntv.find(lpr.program.get());
+		for (auto* f : fun)
+		{
+			lpr.function_map[util::string::to_lower(f->function_name)] = f;
+		}
+
+		script::compiler::FunctionCallReferenceVisitor fcrv(file);
+		fcrv.visit_node(*lpr.program.get());
+		//a skipped body is just tokens, file::function in there is enough to know which files it calls into
+		//return ::foo is a pointer to a function in this file, not a file named return
+		static const std::set<std::string> keywords = {"return", "wait", "thread", "case", "else", "do"};
+		for (auto* f : fun)
+		{
+			auto& tokens = f->skipped_body;
+			for (size_t i = 2; i < tokens.size(); ++i)
+			{
+				if (tokens[i - 1].type != parse::token_type::double_colon || tokens[i - 2].type != parse::token_type::identifier ||
+					tokens[i].type != parse::token_type::identifier)
+					continue;
+				std::string ref = tokens[i - 2].to_string();
+				if (keywords.find(ref) != keywords.end())
+					continue;
+				std::replace(ref.begin(), ref.end(), '\\', '/');
+				fcrv.references()[util::string::to_lower(ref)].insert(util::string::to_lower(tokens[i].to_string()));
+			}
+		}
+		for (auto& pair_ : fcrv.references())
+			result.references.push_back(pair_.first);
+		lpr.references = result.references;
+	}
+
+	void ReferenceSolver::solve(const std::string& file, script::ReferenceMap& refmap, compiler::CompiledFiles* cached)
+	{
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::vector<std::unique_ptr<LoadResult>> finished;
+		std::set<std::string> scheduled;
+		size_t pending = 0;
+
+		auto schedule = [&](const std::string& name) {
+			if (refmap.find(name) != refmap.end() || !scheduled.insert(name).second)
+				return;
+			++pending;
+			m_pool.push([&, name] {
+				auto result = std::make_unique<LoadResult>();
+				result->file = name;
+				try
+				{
+					load(name, *result);
+				}
+				catch (...)
+				{
+					result->error = std::current_exception();
+				}
+				std::lock_guard<std::mutex> lock(mutex);
+				finished.push_back(std::move(result));
+				cv.notify_one();
+			});
+		};
+
+		//every reachable file gets loaded even if one fails, so the error that gets reported doesn't depend on timing
+		std::map<std::string, std::exception_ptr> errors;
+		schedule(file);
+		while (pending > 0)
+		{
+			std::vector<std::unique_ptr<LoadResult>> results;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cv.wait(lock, [&] { return !finished.empty(); });
+				results.swap(finished);
+			}
+			for (auto& result : results)
+			{
+				--pending;
+				if (result->error)
+				{
+					errors[result->file] = result->error;
+					continue;
+				}
+				if (result->from_cache)
+				{
+					if (cached)
+						(*cached)[util::string::to_lower(result->file)] = std::move(result->compiled);
+				}
+				else
+					refmap[result->file] = std::move(result->lpr);
+				for (auto& ref : result->references)
+					schedule(ref);
+			}
+		}
+		if (!errors.empty())
+			std::rethrow_exception(errors.begin()->second);
+	}
+}; // namespace script
@@ -0,0 +1,48 @@
+#pragma once
+#include <core/filesystem/api.h>
+#include <core/thread_pool.h>
+#include <script/compiler/compiler.h>
+#include <script/compiler/bytecode_cache.h>
+#include <string>
+
+namespace script
+{
+	//loads a file and every file it references (directly or through other files) into a ReferenceMap
+	//files are read, preprocessed and parsed on the thread pool as soon as they're discovered
+	//the filesystem has to allow concurrent read_entry calls
+	class ReferenceSolver
+	{
+		filesystem_api& m_fs;
+		core::thread_pool& m_pool;
+		std::string m_path_base;
+		compiler::BytecodeCache* m_cache = nullptr;
+		bool m_lazy = false;
+		bool m_key_sources = false;
+
+		struct LoadResult;
+		void load(const std::string& file, LoadResult&);
+
+	  public:
+		ReferenceSolver(filesystem_api& fs, core::thread_pool& pool, const std::string& path_base)
+			: m_fs(fs), m_pool(pool), m_path_base(path_base)
+		{
+		}
+		//files found in the cache skip the front end and end up in cached instead of the ReferenceMap
+		void set_cache(compiler::BytecodeCache* cache)
+		{
+			m_cache = cache;
+		}
+		//only parse the function signatures, the bodies are kept as tokens for compile_lazy
+		void set_lazy(bool lazy)
+		{
+			m_lazy = lazy;
+		}
+		//set cache_key of every file even without a cache, to tell if a file changed since it was last loaded
+		void set_key_sources(bool key_sources)
+		{
+			m_key_sources = key_sources;
+		}
+		//throws the error of the first failing file (by name) after everything that could be loaded is loaded
+		void solve(const std::string& file, script::ReferenceMap&, compiler::CompiledFiles* cached = nullptr);
+	};
+}; // namespace script
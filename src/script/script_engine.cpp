@@ -7,6 +7,9 @@
 #include <script/ast/type_visitor.h>
 #include <script/compiler/compiler.h>
 #include <script/compiler/exception.h>
+#include <script/compiler/optimizer.h>
+#include <script/compiler/tree_shaker.h>
+#include <script/reference_solver.h>
 #include <script/stockfunctions.h>
 #include <script/vm/types.h>
 #include <script/vm/virtual_machine.h>
@@ -15,64 +18,27 @@
 
 namespace script
 {
-	class ReferenceSolver
+	//the source of a line, only read when an error gets reported
+	static std::string source_line(filesystem_api& fs, const std::string& path, size_t line)
 	{
-		std::string path_base;
-		std::string m_filename;
-		const std::string& m_library_path;
-		script::ReferenceMap& m_global_reference_map;
-
-	  public:
-		ReferenceSolver(filesystem_api &fs, const std::string path_base_, const std::string file_name_,
-						script::ReferenceMap& global_reference_map, const std::string& library_path)
-			: m_global_reference_map(global_reference_map),
-			  path_base(path_base_),
-			  m_filename(file_name_),
-			  m_library_path(library_path)
-		{
-			// first get all the functions that we reference
-			script::ast::ASTGenerator m_generator;
-			bool ret = false;
-			//if (m_filename.find('/') == std::string::npos)
-				//ret = m_generator.generate(fs, m_library_path, m_library_path + m_filename + ".gsc");
-			//else
-				ret = m_generator.generate(fs, path_base, path_base + m_filename + ".gsc");
-			if (!ret)
-			{
-				throw script::compiler::CompileException("Failed to read file {}, {}", m_filename,
-														 path_base + m_filename + ".gsc");
-				//LOG_ERROR("Failed to read file '%s'\n", m_filename.c_str());
-			}
-			script::LoadedProgramReference& lpr = m_global_reference_map[file_name_];
-			lpr.program = std::move(m_generator.root());
-			lpr.name = m_filename;
-
-			script::ast::NodeTypeVisitor<script::ast::FunctionDeclaration> ntv;
-			auto& fun = ntv.find(lpr.program.get());
-			for (auto* f : fun)
-			{
-				lpr.function_map[util::string::to_lower(f->function_name)] = f;
-			}
-
-			// lpr.m_parent_visitor.visit_node(*lpr.program.get());
-
-			script::compiler::FunctionCallReferenceVisitor fcrv(m_filename);
-			fcrv.visit_node(*lpr.program.get());
-
-			// add the references found to the global references
-			// not using it atm, we just load and keep the whole tree, but was maybe nice to only specific functions
-			for (auto& pair_ : fcrv.references())
-			{
-				// for (auto & function_ : pair_.second)
-				// m_global_reference_map[pair_.first].insert(function_);
-				// if (pair_.first != m_filename)
-				if (m_global_reference_map.find(pair_.first) == m_global_reference_map.end())
-				{
-					ReferenceSolver solver(fs, path_base_, pair_.first, global_reference_map, m_library_path);
-				}
-			}
+		std::string text;
+		if (!fs.read_text_entry(path, text))
+			return "";
+		size_t start = 0;
+		for (size_t i = 0; i < line; ++i)
+		{
+			start = text.find('\n', start);
+			if (start == std::string::npos)
+				return "";
+			++start;
 		}
-	};
+		size_t end = text.find('\n', start);
+		std::string s = text.substr(start, end == std::string::npos ? end : end - start);
+		size_t first = s.find_first_not_of(" \t");
+		if (first == std::string::npos)
+			return "";
+		return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+	}
 
 	ScriptEngine::ScriptEngine(filesystem_api &fs) : m_fs(fs)
 	{
@@ -93,6 +59,8 @@ namespace script
 		}
 		catch (vm::Exception& ex)
 		{
+			auto& dbg = m_vm->get_debug_info();
+			dbg.expression_string = source_line(m_fs, dbg.file, dbg.line);
 			m_vm->dump(m_vm->get_last_thread());
 			auto* lt = m_vm->get_last_thread();
 			if (lt)
@@ -104,7 +72,6 @@ namespace script
 					lt->function_name_stack.pop();
 				}
 			}
-			auto& dbg = m_vm->get_debug_info();
 			LOG_ERROR("Script Error: [%s:%s:%d] '%s' [%s]\n", dbg.file.c_str(), dbg.function.c_str(), dbg.line, ex.what(), dbg.expression_string.c_str());
 			m_vm.reset();
 		}
@@ -168,6 +135,36 @@ namespace script
 			m_vm.reset();
 		}
 	}
+	vm::PreparedCall ScriptEngine::prepare_call(const std::string file, const std::string function)
+	{
+		if (!m_vm)
+			return {};
+		return m_vm->prepare_call(file, function);
+	}
+
+	bool ScriptEngine::call(const vm::PreparedCall& pc, vm::ObjectPtr object, std::span<const vm::Variant> args,
+							vm::Variant* result)
+	{
+		if (!m_vm || !pc)
+			return false;
+		//a handle from before a load isn't worth tearing the vm down for
+		if (!m_vm->is_current(pc))
+		{
+			LOG_WARNING("Script Error: prepared call is from before files were loaded again, prepare it again\n");
+			return false;
+		}
+		try
+		{
+			return m_vm->call(pc, object, args, result);
+		}
+		catch (vm::Exception& ex)
+		{
+			LOG_ERROR("Script Error: %s\n", ex.what());
+			m_vm.reset();
+		}
+		return false;
+	}
+
 	bool ScriptEngine::load_file(const std::string path)
 	{
 		return load_file(m_fs, path);
@@ -176,14 +173,113 @@ namespace script
 	{
 		try
 		{
+			if (!m_pool)
+				m_pool = std::make_unique<core::thread_pool>();
 			script::ReferenceMap refmap;
-			ReferenceSolver rs(fs, "", path, refmap, m_library_path);
-			script::compiler::Compiler compiler(refmap);
-			auto cf = compiler.compile();
-			for (auto& it : cf)
+			script::compiler::CompiledFiles cached;
+			size_t hits = m_cache ? m_cache->hits() : 0, misses = m_cache ? m_cache->misses() : 0;
+			//globals the host set since are as good as declared ones, before the cache keys depend on them
+			if (m_vm)
+			{
+				bool added = false;
+				for (auto& it : m_vm->get_globals())
+					added |= m_optimizer_options.globals.insert(it.first).second;
+				if (added && m_cache)
+					m_cache->set_salt(m_optimizer_options.hash());
+			}
+			ReferenceSolver rs(fs, *m_pool, "");
+			rs.set_cache(m_cache.get());
+			rs.set_lazy(m_lazy);
+			//a cache entry has to hold every function of it's file
+			bool shake = !m_entry_points.empty() && !m_cache && !m_lazy;
+			rs.set_key_sources(shake);
+			rs.solve(path, refmap, &cached);
+			if (shake)
+			{
+				script::compiler::TreeShaker shaker(refmap);
+				for (auto& entry : m_entry_points)
+					shaker.add_entry_point(entry.first, entry.second);
+				size_t removed = shaker.shake();
+				if (m_optimizer_options.report)
+					printf("removed %zu unreachable functions\n", removed);
+			}
+			std::unordered_set<std::string> failed;
+			script::compiler::Compiler::Options compiler_options;
+			compiler_options.globals = m_optimizer_options.globals;
+			compiler_options.report = m_optimizer_options.report;
+			//entries in the cache keep their line tables, they get dropped below
+			compiler_options.strip_debug_info = m_strip_debug_info && (!m_cache || m_lazy);
+			script::compiler::CompiledFiles cf;
+			if (m_lazy)
+				cf = script::compiler::compile_lazy(refmap, {m_optimizer_options, compiler_options, false});
+			else
+			{
+				script::compiler::Optimizer optimizer(m_optimizer_options);
+				optimizer.optimize(refmap);
+				cf = script::compiler::Compiler::compile(refmap, *m_pool, &failed, compiler_options);
+			}
+			//stubs have no code to store
+			if (m_cache && !m_lazy)
+			{
+				for (auto& it : refmap)
+				{
+					if (failed.find(it.first) != failed.end())
+						continue;
+					auto* lpr = &it.second;
+					auto* functions = &cf[util::string::to_lower(it.first)];
+					auto* file = &it.first;
+					m_pool->push([this, lpr, functions, file] {
+						m_cache->store(*file, lpr->cache_key, *functions, lpr->references);
+					});
+				}
+				m_pool->wait();
+				printf("bytecode cache: %zu hits, %zu misses\n", m_cache->hits() - hits, m_cache->misses() - misses);
+			}
+			if (m_strip_debug_info)
+			{
+				for (auto* files : {&cached, &cf})
+				{
+					for (auto& it : *files)
+					{
+						for (auto& fn : it.second)
+							fn.second.lines.clear();
+					}
+				}
+			}
+			for (auto& it : cached)
 			{
 				m_compiledfiles[it.first] = it.second;
 			}
+			//compiled files are keyed by the lower case name
+			std::unordered_map<std::string, u64> keys;
+			if (shake)
+			{
+				for (auto& it : refmap)
+					keys[util::string::to_lower(it.first)] = it.second.cache_key;
+			}
+			for (auto& it : cf)
+			{
+				auto& functions = m_compiledfiles[it.first];
+				//an earlier load of the same source may have kept functions that are only reachable from other files
+				if (shake)
+				{
+					u64 key = keys[it.first];
+					auto previous = m_shaken_sources.find(it.first);
+					bool unchanged = previous != m_shaken_sources.end() && previous->second == key;
+					m_shaken_sources[it.first] = key;
+					if (unchanged)
+					{
+						for (auto& fn : it.second)
+							functions[fn.first] = fn.second;
+						continue;
+					}
+				}
+				functions = it.second;
+			}
+			if (m_vm)
+				m_vm->files_changed();
+			if (m_lazy && m_warm_up_lazy)
+				m_warm_up.start(m_compiledfiles);
 		}
 		catch (script::ast::ASTException& e)
 		{
@@ -197,6 +293,31 @@ namespace script
 		}
 		return true;
 	}
+	bool ScriptEngine::load_native(const std::string path)
+	{
+		auto library = std::make_unique<script::compiler::NativeLibrary>();
+		script::compiler::CompiledFiles files;
+		std::string error;
+		if (!library->open(path, error) || !library->load(files, error))
+		{
+			LOG_WARNING("Native module Error: %s\n", error.c_str());
+			return false;
+		}
+		for (auto& it : files)
+		{
+			if (m_strip_debug_info)
+			{
+				for (auto& fn : it.second)
+					fn.second.lines.clear();
+			}
+			m_shaken_sources.erase(it.first);
+			m_compiledfiles[it.first] = std::move(it.second);
+		}
+		if (m_vm)
+			m_vm->files_changed();
+		m_native_libraries.push_back(std::move(library));
+		return true;
+	}
 	void ScriptEngine::create_virtual_machine()
 	{
 		m_vm = std::make_unique<script::vm::VirtualMachine>(m_compiledfiles);
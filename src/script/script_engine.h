@@ -1,6 +1,11 @@
 #pragma once
 #include <core/filesystem/api.h>
+#include <core/thread_pool.h>
 #include <script/compiler/compiler.h>
+#include <script/compiler/bytecode_cache.h>
+#include <script/compiler/lazy_function.h>
+#include <script/compiler/native_library.h>
+#include <script/compiler/optimizer.h>
 #include <script/vm/types.h>
 #include <script/vm/virtual_machine.h>
 
@@ -13,23 +18,89 @@ namespace script
 
 	class ScriptEngine
 	{
+		//first so they're closed after everything that can still point into them
+		std::vector<std::unique_ptr<script::compiler::NativeLibrary>> m_native_libraries;
 		filesystem_api& m_fs;
 		std::unique_ptr<script::vm::VirtualMachine> m_vm;
 		script::compiler::CompiledFiles m_compiledfiles;
 		std::unordered_map<std::string, StockFunction> m_registeredfunctions;
 		std::string m_library_path;
+		//files are loaded and compiled on this pool, created on first load
+		std::unique_ptr<core::thread_pool> m_pool;
+		script::compiler::Optimizer::Options m_optimizer_options;
+		std::unique_ptr<script::compiler::BytecodeCache> m_cache;
+		std::vector<std::pair<std::string, std::string>> m_entry_points;
+		//key of the source every file had when it was last shaken and compiled
+		std::unordered_map<std::string, u64> m_shaken_sources;
+		bool m_strip_debug_info = false;
+		bool m_lazy = false;
+		bool m_warm_up_lazy = false;
+		//last so it's stopped before the functions it compiles are gone
+		script::compiler::WarmUp m_warm_up;
 	  public:
 		void set_library_path(const std::string& path)
 		{
 			m_library_path = path;
 		}
+		//compiled files get stored in and loaded from this directory, files that didn't change skip compiling
+		void set_cache_path(const std::string& path)
+		{
+			//entries are only keyed by the source of their own file
+			m_optimizer_options.inline_across_files = false;
+			m_cache = std::make_unique<script::compiler::BytecodeCache>(path, m_optimizer_options.hash());
+		}
+		//once there is one only functions reachable from the entry points get compiled
+		//with an empty file every function with that name is kept, for callbacks that are looked up by name
+		//nothing gets removed while a cache path is set, an entry holds every function of it's file
+		void add_entry_point(const std::string file, const std::string function)
+		{
+			m_entry_points.emplace_back(file, function);
+		}
+		//drop the line tables of loaded functions, errors only report the file and function then
+		void set_strip_debug_info(bool strip)
+		{
+			m_strip_debug_info = strip;
+		}
+		//only parse signatures on load, a function body is parsed, optimized and compiled when it's first called
+		//there's no tree shaking and no inlining across functions then and nothing is stored in the cache
+		//with warm_up the stubs get compiled in the background after each load
+		void set_lazy_compile(bool lazy, bool warm_up = false)
+		{
+			m_lazy = lazy;
+			m_warm_up_lazy = warm_up;
+		}
+		//names the host exposes through VirtualMachine::set_global, stores to them are kept and their type is never assumed
+		//the ones set on the virtual machine by the time a file is loaded get added to these
+		void set_globals(std::unordered_set<std::string> names)
+		{
+			m_optimizer_options.globals = std::move(names);
+			if (m_cache)
+				m_cache->set_salt(m_optimizer_options.hash());
+		}
+		//print what got removed and optimized on every load
+		void set_report(bool report)
+		{
+			m_optimizer_options.report = report;
+		}
+		script::compiler::BytecodeCache* get_cache()
+		{
+			return m_cache.get();
+		}
 		ScriptEngine(filesystem_api&);
 		~ScriptEngine();
 		bool load_file(const std::string);
 		bool load_file(filesystem_api& fs, const std::string);
+		//installs the files of a module written by gsc2cpp, replacing the ones loaded with the same name
+		//the module has to be built from the same version of the compiler and vm, only runs on the stack backend
+		bool load_native(const std::string path);
 		void create_virtual_machine();
 		void execute_thread(vm::ObjectPtr, const std::string, const std::string, size_t);
 		void execute_thread(vm::ObjectPtr, const std::string, const std::string, std::vector<vm::Variant>& args);
+		//for callbacks that run often, resolve once and call the handle
+		//handles are invalidated when files are loaded again, calling one after that fails
+		vm::PreparedCall prepare_call(const std::string file, const std::string function);
+		bool call(const vm::PreparedCall&, vm::ObjectPtr, std::span<const vm::Variant> args,
+				  vm::Variant* result = nullptr);
 		void register_function(const std::string name, StockFunction sf);
 		void clear_functions()
 		{
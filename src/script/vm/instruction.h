@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <memory>
+#include <atomic>
 #include <common/type_id.h>
 #include <script/debug_info.h>
 
@@ -32,7 +33,8 @@ namespace script
 		struct Instruction
 		{
 			size_t m_id;
-			DebugInfo debug;
+			//specialized form this instruction rewrote itself into, VirtualMachine runs that one instead while it's set
+			std::atomic<Instruction*> quickened{nullptr};
 			void set_id(size_t id)
 			{
 				m_id = id;
@@ -1,6 +1,8 @@
 #include "instructions.h"
 #include <script/vm/virtual_machine.h>
 #include <core/time.h>
+#include <algorithm>
+#include <climits>
 
 namespace script
 {
@@ -52,6 +54,8 @@ namespace script
 		}
 		void CallFunctionFile::execute(VirtualMachine& vm, ThreadContext *thread_context)
 		{
+			if (quicken.enabled(vm))
+				try_quicken(vm, thread_context, *this);
 			vm::ObjectPtr obj = thread_context->function_context().self_object;
 			if (is_method_call)
 			{
@@ -69,6 +73,8 @@ namespace script
 		}
 		void CallFunction::execute(VirtualMachine& vm, ThreadContext *thread_context)
 		{
+			if (quicken.enabled(vm))
+				try_quicken(vm, thread_context, *this);
 			vm::ObjectPtr obj = thread_context->function_context().self_object;
 			if (is_method_call)
 			{
@@ -135,6 +141,15 @@ namespace script
 				}
 			}
 		}
+		void SwitchTable::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		{
+			auto v = thread_context->context()->get_variant(0);
+			thread_context->pop();
+			size_t index = cases.find(vm, v);
+			auto& target = index == SwitchCases::kNoCase ? dest_default : dest[index];
+			if (!target.expired())
+				thread_context->jump(target.lock()->label_index);
+		}
 		void Jump::execute(VirtualMachine& vm, ThreadContext *thread_context)
 		{
 			if (!this->dest.expired())
@@ -167,13 +182,85 @@ namespace script
 		}
 		void BinOp::execute(VirtualMachine& vm, ThreadContext *thread_context)
 		{
+			if (quicken.enabled(vm))
+				try_quicken(vm, thread_context, *this);
 			auto a = thread_context->context()->get_variant(0);
 			auto b = thread_context->context()->get_variant(1);
 			thread_context->pop();
 			thread_context->pop();
 			thread_context->push(vm.binop(a, b, op));
 		}
-		void WaitTillFrameEnd::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		//the result replaces b and a gets popped, no copies of the operands
+#define INTEGER_BINOP(x, expr)                                                                                         \
+	void x::execute(VirtualMachine& vm, ThreadContext* thread_context)                                                 \
+	{                                                                                                                  \
+		int a = std::get<vm::Integer>(thread_context->top(0));                                                         \
+		auto& slot = thread_context->top(1);                                                                           \
+		int b = std::get<vm::Integer>(slot);                                                                           \
+		slot = (vm::Integer)(expr);                                                                                    \
+		thread_context->pop();                                                                                         \
+	}
+		INTEGER_BINOP(AddInt, a + b)
+		INTEGER_BINOP(SubInt, a - b)
+		INTEGER_BINOP(MulInt, a * b)
+		INTEGER_BINOP(LtInt, a < b ? 1 : 0)
+		INTEGER_BINOP(LeqInt, a <= b ? 1 : 0)
+		INTEGER_BINOP(GtInt, a > b ? 1 : 0)
+		INTEGER_BINOP(GeqInt, a >= b ? 1 : 0)
+		INTEGER_BINOP(EqInt, a == b ? 1 : 0)
+		INTEGER_BINOP(NeqInt, a == b ? 0 : 1)
+#undef INTEGER_BINOP
+
+		static float as_float(const Variant& v)
+		{
+			if (v.index() == vm::type_index<vm::Integer>())
+				return (float)std::get<vm::Integer>(v);
+			return std::get<vm::Number>(v);
+		}
+#define FLOAT_BINOP(x, type, expr)                                                                                     \
+	void x::execute(VirtualMachine& vm, ThreadContext* thread_context)                                                 \
+	{                                                                                                                  \
+		float a = as_float(thread_context->top(0));                                                                    \
+		auto& slot = thread_context->top(1);                                                                           \
+		float b = as_float(slot);                                                                                      \
+		slot = (type)(expr);                                                                                           \
+		thread_context->pop();                                                                                         \
+	}
+		FLOAT_BINOP(AddFloat, vm::Number, a + b)
+		FLOAT_BINOP(SubFloat, vm::Number, a - b)
+		FLOAT_BINOP(MulFloat, vm::Number, a * b)
+		FLOAT_BINOP(DivFloat, vm::Number, a / b)
+		FLOAT_BINOP(LtFloat, vm::Integer, a < b ? 1 : 0)
+		FLOAT_BINOP(LeqFloat, vm::Integer, a <= b ? 1 : 0)
+		FLOAT_BINOP(GtFloat, vm::Integer, a > b ? 1 : 0)
+		FLOAT_BINOP(GeqFloat, vm::Integer, a >= b ? 1 : 0)
+#undef FLOAT_BINOP
+
+		void AddVec::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		{
+			auto& a = std::get<vm::Vector>(thread_context->top(0));
+			auto& b = std::get<vm::Vector>(thread_context->top(1));
+			b.x = a.x + b.x;
+			b.y = a.y + b.y;
+			b.z = a.z + b.z;
+			thread_context->pop();
+		}
+		void SubVec::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		{
+			auto& a = std::get<vm::Vector>(thread_context->top(0));
+			auto& b = std::get<vm::Vector>(thread_context->top(1));
+			b.x = a.x - b.x;
+			b.y = a.y - b.y;
+			b.z = a.z - b.z;
+			thread_context->pop();
+		}
+		void ConcatStr::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		{
+			auto& slot = thread_context->top(1);
+			slot = vm::String(vm.variant_to_string(thread_context->top(0)) + vm.variant_to_string(slot));
+			thread_context->pop();
+		}
+		void wait_till_frame_end(VirtualMachine& vm, ThreadContext* thread_context)
 		{
 			struct ThreadLockWaitFrame : vm::ThreadLock
 			{
@@ -193,10 +280,12 @@ namespace script
 			auto l = std::make_unique<ThreadLockWaitFrame>(vm, vm.get_frame_number());
 			thread_context->m_locks.push_back(std::move(l));
 		}
-		void Wait::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		void WaitTillFrameEnd::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		{
+			wait_till_frame_end(vm, thread_context);
+		}
+		void wait(VirtualMachine& vm, ThreadContext* thread_context, float duration)
 		{
-			float duration = thread_context->context()->get_float(0);
-			thread_context->pop();
 			struct ThreadLockWaitDuration : vm::ThreadLock
 			{
 				uint32_t end_time = 0;
@@ -212,6 +301,12 @@ namespace script
 			l->end_time = core::time_milliseconds() + duration * 1000.f;
 			thread_context->m_locks.push_back(std::move(l));
 		}
+		void Wait::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		{
+			float duration = thread_context->context()->get_float(0);
+			thread_context->pop();
+			wait(vm, thread_context, duration);
+		}
 		void Ret::execute(VirtualMachine& vm, ThreadContext *thread_context)
 		{
 			thread_context->ret();
@@ -298,49 +393,62 @@ namespace script
 				}
 			}
 		};
+		void load_object_field_value(VirtualMachine& vm, ThreadContext* thread_context, vm::Variant& object,
+									 const std::string& prop)
+		{
+			std::visit(LoadObjectFieldValueVariantVisitor(vm, thread_context, prop), object);
+		}
 		void LoadObjectFieldValue::execute(VirtualMachine& vm, ThreadContext *thread_context)
 		{
+			if (quicken.enabled(vm))
+				try_quicken(vm, thread_context, *this);
 			//TODO: FIXME we can't actually load anything if ref is undefined...
 			auto ref = thread_context->pop();
 			auto prop = thread_context->context()->get_string(0);
 			thread_context->pop(1);
 
-			std::visit(LoadObjectFieldValueVariantVisitor(vm, thread_context, util::string::to_lower(prop)), ref);
+			load_object_field_value(vm, thread_context, ref, util::string::to_lower(prop));
 		}
-		void LoadObjectFieldRef::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		vm::Variant* load_object_field_ref(vm::Variant* ptr, vm::Reference& ref, const std::string& prop, bool create)
 		{
-			vm::Reference ref;
-			auto* ptr = thread_context->pop_ref(&ref);
-			
 			if (ptr->index() == (int)vm::Type::kUndefined)
 			{
+				if (!create)
+					throw vm::Exception("expected object got undefined");
 				*ptr = std::make_shared<Object>("object created from undefined");
 			}
-
-			auto prop = thread_context->context()->get_string(0);
-			thread_context->pop(1);
 			if (prop == "size")
 				throw vm::Exception("size is read-only");
 			if (!ref.field.has_value())
 			{
-				thread_context->push_ref(ptr, Reference{.field = prop});
+				ref = Reference{.field = prop};
+				return ptr;
 			}
-			else
+			if (ptr->index() != (int)vm::Type::kObject)
 			{
-				if (ptr->index() != (int)vm::Type::kObject)
-				{
-					throw vm::Exception("not a object");
-				}
-				auto o = std::get<vm::ObjectPtr>(*ptr);
-				auto field_name = util::string::to_lower(ref.field.value());
-				auto field_ptr = o->get_field(field_name, true);
-				if (field_ptr->index() == (int)vm::Type::kUndefined)
-				{
-					*field_ptr = std::make_shared<Object>("object created from undefined");
-				}
-				//TODO: FIXME native c++ class members don't work
-				thread_context->push_ref(field_ptr, Reference{.field = prop});
+				throw vm::Exception("not a object");
 			}
+			auto o = std::get<vm::ObjectPtr>(*ptr);
+			auto field_name = util::string::to_lower(ref.field.value());
+			auto field_ptr = o->get_field(field_name, create);
+			if (!field_ptr || field_ptr->index() == (int)vm::Type::kUndefined)
+			{
+				if (!create)
+					throw vm::Exception("expected object got undefined");
+				*field_ptr = std::make_shared<Object>("object created from undefined");
+			}
+			//TODO: FIXME native c++ class members don't work
+			ref = Reference{.field = prop};
+			return field_ptr;
+		}
+		void LoadObjectFieldRef::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		{
+			vm::Reference ref;
+			auto* ptr = thread_context->pop_ref(&ref);
+			auto prop = thread_context->context()->get_string(0);
+			thread_context->pop(1);
+			ptr = load_object_field_ref(ptr, ref, prop, create);
+			thread_context->push_ref(ptr, ref);
 			#if 0
 			try
 			{
@@ -419,11 +527,9 @@ namespace script
 			}
 		};
 
-		void StoreRef::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		void store_ref(VirtualMachine& vm, ThreadContext* thread_context, vm::Variant* ptr, vm::Reference& ref,
+					   vm::Variant& new_value)
 		{
-			vm::Reference ref;
-			auto *ptr = thread_context->pop_ref(&ref);
-			auto new_value = thread_context->pop(1);
 			if (!ref.field.has_value())
 			{
 				*ptr = new_value;
@@ -433,6 +539,36 @@ namespace script
 				std::visit(StoreRefVariantVisitor(vm, thread_context, ref, new_value), *ptr);
 			}
 		}
+		void StoreRef::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		{
+			vm::Reference ref;
+			auto *ptr = thread_context->pop_ref(&ref);
+			auto new_value = thread_context->pop(1);
+			store_ref(vm, thread_context, ptr, ref, new_value);
+		}
+		static vm::Variant load_ref_value(VirtualMachine& vm, ThreadContext* thread_context, vm::Variant* ptr,
+										  vm::Reference& ref)
+		{
+			if (!ref.field.has_value())
+				return *ptr;
+			load_object_field_value(vm, thread_context, *ptr, util::string::to_lower(ref.field.value()));
+			return thread_context->pop();
+		}
+		void BinOpRef::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		{
+			vm::Reference ref;
+			auto* ptr = thread_context->pop_ref(&ref);
+			auto b = thread_context->pop();
+			auto result = vm.binop(load_ref_value(vm, thread_context, ptr, ref), b, op);
+			store_ref(vm, thread_context, ptr, ref, result);
+			thread_context->push_ref(ptr, ref);
+		}
+		void LoadRefValue::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		{
+			vm::Reference ref;
+			auto* ptr = thread_context->pop_ref(&ref);
+			thread_context->push(load_ref_value(vm, thread_context, ptr, ref));
+		}
 		void LoadValue::execute(VirtualMachine& vm, ThreadContext *thread_context)
 		{
 			thread_context->push(vm.get_variable(thread_context, util::string::to_lower(variable_name)));
@@ -459,29 +595,9 @@ namespace script
 		{
 			thread_context->push(vm::Undefined());
 		}
-		void PushAnimationString::execute(VirtualMachine& vm, ThreadContext *thread_context)
-		{
-			vm::Animation a;
-			a.reference = value;
-			thread_context->push(a);
-		}
-		void PushFunctionPointer::execute(VirtualMachine& vm, ThreadContext *thread_context)
-		{
-			vm::FunctionPointer fp;
-			fp.file = this->file;
-			fp.name = this->function;
-			thread_context->push(fp);
-		}
-		void PushLocalizedString::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		void PushConstant::execute(VirtualMachine& vm, ThreadContext *thread_context)
 		{
-			vm::LocalizedString s;
-			s.reference = this->value;
-			thread_context->push(s);
-		}
-		void PushString::execute(VirtualMachine& vm, ThreadContext *thread_context)
-		{
-			vm::String s = value;
-			thread_context->push(s);
+			thread_context->push(constant());
 		}
 		void PushArray::execute(VirtualMachine& vm, ThreadContext *thread_context)
 		{
@@ -512,5 +628,71 @@ namespace script
 		{
 			thread_context->pop();
 		}
+		void SwitchCases::build()
+		{
+			strings.clear();
+			integers.clear();
+			dense.clear();
+			bool has_strings = false, has_integers = false;
+			int lo = INT_MAX, hi = INT_MIN;
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				if (auto* s = std::get_if<vm::String>(&values[i]))
+				{
+					has_strings = true;
+					strings.insert({s->str(), i});
+				}
+				else
+				{
+					int n = std::get<vm::Integer>(values[i]);
+					has_integers = true;
+					integers.insert({n, i});
+					lo = std::min(lo, n);
+					hi = std::max(hi, n);
+				}
+			}
+			//== between a string and an integer compares them as strings, keep doing that one by one
+			mixed = has_strings && has_integers;
+			if (mixed || !has_integers)
+				return;
+			//only worth it when at least about half of the slots are used
+			int64_t range = (int64_t)hi - lo + 1;
+			if (range > (int64_t)integers.size() * 2 + 8)
+				return;
+			dense_base = lo;
+			dense.assign((size_t)range, kNoCase);
+			for (auto& it : integers)
+				dense[it.first - lo] = it.second;
+			integers.clear();
+		}
+
+		size_t SwitchCases::find(VirtualMachine& vm, const Variant& v) const
+		{
+			if (!mixed)
+			{
+				if (auto* s = std::get_if<vm::String>(&v); s && integers.empty() && dense.empty())
+				{
+					auto fnd = strings.find(s->str());
+					return fnd == strings.end() ? kNoCase : fnd->second;
+				}
+				if (auto* n = std::get_if<vm::Integer>(&v); n && strings.empty())
+				{
+					if (!dense.empty())
+					{
+						int64_t slot = (int64_t)*n - dense_base;
+						return slot < 0 || slot >= (int64_t)dense.size() ? kNoCase : dense[(size_t)slot];
+					}
+					auto fnd = integers.find(*n);
+					return fnd == integers.end() ? kNoCase : fnd->second;
+				}
+			}
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				auto eq = vm.binop(values[i], v, parse::TokenType_kEq);
+				if (std::get<vm::Integer>(eq))
+					return i;
+			}
+			return kNoCase;
+		}
 	}; // namespace vm
 };	   // namespace script
@@ -1,11 +1,55 @@
 #pragma once
 #include <script/vm/instruction.h>
 #include <common/format.h>
+#include <script/vm/types.h>
+#include <script/vm/switch_cases.h>
+#include <vector>
+#include <functional>
 
 namespace script
 {
+	namespace compiler
+	{
+		struct CompiledFunction;
+	};
 	namespace vm
 	{
+		//bookkeeping of an instruction that rewrites itself into a specialized form when it runs (quickening)
+		//every form it published stays alive as long as the instruction, another vm sharing the function might still run it
+		//a form deoptimizes back to the generic instruction when it's guard fails, after kMaxMisses the site stays generic
+		struct QuickenState
+		{
+			static constexpr uint32_t kMaxMisses = 8;
+			std::vector<std::unique_ptr<Instruction>> forms;
+			std::atomic<uint32_t> misses{0};
+
+			bool enabled(VirtualMachine& vm) const;
+			void publish(Instruction& site, std::unique_ptr<Instruction> form);
+			//the types seen didn't allow a form
+			void miss()
+			{
+				misses.fetch_add(1, std::memory_order_relaxed);
+			}
+			//it never will, e.g a builtin function
+			void disable()
+			{
+				misses.store(kMaxMisses, std::memory_order_relaxed);
+			}
+			void deoptimize(Instruction& site);
+		};
+		//base of the specialized forms, site is the generic instruction it replaces
+		struct QuickenedInstruction : Instruction
+		{
+			Instruction* site = nullptr;
+			QuickenState* state = nullptr;
+			//runs the generic instruction instead and stops using this form
+			void deoptimize(VirtualMachine& vm, ThreadContext* thread_context)
+			{
+				state->deoptimize(*site);
+				site->execute(vm, thread_context);
+			}
+		};
+
 		struct PushInteger : Instruction
 		{
 			DEFINE_INSTRUCTION_ONLY_KIND(PushInteger)
@@ -41,38 +85,41 @@ namespace script
 			size_t nelements = 0;
 			virtual void execute(VirtualMachine& vm, ThreadContext *);
 		};
-		struct PushString : Instruction
+		//pushes a literal from the constant pool of the file, copying it onto the stack only bumps a refcount
+		struct PushConstant : Instruction
+		{
+			size_t index = 0;
+			const vm::Constants* constants = nullptr;
+			const vm::Variant& constant() const
+			{
+				return (*constants)[index];
+			}
+			virtual void execute(VirtualMachine& vm, ThreadContext *);
+		};
+		struct PushString : PushConstant
 		{
 			DEFINE_INSTRUCTION_ONLY_KIND(PushString)
 			virtual std::string to_string()
 			{
-				return common::format("PushString {}", value);
+				return common::format("PushString {}", std::get<vm::String>(constant()));
 			}
-			std::string value;
-			size_t length;
-			virtual void execute(VirtualMachine& vm, ThreadContext *);
 		};
-		struct PushLocalizedString : Instruction
+		struct PushLocalizedString : PushConstant
 		{
 			DEFINE_INSTRUCTION_ONLY_KIND(PushLocalizedString)
 			virtual std::string to_string()
 			{
-				return common::format("PushLocalizedString {}", value);
+				return common::format("PushLocalizedString {}", std::get<vm::LocalizedString>(constant()).reference);
 			}
-			std::string value;
-			size_t length;
-			virtual void execute(VirtualMachine& vm, ThreadContext *);
 		};
-		struct PushFunctionPointer : Instruction
+		struct PushFunctionPointer : PushConstant
 		{
 			DEFINE_INSTRUCTION_ONLY_KIND(PushFunctionPointer)
 			virtual std::string to_string()
 			{
-				return common::format("PushFunctionPointer {}::{}", file, function);
+				auto& fp = std::get<vm::FunctionPointer>(constant());
+				return common::format("PushFunctionPointer {}::{}", fp.file, fp.name);
 			}
-			std::string file;
-			std::string function;
-			virtual void execute(VirtualMachine& vm, ThreadContext *);
 		};
 		#if 0
 		struct LoadSelfRef : Instruction
@@ -94,15 +141,13 @@ namespace script
 			}
 		};
 		#endif
-		struct PushAnimationString : Instruction
+		struct PushAnimationString : PushConstant
 		{
 			DEFINE_INSTRUCTION_ONLY_KIND(PushAnimationString)
 			virtual std::string to_string()
 			{
-				return common::format("PushAnimationString %{}", value);
+				return common::format("PushAnimationString %{}", std::get<vm::Animation>(constant()).reference);
 			}
-			std::string value;
-			virtual void execute(VirtualMachine& vm, ThreadContext *);
 		};
 		struct PushUndefined : Instruction
 		{
@@ -147,12 +192,15 @@ namespace script
 		{
 			DEFINE_INSTRUCTION(LoadObjectFieldRef)
 			int op;
+			//false when the value is read before it's stored, an undefined object on the way throws like reading it would
+			bool create = true;
 			virtual void execute(VirtualMachine& vm, ThreadContext *);
 		};
 		struct LoadObjectFieldValue : Instruction
 		{
 			DEFINE_INSTRUCTION(LoadObjectFieldValue)
 			int op;
+			QuickenState quicken;
 			virtual void execute(VirtualMachine& vm, ThreadContext *);
 		};
 		struct Not : Instruction
@@ -185,9 +233,56 @@ namespace script
 		{
 			DEFINE_INSTRUCTION(BinOp)
 			int op;
+			QuickenState quicken;
+			virtual void execute(VirtualMachine& vm, ThreadContext *);
+		};
+
+		//compound assignment to a field, the reference on top is read, combined with the value under it and stored back
+		//leaves the reference behind just like an assignment
+		struct BinOpRef : Instruction
+		{
+			DEFINE_INSTRUCTION(BinOpRef)
+			int op;
+			virtual void execute(VirtualMachine& vm, ThreadContext *);
+		};
+		//replaces the reference on top with the value it refers to
+		struct LoadRefValue : Instruction
+		{
+			DEFINE_INSTRUCTION(LoadRefValue)
 			virtual void execute(VirtualMachine& vm, ThreadContext *);
 		};
 
+		//BinOp for operands whose types the compiler proved, a is on top of the stack just like for BinOp
+		//Int takes two integers, Float any mix of integers and numbers, Vec two vectors
+		//ConcatStr converts both to a string, one of them has to be a string already
+#define DEFINE_SPECIALIZED_BINOP(x)                                                                                    \
+	struct x : Instruction                                                                                             \
+	{                                                                                                                  \
+		DEFINE_INSTRUCTION(x)                                                                                          \
+		virtual void execute(VirtualMachine& vm, ThreadContext*);                                                      \
+	};
+		DEFINE_SPECIALIZED_BINOP(AddInt)
+		DEFINE_SPECIALIZED_BINOP(SubInt)
+		DEFINE_SPECIALIZED_BINOP(MulInt)
+		DEFINE_SPECIALIZED_BINOP(LtInt)
+		DEFINE_SPECIALIZED_BINOP(LeqInt)
+		DEFINE_SPECIALIZED_BINOP(GtInt)
+		DEFINE_SPECIALIZED_BINOP(GeqInt)
+		DEFINE_SPECIALIZED_BINOP(EqInt)
+		DEFINE_SPECIALIZED_BINOP(NeqInt)
+		DEFINE_SPECIALIZED_BINOP(AddFloat)
+		DEFINE_SPECIALIZED_BINOP(SubFloat)
+		DEFINE_SPECIALIZED_BINOP(MulFloat)
+		DEFINE_SPECIALIZED_BINOP(DivFloat)
+		DEFINE_SPECIALIZED_BINOP(LtFloat)
+		DEFINE_SPECIALIZED_BINOP(LeqFloat)
+		DEFINE_SPECIALIZED_BINOP(GtFloat)
+		DEFINE_SPECIALIZED_BINOP(GeqFloat)
+		DEFINE_SPECIALIZED_BINOP(AddVec)
+		DEFINE_SPECIALIZED_BINOP(SubVec)
+		DEFINE_SPECIALIZED_BINOP(ConcatStr)
+#undef DEFINE_SPECIALIZED_BINOP
+
 		struct Label : Instruction
 		{
 			size_t label_index = 0;
@@ -228,6 +323,20 @@ namespace script
 			std::weak_ptr<Label> dest;
 			virtual void execute(VirtualMachine& vm, ThreadContext *);
 		};
+		//pops the discriminant of a switch and jumps to the matching case, dest_default if none matches
+		struct SwitchTable : Instruction
+		{
+			DEFINE_INSTRUCTION_ONLY_KIND(SwitchTable)
+			SwitchCases cases;
+			//one for every value in cases
+			std::vector<std::weak_ptr<Label>> dest;
+			std::weak_ptr<Label> dest_default;
+			virtual std::string to_string()
+			{
+				return common::format("SwitchTable {} cases", cases.values.size());
+			}
+			virtual void execute(VirtualMachine& vm, ThreadContext *);
+		};
 
 		struct Call : Instruction
 		{
@@ -253,6 +362,7 @@ namespace script
 				return common::format("CallFunction {}", function);
 			}
 			std::string function;
+			QuickenState quicken;
 			virtual void execute(VirtualMachine& vm, ThreadContext *);
 		};
 		struct CallFunctionFile : Call
@@ -260,6 +370,7 @@ namespace script
 			DEFINE_INSTRUCTION_ONLY_KIND(CallFunctionFile)
 			std::string file;
 			std::string function;
+			QuickenState quicken;
 			virtual void execute(VirtualMachine& vm, ThreadContext *);
 			virtual std::string to_string()
 			{
@@ -271,5 +382,72 @@ namespace script
 			DEFINE_INSTRUCTION(CallFunctionPointer)
 			virtual void execute(VirtualMachine& vm, ThreadContext *);
 		};
+
+		//quickened forms, these never end up in a CompiledFunction or the bytecode cache
+
+		//BinOp that saw two integers, guarded on both still being integers
+		struct BinOpIntInt : QuickenedInstruction
+		{
+			DEFINE_INSTRUCTION_ONLY_KIND(BinOpIntInt)
+			int op;
+			virtual std::string to_string()
+			{
+				return common::format("BinOpIntInt {}", op);
+			}
+			virtual void execute(VirtualMachine& vm, ThreadContext *);
+		};
+		//LoadObjectFieldValue that saw the field key on an object of object_type, guarded on both and the vm's epoch
+		//skips lowercasing the key and looking it up in the field registry
+		struct LoadObjectFieldCached : QuickenedInstruction
+		{
+			DEFINE_INSTRUCTION_ONLY_KIND(LoadObjectFieldCached)
+			enum class Access
+			{
+				kSize,
+				kGetter,
+				kField
+			};
+			Access access = Access::kField;
+			uint64_t epoch = 0;
+			int object_type = 0;
+			//as it was on the stack and lowercased
+			std::string key;
+			std::string prop;
+			//owned by the field registry of the vm with this epoch
+			const std::function<int(void*, VMContext&)>* getter = nullptr;
+			virtual std::string to_string()
+			{
+				return common::format("LoadObjectFieldCached {}", prop);
+			}
+			virtual void execute(VirtualMachine& vm, ThreadContext *);
+		};
+		//CallFunction or CallFunctionFile with the function already looked up, guarded on the vm's epoch
+		struct CallResolved : QuickenedInstruction
+		{
+			DEFINE_INSTRUCTION_ONLY_KIND(CallResolved)
+			uint64_t epoch = 0;
+			compiler::CompiledFunction* function = nullptr;
+			bool is_method_call = false;
+			size_t numargs = 0;
+			virtual std::string to_string();
+			virtual void execute(VirtualMachine& vm, ThreadContext *);
+		};
+
+		//called by the generic instruction before it runs, publishes a form if what's on the stack allows one
+		void try_quicken(VirtualMachine& vm, ThreadContext*, BinOp& site);
+		void try_quicken(VirtualMachine& vm, ThreadContext*, LoadObjectFieldValue& site);
+		void try_quicken(VirtualMachine& vm, ThreadContext*, CallFunction& site);
+		void try_quicken(VirtualMachine& vm, ThreadContext*, CallFunctionFile& site);
+
+		//shared with the register backend
+		//pushes object.prop, prop has to be lowercase
+		void load_object_field_value(VirtualMachine& vm, ThreadContext*, vm::Variant& object, const std::string& prop);
+		//steps from the reference in ptr/ref into prop, returns the new ptr and updates ref
+		//undefined objects on the way get created unless create is false, then it throws
+		vm::Variant* load_object_field_ref(vm::Variant* ptr, vm::Reference& ref, const std::string& prop,
+										   bool create = true);
+		void store_ref(VirtualMachine& vm, ThreadContext*, vm::Variant* ptr, vm::Reference& ref, vm::Variant& new_value);
+		void wait(VirtualMachine& vm, ThreadContext*, float duration);
+		void wait_till_frame_end(VirtualMachine& vm, ThreadContext*);
 	}; // namespace vm
 };	   // namespace script
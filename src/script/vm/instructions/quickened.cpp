@@ -0,0 +1,275 @@
+#include "instructions.h"
+#include <script/vm/virtual_machine.h>
+#include <algorithm>
+#include <mutex>
+
+namespace script
+{
+	namespace vm
+	{
+		//only taken when a site gets (re)quickened, executing a form never locks
+		static std::mutex quicken_mutex;
+
+		bool QuickenState::enabled(VirtualMachine& vm) const
+		{
+			return !(vm.get_flags() & flags::kNoQuickening) && misses.load(std::memory_order_relaxed) < kMaxMisses;
+		}
+		void QuickenState::publish(Instruction& site, std::unique_ptr<Instruction> form)
+		{
+			std::lock_guard<std::mutex> lock(quicken_mutex);
+			//another thread got there first
+			if (site.quickened.load(std::memory_order_relaxed))
+				return;
+			site.quickened.store(form.get(), std::memory_order_release);
+			forms.push_back(std::move(form));
+		}
+		void QuickenState::deoptimize(Instruction& site)
+		{
+			site.quickened.store(nullptr, std::memory_order_release);
+			miss();
+		}
+
+		template <typename T> static std::unique_ptr<T> form(Instruction& site, QuickenState& state)
+		{
+			auto f = std::make_unique<T>();
+			f->site = &site;
+			f->state = &state;
+			return f;
+		}
+
+		static bool is_integer_op(int op)
+		{
+			switch (op)
+			{
+			case '-':
+			case '+':
+			case '*':
+			case '/':
+			case '%':
+			case '&':
+			case '|':
+			case parse::TokenType_kLsht:
+			case parse::TokenType_kRsht:
+			case parse::TokenType_kEq:
+			case parse::TokenType_kNeq:
+			case parse::TokenType_kGeq:
+			case '>':
+			case '<':
+			case parse::TokenType_kLeq:
+			case parse::TokenType_kAndAnd:
+			case parse::TokenType_kOrOr:
+				return true;
+			}
+			return false;
+		}
+
+		void try_quicken(VirtualMachine& vm, ThreadContext* thread_context, BinOp& site)
+		{
+			auto& a = thread_context->top(0);
+			auto& b = thread_context->top(1);
+			if (a.index() != vm::type_index<vm::Integer>() || b.index() != vm::type_index<vm::Integer>() ||
+				!is_integer_op(site.op))
+			{
+				site.quicken.miss();
+				return;
+			}
+			auto f = form<BinOpIntInt>(site, site.quicken);
+			f->op = site.op;
+			site.quicken.publish(site, std::move(f));
+		}
+		void BinOpIntInt::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		{
+			auto* pa = std::get_if<vm::Integer>(&thread_context->top(0));
+			auto& slot = thread_context->top(1);
+			auto* pb = std::get_if<vm::Integer>(&slot);
+			if (!pa || !pb)
+			{
+				deoptimize(vm, thread_context);
+				return;
+			}
+			int a = *pa, b = *pb;
+			int r = 0;
+			switch (op)
+			{
+			case '-':
+				r = a - b;
+				break;
+			case '+':
+				r = a + b;
+				break;
+			case '*':
+				r = a * b;
+				break;
+			case '/':
+				r = a / b;
+				break;
+			case '%':
+				r = a % b;
+				break;
+			case '&':
+				r = a & b;
+				break;
+			case '|':
+				r = a | b;
+				break;
+			case parse::TokenType_kLsht:
+				r = a << b;
+				break;
+			case parse::TokenType_kRsht:
+				r = a >> b;
+				break;
+			case parse::TokenType_kEq:
+				r = a == b ? 1 : 0;
+				break;
+			case parse::TokenType_kNeq:
+				r = a == b ? 0 : 1;
+				break;
+			case parse::TokenType_kGeq:
+				r = a >= b ? 1 : 0;
+				break;
+			case '>':
+				r = a > b ? 1 : 0;
+				break;
+			case '<':
+				r = a < b ? 1 : 0;
+				break;
+			case parse::TokenType_kLeq:
+				r = a <= b ? 1 : 0;
+				break;
+			case parse::TokenType_kAndAnd:
+				r = a && b ? 1 : 0;
+				break;
+			case parse::TokenType_kOrOr:
+				r = a || b ? 1 : 0;
+				break;
+			}
+			slot = r;
+			thread_context->pop();
+		}
+
+		void try_quicken(VirtualMachine& vm, ThreadContext* thread_context, LoadObjectFieldValue& site)
+		{
+			auto* object = std::get_if<vm::ObjectPtr>(&thread_context->top(0));
+			auto* key = std::get_if<vm::String>(&thread_context->top(1));
+			if (!object || !*object || !key)
+			{
+				site.quicken.miss();
+				return;
+			}
+			auto f = form<LoadObjectFieldCached>(site, site.quicken);
+			f->epoch = vm.epoch();
+			f->object_type = (*object)->type_id();
+			f->key = key->str();
+			f->prop = util::string::to_lower(f->key);
+			if (f->prop == "size")
+				f->access = LoadObjectFieldCached::Access::kSize;
+			else
+			{
+				auto& registry = vm.get_field_registry();
+				auto fnd = registry.find(f->object_type);
+				if (fnd != registry.end())
+				{
+					auto entry = fnd->second.find(f->prop);
+					if (entry != fnd->second.end())
+					{
+						f->access = LoadObjectFieldCached::Access::kGetter;
+						f->getter = &entry->second.getter;
+					}
+				}
+			}
+			site.quicken.publish(site, std::move(f));
+		}
+		void LoadObjectFieldCached::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		{
+			auto* object = std::get_if<vm::ObjectPtr>(&thread_context->top(0));
+			auto* k = std::get_if<vm::String>(&thread_context->top(1));
+			if (!object || !*object || !k || vm.epoch() != epoch || (*object)->type_id() != object_type ||
+				k->str() != key)
+			{
+				deoptimize(vm, thread_context);
+				return;
+			}
+			vm::ObjectPtr o = std::move(*object);
+			thread_context->pop(2);
+			switch (access)
+			{
+			case Access::kSize:
+				thread_context->push(vm::Integer(o->size()));
+				break;
+			case Access::kGetter:
+				if ((*getter)(o.get(), *thread_context->m_context.get()) == 0)
+					thread_context->push(vm::Undefined());
+				break;
+			case Access::kField:
+				try
+				{
+					auto fv = o->get_field(prop, false);
+					if (fv)
+						thread_context->push(*fv);
+					else
+						thread_context->push(vm::Undefined());
+				}
+				catch (...)
+				{
+					throw vm::Exception("failed getting field {}", prop);
+				}
+				break;
+			}
+		}
+
+		static void try_quicken_call(VirtualMachine& vm, Instruction& site, QuickenState& state, const std::string& file,
+									 const std::string& function, bool is_method_call, bool is_threaded, size_t numargs)
+		{
+			//threads and the builtin methods go through their own paths every time
+			if (is_threaded ||
+				(is_method_call && (function == "endon" || function == "notify" || function == "waittill")))
+			{
+				state.disable();
+				return;
+			}
+			auto* fn = vm.find_function_in_file(file, function);
+			if (!fn)
+			{
+				state.disable();
+				return;
+			}
+			auto f = form<CallResolved>(site, state);
+			f->epoch = vm.epoch();
+			f->function = fn;
+			f->is_method_call = is_method_call;
+			f->numargs = numargs;
+			state.publish(site, std::move(f));
+		}
+		void try_quicken(VirtualMachine& vm, ThreadContext* thread_context, CallFunction& site)
+		{
+			try_quicken_call(vm, site, site.quicken, thread_context->current_file(), site.function, site.is_method_call,
+							 site.is_threaded, site.numargs);
+		}
+		void try_quicken(VirtualMachine& vm, ThreadContext* thread_context, CallFunctionFile& site)
+		{
+			std::string ref = site.file;
+			std::replace(ref.begin(), ref.end(), '\\', '/');
+			try_quicken_call(vm, site, site.quicken, ref, site.function, site.is_method_call, site.is_threaded,
+							 site.numargs);
+		}
+		std::string CallResolved::to_string()
+		{
+			return common::format("CallResolved {}::{}", function->file, function->name);
+		}
+		void CallResolved::execute(VirtualMachine& vm, ThreadContext *thread_context)
+		{
+			if (vm.epoch() != epoch)
+			{
+				deoptimize(vm, thread_context);
+				return;
+			}
+			vm::ObjectPtr obj = thread_context->function_context().self_object;
+			if (is_method_call)
+			{
+				obj = thread_context->context()->get_object(0);
+				thread_context->pop();
+			}
+			vm.call_impl(thread_context, thread_context, obj, function, numargs);
+		}
+	}; // namespace vm
+};	   // namespace script
@@ -0,0 +1,696 @@
+#include "jit.h"
+#include <script/vm/native_runtime.h>
+#include <common/stringutil.h>
+#include <cstring>
+#include <exception>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define GSC_JIT_X64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace script
+{
+	namespace vm
+	{
+		JitCode::~JitCode()
+		{
+#ifdef GSC_JIT_X64
+			if (memory)
+				munmap(memory, size);
+#endif
+		}
+
+		JitCode* Jit::code(compiler::CompiledFunction& function, uint32_t threshold)
+		{
+			auto& slot = function.jit;
+			auto* code = slot.code.load(std::memory_order_acquire);
+			if (code || slot.hotness.load(std::memory_order_relaxed) < threshold ||
+				slot.failed.load(std::memory_order_relaxed))
+				return code;
+			code = translate(function);
+			if (!code)
+			{
+				slot.failed.store(true, std::memory_order_relaxed);
+				return nullptr;
+			}
+			//another vm may have translated it at the same time
+			JitCode* published = nullptr;
+			if (!slot.code.compare_exchange_strong(published, code, std::memory_order_acq_rel))
+			{
+				delete code;
+				return published;
+			}
+			return code;
+		}
+
+#ifndef GSC_JIT_X64
+		bool Jit::supported()
+		{
+			return false;
+		}
+		JitCode* Jit::translate(compiler::CompiledFunction&)
+		{
+			return nullptr;
+		}
+		void Jit::run(VirtualMachine&, ThreadContext*, JitCode&)
+		{
+			throw vm::Exception("no jit on this platform");
+		}
+#else
+		//exceptions can't unwind through the generated code, the helpers catch them and the code returns
+		static thread_local std::exception_ptr t_exception;
+
+		//every helper returns non zero when the code has to return to run_thread
+		static int jit_execute(VirtualMachine* vm, ThreadContext* tc, Instruction* instr)
+		{
+			try
+			{
+				native::execute(*vm, tc, *instr);
+				return 0;
+			}
+			catch (...)
+			{
+				t_exception = std::current_exception();
+				return 1;
+			}
+		}
+		static int jit_execute_suspending(VirtualMachine* vm, ThreadContext* tc, Instruction* instr)
+		{
+			try
+			{
+				size_t depth = tc->m_callstack.size();
+				native::execute(*vm, tc, *instr);
+				return native::suspended(tc, depth) ? 1 : 0;
+			}
+			catch (...)
+			{
+				t_exception = std::current_exception();
+				return 1;
+			}
+		}
+		//-1 if it threw, otherwise the zero flag the test left
+		static int jit_test(VirtualMachine* vm, ThreadContext* tc, Instruction* instr)
+		{
+			if (jit_execute(vm, tc, instr))
+				return -1;
+			return (vm->get_flags() & flags::kZF) ? 1 : 0;
+		}
+		static int jit_zero_flag(VirtualMachine* vm)
+		{
+			return (vm->get_flags() & flags::kZF) ? 1 : 0;
+		}
+		static int jit_push_integer(VirtualMachine* vm, ThreadContext* tc, int64_t value)
+		{
+			try
+			{
+				tc->push(vm::Integer((int)value));
+				return 0;
+			}
+			catch (...)
+			{
+				t_exception = std::current_exception();
+				return 1;
+			}
+		}
+		static int jit_push_constant(VirtualMachine* vm, ThreadContext* tc, PushConstant* instr)
+		{
+			try
+			{
+				tc->push(instr->constant());
+				return 0;
+			}
+			catch (...)
+			{
+				t_exception = std::current_exception();
+				return 1;
+			}
+		}
+		static int jit_load_value(VirtualMachine* vm, ThreadContext* tc, const std::string* name)
+		{
+			try
+			{
+				tc->push(vm->get_variable(tc, *name));
+				return 0;
+			}
+			catch (...)
+			{
+				t_exception = std::current_exception();
+				return 1;
+			}
+		}
+		static int jit_pop(VirtualMachine* vm, ThreadContext* tc)
+		{
+			try
+			{
+				tc->pop();
+				return 0;
+			}
+			catch (...)
+			{
+				t_exception = std::current_exception();
+				return 1;
+			}
+		}
+		static int jit_push_undefined(VirtualMachine* vm, ThreadContext* tc)
+		{
+			try
+			{
+				tc->push(vm::Undefined());
+				return 0;
+			}
+			catch (...)
+			{
+				t_exception = std::current_exception();
+				return 1;
+			}
+		}
+		//same as INTEGER_BINOP in instructions.cpp
+		enum class IntegerOp
+		{
+			kAdd,
+			kSub,
+			kMul,
+			kLt,
+			kLeq,
+			kGt,
+			kGeq,
+			kEq,
+			kNeq
+		};
+		template <IntegerOp op> static int jit_integer_binop(VirtualMachine* vm, ThreadContext* tc)
+		{
+			try
+			{
+				int a = std::get<vm::Integer>(tc->top(0));
+				auto& slot = tc->top(1);
+				int b = std::get<vm::Integer>(slot);
+				switch (op)
+				{
+				case IntegerOp::kAdd:
+					slot = (vm::Integer)(a + b);
+					break;
+				case IntegerOp::kSub:
+					slot = (vm::Integer)(a - b);
+					break;
+				case IntegerOp::kMul:
+					slot = (vm::Integer)(a * b);
+					break;
+				case IntegerOp::kLt:
+					slot = (vm::Integer)(a < b ? 1 : 0);
+					break;
+				case IntegerOp::kLeq:
+					slot = (vm::Integer)(a <= b ? 1 : 0);
+					break;
+				case IntegerOp::kGt:
+					slot = (vm::Integer)(a > b ? 1 : 0);
+					break;
+				case IntegerOp::kGeq:
+					slot = (vm::Integer)(a >= b ? 1 : 0);
+					break;
+				case IntegerOp::kEq:
+					slot = (vm::Integer)(a == b ? 1 : 0);
+					break;
+				case IntegerOp::kNeq:
+					slot = (vm::Integer)(a == b ? 0 : 1);
+					break;
+				}
+				tc->pop();
+				return 0;
+			}
+			catch (...)
+			{
+				t_exception = std::current_exception();
+				return 1;
+			}
+		}
+		//the interpreter fails the same way when it runs past the end
+		static int jit_end(VirtualMachine* vm, ThreadContext* tc)
+		{
+			t_exception = std::make_exception_ptr(vm::Exception("shouldn't be nullptr"));
+			return 1;
+		}
+		static int jit_bad_resume(VirtualMachine* vm, ThreadContext* tc)
+		{
+			auto& fc = tc->m_callstack.top();
+			t_exception = std::make_exception_ptr(
+				vm::Exception("can't resume {}::{} at {}", fc.file_name, fc.function_name, fc.instruction_index));
+			return 1;
+		}
+
+		//just the encodings the templates need
+		class X64
+		{
+		  public:
+			enum Register
+			{
+				rax = 0,
+				rcx = 1,
+				rdx = 2,
+				rbx = 3,
+				rsp = 4,
+				rbp = 5,
+				rsi = 6,
+				rdi = 7,
+				r12 = 12,
+				r13 = 13,
+				r14 = 14
+			};
+			enum Condition
+			{
+				kEqual = 0x84,
+				kNotEqual = 0x85,
+				kAbove = 0x87
+			};
+			std::vector<uint8_t> code;
+
+			void byte(uint8_t b)
+			{
+				code.push_back(b);
+			}
+			void u32(uint32_t v)
+			{
+				for (int i = 0; i < 4; ++i)
+					byte((v >> (i * 8)) & 0xff);
+			}
+			void u64(uint64_t v)
+			{
+				for (int i = 0; i < 8; ++i)
+					byte((v >> (i * 8)) & 0xff);
+			}
+			void push(Register r)
+			{
+				if (r >= 8)
+					byte(0x41);
+				byte(0x50 + (r & 7));
+			}
+			void pop(Register r)
+			{
+				if (r >= 8)
+					byte(0x41);
+				byte(0x58 + (r & 7));
+			}
+			void mov(Register dst, Register src)
+			{
+				byte(0x48 | (src >= 8 ? 4 : 0) | (dst >= 8 ? 1 : 0));
+				byte(0x89);
+				byte(0xc0 | ((src & 7) << 3) | (dst & 7));
+			}
+			void mov(Register dst, uint64_t imm)
+			{
+				byte(0x48 | (dst >= 8 ? 1 : 0));
+				byte(0xb8 + (dst & 7));
+				u64(imm);
+			}
+			//mov qword [r13 + disp], imm
+			void store_r13(uint32_t disp, uint32_t imm)
+			{
+				byte(0x49);
+				byte(0xc7);
+				byte(0x85);
+				u32(disp);
+				u32(imm);
+			}
+			//mov rax, qword [r13 + disp]
+			void load_rax_r13(uint32_t disp)
+			{
+				byte(0x49);
+				byte(0x8b);
+				byte(0x85);
+				u32(disp);
+			}
+			void cmp_rax(uint32_t imm)
+			{
+				byte(0x48);
+				byte(0x3d);
+				u32(imm);
+			}
+			void cmp_eax(int8_t imm)
+			{
+				byte(0x83);
+				byte(0xf8);
+				byte((uint8_t)imm);
+			}
+			void test_eax()
+			{
+				byte(0x85);
+				byte(0xc0);
+			}
+			void sub_rsp(uint8_t imm)
+			{
+				byte(0x48);
+				byte(0x83);
+				byte(0xec);
+				byte(imm);
+			}
+			void add_rsp(uint8_t imm)
+			{
+				byte(0x48);
+				byte(0x83);
+				byte(0xc4);
+				byte(imm);
+			}
+			//jmp qword [rcx + rax * 8]
+			void jmp_table()
+			{
+				byte(0xff);
+				byte(0x24);
+				byte(0xc1);
+			}
+			void call_rax()
+			{
+				byte(0xff);
+				byte(0xd0);
+			}
+			void ret()
+			{
+				byte(0xc3);
+			}
+			//returns where the displacement goes
+			size_t jmp()
+			{
+				byte(0xe9);
+				u32(0);
+				return code.size() - 4;
+			}
+			size_t jcc(Condition c)
+			{
+				byte(0x0f);
+				byte((uint8_t)c);
+				u32(0);
+				return code.size() - 4;
+			}
+			void patch(size_t at, size_t target)
+			{
+				int32_t rel = (int32_t)((int64_t)target - (int64_t)(at + 4));
+				memcpy(&code[at], &rel, 4);
+			}
+		};
+
+		//the frame is in r13, vm in rbx and the thread in r12 for the whole function
+		class Translator
+		{
+			X64 a;
+			JitCode& m_jit;
+			compiler::CompiledFunction& m_function;
+			std::unordered_map<size_t, size_t> m_labels;
+			//code offset of every instruction, the last one is the end of the function
+			std::vector<size_t> m_offsets;
+			//displacements that go to an instruction
+			std::vector<std::pair<size_t, size_t>> m_jumps;
+			std::vector<size_t> m_exits;
+			std::vector<size_t> m_dispatches;
+			size_t m_index_offset;
+
+			//helpers get the vm and thread in rdi/rsi, there's only rdx/rcx left for the rest
+			template <typename... Ts> void call(void* helper, Ts... args)
+			{
+				static_assert(sizeof...(Ts) <= 2, "jit helpers take at most 2 arguments");
+				a.mov(X64::rdi, X64::rbx);
+				a.mov(X64::rsi, X64::r12);
+				if constexpr (sizeof...(Ts) > 0)
+				{
+					X64::Register regs[] = {X64::rdx, X64::rcx};
+					size_t i = 0;
+					((a.mov(regs[i++], (uint64_t)args)), ...);
+				}
+				a.mov(X64::rax, (uint64_t)helper);
+				a.call_rax();
+			}
+			//return to run_thread when the helper returned non zero
+			void exit_if_set()
+			{
+				a.test_eax();
+				m_exits.push_back(a.jcc(X64::kNotEqual));
+			}
+			void jump_to(size_t instruction)
+			{
+				m_jumps.emplace_back(a.jmp(), instruction);
+			}
+			void jump_to_if(X64::Condition c, size_t instruction)
+			{
+				m_jumps.emplace_back(a.jcc(c), instruction);
+			}
+			//same as VirtualMachine::call_impl, a later label with the same index wins
+			bool jump_target(const std::weak_ptr<Label>& dest, size_t& position)
+			{
+				if (dest.expired())
+					return false;
+				auto fnd = m_labels.find(dest.lock()->label_index);
+				if (fnd == m_labels.end())
+					return false;
+				position = fnd->second;
+				return true;
+			}
+			//the destination of a conditional jump if the instruction is one that can be taken from the test
+			bool conditional_jump(Instruction& instr, X64::Condition& taken, size_t& target)
+			{
+				if (auto* jz = instr.cast<JumpZero>())
+				{
+					taken = X64::kNotEqual;
+					return jump_target(jz->dest, target);
+				}
+				if (auto* jnz = instr.cast<JumpNotZero>())
+				{
+					taken = X64::kEqual;
+					return jump_target(jnz->dest, target);
+				}
+				return false;
+			}
+
+			void translate(size_t i);
+
+		  public:
+			Translator(JitCode& jit, compiler::CompiledFunction& function) : m_jit(jit), m_function(function)
+			{
+				FunctionContext fc;
+				m_index_offset = (const char*)&fc.instruction_index - (const char*)&fc;
+			}
+			bool translate();
+			std::vector<uint8_t>& code()
+			{
+				return a.code;
+			}
+			const std::vector<size_t>& offsets() const
+			{
+				return m_offsets;
+			}
+		};
+
+		void Translator::translate(size_t i)
+		{
+			auto& instructions = m_function.instructions;
+			auto& instr = *instructions[i];
+			size_t target = 0;
+			X64::Condition taken;
+
+			a.store_r13(m_index_offset, (uint32_t)(i + 1));
+			if (instr.cast<Label>())
+				return;
+			if (auto* pi = instr.cast<PushInteger>())
+				call((void*)&jit_push_integer, (int64_t)pi->value);
+			else if (instr.cast<Constant0>())
+				call((void*)&jit_push_integer, (int64_t)0);
+			else if (instr.cast<Constant1>())
+				call((void*)&jit_push_integer, (int64_t)1);
+			else if (instr.cast<PushString>() || instr.cast<PushLocalizedString>() ||
+					 instr.cast<PushFunctionPointer>() || instr.cast<PushAnimationString>())
+				call((void*)&jit_push_constant, (PushConstant*)&instr);
+			else if (instr.cast<PushUndefined>())
+				call((void*)&jit_push_undefined);
+			else if (instr.cast<Pop>())
+				call((void*)&jit_pop);
+			else if (auto* lv = instr.cast<LoadValue>())
+			{
+				m_jit.names.push_back(util::string::to_lower(lv->variable_name));
+				call((void*)&jit_load_value, &m_jit.names.back());
+			}
+			else if (auto* j = instr.cast<Jump>())
+			{
+				if (j->dest.expired())
+					return;
+				if (jump_target(j->dest, target))
+				{
+					jump_to(target);
+					return;
+				}
+				call((void*)&jit_execute, &instr);
+				exit_if_set();
+				m_dispatches.push_back(a.jmp());
+				return;
+			}
+			else if (instr.cast<JumpZero>() || instr.cast<JumpNotZero>())
+			{
+				//only reached when the frame continues here, a test in front of it jumps on it's own
+				if (!conditional_jump(instr, taken, target))
+				{
+					call((void*)&jit_execute, &instr);
+					exit_if_set();
+					m_dispatches.push_back(a.jmp());
+					return;
+				}
+				a.mov(X64::rdi, X64::rbx);
+				a.mov(X64::rax, (uint64_t)&jit_zero_flag);
+				a.call_rax();
+				a.test_eax();
+				jump_to_if(taken, target);
+				return;
+			}
+			else if (instr.cast<Test>())
+			{
+				call((void*)&jit_test, &instr);
+				a.cmp_eax(-1);
+				m_exits.push_back(a.jcc(X64::kEqual));
+				if (i + 1 < instructions.size() && conditional_jump(*instructions[i + 1], taken, target))
+				{
+					a.test_eax();
+					jump_to_if(taken, target);
+					jump_to(i + 2);
+				}
+				return;
+			}
+			else
+			{
+				static const std::pair<size_t, void*> integer_binops[] = {
+					{type_id<AddInt>::id(), (void*)&jit_integer_binop<IntegerOp::kAdd>},
+					{type_id<SubInt>::id(), (void*)&jit_integer_binop<IntegerOp::kSub>},
+					{type_id<MulInt>::id(), (void*)&jit_integer_binop<IntegerOp::kMul>},
+					{type_id<LtInt>::id(), (void*)&jit_integer_binop<IntegerOp::kLt>},
+					{type_id<LeqInt>::id(), (void*)&jit_integer_binop<IntegerOp::kLeq>},
+					{type_id<GtInt>::id(), (void*)&jit_integer_binop<IntegerOp::kGt>},
+					{type_id<GeqInt>::id(), (void*)&jit_integer_binop<IntegerOp::kGeq>},
+					{type_id<EqInt>::id(), (void*)&jit_integer_binop<IntegerOp::kEq>},
+					{type_id<NeqInt>::id(), (void*)&jit_integer_binop<IntegerOp::kNeq>},
+				};
+				void* helper = nullptr;
+				for (auto& it : integer_binops)
+				{
+					if (it.first == instr.kind())
+						helper = it.second;
+				}
+				if (helper)
+					call(helper);
+				else if (instr.cast<Ret>())
+				{
+					call((void*)&jit_execute, &instr);
+					m_exits.push_back(a.jmp());
+					return;
+				}
+				else if (instr.cast<CallFunction>() || instr.cast<CallFunctionFile>() ||
+						 instr.cast<CallFunctionPointer>() || instr.cast<WaitTill>() || instr.cast<Wait>() ||
+						 instr.cast<WaitTillFrameEnd>())
+					call((void*)&jit_execute_suspending, &instr);
+				else if (instr.cast<SwitchTable>())
+				{
+					call((void*)&jit_execute, &instr);
+					exit_if_set();
+					m_dispatches.push_back(a.jmp());
+					return;
+				}
+				else
+					call((void*)&jit_execute, &instr);
+			}
+			exit_if_set();
+		}
+
+		bool Translator::translate()
+		{
+			auto& instructions = m_function.instructions;
+			size_t n = instructions.size();
+			for (size_t i = 0; i < n; ++i)
+			{
+				if (auto* l = instructions[i]->cast<Label>())
+					m_labels[l->label_index] = i;
+			}
+			m_jit.resume.resize(n + 1);
+			//names get pointed at while translating
+			m_jit.names.reserve(n);
+
+			//void entry(vm, thread, frame)
+			a.push(X64::rbx);
+			a.push(X64::r12);
+			a.push(X64::r13);
+			a.push(X64::r14);
+			//keep the stack 16 byte aligned for the calls
+			a.sub_rsp(8);
+			a.mov(X64::rbx, X64::rdi);
+			a.mov(X64::r12, X64::rsi);
+			a.mov(X64::r13, X64::rdx);
+			size_t dispatch = a.code.size();
+			a.load_rax_r13(m_index_offset);
+			a.cmp_rax((uint32_t)n);
+			size_t bad_resume = a.jcc(X64::kAbove);
+			a.mov(X64::rcx, (uint64_t)m_jit.resume.data());
+			a.jmp_table();
+
+			for (size_t i = 0; i < n; ++i)
+			{
+				m_offsets.push_back(a.code.size());
+				translate(i);
+			}
+			m_offsets.push_back(a.code.size());
+			call((void*)&jit_end);
+			m_exits.push_back(a.jmp());
+
+			a.patch(bad_resume, a.code.size());
+			call((void*)&jit_bad_resume);
+			size_t exit = a.code.size();
+			a.add_rsp(8);
+			a.pop(X64::r14);
+			a.pop(X64::r13);
+			a.pop(X64::r12);
+			a.pop(X64::rbx);
+			a.ret();
+
+			for (auto& it : m_jumps)
+				a.patch(it.first, m_offsets[it.second]);
+			for (auto at : m_exits)
+				a.patch(at, exit);
+			for (auto at : m_dispatches)
+				a.patch(at, dispatch);
+			return true;
+		}
+
+		bool Jit::supported()
+		{
+			return true;
+		}
+
+		JitCode* Jit::translate(compiler::CompiledFunction& function)
+		{
+			auto jit = std::make_unique<JitCode>();
+			Translator translator(*jit, function);
+			if (!translator.translate())
+				return nullptr;
+			auto& code = translator.code();
+			size_t page = (size_t)sysconf(_SC_PAGESIZE);
+			size_t size = (code.size() + page - 1) / page * page;
+			void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (memory == MAP_FAILED)
+				return nullptr;
+			jit->memory = memory;
+			jit->size = size;
+			memcpy(memory, code.data(), code.size());
+			if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+				return nullptr;
+			auto* base = (const uint8_t*)memory;
+			for (size_t i = 0; i < translator.offsets().size(); ++i)
+				jit->resume[i] = base + translator.offsets()[i];
+			jit->entry = (JitCode::Entry)memory;
+			return jit.release();
+		}
+
+		void Jit::run(VirtualMachine& vm, ThreadContext* tc, JitCode& code)
+		{
+			code.entry(&vm, tc, &tc->function_context());
+			if (t_exception)
+			{
+				auto e = std::move(t_exception);
+				t_exception = nullptr;
+				std::rethrow_exception(e);
+			}
+		}
+#endif
+	}; // namespace vm
+};	   // namespace script
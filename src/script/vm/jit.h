@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace script
+{
+	namespace compiler
+	{
+		struct CompiledFunction;
+	};
+	namespace vm
+	{
+		class VirtualMachine;
+		struct ThreadContext;
+		struct FunctionContext;
+
+		//machine code of a function, lives in it's own executable mapping
+		struct JitCode
+		{
+			//returns after the frame called a script function, waited, returned or threw
+			using Entry = void (*)(VirtualMachine*, ThreadContext*, FunctionContext*);
+			void* memory = nullptr;
+			size_t size = 0;
+			Entry entry = nullptr;
+			//start of the code of every instruction, the frame continues at the one of it's instruction_index
+			std::vector<const uint8_t*> resume;
+			//lowercased names of the variables the code loads, the code points into it so it's never resized
+			std::vector<std::string> names;
+			~JitCode();
+		};
+
+		//how often a function got called or jumped backwards and the code once it got hot
+		//copies start out cold, the code belongs to the instructions of the function it was made from
+		struct JitSlot
+		{
+			std::atomic<uint32_t> hotness{0};
+			//published once, vm's on other threads that share the compiled files pick it up
+			std::atomic<JitCode*> code{nullptr};
+			//translating it failed, it stays interpreted
+			std::atomic<bool> failed{false};
+
+			JitSlot() = default;
+			JitSlot(const JitSlot&)
+			{
+			}
+			JitSlot& operator=(const JitSlot&)
+			{
+				reset();
+				return *this;
+			}
+			~JitSlot()
+			{
+				reset();
+			}
+			void reset()
+			{
+				delete code.exchange(nullptr);
+				hotness.store(0, std::memory_order_relaxed);
+				failed.store(false, std::memory_order_relaxed);
+			}
+			//lossy when two threads count at once, it's only a heuristic
+			void count()
+			{
+				hotness.store(hotness.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			}
+		};
+
+		//baseline tier, translates every instruction of a function into a fixed sequence of x86-64 that calls into the
+		//runtime for anything that isn't control flow, a frame can switch to it at any instruction
+		//only available on x86-64 linux, translate always fails elsewhere
+		class Jit
+		{
+		  public:
+			static bool supported();
+			//nullptr if the function can't be translated
+			static JitCode* translate(compiler::CompiledFunction&);
+			//the code of the function, translated once it got at least threshold hot
+			static JitCode* code(compiler::CompiledFunction&, uint32_t threshold);
+			//runs the frame on top of the callstack like VirtualMachine::run_thread would, rethrows what the
+			//instructions threw
+			static void run(VirtualMachine&, ThreadContext*, JitCode&);
+		};
+	}; // namespace vm
+};	   // namespace script
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace script
+{
+	namespace vm
+	{
+		class VirtualMachine;
+		struct ThreadContext;
+
+		//runs the frame on top of the callstack from it's instruction_index until it calls, returns or yields
+		using NativeFunction = void (*)(VirtualMachine&, ThreadContext*);
+
+		//bump whenever the layout below or the code gsc2cpp writes changes
+		static constexpr uint32_t kNativeModuleVersion = 1;
+
+		struct NativeModuleFunction
+		{
+			const char* name;
+			NativeFunction function;
+		};
+		struct NativeModuleFile
+		{
+			const char* name;
+			//the compiled functions of the file as written by BytecodeCache::serialize with a key of 0
+			//the native code runs their instructions for everything it doesn't do itself
+			const unsigned char* bytecode;
+			size_t bytecode_size;
+			const NativeModuleFunction* functions;
+			size_t num_functions;
+		};
+		//exported as gsc_module by shared objects written by gsc2cpp
+		struct NativeModule
+		{
+			uint32_t version;
+			const NativeModuleFile* files;
+			size_t num_files;
+		};
+	}; // namespace vm
+};	   // namespace script
@@ -0,0 +1,29 @@
+#pragma once
+#include <script/vm/native_module.h>
+#include <script/vm/virtual_machine.h>
+#include <script/vm/instructions/instructions.h>
+#include <script/compiler/compiler.h>
+
+//included by the source gsc2cpp writes, everything in here has to behave exactly like VirtualMachine::run_thread
+
+namespace script
+{
+	namespace vm
+	{
+		namespace native
+		{
+			//the form the instruction quickened into if there is one, like run_thread does
+			inline void execute(VirtualMachine& vm, ThreadContext* tc, Instruction& instr)
+			{
+				auto* quickened = instr.quickened.load(std::memory_order_acquire);
+				(quickened ? quickened : &instr)->execute(vm, tc);
+			}
+			//true if the frame has to go back to run_thread, it called a script function or is waiting
+			//locks that aren't locked anymore are left for run_thread to remove
+			inline bool suspended(ThreadContext* tc, size_t depth)
+			{
+				return tc->m_callstack.size() != depth || !tc->m_locks.empty();
+			}
+		}; // namespace native
+	}; // namespace vm
+};	   // namespace script
@@ -0,0 +1,126 @@
+#pragma once
+#include <script/vm/types.h>
+#include <script/vm/switch_cases.h>
+#include <script/debug_info.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace script
+{
+	namespace vm
+	{
+		//operands marked RK are either a register or, with kConstantBit set, an index into the constant table
+		static constexpr uint32_t kConstantBit = 0x80000000u;
+		//destination for results that get thrown away, also means "no object" for call sites
+		static constexpr uint32_t kNoRegister = 0xffffffffu;
+
+		enum class RegisterOpcode : uint8_t
+		{
+			kMove,		 // a = RK(b)
+			kLoadGlobal, // a = global, level or game named by constant b
+			kAdd,		 // a = RK(b) op RK(c) for the binary opcodes up to kOrOr
+			kSub,
+			kMul,
+			kDiv,
+			kMod,
+			kAnd,
+			kOr,
+			kXor,
+			kShl,
+			kShr,
+			kEq,
+			kNeq,
+			kLt,
+			kLeq,
+			kGt,
+			kGeq,
+			kOrOr,
+			kNeg,		   // a = -RK(b)
+			kNot,		   // a = ~RK(b)
+			kLogicalNot,   // a = !RK(b)
+			kJump,		   // pc = a
+			kJumpZero,	   // pc = a if RK(b) is zero or undefined
+			kJumpNotZero,  // pc = a if RK(b) is non-zero
+			kSwitch,	   // pc = switches[a] case matching RK(b)
+			kGetField,	   // a = RK(b).RK(c)
+			kStore,		   // stores[a]
+			kVector,	   // a = (b, b + 1, b + 2)
+			kNewArray,	   // a = []
+			kCall,		   // a = calls[b]
+			kWait,		   // wait RK(a)
+			kWaitTill,	   // waittills[a]
+			kWaitTillFrameEnd,
+			kRet		   // return RK(a)
+		};
+
+		struct RegisterInstruction
+		{
+			RegisterOpcode op;
+			uint32_t a = 0;
+			uint32_t b = 0;
+			uint32_t c = 0;
+		};
+
+		struct RegisterCallSite
+		{
+			enum class Kind
+			{
+				kFunction,
+				kFile,
+				kPointer
+			};
+			Kind kind = Kind::kFunction;
+			std::string file;
+			std::string function;
+			//RK, in the order of the parameters
+			std::vector<uint32_t> arguments;
+			uint32_t pointer = kNoRegister;
+			uint32_t object = kNoRegister;
+			bool threaded = false;
+		};
+
+		//base.keys[0].keys[1]... = value, base is a register or a global when name is set
+		struct RegisterStore
+		{
+			uint32_t base = kNoRegister;
+			std::string name;
+			std::vector<uint32_t> keys;
+			uint32_t value = 0;
+		};
+
+		struct RegisterWaitTill
+		{
+			uint32_t object = kNoRegister;
+			uint32_t event = 0;
+			std::vector<uint32_t> registers;
+		};
+
+		struct RegisterSwitch
+		{
+			SwitchCases cases;
+			//pc for every value in cases
+			std::vector<uint32_t> targets;
+			uint32_t target_default = 0;
+		};
+
+		struct RegisterFunction
+		{
+			std::vector<RegisterInstruction> instructions;
+			LineTable lines;
+			std::vector<Variant> constants;
+			std::vector<RegisterCallSite> calls;
+			std::vector<RegisterStore> stores;
+			std::vector<RegisterWaitTill> waittills;
+			std::vector<RegisterSwitch> switches;
+			//registers the arguments are stored in, by position
+			std::vector<uint32_t> parameter_registers;
+			//name of every local, temporaries have no name
+			std::vector<std::string> register_names;
+			uint32_t self_register = 0;
+			uint32_t num_registers = 0;
+
+			std::string to_string(size_t pc) const;
+		};
+	}; // namespace vm
+};	   // namespace script
@@ -0,0 +1,376 @@
+#include "virtual_machine.h"
+#include <algorithm>
+
+namespace script
+{
+	namespace vm
+	{
+		static const char* kRegisterOpcodeNames[] = {
+			"Move", "LoadGlobal", "Add",  "Sub",		"Mul",		  "Div",	  "Mod",	  "And",   "Or",
+			"Xor",	"Shl",		  "Shr",  "Eq",			"Neq",		  "Lt",		  "Leq",	  "Gt",	   "Geq",
+			"OrOr", "Neg",		  "Not",  "LogicalNot", "Jump",		  "JumpZero", "JumpNotZero", "Switch", "GetField", "Store",
+			"Vector", "NewArray", "Call", "Wait",		"WaitTill", "WaitTillFrameEnd", "Ret"};
+
+		//operator binop() expects for kAdd...kOrOr
+		static const int kBinaryOperators[] = {'+',
+											   '-',
+											   '*',
+											   '/',
+											   '%',
+											   '&',
+											   '|',
+											   '^',
+											   parse::TokenType_kLsht,
+											   parse::TokenType_kRsht,
+											   parse::TokenType_kEq,
+											   parse::TokenType_kNeq,
+											   '<',
+											   parse::TokenType_kLeq,
+											   '>',
+											   parse::TokenType_kGeq,
+											   parse::TokenType_kOrOr};
+
+		static std::string operand_to_string(uint32_t x)
+		{
+			if (x == kNoRegister)
+				return "-";
+			if (x & kConstantBit)
+				return common::format("k{}", x & ~kConstantBit);
+			return common::format("r{}", x);
+		}
+
+		std::string RegisterFunction::to_string(size_t pc) const
+		{
+			auto& i = instructions[pc];
+			std::string s = kRegisterOpcodeNames[(int)i.op];
+			switch (i.op)
+			{
+			case RegisterOpcode::kLoadGlobal:
+				return common::format("{} {} {}", s, operand_to_string(i.a), std::get<vm::String>(constants[i.b & ~kConstantBit]));
+			case RegisterOpcode::kJump:
+				return common::format("{} {}", s, i.a);
+			case RegisterOpcode::kJumpZero:
+			case RegisterOpcode::kJumpNotZero:
+				return common::format("{} {} {}", s, i.a, operand_to_string(i.b));
+			case RegisterOpcode::kSwitch:
+				return common::format("{} {} {} ({} cases)", s, i.a, operand_to_string(i.b),
+									  switches[i.a].cases.values.size());
+			case RegisterOpcode::kCall:
+				return common::format("{} {} {}", s, operand_to_string(i.a), calls[i.b].function);
+			case RegisterOpcode::kStore:
+			case RegisterOpcode::kWaitTill:
+				return common::format("{} {}", s, i.a);
+			case RegisterOpcode::kWaitTillFrameEnd:
+				return s;
+			case RegisterOpcode::kWait:
+			case RegisterOpcode::kRet:
+				return common::format("{} {}", s, operand_to_string(i.a));
+			case RegisterOpcode::kVector:
+			case RegisterOpcode::kNewArray:
+			case RegisterOpcode::kMove:
+			case RegisterOpcode::kNeg:
+			case RegisterOpcode::kNot:
+			case RegisterOpcode::kLogicalNot:
+				return common::format("{} {} {}", s, operand_to_string(i.a), operand_to_string(i.b));
+			default:
+				break;
+			}
+			return common::format("{} {} {} {}", s, operand_to_string(i.a), operand_to_string(i.b),
+								  operand_to_string(i.c));
+		}
+
+		//same as Test + JumpZero/JumpNotZero
+		static bool register_test(const vm::Variant& v)
+		{
+			if (v.index() == (int)vm::Type::kInteger)
+				return std::get<vm::Integer>(v) != 0;
+			if (v.index() == (int)vm::Type::kUndefined)
+				return false;
+			throw vm::Exception("unexpected {}", v.index());
+		}
+
+		static float register_float(const vm::Variant& v, size_t index)
+		{
+			if (v.index() == vm::type_index<vm::Number>())
+				return std::get<vm::Number>(v);
+			else if (v.index() == vm::type_index<vm::Integer>())
+				return (float)std::get<vm::Integer>(v);
+			throw vm::Exception("cannot convert index {} from {} to float", index, vm::kVariantNames[v.index()]);
+		}
+
+		static vm::Integer integer_binop(RegisterOpcode op, vm::Integer a, vm::Integer b)
+		{
+			switch (op)
+			{
+			case RegisterOpcode::kAdd:
+				return a + b;
+			case RegisterOpcode::kSub:
+				return a - b;
+			case RegisterOpcode::kMul:
+				return a * b;
+			case RegisterOpcode::kDiv:
+				return a / b;
+			case RegisterOpcode::kMod:
+				return a % b;
+			case RegisterOpcode::kAnd:
+				return a & b;
+			case RegisterOpcode::kOr:
+				return a | b;
+			case RegisterOpcode::kShl:
+				return a << b;
+			case RegisterOpcode::kShr:
+				return a >> b;
+			case RegisterOpcode::kEq:
+				return a == b ? 1 : 0;
+			case RegisterOpcode::kNeq:
+				return a == b ? 0 : 1;
+			case RegisterOpcode::kLt:
+				return a < b ? 1 : 0;
+			case RegisterOpcode::kLeq:
+				return a <= b ? 1 : 0;
+			case RegisterOpcode::kGt:
+				return a > b ? 1 : 0;
+			case RegisterOpcode::kGeq:
+				return a >= b ? 1 : 0;
+			case RegisterOpcode::kOrOr:
+				return a || b ? 1 : 0;
+			default:
+				break;
+			}
+			throw vm::Exception("invalid operator {}", kRegisterOpcodeNames[(int)op]);
+		}
+
+		void VirtualMachine::run_registers(ThreadContext* tc)
+		{
+			auto& fc = tc->function_context();
+			auto& rf = *fc.register_function;
+			auto* regs = fc.registers.data();
+			auto* code = rf.instructions.data();
+			const auto* constants = rf.constants.data();
+			auto rk = [regs, constants](uint32_t x) -> const vm::Variant&
+			{
+				return (x & kConstantBit) ? constants[x & ~kConstantBit] : regs[x];
+			};
+			size_t pc = fc.instruction_index;
+			try
+			{
+				while (1)
+				{
+					auto& i = code[pc++];
+					++m_executed_instructions;
+					if (m_flags & flags::kVerbose)
+					{
+						printf("\t\t-->%s\t%s::%s\n", rf.to_string(pc - 1).c_str(), fc.file_name.c_str(),
+							   fc.function_name.c_str());
+					}
+					switch (i.op)
+					{
+					case RegisterOpcode::kMove:
+						regs[i.a] = rk(i.b);
+						break;
+					case RegisterOpcode::kLoadGlobal:
+						regs[i.a] = get_variable(tc, std::get<vm::String>(rk(i.b)));
+						break;
+					case RegisterOpcode::kAdd:
+					case RegisterOpcode::kSub:
+					case RegisterOpcode::kMul:
+					case RegisterOpcode::kDiv:
+					case RegisterOpcode::kMod:
+					case RegisterOpcode::kAnd:
+					case RegisterOpcode::kOr:
+					case RegisterOpcode::kShl:
+					case RegisterOpcode::kShr:
+					case RegisterOpcode::kEq:
+					case RegisterOpcode::kNeq:
+					case RegisterOpcode::kLt:
+					case RegisterOpcode::kLeq:
+					case RegisterOpcode::kGt:
+					case RegisterOpcode::kGeq:
+					case RegisterOpcode::kOrOr:
+					{
+						auto& a = rk(i.b);
+						auto& b = rk(i.c);
+						if (a.index() == (int)vm::Type::kInteger && b.index() == (int)vm::Type::kInteger)
+						{
+							vm::Integer result = integer_binop(i.op, std::get<vm::Integer>(a), std::get<vm::Integer>(b));
+							regs[i.a] = result;
+						}
+						else
+							regs[i.a] = binop(a, b, kBinaryOperators[(int)i.op - (int)RegisterOpcode::kAdd]);
+					}
+					break;
+					case RegisterOpcode::kXor:
+						regs[i.a] = binop(rk(i.b), rk(i.c), '^');
+						break;
+					case RegisterOpcode::kNeg:
+						regs[i.a] = binop(vm::Integer(0), rk(i.b), '-');
+						break;
+					case RegisterOpcode::kNot:
+					{
+						auto& v = rk(i.b);
+						if (v.index() != (int)vm::Type::kInteger)
+							throw vm::Exception("cannot convert index 0 from {} to integer", kVariantNames[v.index()]);
+						regs[i.a] = vm::Integer(~std::get<vm::Integer>(v));
+					}
+					break;
+					case RegisterOpcode::kLogicalNot:
+					{
+						auto& v = rk(i.b);
+						if (v.index() == (int)vm::Type::kInteger)
+							regs[i.a] = vm::Integer(std::get<vm::Integer>(v) ? 0 : 1);
+						else if (v.index() == (int)vm::Type::kUndefined)
+							regs[i.a] = vm::Integer(1);
+						else
+							throw vm::Exception("unexpected {}", v.index());
+					}
+					break;
+					case RegisterOpcode::kJump:
+						pc = i.a;
+						break;
+					case RegisterOpcode::kJumpZero:
+						if (!register_test(rk(i.b)))
+							pc = i.a;
+						break;
+					case RegisterOpcode::kJumpNotZero:
+						if (register_test(rk(i.b)))
+							pc = i.a;
+						break;
+					case RegisterOpcode::kSwitch:
+					{
+						auto& sw = rf.switches[i.a];
+						size_t index = sw.cases.find(*this, rk(i.b));
+						pc = index == SwitchCases::kNoCase ? sw.target_default : sw.targets[index];
+					}
+					break;
+					case RegisterOpcode::kGetField:
+					{
+						vm::Variant object = rk(i.b);
+						load_object_field_value(*this, tc, object, util::string::to_lower(variant_to_string(rk(i.c))));
+						regs[i.a] = tc->pop();
+					}
+					break;
+					case RegisterOpcode::kStore:
+					{
+						auto& store = rf.stores[i.a];
+						vm::Variant* ptr =
+							store.name.empty() ? &regs[store.base] : get_variable_reference(tc, store.name);
+						vm::Reference ref;
+						for (auto key : store.keys)
+							ptr = load_object_field_ref(ptr, ref, variant_to_string(rk(key)));
+						vm::Variant value = rk(store.value);
+						store_ref(*this, tc, ptr, ref, value);
+					}
+					break;
+					case RegisterOpcode::kVector:
+					{
+						vm::Vector v;
+						v.x = register_float(regs[i.b], 0);
+						v.y = register_float(regs[i.b + 1], 1);
+						v.z = register_float(regs[i.b + 2], 2);
+						regs[i.a] = v;
+					}
+					break;
+					case RegisterOpcode::kNewArray:
+					{
+						//TODO: FIXME don't use object as array
+						vm::ObjectPtr o = std::make_shared<vm::Object>("pusharray");
+						regs[i.a] = o;
+					}
+					break;
+					case RegisterOpcode::kCall:
+					{
+						auto& site = rf.calls[i.b];
+						fc.instruction_index = pc;
+						vm::ObjectPtr obj = fc.self_object;
+						bool is_method_call = site.object != kNoRegister;
+						if (is_method_call)
+						{
+							auto& o = rk(site.object);
+							if (o.index() != (int)vm::Type::kObject)
+								throw vm::Exception("expected object got {}", o.index());
+							obj = std::get<vm::ObjectPtr>(o);
+						}
+						std::string file = site.kind == RegisterCallSite::Kind::kFile ? site.file : fc.file_name;
+						std::string function = site.function;
+						if (site.kind == RegisterCallSite::Kind::kPointer)
+						{
+							auto& vfp = rk(site.pointer);
+							if (vfp.index() != (int)vm::Type::kFunctionPointer)
+								throw vm::Exception("{} is not a function pointer", vfp.index());
+							auto& fp = std::get<vm::FunctionPointer>(vfp);
+							file = fp.file.str();
+							std::replace(file.begin(), file.end(), '\\', '/');
+							function = fp.name.str();
+						}
+						size_t numargs = site.arguments.size();
+						for (size_t n = numargs; n-- > 0;)
+							tc->push(rk(site.arguments[n]));
+						if (site.threaded)
+						{
+							auto result = exec_thread(tc, obj, file, function, numargs, is_method_call);
+							if (i.a != kNoRegister)
+								regs[i.a] = std::move(result);
+							break;
+						}
+						size_t depth = tc->m_callstack.size();
+						fc.return_register = i.a;
+						call_function(tc, obj, file, function, numargs, is_method_call);
+						//a script function got a new frame, Ret stores the result in return_register
+						if (tc->m_callstack.size() != depth)
+							return;
+						auto result = tc->pop();
+						if (i.a != kNoRegister)
+							regs[i.a] = std::move(result);
+					}
+					break;
+					case RegisterOpcode::kWait:
+						wait(*this, tc, register_float(rk(i.a), 0));
+						fc.instruction_index = pc;
+						return;
+					case RegisterOpcode::kWaitTill:
+					{
+						auto& site = rf.waittills[i.a];
+						if (site.object == kNoRegister)
+							throw vm::Exception("no obj");
+						auto& o = rk(site.object);
+						if (o.index() != (int)vm::Type::kObject)
+							throw vm::Exception("expected object got {}", o.index());
+						std::vector<std::string> vars;
+						waittill(tc, std::get<vm::ObjectPtr>(o), variant_to_string(rk(site.event)), vars,
+								 &site.registers);
+						tc->pop();
+						fc.instruction_index = pc;
+					}
+						return;
+					case RegisterOpcode::kWaitTillFrameEnd:
+						wait_till_frame_end(*this, tc);
+						fc.instruction_index = pc;
+						return;
+					case RegisterOpcode::kRet:
+					{
+						vm::Variant result = rk(i.a);
+						tc->ret();
+						if (!tc->m_callstack.empty())
+						{
+							auto& caller = tc->m_callstack.top();
+							if (caller.register_function)
+							{
+								if (caller.return_register != kNoRegister)
+									caller.registers[caller.return_register] = std::move(result);
+								return;
+							}
+						}
+						tc->push(std::move(result));
+					}
+						return;
+					}
+				}
+			}
+			catch (...)
+			{
+				fc.instruction_index = pc;
+				throw;
+			}
+		}
+	}; // namespace vm
+};	   // namespace script
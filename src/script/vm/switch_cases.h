@@ -0,0 +1,35 @@
+#pragma once
+#include <script/vm/types.h>
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+namespace script
+{
+	namespace vm
+	{
+		class VirtualMachine;
+
+		//case labels of a switch, used by the SwitchTable instruction and the register backend
+		//a string looked up in all string cases or an integer in all integer cases is a single lookup
+		//anything else compares against every case in order like a chain of == would
+		struct SwitchCases
+		{
+			static constexpr size_t kNoCase = ~(size_t)0;
+			//in the order they're written, only integers and strings
+			std::vector<Variant> values;
+
+			//built from values, not stored in the bytecode cache
+			std::unordered_map<std::string, size_t> strings;
+			std::unordered_map<int, size_t> integers;
+			//index by value - dense_base when the integers are close together
+			std::vector<size_t> dense;
+			int dense_base = 0;
+			bool mixed = false;
+
+			void build();
+			//index of the first case equal to v, kNoCase if there is none
+			size_t find(VirtualMachine& vm, const Variant& v) const;
+		};
+	}; // namespace vm
+};	   // namespace script
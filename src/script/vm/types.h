@@ -2,6 +2,7 @@
 #include <memory>
 #include <string>
 #include <optional>
+#include <ostream>
 #include <stdexcept>
 #include <unordered_map>
 #include <variant>
@@ -108,7 +109,47 @@ namespace script
 				return v;
 			}
 		};
-		using String = std::string;
+		//immutable and refcounted, copying a string (e.g pushing a constant onto the stack) doesn't allocate
+		class String
+		{
+			std::shared_ptr<const std::string> m_value;
+
+		  public:
+			String()
+			{
+			}
+			String(const char* s) : m_value(std::make_shared<const std::string>(s))
+			{
+			}
+			String(std::string s) : m_value(std::make_shared<const std::string>(std::move(s)))
+			{
+			}
+			const std::string& str() const
+			{
+				static const std::string empty;
+				return m_value ? *m_value : empty;
+			}
+			operator const std::string&() const
+			{
+				return str();
+			}
+			const char* c_str() const
+			{
+				return str().c_str();
+			}
+			size_t size() const
+			{
+				return str().size();
+			}
+			bool operator==(const String& o) const
+			{
+				return m_value == o.m_value || str() == o.str();
+			}
+		};
+		inline std::ostream& operator<<(std::ostream& os, const String& s)
+		{
+			return os << s.str();
+		}
 		using Integer = int;
 		using Number = float;
 
@@ -118,18 +159,18 @@ namespace script
 
 		struct LocalizedString
 		{
-			std::string reference;
+			String reference;
 		};
 
 		struct Animation
 		{
-			std::string reference;
+			String reference;
 		};
 
 		struct FunctionPointer
 		{
-			std::string file;
-			std::string name;
+			String file;
+			String name;
 		};
 
 		struct Undefined
@@ -239,6 +280,7 @@ namespace script
 			}
 		};
 
+		//literals of a file, deduplicated by the compiler and referenced by index from the push instructions
 		using Constants = std::vector<Variant>;
 	}; // namespace vm
 };	   // namespace script
@@ -1,4 +1,6 @@
 #include "virtual_machine.h"
+#include <script/compiler/lazy_function.h>
+#include <script/compiler/exception.h>
 
 namespace script
 {
@@ -216,6 +218,7 @@ namespace script
 
 		VirtualMachine::VirtualMachine(compiler::CompiledFiles& cf_) : m_compiledfiles(cf_)
 		{
+			invalidate_caches();
 			level_object = std::make_shared<vm::Object>("level");
 			game_object = std::make_shared<vm::Object>("game");
 			for (auto& it : cf_)
@@ -236,9 +239,8 @@ namespace script
 			auto* fn = find_function_in_file(file, function);
 			if (!fn)
 				throw vm::Exception("can't find {}::{} is_method = {}, numargs = {}", file, function, is_method, numargs);
-			m_newthreads.push_back(std::make_unique<ThreadContext>());
+			m_newthreads.push_back(acquire_thread());
 			auto* thr = m_newthreads[m_newthreads.size() - 1].get();
-			thr->m_context = std::make_unique<VMContextImpl>(*this, thr);
 			//TODO: FIXME there's no guarantee in which order the thread runs, atm it runs after the thread that made a new thread
 			//but we could run the thread first till we hit a wait then return control to the former thread
 			call_impl(current_thread, thr, obj, fn, numargs);
@@ -251,6 +253,84 @@ namespace script
 			return vm::Undefined();
 		}
 
+		std::unique_ptr<ThreadContext> VirtualMachine::acquire_thread()
+		{
+			if (m_threadpool.empty())
+			{
+				auto thr = std::make_unique<ThreadContext>();
+				thr->m_context = std::make_unique<VMContextImpl>(*this, thr.get());
+				return thr;
+			}
+			auto thr = std::move(m_threadpool.back());
+			m_threadpool.pop_back();
+			return thr;
+		}
+
+		void VirtualMachine::release_thread(std::unique_ptr<ThreadContext> thr)
+		{
+			if (m_threadpool.size() >= kMaxPooledThreads)
+				return;
+			thr->reset();
+			m_threadpool.push_back(std::move(thr));
+		}
+
+		PreparedCall VirtualMachine::prepare_call(const std::string& file, const std::string& function)
+		{
+			PreparedCall pc;
+			pc.function = find_function_in_file(file, function);
+			pc.generation = m_files_generation;
+			return pc;
+		}
+
+		bool VirtualMachine::call(const PreparedCall& pc, vm::ObjectPtr obj, std::span<const vm::Variant> args,
+								  vm::Variant* result)
+		{
+			if (!pc)
+				throw vm::Exception("invalid prepared call");
+			if (!is_current(pc))
+				throw vm::Exception("prepared call is from before files were loaded again, prepare it again");
+			if (!obj)
+				obj = get_level_object();
+			auto thr = acquire_thread();
+			for (auto it = args.rbegin(); it != args.rend(); ++it)
+				thr->push(*it);
+			call_impl(thr.get(), thr.get(), obj, pc.function, args.size());
+			if (!run_thread(thr.get()))
+			{
+				m_newthreads.push_back(std::move(thr));
+				return false;
+			}
+			if (result)
+				*result = thr->pop();
+			release_thread(std::move(thr));
+			return true;
+		}
+
+		void VirtualMachine::invalidate_caches()
+		{
+			static std::atomic<uint64_t> epochs{0};
+			m_epoch = ++epochs;
+		}
+
+		DebugInfo& VirtualMachine::get_debug_info()
+		{
+			m_debug_info = {};
+			if (!last_thread || last_thread->m_callstack.empty())
+				return m_debug_info;
+			auto& fc = last_thread->m_callstack.top();
+			const LineTable* lines = nullptr;
+			if (fc.register_function)
+				lines = &fc.register_function->lines;
+			else if (fc.function)
+				lines = &fc.function->lines;
+			m_debug_info.file = lines && !lines->source.empty() ? lines->source : fc.file_name;
+			m_debug_info.function = fc.function_name;
+			//the index already points past the instruction that is running
+			if (lines && fc.instruction_index > 0)
+				m_debug_info.line = lines->line(fc.instruction_index - 1);
+			return m_debug_info;
+		}
+
 		compiler::CompiledFunction* VirtualMachine::find_function_in_file(const std::string file,
 																		  const std::string function)
 		{
@@ -263,9 +343,24 @@ namespace script
 				auto fnd3 = m_allcustomfunctions.find(util::string::to_lower(function));
 				if (fnd3 == m_allcustomfunctions.end())
 					return nullptr;
-				return fnd3->second;
+				return resolve(fnd3->second);
+			}
+			return resolve(&fnd2->second);
+		}
+
+		compiler::CompiledFunction* VirtualMachine::resolve(compiler::CompiledFunction* fn)
+		{
+			if (!fn->lazy)
+				return fn;
+			try
+			{
+				compiler::resolve_lazy(*fn);
+			}
+			catch (compiler::CompileException& e)
+			{
+				throw vm::Exception("{}", e.what());
 			}
-			return &fnd2->second;
+			return fn;
 		}
 
 		void VirtualMachine::dump_object(const std::string name,
@@ -303,17 +398,38 @@ namespace script
 			dump_object("level", seen, std::get<vm::ObjectPtr>(level_object), 0);
 			dump_object("game", seen, std::get<vm::ObjectPtr>(game_object), 0);
 			dump_object("self", seen, fc.self_object, 0);
+			auto dump_variable = [&](const std::string& name, vm::Variant& value)
+			{
+				printf("%s = %s;\n", name.c_str(), variant_to_string_for_dump(value).c_str());
+				if (value.index() == (int)vm::Type::kObject)
+				{
+					printf("%s fields:\n", name.c_str());
+					dump_object(name, seen, std::get<vm::ObjectPtr>(value), 0);
+				}
+			};
 			for (auto& it : fc.variables)
+				dump_variable(it.first, it.second);
+			if (fc.register_function)
 			{
-				printf("%s = %s;\n", it.first.c_str(), variant_to_string_for_dump(it.second).c_str());
-				if (it.second.index() == (int)vm::Type::kObject)
+				auto& names = fc.register_function->register_names;
+				for (size_t i = 0; i < names.size(); ++i)
 				{
-					printf("%s fields:\n", it.first.c_str());
-					dump_object(it.first, seen, std::get<vm::ObjectPtr>(it.second), 0);
+					if (!names[i].empty())
+						dump_variable(names[i], fc.registers[i]);
 				}
 			}
 		}
 
+		void ThreadContext::reset()
+		{
+			m_stack.clear();
+			m_referencestack = {};
+			m_callstack = {};
+			m_locks.clear();
+			function_name_stack = {};
+			marked_for_deletion = false;
+		}
+
 		void ThreadContext::ret()
 		{
 			if (m_callstack.empty())
@@ -329,10 +445,31 @@ namespace script
 
 		void VirtualMachine::call_impl(ThreadContext *caller_thread, ThreadContext* callee_thread, vm::ObjectPtr obj, script::compiler::CompiledFunction* fn, size_t numargs)
 		{
+			if (m_backend == Backend::kRegister && !fn->register_function)
+				throw vm::Exception("{}::{} has no register code", fn->file, fn->name);
 			callee_thread->m_callstack.push(FunctionContext());
 			callee_thread->function_name_stack.push(fn->name);
 			auto& fc = callee_thread->function_context();
 
+			if (m_backend == Backend::kRegister)
+			{
+				auto& rf = *fn->register_function;
+				fc.register_function = &rf;
+				fc.registers.resize(rf.num_registers);
+				for (size_t i = 0; i < numargs; ++i)
+				{
+					auto arg = caller_thread->pop();
+					if (i < rf.parameter_registers.size())
+						fc.registers[rf.parameter_registers[i]] = std::move(arg);
+				}
+				fc.file_name = fn->file;
+				fc.function_name = fn->name;
+				fc.function = fn;
+				fc.self_object = obj;
+				fc.registers[rf.self_register] = fc.self_object;
+				return;
+			}
+
 			for (size_t i = 0; i < numargs; ++i)
 			{
 				auto arg = caller_thread->pop(); // we're still calling m_thread pop because we want to pop the arguments
@@ -344,6 +481,8 @@ namespace script
 				fc.variables[util::string::to_lower(parm)] = arg;
 			}
 
+			if (m_flags & flags::kJit)
+				fn->jit.count();
 			fc.instruction_index = 0;
 			fc.file_name = fn->file;
 			fc.function_name = fn->name;
@@ -387,12 +526,13 @@ namespace script
 			thread->push(vm::Undefined());
 		}
 		void VirtualMachine::waittill(ThreadContext* thread, vm::ObjectPtr obj, const std::string event_str,
-									  std::vector<std::string>& vars)
+									  std::vector<std::string>& vars, const std::vector<uint32_t>* registers)
 		{
 			struct ThreadLockWaitForEventString : vm::ThreadLock
 			{
 				VirtualMachine* vm;
 				std::vector<std::string> parameters;
+				std::vector<uint32_t> registers;
 				std::string string;
 				vm::ObjectPtr object;
 				bool notified = false;
@@ -410,6 +550,10 @@ namespace script
 							auto &var = fc->get_variable(parameters[i]);
 							var = ne.arguments[i];
 						}
+						for (size_t i = 0; i < registers.size() && i < ne.arguments.size(); ++i)
+						{
+							fc->registers[registers[i]] = ne.arguments[i];
+						}
 						notified = true;
 					}
 					else
@@ -428,6 +572,8 @@ namespace script
 			{
 				l->parameters.push_back(vars[i]);
 			}
+			if (registers)
+				l->registers = *registers;
 			l->fc = &thread->function_context();
 			l->vm = this;
 			l->object = obj;
@@ -588,18 +734,39 @@ namespace script
 				}
 				if (tc->marked_for_deletion)
 					break;
+				auto& top = tc->function_context();
+				if (top.register_function)
+				{
+					run_registers(tc);
+					continue;
+				}
+				if (top.function->native)
+				{
+					top.function->native(*this, tc);
+					continue;
+				}
+				if (m_flags & flags::kJit)
+				{
+					if (auto* code = Jit::code(*top.function, m_jit_threshold))
+					{
+						Jit::run(*this, tc, *code);
+						continue;
+					}
+				}
 				auto instr = fetch(tc);
 				if (!instr)
 					throw vm::Exception("shouldn't be nullptr");
 				last_instruction = instr;
+				auto* quickened = instr->quickened.load(std::memory_order_acquire);
+				auto* target = quickened ? quickened : instr.get();
 				auto& fc = tc->function_context();
 				if (m_flags & flags::kVerbose)
 				{
-					printf("\t\t-->%s (%d)\t%s::%s\n", instr->to_string().c_str(), tc->m_stack.size(),
+					printf("\t\t-->%s (%d)\t%s::%s\n", target->to_string().c_str(), tc->m_stack.size(),
 						   fc.file_name.c_str(), fc.function_name.c_str());
 				}
-				debug = &instr->debug;
-				instr->execute(*this, tc);
+				++m_executed_instructions;
+				target->execute(*this, tc);
 			}
 			return true;
 		}
@@ -612,7 +779,10 @@ namespace script
 				for (auto it = m_threads.begin(); it != m_threads.end();)
 				{
 					if ((*it)->marked_for_deletion)
+					{
+						release_thread(std::move(*it));
 						it = m_threads.erase(it);
+					}
 					else
 						++it;
 				}
@@ -9,6 +9,7 @@
 #include <script/property.h>
 #include <parse/token.h>
 #include <unordered_set>
+#include <span>
 
 namespace script
 {
@@ -63,10 +64,21 @@ namespace script
 			{
 				kNone = 0,
 				kZF = 1,
-				kVerbose = 2
+				kVerbose = 2,
+				//instructions stay generic instead of rewriting themselves into specialized forms
+				kNoQuickening = 4,
+				//functions that got hot run as machine code (Jit), without it everything is interpreted again
+				kJit = 8
 			};
 		}; // namespace flags
 
+		//which code of a compiled function gets executed, register needs RegisterCompiler to have run
+		enum class Backend
+		{
+			kStack,
+			kRegister
+		};
+
 		struct NotifyEvent
 		{
 			std::string event_string;
@@ -105,6 +117,11 @@ namespace script
 			}
 			size_t instruction_index = 0;
 			compiler::CompiledFunction* function = nullptr;
+			//only set for frames of the register backend
+			vm::RegisterFunction* register_function = nullptr;
+			std::vector<vm::Variant> registers;
+			//where the result of the script function this frame is calling goes
+			uint32_t return_register = kNoRegister;
 		};
 		struct ThreadContext
 		{
@@ -127,6 +144,8 @@ namespace script
 			}
 			bool marked_for_deletion = false;
 			void ret();
+			//clears all the state so the context can be handed out again, keeps m_context
+			void reset();
 
 			const std::string& current_file()
 			{
@@ -145,11 +164,14 @@ namespace script
 					}
 					throw vm::Exception("cannot jump to non existing label {}", i);
 				}
+				//backwards is a loop, counts towards translating the function
+				if (fnd->second < fc.instruction_index)
+					fc.function->jit.count();
 				fc.instruction_index = fnd->second;
 			}
 			void push(Variant v)
 			{
-				m_stack.push_back(v);
+				m_stack.push_back(std::move(v));
 			}
 			Variant& top(int offset = 0)
 			{
@@ -168,7 +190,7 @@ namespace script
 				{
 					if (m_stack.empty())
 						throw vm::Exception("empty stack");
-					v = m_stack[m_stack.size() - 1];
+					v = std::move(m_stack[m_stack.size() - 1]);
 					m_stack.pop_back();
 				}
 				return v;
@@ -200,11 +222,28 @@ namespace script
 				return ref;
 			}
 		};
+		//resolved function handle, lookup only happens once in prepare_call
+		//only good until files are loaded again, calling it after that throws
+		struct PreparedCall
+		{
+			compiler::CompiledFunction* function = nullptr;
+			//of the compiled files when it was prepared
+			uint64_t generation = 0;
+			explicit operator bool() const
+			{
+				return function != nullptr;
+			}
+		};
+
 //		inline int runtime_generated_type_id_sequence = 0;
 //		template <typename T> inline const int runtime_generated_type_id = runtime_generated_type_id_sequence++;
 		class VirtualMachine
 		{
 			int m_flags = flags::kNone;
+			Backend m_backend = Backend::kStack;
+			size_t m_executed_instructions = 0;
+			//calls and backwards jumps after which a function gets translated with flags::kJit
+			uint32_t m_jit_threshold = 1000;
 			compiler::CompiledFiles& m_compiledfiles;
 			size_t frame_number = 0;
 
@@ -212,6 +251,11 @@ namespace script
 
 			std::vector<std::unique_ptr<ThreadContext>> m_threads;
 			std::vector<std::unique_ptr<ThreadContext>> m_newthreads;
+			//finished thread contexts get recycled so hot host callbacks don't allocate a new context each time
+			std::vector<std::unique_ptr<ThreadContext>> m_threadpool;
+			static constexpr size_t kMaxPooledThreads = 256;
+			std::unique_ptr<ThreadContext> acquire_thread();
+			void release_thread(std::unique_ptr<ThreadContext>);
 			std::vector<NotifyEvent> notification_events;
 
 			vm::Variant level_object;
@@ -223,11 +267,15 @@ namespace script
 			//hackish solution, just make a large global list of all the functions and then if we can't find the function
 			//just try to find it here
 			std::unordered_map<std::string, compiler::CompiledFunction*> m_allcustomfunctions;
-			void call_impl(ThreadContext *, ThreadContext*, vm::ObjectPtr obj, script::compiler::CompiledFunction*, size_t);
+			//runs the register frame on top of the callstack until it calls, returns or yields
+			void run_registers(ThreadContext*);
 			std::shared_ptr<vm::Instruction> last_instruction;
 			ThreadContext *last_thread = nullptr;
 			std::unordered_map<std::string, vm::Variant> m_globals;
-			DebugInfo* debug = nullptr;
+			DebugInfo m_debug_info;
+			uint64_t m_epoch = 0;
+			//counts loads into m_compiledfiles, a prepared call from an older one may point at a function that's gone
+			uint64_t m_files_generation = 0;
 
 			
 			std::unordered_map<int, std::unordered_map<std::string, std::function<int(void*, VMContext&)>>>
@@ -243,6 +291,8 @@ namespace script
 				std::function<int(void*, VMContext&)> setter;
 			};
 			std::unordered_map<int, std::unordered_map<std::string, FieldRegistryEntry>> m_field_registry;
+			//compiles a stub from compile_lazy, errors are thrown as vm::Exception
+			compiler::CompiledFunction* resolve(compiler::CompiledFunction* fn);
 		  public:
 			  
 			template<typename T>
@@ -283,6 +333,7 @@ namespace script
 					entry.setter = setter;
 				}
 				m_field_registry[type_id][name] = entry;
+				invalidate_caches();
 			}
 
 			template <typename T>
@@ -307,10 +358,8 @@ namespace script
 			{
 				return last_thread;
 			}
-			DebugInfo& get_debug_info()
-			{
-				return *debug;
-			}
+			//of the instruction the last thread is running, looked up in the line table of it's function
+			DebugInfo& get_debug_info();
 
 			std::unordered_map<std::string, vm::Variant> get_object_keys_and_values(vm::ObjectPtr& o)
 			{
@@ -344,6 +393,10 @@ namespace script
 			{
 				m_globals[name] = value;
 			}
+			const std::unordered_map<std::string, vm::Variant>& get_globals() const
+			{
+				return m_globals;
+			}
 
 			std::shared_ptr<vm::Instruction> get_last_instruction()
 			{
@@ -370,6 +423,26 @@ namespace script
 				return m_flags;
 			}
 
+			void set_backend(Backend backend)
+			{
+				m_backend = backend;
+			}
+			void set_jit_threshold(uint32_t threshold)
+			{
+				m_jit_threshold = threshold;
+			}
+
+			Backend get_backend()
+			{
+				return m_backend;
+			}
+
+			//instructions executed by either backend since the vm was created
+			size_t executed_instructions()
+			{
+				return m_executed_instructions;
+			}
+
 			vm::Variant get_variable(ThreadContext*, const std::string var);
 			vm::Variant* get_variable_reference(ThreadContext*, const std::string var);
 			std::string variant_to_string_for_dump(Variant v);
@@ -389,7 +462,27 @@ namespace script
 				}
 				notification_events.push_back(ev);
 			}
+			//compiles it first if it's a stub from compile_lazy
 			compiler::CompiledFunction* find_function_in_file(const std::string file, const std::string function);
+			void call_impl(ThreadContext *, ThreadContext*, vm::ObjectPtr obj, script::compiler::CompiledFunction*, size_t);
+			//quickened instructions only trust what they cached while this is the same, no two vm's share one
+			uint64_t epoch() const
+			{
+				return m_epoch;
+			}
+			//call after changing anything a quickened instruction could have cached (functions, fields)
+			void invalidate_caches();
+			//call after files got loaded into the compiled files, besides the caches it invalidates prepared calls
+			void files_changed()
+			{
+				++m_files_generation;
+				invalidate_caches();
+			}
+			//false for a prepared call from before the last files_changed
+			bool is_current(const PreparedCall& pc) const
+			{
+				return pc.generation == m_files_generation;
+			}
 			
 			template <typename T> VariantPtr variant(T t)
 			{
@@ -406,7 +499,9 @@ namespace script
 			void call_builtin(ThreadContext*, const std::string, size_t);
 			void call_builtin_method(ThreadContext*, vm::ObjectPtr obj, const std::string, size_t);
 			void notify(ThreadContext*, vm::ObjectPtr obj, size_t);
-			void waittill(ThreadContext*, vm::ObjectPtr obj, const std::string, std::vector<std::string>&);
+			//the notify arguments are stored in the variables named vars or for register frames in registers
+			void waittill(ThreadContext*, vm::ObjectPtr obj, const std::string, std::vector<std::string>& vars,
+						  const std::vector<uint32_t>* registers = nullptr);
 			void endon(ThreadContext*, vm::ObjectPtr obj, size_t);
 
 			std::string variant_to_string(vm::Variant v);
@@ -418,6 +513,12 @@ namespace script
 
 			bool run_thread(ThreadContext*);
 
+			PreparedCall prepare_call(const std::string& file, const std::string& function);
+			//returns true if the function returned without yielding, result is only set in that case
+			//if it did yield (wait, waittill) it'll continue as a regular thread from the next run()
+			bool call(const PreparedCall&, vm::ObjectPtr obj, std::span<const vm::Variant> args,
+					  vm::Variant* result = nullptr);
+
 			template <typename T> vm::Variant handle_binary_op(const T& a, const T& b, int op)
 			{
 				switch (op)
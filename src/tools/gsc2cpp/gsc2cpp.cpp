@@ -0,0 +1,169 @@
+#include <script/ast/ast_generator.h>
+#include <core/mmap_filesystem.h>
+#include <core/time.h>
+#include <script/compiler/compiler.h>
+#include <script/compiler/cpp_emitter.h>
+#include <script/compiler/exception.h>
+#include <script/compiler/native_library.h>
+#include <script/compiler/optimizer.h>
+#include <script/reference_solver.h>
+#include <script/stockfunctions.h>
+#include <script/vm/virtual_machine.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+//gsc2cpp <file> [function] [-o <module.so>] [--verify]
+//writes <module>.cpp with every function of the file and the files it references and compiles it into <module>.so
+//--verify runs function (main by default) interpreted and from the module and compares what they print
+
+//runs function until every thread finished and returns what got printed
+static std::string run(script::compiler::CompiledFiles& cf, const char* file, const char* function)
+{
+	fflush(stdout);
+	FILE* capture = tmpfile();
+	int saved = dup(fileno(stdout));
+	dup2(fileno(capture), fileno(stdout));
+	try
+	{
+		script::vm::VirtualMachine vm(cf);
+		script::register_stockfunctions(vm);
+		vm.exec_thread(nullptr, vm.get_level_object(), file, function, 0, false);
+		do
+		{
+			vm.run();
+			core::sleep(1000 / 20);
+		} while (vm.thread_count() > 0);
+	}
+	catch (script::vm::Exception& e)
+	{
+		printf("VM Error: %s\n", e.what());
+	}
+	fflush(stdout);
+	dup2(saved, fileno(stdout));
+	close(saved);
+
+	std::string output;
+	rewind(capture);
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), capture)) > 0)
+		output.append(buf, n);
+	fclose(capture);
+	return output;
+}
+
+static bool verify(script::compiler::CompiledFiles& cf, const std::string& module, const char* file,
+				   const char* function)
+{
+	script::compiler::NativeLibrary library;
+	script::compiler::CompiledFiles native;
+	std::string error;
+	if (!library.open(module, error) || !library.load(native, error))
+	{
+		printf("verify: %s\n", error.c_str());
+		return false;
+	}
+	std::string interpreted = run(cf, file, function);
+	std::string aot = run(native, file, function);
+	if (interpreted == aot)
+	{
+		printf("verify: %s::%s prints the same %zu bytes interpreted and native\n", file, function,
+			   interpreted.size());
+		return true;
+	}
+	printf("verify: %s::%s output differs\n--- interpreted\n%s--- native\n%s", file, function, interpreted.c_str(),
+		   aot.c_str());
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<const char*> positional;
+	std::string module;
+	bool verify_module = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			module = argv[++i];
+		else if (!strcmp(argv[i], "--verify"))
+			verify_module = true;
+		else
+			positional.push_back(argv[i]);
+	}
+	if (positional.empty())
+	{
+		printf("usage: gsc2cpp <file> [function] [-o <module.so>] [--verify]\n");
+		return 1;
+	}
+	const char* file = positional[0];
+	const char* function = positional.size() > 1 ? positional[1] : "main";
+	if (module.empty())
+	{
+		module = file;
+		auto slash = module.find_last_of("/\\");
+		if (slash != std::string::npos)
+			module = module.substr(slash + 1);
+		module += ".so";
+	}
+	std::string source = module;
+	auto dot = source.find_last_of('.');
+	if (dot != std::string::npos && source.find_first_of("/\\", dot) == std::string::npos)
+		source = source.substr(0, dot);
+	source += ".cpp";
+
+	mmap_filesystem fs;
+	script::compiler::CompiledFiles cf;
+	try
+	{
+		core::thread_pool pool;
+		script::ReferenceMap refmap;
+		script::ReferenceSolver rs(fs, pool, "./");
+		rs.solve(file, refmap);
+		//a module is a library, every function of it's files is kept
+		script::compiler::Optimizer optimizer;
+		optimizer.optimize(refmap);
+		cf = script::compiler::Compiler::compile(refmap, pool);
+	}
+	catch (script::ast::ASTException& e)
+	{
+		printf("AST Error: %s\n", e.what());
+		return 1;
+	}
+	catch (script::compiler::CompileException& e)
+	{
+		printf("Compile Error: %s\n", e.what());
+		return 1;
+	}
+
+	script::compiler::CppEmitter emitter;
+	std::string code = emitter.emit(cf);
+	{
+		std::ofstream out(source, std::ios::binary);
+		out << code;
+		if (!out.good())
+		{
+			printf("can't write %s\n", source.c_str());
+			return 1;
+		}
+	}
+	printf("%s: %zu of %zu instructions inlined\n", source.c_str(), emitter.num_inlined(),
+		   emitter.num_instructions());
+
+	const char* cxx = getenv("CXX");
+	std::string command = std::string(cxx ? cxx : GSC_CXX) + " -std=c++20 -O2 -shared -fPIC -I\"" + GSC_INCLUDE_DIR +
+						  "\" -o \"" + module + "\" \"" + source + "\"";
+	printf("%s\n", command.c_str());
+	fflush(stdout);
+	if (system(command.c_str()) != 0)
+	{
+		printf("compiling %s failed\n", source.c_str());
+		return 1;
+	}
+	if (verify_module && !verify(cf, module, file, function))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,146 @@
+#include <core/pack_filesystem.h>
+#include <core/filesystem/pack.h>
+#include <core/thread_pool.h>
+#include <common/filesystem.h>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+//gscpack <archive> <directory> [--store]
+//gscpack --list <archive>
+//gscpack --check <archive> <directory>
+//packs every file under the directory, names are relative to it, --store leaves everything uncompressed
+//--check reads every file under the directory back out of the archive and fails unless they're all the same
+
+static int list(const char* path)
+{
+	pack_filesystem fs;
+	std::string error;
+	if (!fs.open(path, error))
+	{
+		printf("%s\n", error.c_str());
+		return 1;
+	}
+	size_t size = 0, stored = 0;
+	for (size_t i = 0; i < fs.size(); ++i)
+	{
+		auto e = fs.entry(i);
+		auto name = fs.name(i);
+		printf("%10u %10u %.*s\n", e.size, e.stored_size, (int)name.size(), name.data());
+		size += e.size;
+		stored += e.stored_size;
+	}
+	printf("%zu files, %zu -> %zu bytes\n", fs.size(), size, stored);
+	return 0;
+}
+
+static int check(const char* path, const char* directory)
+{
+	pack_filesystem fs;
+	std::string error;
+	if (!fs.open(path, error))
+	{
+		printf("%s\n", error.c_str());
+		return 1;
+	}
+	size_t count = 0;
+	int result = 0;
+	std::error_code ec;
+	std::filesystem::path root(directory);
+	for (auto it = std::filesystem::recursive_directory_iterator(root, ec); !ec && it != std::filesystem::end(it);
+		 it.increment(ec))
+	{
+		if (!it->is_regular_file())
+			continue;
+		++count;
+		auto name = std::filesystem::relative(it->path(), root).generic_string();
+		auto expected = filesystem::read_file(it->path().string());
+		int index = fs.find(name);
+		auto data = fs.read_entry(name);
+		if (!expected || index == -1 || !data || *data != *expected)
+		{
+			printf("%s differs\n", name.c_str());
+			result = 1;
+			continue;
+		}
+		bool compressed = fs.entry(index).flags & filesystem::pack::kFlagCompressed;
+		printf("%s ok, %s\n", name.c_str(), compressed ? "compressed" : "stored");
+	}
+	if (ec)
+	{
+		printf("can't read %s: %s\n", directory, ec.message().c_str());
+		return 1;
+	}
+	if (count != fs.size())
+	{
+		printf("%zu files, the archive has %zu\n", count, fs.size());
+		return 1;
+	}
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<const char*> positional;
+	bool compress = true;
+	bool list_only = false;
+	bool check_only = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--store"))
+			compress = false;
+		else if (!strcmp(argv[i], "--list"))
+			list_only = true;
+		else if (!strcmp(argv[i], "--check"))
+			check_only = true;
+		else
+			positional.push_back(argv[i]);
+	}
+	if (list_only && positional.size() == 1)
+		return list(positional[0]);
+	if (check_only && positional.size() == 2)
+		return check(positional[0], positional[1]);
+	if (list_only || check_only || positional.size() != 2)
+	{
+		printf("usage: gscpack <archive> <directory> [--store]\n       gscpack --list <archive>\n       gscpack --check "
+			   "<archive> <directory>\n");
+		return 1;
+	}
+
+	filesystem::pack::writer writer;
+	size_t size = 0;
+	std::error_code ec;
+	std::filesystem::path root(positional[1]);
+	for (auto it = std::filesystem::recursive_directory_iterator(root, ec); !ec && it != std::filesystem::end(it);
+		 it.increment(ec))
+	{
+		if (!it->is_regular_file())
+			continue;
+		auto data = filesystem::read_file(it->path().string());
+		if (!data)
+		{
+			printf("can't read %s\n", it->path().string().c_str());
+			return 1;
+		}
+		size += data->size();
+		writer.add(std::filesystem::relative(it->path(), root).generic_string(), data);
+	}
+	if (ec)
+	{
+		printf("can't read %s: %s\n", positional[1], ec.message().c_str());
+		return 1;
+	}
+
+	core::thread_pool pool;
+	std::string error;
+	size_t archive_size = 0;
+	if (!writer.write(positional[0], pool, compress, error, &archive_size))
+	{
+		printf("%s\n", error.c_str());
+		return 1;
+	}
+	printf("%zu files, %zu -> %zu bytes\n", writer.size(), size, archive_size);
+	return 0;
+}
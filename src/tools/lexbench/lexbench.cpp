@@ -0,0 +1,82 @@
+#include <parse/lexer.h>
+#include <common/filesystem.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+
+//lexbench <file>... [-n <iterations>]
+//tokenizes the files the same way ASTGenerator does and prints the throughput of the fastest iteration
+
+//same as the lexer in ASTGenerator::generate
+class gsc_lexer : public parse::lexer
+{
+  public:
+	gsc_lexer(const parse::source* src, parse::lexer_opts opts) : lexer(src, opts)
+	{
+	}
+
+	virtual bool is_identifier_character(int ch) override
+	{
+		return parse::lexer::is_identifier_character(ch) || ch == '\\';
+	}
+};
+
+int main(int argc, char** argv)
+{
+	//sources don't move, tokens refer to them by id
+	std::deque<parse::source> sources;
+	int iterations = 20;
+	size_t bytes = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+		{
+			iterations = std::max(1, atoi(argv[++i]));
+			continue;
+		}
+		//lexed straight from the mapping like the preprocessor does
+		auto view = filesystem::map_file(argv[i]);
+		if (!view)
+		{
+			printf("can't open %s\n", argv[i]);
+			return 1;
+		}
+		sources.emplace_back(argv[i], view);
+		bytes += sources.back().length();
+	}
+	if (sources.empty())
+	{
+		printf("usage: lexbench <file>... [-n <iterations>]\n");
+		return 1;
+	}
+
+	parse::lexer_opts opts;
+	opts.backslash_comments = true;
+	opts.tokenize_newlines = true;
+	double best = 0.0;
+	size_t num_tokens = 0;
+	//the text stays interned between iterations like it does for files that get loaded again
+	parse::string_refs strings;
+	parse::string_refs::scope scope(&strings);
+	for (int it = 0; it < iterations; ++it)
+	{
+		num_tokens = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (auto& src : sources)
+		{
+			gsc_lexer lexer(&src, opts);
+			while (lexer.read_token().type != parse::token_type::eof)
+				++num_tokens;
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (it == 0 || seconds < best)
+			best = seconds;
+	}
+	printf("%zu files, %zu bytes, %zu tokens\n", sources.size(), bytes, num_tokens);
+	printf("%.3f ms, %.1f MB/s, %.1f M tokens/s\n", best * 1000.0, bytes / best / 1e6, num_tokens / best / 1e6);
+	return 0;
+}
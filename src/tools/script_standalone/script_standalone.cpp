@@ -1,5 +1,6 @@
 #include <script/ast/ast_generator.h>
-#include <core/default_filesystem.h>
+#include <core/mmap_filesystem.h>
+#include <core/pack_filesystem.h>
 #include <script/ast/recursive_visitor.h>
 #include <script/ast/gsc_writer.h>
 #include <stdexcept>
@@ -11,102 +12,128 @@
 #include <script/vm/virtual_machine.h>
 #include <script/compiler/compiler.h>
 #include <script/compiler/exception.h>
+#include <script/compiler/lazy_function.h>
+#include <script/compiler/native_library.h>
+#include <script/compiler/optimizer.h>
+#include <script/compiler/register_compiler.h>
+#include <script/compiler/tree_shaker.h>
+#include <script/reference_solver.h>
 #include <script/stockfunctions.h>
 #include <chrono>
 #include <thread>
 #include <cassert>
+#include <cstring>
 #include <core/time.h>
 #ifdef EMSCRIPTEN
 #include <emscripten.h>
 #endif
 
-class ReferenceSolver
-{
-	std::string path_base;
-	std::string m_filename;
-	const std::string& m_library_path;
-	script::ReferenceMap& m_global_reference_map;
-
-  public:
-	ReferenceSolver(const std::string path_base_, const std::string file_name_,
-					script::ReferenceMap& global_reference_map, const std::string& library_path)
-		: m_global_reference_map(global_reference_map),
-		  path_base(path_base_),
-		  m_filename(file_name_),
-		  m_library_path(library_path)
-	{
-		default_filesystem fs;
-		// first get all the functions that we reference
-		script::ast::ASTGenerator m_generator;
-
-		bool ret = false;
-		//if (m_filename.find('/') == std::string::npos)
-			//ret = m_generator.generate(fs, m_library_path, m_library_path + m_filename + ".gsc");
-		//else
-			ret = m_generator.generate(fs, path_base, path_base + m_filename + ".gsc");
-		if (!ret)
-		{
-			throw script::compiler::CompileException("Failed to read file {}", m_filename.c_str());
-		}
-
-		script::LoadedProgramReference& lpr = m_global_reference_map[file_name_];
-		lpr.program = std::move(m_generator.root());
-		lpr.name = m_filename;
-
-		script::ast::NodeTypeVisitor<script::ast::FunctionDeclaration> ntv;
-		auto &fun = ntv.find(lpr.program.get());
-		for (auto* f : fun)
-		{
-			lpr.function_map[util::string::to_lower(f->function_name)] = f;
-		}
-
-		//lpr.m_parent_visitor.visit_node(*lpr.program.get());
-
-		script::compiler::FunctionCallReferenceVisitor fcrv(m_filename);
-		fcrv.visit_node(*lpr.program.get());
-
-		//add the references found to the global references
-		//not using it atm, we just load and keep the whole tree, but was maybe nice to only specific functions
-		for (auto& pair_ : fcrv.references())
-		{
-			//for (auto & function_ : pair_.second)
-				//m_global_reference_map[pair_.first].insert(function_);
-			//if (pair_.first != m_filename)
-			if (m_global_reference_map.find(pair_.first) == m_global_reference_map.end())
-			{
-				ReferenceSolver solver(path_base_, pair_.first, global_reference_map, m_library_path);
-			}
-		}
-	}
-};
-
 #ifndef EMSCRIPTEN
 #define EMSCRIPTEN_KEEPALIVE
 #endif
 
+static script::vm::Backend backend = script::vm::Backend::kStack;
+static size_t inline_threshold = script::compiler::Optimizer::Options().inline_threshold;
+static bool quicken = true;
+static bool fold = true;
+static bool hoist = true;
+static bool cse = true;
+static bool shake = true;
+static bool strip = false;
+static bool lazy = false;
+static const char* pack_path = nullptr;
+static const char* native_module = nullptr;
+static bool jit = false;
+static uint32_t jit_threshold = 1000;
+
 extern "C" EMSCRIPTEN_KEEPALIVE void run_file(const char* file, const char *function)
 {
 	printf("run_file(%s, %s)\n", file, function);
 	bool verbose = true;
-	default_filesystem fs;
+	mmap_filesystem files;
+	//scripts come out of the pack instead of the working directory
+	pack_filesystem pack;
+	filesystem_api* fs = &files;
+	if (pack_path)
+	{
+		std::string error;
+		if (!pack.open(pack_path, error))
+		{
+			printf("%s\n", error.c_str());
+			return;
+		}
+		fs = &pack;
+	}
 	try
 	{
+		core::thread_pool pool;
 		script::ReferenceMap refmap;
-		ReferenceSolver rs("./", file, refmap, "data/scriptlib/");
+		script::ReferenceSolver rs(*fs, pool, "./");
+		rs.set_lazy(lazy);
+		rs.solve(file, refmap);
 		printf("loaded files:\n");
 		for (auto& it : refmap)
 		{
 			printf("\t%s\n", it.first.c_str());
 		}
-		script::compiler::Compiler compiler(refmap);
-		auto cf = compiler.compile();
+		if (shake && !lazy)
+		{
+			script::compiler::TreeShaker shaker(refmap);
+			shaker.add_entry_point(file, function);
+			printf("removed %zu unreachable functions\n", shaker.shake());
+		}
+		script::compiler::Optimizer::Options optimizer_options;
+		optimizer_options.report = true;
+		optimizer_options.fold_constants = fold;
+		optimizer_options.inline_threshold = inline_threshold;
+		optimizer_options.hoist_loop_invariants = hoist;
+		optimizer_options.eliminate_common_subexpressions = cse;
+		script::compiler::Compiler::Options compiler_options;
+		compiler_options.strip_debug_info = strip;
+		compiler_options.report = true;
+		script::compiler::CompiledFiles cf;
+		if (lazy)
+		{
+			bool register_backend = backend == script::vm::Backend::kRegister;
+			cf = script::compiler::compile_lazy(refmap, {optimizer_options, compiler_options, register_backend});
+		}
+		else
+		{
+			script::compiler::Optimizer optimizer(optimizer_options);
+			optimizer.optimize(refmap);
+			cf = script::compiler::Compiler::compile(refmap, pool, nullptr, compiler_options);
+			if (backend == script::vm::Backend::kRegister)
+			{
+				script::compiler::RegisterCompiler rc;
+				rc.compile(refmap, cf);
+				printf("register backend: %zu instructions\n", rc.num_instructions());
+			}
+		}
+		script::compiler::NativeLibrary library;
+		if (native_module)
+		{
+			std::string error;
+			if (!library.open(native_module, error) || !library.load(cf, error))
+			{
+				printf("%s\n", error.c_str());
+				return;
+			}
+		}
 		// register_stockfunctions(interpreter);
 		// script::FunctionArguments args;
 		// interpreter.call_function("maps/mp/gametypes/dm", "main", args);
 
 		script::vm::VirtualMachine vm(cf);
+		vm.set_backend(backend);
 		if (verbose)
 			vm.set_flags(script::vm::flags::kVerbose);
+		if (!quicken)
+			vm.set_flags(vm.get_flags() | script::vm::flags::kNoQuickening);
+		if (jit)
+		{
+			vm.set_flags(vm.get_flags() | script::vm::flags::kJit);
+			vm.set_jit_threshold(jit_threshold);
+		}
 		script::register_stockfunctions(vm);
 		vm.exec_thread(nullptr, vm.get_level_object(), file, function, 0, false);
 		// vm.exec_thread(vm.get_level_object(), "maps/mp/gametypes/_callbacksetup", "CodeCallback_StartGameType", 0);
@@ -118,6 +145,7 @@ extern "C" EMSCRIPTEN_KEEPALIVE void run_file(const char* file, const char *func
 			// std::this_thread::sleep_for(std::chrono::milliseconds(1000 / 20));
 			// printf("%d threads\n", vm.thread_count());
 		} while (vm.thread_count() > 0);
+		printf("executed %zu instructions\n", vm.executed_instructions());
 	}
 	catch (script::ast::ASTException& e)
 	{
@@ -136,8 +164,44 @@ extern "C" EMSCRIPTEN_KEEPALIVE void run_file(const char* file, const char *func
 int main(int argc, char **argv)
 {
 	#ifndef EMSCRIPTEN
-	assert(argc > 1);
-	run_file(argv[1], argc > 2 ? argv[2] : "main");
+	//gsc <file> [function] [--backend stack|register] [--inline <max nodes, 0 disables>] [--no-quicken] [--no-fold] [--no-hoist] [--no-cse] [--no-shake] [--strip] [--lazy] [--pack <archive>] [--native <module.so>] [--jit [--jit-threshold <n>]]
+	std::vector<const char*> positional;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--backend") && i + 1 < argc)
+		{
+			++i;
+			backend = !strcmp(argv[i], "register") ? script::vm::Backend::kRegister : script::vm::Backend::kStack;
+		}
+		else if (!strcmp(argv[i], "--inline") && i + 1 < argc)
+			inline_threshold = (size_t)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--no-quicken"))
+			quicken = false;
+		else if (!strcmp(argv[i], "--no-fold"))
+			fold = false;
+		else if (!strcmp(argv[i], "--no-hoist"))
+			hoist = false;
+		else if (!strcmp(argv[i], "--no-cse"))
+			cse = false;
+		else if (!strcmp(argv[i], "--no-shake"))
+			shake = false;
+		else if (!strcmp(argv[i], "--strip"))
+			strip = true;
+		else if (!strcmp(argv[i], "--lazy"))
+			lazy = true;
+		else if (!strcmp(argv[i], "--pack") && i + 1 < argc)
+			pack_path = argv[++i];
+		else if (!strcmp(argv[i], "--native") && i + 1 < argc)
+			native_module = argv[++i];
+		else if (!strcmp(argv[i], "--jit"))
+			jit = true;
+		else if (!strcmp(argv[i], "--jit-threshold") && i + 1 < argc)
+			jit_threshold = (uint32_t)atoi(argv[++i]);
+		else
+			positional.push_back(argv[i]);
+	}
+	assert(positional.size() > 0);
+	run_file(positional[0], positional.size() > 1 ? positional[1] : "main");
 	#endif
 	return 0;
 }
@@ -0,0 +1,27 @@
+#runs fold/fold.gsc with and without constant folding, on both backends, and fails unless everything it prints is the same
+#cmake -DGSC=<gsc> -P fold.cmake
+
+function(run out)
+	execute_process(COMMAND ${GSC} fold main ${ARGN} WORKING_DIRECTORY ${CMAKE_CURRENT_LIST_DIR}/fold
+					RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE output)
+	if(NOT result EQUAL 0 OR output MATCHES "(AST|Compile|VM) Error")
+		message(FATAL_ERROR "gsc fold ${ARGN} failed: ${output}")
+	endif()
+	#only what print wrote, it starts with the location of the call
+	string(REGEX MATCHALL "\\[[^\n]*\n" printed "${output}")
+	set(${out} "${printed}" PARENT_SCOPE)
+endfunction()
+
+run(folded)
+if(folded STREQUAL "")
+	message(FATAL_ERROR "fold.gsc didn't print anything")
+endif()
+message("${folded}")
+run(unfolded --no-fold)
+run(unfolded_register --no-fold --backend register)
+run(folded_register --backend register)
+foreach(other unfolded unfolded_register folded_register)
+	if(NOT folded STREQUAL ${other})
+		message(FATAL_ERROR "folded and ${other} differ:\n${folded}\n${${other}}")
+	endif()
+endforeach()
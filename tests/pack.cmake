@@ -0,0 +1,61 @@
+#round trips files through gscpack, compressed and stored, and checks what ended up compressed
+#cmake -DGSCPACK=<gscpack> -DWORK_DIR=<scratch directory> -P pack.cmake
+
+set(files ${WORK_DIR}/files)
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${files})
+
+function(repeat out text count)
+	set(s "")
+	foreach(i RANGE 1 ${count})
+		string(APPEND s "${text}")
+	endforeach()
+	set(${out} "${s}" PARENT_SCOPE)
+endfunction()
+
+#random letters and digits hardly ever repeat 4 bytes, nothing gets smaller so they're stored
+string(RANDOM LENGTH 4096 RANDOM_SEED 1 random)
+string(RANDOM LENGTH 20 RANDOM_SEED 2 literals20)
+string(RANDOM LENGTH 300 RANDOM_SEED 3 literals300)
+#offset 3 and a length of almost 3000, the match copies what it just wrote and its length takes several bytes
+repeat(abc "abc" 1000)
+repeat(abcd "abcd" 50)
+repeat(wxyz "wxyz" 50)
+
+file(WRITE ${files}/empty.txt "")
+file(WRITE ${files}/incompressible.txt "${random}")
+file(WRITE ${files}/overlap.txt "x${abc}")
+#literal runs of 15 and up take an extra byte, 270 and up more than one
+file(WRITE ${files}/literals.txt "${literals20}${abcd}${literals300}${wxyz}${literals20}")
+file(WRITE ${files}/sub/nested.gsc "main()\n{\n${abcd}\n}\n")
+
+set(expected
+	"empty.txt ok, stored"
+	"incompressible.txt ok, stored"
+	"literals.txt ok, compressed"
+	"overlap.txt ok, compressed"
+	"sub/nested.gsc ok, compressed")
+
+function(check archive)
+	execute_process(COMMAND ${GSCPACK} ${WORK_DIR}/${archive} ${files} ${ARGN} RESULT_VARIABLE result OUTPUT_VARIABLE out)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "gscpack ${archive} failed: ${out}")
+	endif()
+	execute_process(COMMAND ${GSCPACK} --check ${WORK_DIR}/${archive} ${files} RESULT_VARIABLE result OUTPUT_VARIABLE out)
+	message("${out}")
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "${archive} doesn't have the same files")
+	endif()
+	foreach(line ${expected})
+		if(ARGN STREQUAL "--store")
+			string(REPLACE "compressed" "stored" line "${line}")
+		endif()
+		string(FIND "${out}" "${line}\n" found)
+		if(found EQUAL -1)
+			message(FATAL_ERROR "${archive}: expected \"${line}\"")
+		endif()
+	endforeach()
+endfunction()
+
+check(compressed.gscp)
+check(stored.gscp --store)